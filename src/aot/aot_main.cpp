@@ -0,0 +1,27 @@
+// gamingcpu-aot -- translate a firmware ELF into a .so the VP can dlopen
+//
+//   gamingcpu-aot firmware.elf firmware.so
+//
+// Leaves the generated firmware.so.cpp next to the .so
+
+#include "aot_translate.h"
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <firmware.elf> <out.so>\n";
+        return 2;
+    }
+
+    std::string err;
+    aot::GenStats stats;
+    if (!aot::translate_elf(argv[1], argv[2], err, &stats)) {
+        std::cerr << "[AOT] " << err << "\n";
+        return 1;
+    }
+
+    std::cout << "[AOT] " << argv[2] << ": " << stats.blocks << " blocks, "
+              << stats.insns << " instructions\n";
+    return 0;
+}
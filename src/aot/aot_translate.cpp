@@ -0,0 +1,371 @@
+#include "aot_translate.h"
+#include "cpu/aot_abi.h"
+#include "cpu/decode.h"
+#include "util/elf_loader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#ifndef AOT_CXX
+#define AOT_CXX "c++"
+#endif
+#ifndef AOT_INCLUDE_DIR
+#define AOT_INCLUDE_DIR "src"
+#endif
+
+namespace aot {
+
+namespace {
+
+constexpr uint32_t PAGE_SIZE = 4096;
+
+struct Insn {
+    DecodedInstr d;
+    uint32_t len;
+};
+
+// Everything the block functions handle. The rest ends the block with
+// AOT_INTERP and the ISS runs it
+bool translatable(InstrType t) {
+    return (t >= InstrType::LUI && t <= InstrType::REMU) || t == InstrType::FENCE;
+}
+
+bool is_branch(InstrType t) { return t >= InstrType::BEQ && t <= InstrType::BGEU; }
+bool is_load(InstrType t)   { return t >= InstrType::LB && t <= InstrType::LHU; }
+bool is_store(InstrType t)  { return t >= InstrType::SB && t <= InstrType::SW; }
+
+std::string hex(uint32_t v) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "0x%Xu", v);
+    return buf;
+}
+
+// Linear sweep. Data in .text decodes as junk and just never gets entered
+std::map<uint32_t, Insn> disassemble(const CodeSegment& seg) {
+    std::map<uint32_t, Insn> out;
+    const std::vector<uint8_t>& b = seg.bytes;
+    size_t off = 0;
+    while (off + 2 <= b.size()) {
+        uint32_t w = b[off] | b[off + 1] << 8;
+        uint32_t len = (w & 3) == 3 ? 4 : 2;
+        if (off + len > b.size())
+            break;
+        if (len == 4)
+            w |= static_cast<uint32_t>(b[off + 2]) << 16 | static_cast<uint32_t>(b[off + 3]) << 24;
+        out[seg.paddr + static_cast<uint32_t>(off)] = {decode(w), len};
+        off += len;
+    }
+    return out;
+}
+
+const char* load_cast(InstrType t) {
+    switch (t) {
+    case InstrType::LB:  return "S(static_cast<int8_t>(v))";
+    case InstrType::LH:  return "S(static_cast<int16_t>(v))";
+    case InstrType::LBU: return "static_cast<uint8_t>(v)";
+    case InstrType::LHU: return "static_cast<uint16_t>(v)";
+    default:             return "v";
+    }
+}
+
+int access_bytes(InstrType t) {
+    switch (t) {
+    case InstrType::LB: case InstrType::LBU: case InstrType::SB: return 1;
+    case InstrType::LH: case InstrType::LHU: case InstrType::SH: return 2;
+    default: return 4;
+    }
+}
+
+// Right-hand side for ALU ops, empty if d isn't one
+std::string alu_expr(const DecodedInstr& d) {
+    std::string a = "R(" + std::to_string(d.rs1) + ")";
+    std::string b = "R(" + std::to_string(d.rs2) + ")";
+    std::string i = hex(static_cast<uint32_t>(d.imm));
+    std::string sh = std::to_string(d.imm & 0x1F);
+
+    switch (d.type) {
+    case InstrType::LUI:    return i;
+    case InstrType::ADDI:   return a + " + " + i;
+    case InstrType::SLTI:   return "S(" + a + ") < " + std::to_string(d.imm);
+    case InstrType::SLTIU:  return a + " < " + i;
+    case InstrType::XORI:   return a + " ^ " + i;
+    case InstrType::ORI:    return a + " | " + i;
+    case InstrType::ANDI:   return a + " & " + i;
+    case InstrType::SLLI:   return a + " << " + sh;
+    case InstrType::SRLI:   return a + " >> " + sh;
+    case InstrType::SRAI:   return "S(" + a + ") >> " + sh;
+    case InstrType::ADD:    return a + " + " + b;
+    case InstrType::SUB:    return a + " - " + b;
+    case InstrType::SLL:    return a + " << (" + b + " & 31)";
+    case InstrType::SLT:    return "S(" + a + ") < S(" + b + ")";
+    case InstrType::SLTU:   return a + " < " + b;
+    case InstrType::XOR:    return a + " ^ " + b;
+    case InstrType::SRL:    return a + " >> (" + b + " & 31)";
+    case InstrType::SRA:    return "S(" + a + ") >> (" + b + " & 31)";
+    case InstrType::OR:     return a + " | " + b;
+    case InstrType::AND:    return a + " & " + b;
+    case InstrType::MUL:    return a + " * " + b;
+    case InstrType::MULH:   return "(int64_t(S(" + a + ")) * S(" + b + ")) >> 32";
+    case InstrType::MULHSU: return "(int64_t(S(" + a + ")) * int64_t(" + b + ")) >> 32";
+    case InstrType::MULHU:  return "(uint64_t(" + a + ") * " + b + ") >> 32";
+    case InstrType::DIV:    return "aot_div(" + a + ", " + b + ")";
+    case InstrType::DIVU:   return "aot_divu(" + a + ", " + b + ")";
+    case InstrType::REM:    return "aot_rem(" + a + ", " + b + ")";
+    case InstrType::REMU:   return "aot_remu(" + a + ", " + b + ")";
+    default:                return "";
+    }
+}
+
+const char* branch_cond(InstrType t) {
+    switch (t) {
+    case InstrType::BEQ:  return "R(%u) == R(%u)";
+    case InstrType::BNE:  return "R(%u) != R(%u)";
+    case InstrType::BLT:  return "S(R(%u)) < S(R(%u))";
+    case InstrType::BGE:  return "S(R(%u)) >= S(R(%u))";
+    case InstrType::BLTU: return "R(%u) < R(%u)";
+    default:              return "R(%u) >= R(%u)";
+    }
+}
+
+// One block function starting at `start`. Returns the bytes it covers (0 if
+// the first instruction isn't translatable or crosses the page end, nothing
+// emitted then) and adds the fall-through address to `next` when it stops
+// on the length cap
+uint32_t emit_block(std::ostream& os, const std::map<uint32_t, Insn>& insns,
+                    uint32_t start, std::set<uint32_t>& next, uint32_t& count) {
+    uint32_t page_end = (start & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+    auto it = insns.find(start);
+    if (it == insns.end() || !translatable(it->second.d.type) || start + it->second.len > page_end)
+        return 0;
+
+    std::ostringstream body;
+    uint32_t off = 0;
+    uint32_t k = 0;
+    uint32_t claim = 0; // bytes the block depends on
+    char line[256];
+
+    while (true) {
+        it = insns.find(start + off);
+        if (it == insns.end()) {
+            // Ran off the segment, let the ISS deal with whatever's there
+            std::snprintf(line, sizeof(line), "    EXIT(%u, %u, AOT_INTERP);\n", off, k);
+            body << line;
+            claim = off;
+            break;
+        }
+        const DecodedInstr& d = it->second.d;
+        uint32_t len = it->second.len;
+
+        // Crosses into the next page: the ISS doesn't cache that one, so its
+        // Block ends here and stores to it wouldn't retire ours
+        if (start + off + len > page_end) {
+            std::snprintf(line, sizeof(line), "    EXIT(%u, %u, AOT_INTERP);\n", off, k);
+            body << line;
+            claim = off;
+            break;
+        }
+
+        // Still claimed, no harm in dropping the block if that one changes too
+        claim = off + len;
+        if (!translatable(d.type)) {
+            std::snprintf(line, sizeof(line), "    EXIT(%u, %u, AOT_INTERP);\n", off, k);
+            body << line;
+            break;
+        }
+
+        if (d.type == InstrType::AUIPC) {
+            if (d.rd)
+                body << "    W(" << d.rd << ", pc0 + " << hex(off + static_cast<uint32_t>(d.imm)) << ");\n";
+        } else if (d.type == InstrType::JAL) {
+            if (d.rd)
+                body << "    W(" << d.rd << ", pc0 + " << hex(off + len) << ");\n";
+            std::snprintf(line, sizeof(line), "    EXIT(0x%Xu, %u, AOT_DONE);\n",
+                          off + static_cast<uint32_t>(d.imm), k + 1);
+            body << line;
+            k++;
+            break;
+        } else if (d.type == InstrType::JALR) {
+            body << "    { uint32_t t = (R(" << d.rs1 << ") + " << hex(static_cast<uint32_t>(d.imm)) << ") & ~1u;\n";
+            if (d.rd)
+                body << "      W(" << d.rd << ", pc0 + " << hex(off + len) << ");\n";
+            body << "      c->pc = t; c->retired = " << k + 1 << "; return AOT_DONE; }\n";
+            k++;
+            break;
+        } else if (is_branch(d.type)) {
+            std::snprintf(line, sizeof(line), branch_cond(d.type), d.rs1, d.rs2);
+            body << "    if (" << line << ") ";
+            std::snprintf(line, sizeof(line), "EXIT(0x%Xu, %u, AOT_DONE);\n    EXIT(%u, %u, AOT_DONE);\n",
+                          off + static_cast<uint32_t>(d.imm), k + 1, off + len, k + 1);
+            body << line;
+            k++;
+            break;
+        } else if (is_load(d.type) || is_store(d.type)) {
+            // Misaligned goes back to the ISS for the trap, same as the JIT
+            int bytes = access_bytes(d.type);
+            body << "    { uint32_t a = R(" << d.rs1 << ") + " << hex(static_cast<uint32_t>(d.imm)) << ";\n";
+            if (bytes > 1)
+                body << "      if (a & " << bytes - 1 << ") EXIT(" << off << ", " << k << ", AOT_INTERP);\n";
+            if (is_load(d.type)) {
+                body << "      uint32_t v = c->read(c, a, " << bytes << ");\n"
+                     << "      if (c->stop) EXIT(" << off << ", " << k << ", AOT_INTERP);\n";
+                if (d.rd)
+                    body << "      W(" << d.rd << ", " << load_cast(d.type) << ");\n";
+                body << "    }\n";
+            } else {
+                const char* mask = bytes == 1 ? " & 0xFFu" : bytes == 2 ? " & 0xFFFFu" : "";
+                body << "      c->write(c, a, R(" << d.rs2 << ")" << mask << ", " << bytes << ");\n"
+                     << "      if (c->stop == AOT_STOP_FAULT) EXIT(" << off << ", " << k << ", AOT_INTERP);\n"
+                     << "      if (c->stop) EXIT(" << off + len << ", " << k + 1 << ", AOT_INTERP); }\n";
+            }
+        } else if (d.type != InstrType::FENCE && d.rd) {
+            body << "    W(" << d.rd << ", " << alu_expr(d) << ");\n";
+        }
+
+        off += len;
+        k++;
+        if (start + off >= page_end || k == MAX_BLOCK_INSNS) {
+            if (start + off < page_end)
+                next.insert(start + off);
+            std::snprintf(line, sizeof(line), "    EXIT(%u, %u, AOT_DONE);\n", off, k);
+            body << line;
+            break;
+        }
+    }
+
+    os << "static uint32_t b_" << std::hex << start << std::dec << "(AotCtx* c) {\n"
+       << "    int32_t* x = c->regs;\n"
+       << "    const uint32_t pc0 = c->pc;\n"
+       << "    (void)x; (void)pc0;\n"
+       << body.str() << "}\n\n";
+    count += k;
+    return claim;
+}
+
+} // anonymous namespace
+
+std::string generate(const std::vector<CodeSegment>& code, GenStats* stats) {
+    std::ostringstream os;
+    os << "// Generated by gamingcpu-aot, don't edit\n"
+       << "#include \"cpu/aot_abi.h\"\n\n"
+       << "#define R(n) static_cast<uint32_t>(x[n])\n"
+       << "#define S(v) static_cast<int32_t>(v)\n"
+       << "#define W(n, v) (x[n] = static_cast<int32_t>(v))\n"
+       << "#define EXIT(off, n, st) do { c->pc = pc0 + (off); c->retired = (n); return (st); } while (0)\n\n";
+
+    struct Emitted {
+        uint32_t paddr;
+        uint32_t bytes;
+        uint64_t hash;
+    };
+    std::vector<Emitted> table;
+    GenStats st;
+
+    for (const CodeSegment& seg : code) {
+        std::map<uint32_t, Insn> insns = disassemble(seg);
+        uint32_t seg_end = seg.paddr + static_cast<uint32_t>(seg.bytes.size());
+
+        std::set<uint32_t> leaders;
+        leaders.insert(seg.paddr);
+        for (const auto& [pc, in] : insns) {
+            const DecodedInstr& d = in.d;
+            if ((pc & (PAGE_SIZE - 1)) == 0)
+                leaders.insert(pc);
+            if (is_branch(d.type) || d.type == InstrType::JAL) {
+                uint32_t t = pc + static_cast<uint32_t>(d.imm);
+                if (t >= seg.paddr && t < seg_end)
+                    leaders.insert(t);
+            }
+            // Return addresses, trap returns, resuming after a CSR op...
+            if (is_branch(d.type) || d.type == InstrType::JAL || d.type == InstrType::JALR ||
+                !translatable(d.type))
+                leaders.insert(pc + in.len);
+        }
+
+        // Length-capped blocks add their fall-through, so keep going until stable
+        std::set<uint32_t> done;
+        while (!leaders.empty()) {
+            uint32_t pc = *leaders.begin();
+            leaders.erase(leaders.begin());
+            if (!done.insert(pc).second)
+                continue;
+            uint32_t bytes = emit_block(os, insns, pc, leaders, st.insns);
+            if (!bytes)
+                continue;
+            table.push_back({pc, bytes, aot_hash(seg.bytes.data() + (pc - seg.paddr), bytes)});
+            st.blocks++;
+        }
+    }
+
+    os << "static const AotBlock blocks[] = {\n";
+    char line[128];
+    for (const Emitted& e : table) {
+        std::snprintf(line, sizeof(line), "    {0x%Xu, %uu, 0x%llXull, b_%x},\n",
+                      e.paddr, e.bytes, static_cast<unsigned long long>(e.hash), e.paddr);
+        os << line;
+    }
+    if (table.empty())
+        os << "    {0, 0, 0, nullptr},\n";
+    os << "};\n\n"
+       << "extern \"C\" const AotImage " AOT_IMAGE_SYMBOL " = {AOT_ABI_VERSION, "
+       << table.size() << "u, blocks};\n";
+
+    if (stats)
+        *stats = st;
+    return os.str();
+}
+
+bool compile(const std::string& source, const std::string& so_path, std::string& err) {
+    std::string src_path = so_path + ".cpp";
+    {
+        std::ofstream f(src_path);
+        if (!f) {
+            err = "cannot write " + src_path;
+            return false;
+        }
+        f << source;
+    }
+
+    std::string cmd = std::string(AOT_CXX) + " -std=c++17 -O2 -fPIC -shared -I\"" AOT_INCLUDE_DIR
+                      "\" -o \"" + so_path + "\" \"" + src_path + "\"";
+    int rc = std::system(cmd.c_str());
+    if (rc != 0) {
+        err = cmd + " failed (" + std::to_string(rc) + ")";
+        return false;
+    }
+    return true;
+}
+
+bool translate_elf(const std::string& elf_path, const std::string& so_path,
+                   std::string& err, GenStats* stats) {
+    // Keep every segment's file bytes, then pick out the executable ones
+    std::map<uint32_t, std::vector<uint8_t>> chunks;
+    ElfLoadResult r;
+    try {
+        r = load_elf(elf_path, [&](uint32_t paddr, const uint8_t* data, size_t len) {
+            chunks[paddr].assign(data, data + len);
+        });
+    } catch (const std::exception& e) {
+        err = e.what();
+        return false;
+    }
+
+    std::vector<CodeSegment> code;
+    for (const ElfSegment& s : r.segments) {
+        auto it = chunks.find(s.paddr);
+        if (!s.exec || !s.filesz || it == chunks.end())
+            continue;
+        code.push_back({s.paddr, it->second});
+    }
+    if (code.empty()) {
+        err = elf_path + ": no executable segments";
+        return false;
+    }
+
+    return compile(generate(code, stats), so_path, err);
+}
+
+} // namespace aot
@@ -0,0 +1,43 @@
+#ifndef GAMINGCPU_VP_AOT_TRANSLATE_H
+#define GAMINGCPU_VP_AOT_TRANSLATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline half of the AOT path: guest code in, C++ out (one function per
+// basic block, see cpu/aot_abi.h for what the functions do), then the host
+// compiler turns that into a .so the ISS can dlopen
+namespace aot {
+
+// Executable bytes at a physical address, e.g. a PF_X segment's file data
+struct CodeSegment {
+    uint32_t paddr = 0;
+    std::vector<uint8_t> bytes;
+};
+
+struct GenStats {
+    uint32_t blocks = 0;
+    uint32_t insns = 0; // translated, summed over blocks
+};
+
+// Longest block we emit. Blocks never cross a 4K page either, same as the ISS
+constexpr uint32_t MAX_BLOCK_INSNS = 64;
+
+// Translate every block that starts at a leader: segment/page starts, branch
+// and jal targets, and whatever follows a control transfer or something we
+// can't translate. jalr targets aren't known statically, those only get
+// covered if they're one of the above
+std::string generate(const std::vector<CodeSegment>& code, GenStats* stats = nullptr);
+
+// Compile a generate() result into so_path. Uses the compiler the VP was
+// built with. On failure err has the compiler command and exit status
+bool compile(const std::string& source, const std::string& so_path, std::string& err);
+
+// ELF in, translated .so out
+bool translate_elf(const std::string& elf_path, const std::string& so_path,
+                   std::string& err, GenStats* stats = nullptr);
+
+} // namespace aot
+
+#endif // GAMINGCPU_VP_AOT_TRANSLATE_H
@@ -0,0 +1,72 @@
+#ifndef GAMINGCPU_VP_AOT_ABI_H
+#define GAMINGCPU_VP_AOT_ABI_H
+
+#include <cstdint>
+
+// Contract between the ISS and a shared object built by gamingcpu-aot.
+// Generated code includes this and nothing else, so no VP types in here
+constexpr uint32_t AOT_ABI_VERSION = 1;
+
+// AotCtx::stop, set by the read/write callbacks
+constexpr uint8_t AOT_STOP_FAULT = 1; // MMU/bus fault, the access didn't happen
+constexpr uint8_t AOT_STOP_CODE = 2;  // store hit the code we're running
+
+struct AotCtx {
+    int32_t* regs = nullptr; // CPUState::regs, x0 stays 0
+    uint32_t pc = 0;         // in: block start (virtual), out: next pc
+    uint32_t retired = 0;    // out
+    uint8_t stop = 0;
+    void* user = nullptr;
+    uint32_t (*read)(AotCtx* c, uint32_t addr, int bytes) = nullptr;
+    void (*write)(AotCtx* c, uint32_t addr, uint32_t data, int bytes) = nullptr;
+};
+
+// Returns AOT_DONE if the block ran to its end (branch resolved, pc is the
+// target), AOT_INTERP if it stopped at an instruction it doesn't do itself
+// (CSR, AMO, misaligned access, fault...). ctx->pc is then that instruction
+// and everything before it retired
+constexpr uint32_t AOT_DONE = 0;
+constexpr uint32_t AOT_INTERP = 1;
+using AotBlockFn = uint32_t (*)(AotCtx* c);
+
+struct AotBlock {
+    uint32_t paddr;  // first instruction
+    uint32_t bytes;  // guest bytes the translation assumed
+    uint64_t hash;   // aot_hash() of those bytes
+    AotBlockFn fn;
+};
+
+// The one symbol a translated image exports (extern "C")
+struct AotImage {
+    uint32_t abi_version;
+    uint32_t count;
+    const AotBlock* blocks;
+};
+#define AOT_IMAGE_SYMBOL "gamingcpu_aot_image"
+
+// FNV-1a, just has to notice the bytes changed
+inline uint64_t aot_hash(const uint8_t* p, uint32_t n) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (uint32_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// RV32M division corner cases, same as rv32m:: but inline so the .so
+// doesn't need anything from the VP
+inline uint32_t aot_div(uint32_t a, uint32_t b) {
+    if (b == 0) return 0xFFFFFFFF;
+    if (a == 0x80000000u && b == 0xFFFFFFFFu) return a;
+    return static_cast<uint32_t>(static_cast<int32_t>(a) / static_cast<int32_t>(b));
+}
+inline uint32_t aot_divu(uint32_t a, uint32_t b) { return b ? a / b : 0xFFFFFFFF; }
+inline uint32_t aot_rem(uint32_t a, uint32_t b) {
+    if (b == 0) return a;
+    if (a == 0x80000000u && b == 0xFFFFFFFFu) return 0;
+    return static_cast<uint32_t>(static_cast<int32_t>(a) % static_cast<int32_t>(b));
+}
+inline uint32_t aot_remu(uint32_t a, uint32_t b) { return b ? a % b : a; }
+
+#endif // GAMINGCPU_VP_AOT_ABI_H
@@ -0,0 +1,42 @@
+#include "aot_library.h"
+#include <dlfcn.h>
+
+AotLibrary::~AotLibrary() {
+    unload();
+}
+
+bool AotLibrary::load(const std::string& path, std::string& err) {
+    unload();
+
+    void* h = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!h) {
+        err = dlerror();
+        return false;
+    }
+
+    auto* img = static_cast<const AotImage*>(dlsym(h, AOT_IMAGE_SYMBOL));
+    if (!img) {
+        err = path + ": no " AOT_IMAGE_SYMBOL;
+        dlclose(h);
+        return false;
+    }
+    if (img->abi_version != AOT_ABI_VERSION) {
+        err = path + ": ABI version " + std::to_string(img->abi_version) +
+              ", expected " + std::to_string(AOT_ABI_VERSION);
+        dlclose(h);
+        return false;
+    }
+
+    handle_ = h;
+    for (uint32_t i = 0; i < img->count; i++)
+        blocks_[img->blocks[i].paddr] = &img->blocks[i];
+    return true;
+}
+
+void AotLibrary::unload() {
+    blocks_.clear();
+    if (handle_) {
+        dlclose(handle_);
+        handle_ = nullptr;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef GAMINGCPU_VP_AOT_LIBRARY_H
+#define GAMINGCPU_VP_AOT_LIBRARY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "aot_abi.h"
+
+// A dlopen'd gamingcpu-aot image. Blocks are looked up by physical start
+// address, the ISS still has to check the hash against what's in memory
+// before trusting one
+class AotLibrary
+{
+public:
+    AotLibrary() = default;
+    ~AotLibrary();
+    AotLibrary(const AotLibrary&) = delete;
+    AotLibrary& operator=(const AotLibrary&) = delete;
+
+    // Replaces whatever was loaded before. False + err if the file won't
+    // open, isn't an AOT image, or was built against another ABI
+    bool load(const std::string& path, std::string& err);
+    void unload();
+
+    bool loaded() const { return handle_ != nullptr; }
+    size_t size() const { return blocks_.size(); }
+
+    const AotBlock* find(uint32_t paddr) const {
+        auto it = blocks_.find(paddr);
+        return it == blocks_.end() ? nullptr : it->second;
+    }
+
+    uint64_t attached = 0; // blocks built with a translation
+    uint64_t stale = 0;    // translation found but the bytes changed
+    uint64_t runs = 0;
+
+private:
+    void* handle_ = nullptr;
+    std::unordered_map<uint32_t, const AotBlock*> blocks_;
+};
+
+#endif // GAMINGCPU_VP_AOT_LIBRARY_H
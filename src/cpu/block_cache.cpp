@@ -0,0 +1,174 @@
+#include "block_cache.h"
+#include <algorithm>
+
+Block* BlockCache::lookup(uint32_t paddr) {
+    auto it = blocks_.find(paddr);
+    if (it != blocks_.end()) {
+        hits++;
+        return it->second.get();
+    }
+    misses++;
+    return nullptr;
+}
+
+Block* BlockCache::insert(std::unique_ptr<Block> b) {
+    uint32_t paddr = b->paddr;
+    Block* raw = b.get();
+
+    auto it = blocks_.find(paddr);
+    if (it != blocks_.end()) {
+        it->second->valid = false;
+        retired_.push_back(std::move(it->second));
+        it->second = std::move(b);
+    } else {
+        blocks_.emplace(paddr, std::move(b));
+        page_index_[paddr >> PAGE_SHIFT].push_back(paddr);
+    }
+
+    built++;
+    return raw;
+}
+
+void BlockCache::retire(uint32_t paddr) {
+    auto it = blocks_.find(paddr);
+    if (it == blocks_.end())
+        return;
+    it->second->valid = false;
+    retired_.push_back(std::move(it->second));
+    blocks_.erase(it);
+    invalidations++;
+}
+
+void BlockCache::invalidate(uint64_t start, uint64_t end) {
+    if (end > 0xFFFFFFFFull)
+        end = 0xFFFFFFFFull;
+    if (start > end || blocks_.empty())
+        return;
+
+    for (uint64_t ppn = start >> PAGE_SHIFT; ppn <= (end >> PAGE_SHIFT); ppn++) {
+        auto pit = page_index_.find(static_cast<uint32_t>(ppn));
+        if (pit == page_index_.end())
+            continue;
+
+        auto& starts = pit->second;
+        auto keep = std::remove_if(starts.begin(), starts.end(), [&](uint32_t s) {
+            auto it = blocks_.find(s);
+            if (it == blocks_.end())
+                return true;
+            uint64_t b_end = (uint64_t)s + it->second->bytes - 1;
+            if (b_end < start || s > end)
+                return false;
+            retire(s);
+            return true;
+        });
+        starts.erase(keep, starts.end());
+        if (starts.empty())
+            page_index_.erase(pit);
+    }
+}
+
+void BlockCache::flush() {
+    for (auto& kv : blocks_) {
+        kv.second->valid = false;
+        retired_.push_back(std::move(kv.second));
+    }
+    blocks_.clear();
+    page_index_.clear();
+    invalidations++;
+}
+
+namespace {
+
+// Registers an instruction reads/writes as bitmasks, false if it can't be
+// part of a poll loop at all
+bool poll_regs(const DecodedInstr& d, uint32_t& reads, uint32_t& writes, int& loads) {
+    auto bit = [](uint32_t r) { return r ? 1u << r : 0u; };
+    reads = writes = 0;
+
+    switch (d.type) {
+    case InstrType::LUI:
+    case InstrType::AUIPC:
+    case InstrType::FUSED_LUI_ADDI:
+        writes = bit(d.rd);
+        return true;
+    case InstrType::LB:
+    case InstrType::LH:
+    case InstrType::LW:
+    case InstrType::LBU:
+    case InstrType::LHU:
+        loads++;
+        reads = bit(d.rs1);
+        writes = bit(d.rd);
+        return true;
+    case InstrType::ADDI:
+    case InstrType::SLTI:
+    case InstrType::SLTIU:
+    case InstrType::XORI:
+    case InstrType::ORI:
+    case InstrType::ANDI:
+    case InstrType::SLLI:
+    case InstrType::SRLI:
+    case InstrType::SRAI:
+    case InstrType::FUSED_SLLI_SRLI:
+        reads = bit(d.rs1);
+        writes = bit(d.rd);
+        return true;
+    case InstrType::FUSED_LUI_MEM:
+        // lui rt, then the load through rt: rt is written before it's read
+        if (d.op2 < InstrType::LB || d.op2 > InstrType::LHU)
+            return false;
+        loads++;
+        writes = bit(d.rd) | bit(d.rd2);
+        return true;
+    default:
+        break;
+    }
+
+    if (d.type >= InstrType::ADD && d.type <= InstrType::BSETI) {
+        reads = bit(d.rs1) | bit(d.rs2);
+        writes = bit(d.rd);
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool is_poll_loop(const Block& b) {
+    if (b.insns.empty())
+        return false;
+
+    const DecodedInstr& br = b.insns.back();
+    if (br.type < InstrType::BEQ || br.type > InstrType::BGEU)
+        return false;
+    uint32_t br_pc = b.paddr + b.bytes - br.instr_len();
+    if (br_pc + static_cast<uint32_t>(br.imm) != b.paddr)
+        return false;
+
+    uint32_t insns = 1;
+    for (size_t i = 0; i + 1 < b.insns.size(); i++)
+        insns += b.insns[i].insn_count();
+    if (insns > MAX_POLL_INSNS)
+        return false;
+
+    uint32_t written = 0;
+    int loads = 0;
+    std::vector<uint32_t> reads(b.insns.size()), writes(b.insns.size());
+    for (size_t i = 0; i + 1 < b.insns.size(); i++) {
+        if (!poll_regs(b.insns[i], reads[i], writes[i], loads))
+            return false;
+        written |= writes[i];
+    }
+    if (loads != 1)
+        return false;
+    reads.back() = (br.rs1 ? 1u << br.rs1 : 0) | (br.rs2 ? 1u << br.rs2 : 0);
+
+    // Anything read before this iteration wrote it must stay loop-invariant
+    uint32_t live = 0;
+    for (size_t i = 0; i < b.insns.size(); i++) {
+        if (reads[i] & ~live & written)
+            return false;
+        live |= writes[i];
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef GAMINGCPU_VP_BLOCK_CACHE_H
+#define GAMINGCPU_VP_BLOCK_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "decode.h"
+#include "threaded.h"
+#include "aot_abi.h"
+
+struct JitCtx;
+struct Intercept;
+
+// Straight-line run of decoded instructions starting at a physical PC
+// Ends at the first branch/jump/system instruction, the page end, or MAX_INSNS
+// Never crosses a page so one fetch translation covers the whole thing
+struct Block {
+    uint32_t paddr = 0;      // physical start
+    uint32_t bytes = 0;      // guest bytes covered
+    uint32_t retired = 0;    // instructions a full run retires (fused count twice)
+    bool valid = true;       // cleared when code under it gets written
+    uint64_t exec_count = 0;
+    std::vector<DecodedInstr> insns;
+    std::vector<ThreadedOp> ops; // filled on first threaded run
+
+    // Native translation, only trusted while jit_gen matches the JIT's generation
+    uint32_t (*jit_fn)(JitCtx*) = nullptr;
+    uint64_t jit_gen = 0;
+    bool jit_failed = false; // don't keep retrying blocks the JIT can't take
+
+    // Ahead-of-time translation, hash-checked against these bytes at build time
+    AotBlockFn aot_fn = nullptr;
+
+    // Native hook for the guest function starting here, see intercept.h
+    Intercept* intercept = nullptr;
+
+    // Set by is_poll_loop(): the block branches back to its own start and
+    // all it does is one load plus ALU work on it. poll_insns = per iteration
+    bool poll_loop = false;
+    uint32_t poll_insns = 0;
+};
+
+// Does this instruction end a basic block?
+// Anything that redirects the PC or can change priv/CSR/interrupt state
+inline bool ends_block(const DecodedInstr& d) {
+    switch (d.type) {
+    case InstrType::JAL:
+    case InstrType::JALR:
+    case InstrType::FUSED_AUIPC_JALR:
+    case InstrType::BEQ:
+    case InstrType::BNE:
+    case InstrType::BLT:
+    case InstrType::BGE:
+    case InstrType::BLTU:
+    case InstrType::BGEU:
+    case InstrType::ECALL:
+    case InstrType::EBREAK:
+    case InstrType::MRET:
+    case InstrType::SRET:
+    case InstrType::URET:
+    case InstrType::WFI:
+    case InstrType::SFENCE_VMA:
+    case InstrType::CSRRW:
+    case InstrType::CSRRS:
+    case InstrType::CSRRC:
+    case InstrType::CSRRWI:
+    case InstrType::CSRRSI:
+    case InstrType::CSRRCI:
+    case InstrType::FENCEI:
+    case InstrType::ILLEGAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// A spin on one load: ends in a branch back to b.paddr, at most
+// MAX_POLL_INSNS long, exactly one load, no stores/AMOs/CSRs, and nothing
+// carried from one iteration to the next (no register read before it's
+// written and then written later, e.g. a timeout counter). Two iterations
+// that load the same value therefore leave identical state
+constexpr uint32_t MAX_POLL_INSNS = 8;
+bool is_poll_loop(const Block& b);
+
+class BlockCache
+{
+public:
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+    static constexpr size_t MAX_INSNS = 64;
+
+    // nullptr on miss. Bumps hits/misses
+    Block* lookup(uint32_t paddr);
+    Block* insert(std::unique_ptr<Block> b);
+
+    // Kill every block overlapping [start, end] (inclusive)
+    // Killed blocks stay allocated until reclaim() since the ISS may be mid-block
+    void invalidate(uint64_t start, uint64_t end);
+    void flush();
+
+    // Free blocks killed by invalidate()/flush(). Only safe between blocks
+    void reclaim() { if (!retired_.empty()) retired_.clear(); }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t built = 0;
+    uint64_t invalidations = 0;
+
+private:
+    void retire(uint32_t paddr);
+
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> page_index_; // ppn -> block starts
+    std::vector<std::unique_ptr<Block>> retired_;
+};
+
+#endif // GAMINGCPU_VP_BLOCK_CACHE_H
@@ -8,132 +8,134 @@ CSRFile::CSRFile() {
     mstatus = 0;
 }
 
-// Privilege check!! CSR addr[9:8] encodes minimum privilege level
-static bool priv_ok(uint16_t addr, uint8_t priv) {
-    uint8_t required = (addr >> 8) & 0x3;
-    return priv >= required;
-}
-
-static bool is_read_only(uint16_t addr) {
-    return ((addr >> 10) & 0x3) == 0x3;
-}
+constexpr CSRFile::Table CSRFile::make_table() {
+    Table t{};
+
+    // CSR addr[9:8] encodes the minimum privilege, addr[11:10] == 3 is read-only
+    auto add = [&t](uint16_t addr, uint32_t CSRFile::*field, uint32_t wmask) -> Desc& {
+        Desc& d = t.csr[addr];
+        d.rpriv = (addr >> 8) & 0x3;
+        d.wpriv = ((addr >> 10) & 0x3) == 0x3 ? 4 : d.rpriv;
+        d.field = field;
+        d.wmask = wmask;
+        return d;
+    };
+    auto counter = [&add](uint16_t addr, uint32_t (*get)(const CSRFile&)) -> Desc& {
+        Desc& d = add(addr, nullptr, 0);
+        d.get = get;
+        return d;
+    };
 
-bool CSRFile::read(uint16_t addr, uint8_t priv, uint32_t& val) const {
-    if (!priv_ok(addr, priv)) return false;
-
-    switch (addr) {
     // Machine info (read-only constants)
-    case CSR_MVENDORID: val = 0;          return true;
-    case CSR_MARCHID:   val = 0;          return true;
-    case CSR_MIMPID:    val = 0;          return true;
-    case CSR_MHARTID:   val = 0;          return true;
+    add(CSR_MVENDORID, nullptr, 0);
+    add(CSR_MARCHID, nullptr, 0);
+    add(CSR_MIMPID, nullptr, 0);
+    add(CSR_MHARTID, &CSRFile::hartid, 0);
 
     // Machine trap setup
-    case CSR_MSTATUS:    val = mstatus;    return true;
-    case CSR_MISA:       val = misa;       return true;
-    case CSR_MEDELEG:    val = medeleg;    return true;
-    case CSR_MIDELEG:    val = mideleg;    return true;
-    case CSR_MIE:        val = mie;        return true;
-    case CSR_MTVEC:      val = mtvec;      return true;
-    case CSR_MCOUNTEREN: val = mcounteren; return true;
+    add(CSR_MSTATUS, &CSRFile::mstatus, MSTATUS_WRITE_MASK).after = [](CSRFile& c) {
+        // Enforce MPP is a legal value (only M=3 or S=1 or U=0)
+        if (((c.mstatus >> 11) & 0x3) == 2)
+            c.mstatus &= ~(3u << 11); // illegal -> U
+        c.update_sd();
+    };
+    add(CSR_MISA, &CSRFile::misa, 0); // writes ignored (fixed ISA!!!)
+    add(CSR_MEDELEG, &CSRFile::medeleg, ~0u);
+    add(CSR_MIDELEG, &CSRFile::mideleg, ~0u);
+    add(CSR_MIE, &CSRFile::mie, ~0u).after = [](CSRFile& c) { c.update_irq_flag(); };
+    add(CSR_MTVEC, &CSRFile::mtvec, ~0u);
+    add(CSR_MCOUNTEREN, &CSRFile::mcounteren, ~0u);
 
     // Machine trap handling
-    case CSR_MSCRATCH: val = mscratch; return true;
-    case CSR_MEPC:     val = mepc;     return true;
-    case CSR_MCAUSE:   val = mcause;   return true;
-    case CSR_MTVAL:    val = mtval;    return true;
-    case CSR_MIP:      val = get_mip(); return true;
+    add(CSR_MSCRATCH, &CSRFile::mscratch, ~0u);
+    add(CSR_MEPC, &CSRFile::mepc, ~0x1u); // bit 0 always 0
+    add(CSR_MCAUSE, &CSRFile::mcause, ~0u);
+    add(CSR_MTVAL, &CSRFile::mtval, ~0u);
+    Desc& mip = add(CSR_MIP, &CSRFile::sw_mip, 1u << 1); // only SSIP writable
+    mip.get = [](const CSRFile& c) { return c.get_mip(); };
+    mip.after = [](CSRFile& c) { c.update_irq_flag(); };
 
     // Machine counters
-    case CSR_MCYCLE:    val = mcycle;    return true;
-    case CSR_MCYCLEH:   val = mcycleh;   return true;
-    case CSR_MINSTRET:  val = minstret;  return true;
-    case CSR_MINSTRETH: val = minstreth; return true;
+    counter(CSR_MCYCLE, [](const CSRFile& c) { return static_cast<uint32_t>(c.mcycle64()); }).set =
+        [](CSRFile& c, uint32_t v) { c.write_counter(c.cycle_offset_, c.mcycle64(), v, false); };
+    counter(CSR_MCYCLEH, [](const CSRFile& c) { return static_cast<uint32_t>(c.mcycle64() >> 32); }).set =
+        [](CSRFile& c, uint32_t v) { c.write_counter(c.cycle_offset_, c.mcycle64(), v, true); };
+    counter(CSR_MINSTRET, [](const CSRFile& c) { return static_cast<uint32_t>(c.minstret64()); }).set =
+        [](CSRFile& c, uint32_t v) { c.write_counter(c.instret_offset_, c.minstret64(), v, false); };
+    counter(CSR_MINSTRETH, [](const CSRFile& c) { return static_cast<uint32_t>(c.minstret64() >> 32); }).set =
+        [](CSRFile& c, uint32_t v) { c.write_counter(c.instret_offset_, c.minstret64(), v, true); };
 
     // User counters (read-only shadows, gated by mcounteren/scounteren)
-    case CSR_CYCLE:    val = mcycle;    return true;
-    case CSR_CYCLEH:   val = mcycleh;   return true;
-    case CSR_INSTRET:  val = minstret;  return true;
-    case CSR_INSTRETH: val = minstreth; return true;
-    case CSR_TIME:     val = mcycle;    return true; // // no RTC, alias to cycle counter
-    case CSR_TIMEH:    val = mcycleh;   return true;
-
-    // Supervisor trap setup
-    case CSR_SSTATUS:    val = mstatus & SSTATUS_MASK; return true;
-    case CSR_SIE:        val = mie & S_INT_MASK;       return true;
-    case CSR_STVEC:      val = stvec;      return true;
-    case CSR_SCOUNTEREN: val = scounteren; return true;
+    counter(CSR_CYCLE, [](const CSRFile& c) { return static_cast<uint32_t>(c.mcycle64()); });
+    counter(CSR_CYCLEH, [](const CSRFile& c) { return static_cast<uint32_t>(c.mcycle64() >> 32); });
+    counter(CSR_INSTRET, [](const CSRFile& c) { return static_cast<uint32_t>(c.minstret64()); });
+    counter(CSR_INSTRETH, [](const CSRFile& c) { return static_cast<uint32_t>(c.minstret64() >> 32); });
+    counter(CSR_TIME, [](const CSRFile& c) { return static_cast<uint32_t>(c.time64()); });
+    counter(CSR_TIMEH, [](const CSRFile& c) { return static_cast<uint32_t>(c.time64() >> 32); });
+
+    // Supervisor trap setup. sstatus/sie are views of mstatus/mie, SD stays
+    // out of the write mask since update_sd() owns it
+    Desc& sstatus = add(CSR_SSTATUS, &CSRFile::mstatus, SSTATUS_MASK & ~(1u << 31));
+    sstatus.rmask = SSTATUS_MASK;
+    sstatus.after = [](CSRFile& c) { c.update_sd(); };
+    Desc& sie = add(CSR_SIE, &CSRFile::mie, S_INT_MASK);
+    sie.rmask = S_INT_MASK;
+    sie.after = [](CSRFile& c) { c.update_irq_flag(); };
+    add(CSR_STVEC, &CSRFile::stvec, ~0u);
+    add(CSR_SCOUNTEREN, &CSRFile::scounteren, ~0u);
 
     // Supervisor trap handling
-    case CSR_SSCRATCH: val = sscratch;             return true;
-    case CSR_SEPC:     val = sepc;                 return true;
-    case CSR_SCAUSE:   val = scause;               return true;
-    case CSR_STVAL:    val = stval;                return true;
-    case CSR_SIP:      val = get_mip() & S_INT_MASK; return true;
-    case CSR_SATP:     val = satp;                 return true;
-
-    default: return false;
+    add(CSR_SSCRATCH, &CSRFile::sscratch, ~0u);
+    add(CSR_SEPC, &CSRFile::sepc, ~0x1u);
+    add(CSR_SCAUSE, &CSRFile::scause, ~0u);
+    add(CSR_STVAL, &CSRFile::stval, ~0u);
+    Desc& sip = add(CSR_SIP, &CSRFile::sw_mip, 1u << 1); // only SSIP
+    sip.get = [](const CSRFile& c) { return c.get_mip() & S_INT_MASK; };
+    sip.after = [](CSRFile& c) { c.update_irq_flag(); };
+    add(CSR_SATP, &CSRFile::satp, ~0u).after = [](CSRFile& c) {
+        if (c.on_satp_write) c.on_satp_write();
+    };
+
+    // Floating point, only while mstatus.FS != Off
+    Desc& fflags = add(CSR_FFLAGS, &CSRFile::fflags, 0x1F);
+    Desc& frm = add(CSR_FRM, &CSRFile::frm, 0x7);
+    Desc& fcsr = add(CSR_FCSR, nullptr, 0);
+    fcsr.get = [](const CSRFile& c) { return (c.frm << 5) | c.fflags; };
+    fcsr.set = [](CSRFile& c, uint32_t v) {
+        c.fflags = v & 0x1F;
+        c.frm = (v >> 5) & 0x7;
+    };
+    for (Desc* d : {&fflags, &frm, &fcsr}) {
+        d->fp = true;
+        d->after = [](CSRFile& c) { c.mark_fs_dirty(); };
     }
-}
-
-bool CSRFile::write(uint16_t addr, uint8_t priv, uint32_t val) {
-    if (!priv_ok(addr, priv)) return false;
-    if (is_read_only(addr))   return false;
 
-    switch (addr) {
-    // Machine trap setup
-    case CSR_MSTATUS: {
-        mstatus = (val & MSTATUS_WRITE_MASK);
-        // Enforce MPP is a legal value (only M=3 or S=1 or U=0)
-        uint32_t mpp = (mstatus >> 11) & 0x3;
-        if (mpp == 2) mstatus = (mstatus & ~(3u << 11)); // illegal -> U
-        return true;
-    }
-    case CSR_MISA:       return true; // writes ignored (fixed ISA!!!)
-    case CSR_MEDELEG:    medeleg = val;    return true;
-    case CSR_MIDELEG:    mideleg = val;    return true;
-    case CSR_MIE:        mie = val;        return true;
-    case CSR_MTVEC:      mtvec = val;      return true;
-    case CSR_MCOUNTEREN: mcounteren = val; return true;
+    return t;
+}
 
-    // Machine trap handling
-    case CSR_MSCRATCH: mscratch = val;       return true;
-    case CSR_MEPC:     mepc = val & ~0x1u;   return true; // bit 0 always 0
-    case CSR_MCAUSE:   mcause = val;         return true;
-    case CSR_MTVAL:    mtval = val;          return true;
-    case CSR_MIP:      sw_mip = val & (1 << 1); return true; // only SSIP writable
+constexpr CSRFile::Table CSRFile::TABLE = CSRFile::make_table();
 
-    // Machine counters
-    case CSR_MCYCLE:    mcycle = val;    return true;
-    case CSR_MCYCLEH:   mcycleh = val;   return true;
-    case CSR_MINSTRET:  minstret = val;  return true;
-    case CSR_MINSTRETH: minstreth = val; return true;
-
-    // Supervisor trap setup
-    case CSR_SSTATUS: {
-        uint32_t new_bits = val & SSTATUS_MASK;
-        mstatus = (mstatus & ~SSTATUS_MASK) | new_bits;
-        return true;
-    }
-    case CSR_SIE: {
-        uint32_t new_bits = val & S_INT_MASK;
-        mie = (mie & ~S_INT_MASK) | new_bits;
-        return true;
-    }
-    case CSR_STVEC:      stvec = val;      return true;
-    case CSR_SCOUNTEREN: scounteren = val; return true;
+bool CSRFile::read(uint16_t addr, uint8_t priv, uint32_t& val) const {
+    const Desc& d = TABLE.csr[addr & 0xFFF];
+    if (priv < d.rpriv || (d.fp && fs_off())) return false;
+
+    if (d.get)
+        val = d.get(*this);
+    else
+        val = d.field ? (this->*d.field) & d.rmask : 0;
+    return true;
+}
 
-    // Supervisor trap handling
-    case CSR_SSCRATCH: sscratch = val;           return true;
-    case CSR_SEPC:     sepc = val & ~0x1u;       return true;
-    case CSR_SCAUSE:   scause = val;             return true;
-    case CSR_STVAL:    stval = val;              return true;
-    case CSR_SIP:      sw_mip = val & (1 << 1);  return true; // only SSIP
-    case CSR_SATP:
-        satp = val;
-        if (on_satp_write) on_satp_write();
-        return true;
-
-    default: return false;
+bool CSRFile::write(uint16_t addr, uint8_t priv, uint32_t val) {
+    const Desc& d = TABLE.csr[addr & 0xFFF];
+    if (priv < d.wpriv || (d.fp && fs_off())) return false;
+
+    if (d.set) {
+        d.set(*this, val);
+    } else if (d.field) {
+        uint32_t& f = this->*d.field;
+        f = (f & ~d.wmask) | (val & d.wmask);
     }
+    if (d.after) d.after(*this);
+    return true;
 }
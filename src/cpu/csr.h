@@ -9,21 +9,19 @@ class CSRFile
 public:
     CSRFile();
 
-    // Returns false on privilege violation or non-existent CSR
+    // Returns false on privilege violation or non-existent CSR. Both are one
+    // lookup in a compile-time table indexed by the CSR address, see Desc
     bool read(uint16_t addr, uint8_t priv, uint32_t &val) const;
     bool write(uint16_t addr, uint8_t priv, uint32_t val);
 
-    // ISS main loop increments
-    void inc_mcycle()
-    {
-        if (++mcycle == 0)
-            ++mcycleh;
-    }
-    void inc_minstret()
-    {
-        if (++minstret == 0)
-            ++minstreth;
-    }
+    // Counters aren't counted, they're derived on read: mcycle/minstret are
+    // the bound retired count (one cycle per instruction) plus an offset that
+    // CSR writes adjust, time comes from read_mtime. Nothing bound reads as 0
+    void bind_retired(const uint64_t* count) { retired_ = count; }
+
+    // time/timeh source, the platform hooks this to CLINT mtime. Unset falls
+    // back to mcycle
+    std::function<uint64_t()> read_mtime;
 
     // Hardware-driven mip bits (CLINT/PLIC set these, not software)
     void set_mip_mtip(bool v) { set_hw_bit(7, v); }
@@ -34,6 +32,18 @@ public:
     void set_mip_ssip(bool v) { set_hw_bit(1, v); }
     uint32_t get_mip() const { return sw_mip | hw_mip; }
 
+    // Cached "an interrupt may be deliverable": something is pending in mip
+    // and enabled in mie. set_mip_* and CSR writes keep it current, code that
+    // pokes mie directly has to call update_irq_flag(). The ISS only runs the
+    // full check_pending_interrupts() (global enables, deleg, priority) when set
+    bool irq_maybe_pending() const { return irq_maybe_pending_; }
+    void update_irq_flag() { irq_maybe_pending_ = (get_mip() & mie) != 0; }
+
+    // mstatus.FS gates the F extension: Off makes FP instructions and the
+    // fcsr CSRs illegal, anything that writes FP state marks it Dirty (SD follows)
+    bool fs_off() const { return ((mstatus >> 13) & 0x3) == 0; }
+    void mark_fs_dirty() { mstatus |= (3u << 13) | (1u << 31); }
+
     // satp write callback (triggers TLB flush in MMU)
     std::function<void()> on_satp_write;
 
@@ -58,13 +68,60 @@ public:
     uint32_t stval = 0;
     uint32_t satp = 0;
 
+    uint32_t fflags = 0; // accrued exceptions, NV DZ OF UF NX
+    uint32_t frm = 0;    // dynamic rounding mode
+
+    uint32_t hartid = 0; // mhartid, set by whoever builds the SoC
+
 private:
-    uint32_t mcycle = 0;
-    uint32_t mcycleh = 0;
-    uint32_t minstret = 0;
-    uint32_t minstreth = 0;
+    // One entry per CSR address. Plain CSRs are a field pointer plus masks,
+    // the odd ones (counters, mip, fcsr) get/set through hooks. Addresses
+    // nobody implements keep the defaults: unreachable at any privilege
+    struct Desc {
+        uint8_t rpriv = 4;                    // lowest privilege that may read, 4 = nobody
+        uint8_t wpriv = 4;                    // same for writes, 4 for read-only CSRs too
+        bool fp = false;                      // illegal while mstatus.FS is Off
+        uint32_t CSRFile::*field = nullptr;   // backing field, reads as 0 without one
+        uint32_t rmask = ~0u;                 // bits of the field this CSR shows
+        uint32_t wmask = 0;                   // WARL: bits a write changes, the rest stay
+        uint32_t (*get)(const CSRFile&) = nullptr;  // instead of reading field
+        void (*set)(CSRFile&, uint32_t) = nullptr;  // instead of writing field
+        void (*after)(CSRFile&) = nullptr;          // side effects once written
+    };
+    struct Table {
+        Desc csr[4096];
+    };
+    static constexpr Table make_table();
+    static const Table TABLE;
+
+    const uint64_t* retired_ = nullptr;
+    uint64_t cycle_offset_ = 0;
+    uint64_t instret_offset_ = 0;
+
+    uint64_t retired() const { return retired_ ? *retired_ : 0; }
+    uint64_t mcycle64() const { return retired() + cycle_offset_; }
+    uint64_t minstret64() const { return retired() + instret_offset_; }
+    uint64_t time64() const { return read_mtime ? read_mtime() : mcycle64(); }
+
+    // Write one half of a derived counter by moving its offset
+    void write_counter(uint64_t& offset, uint64_t cur, uint32_t val, bool high)
+    {
+        uint64_t v = high ? (cur & 0xFFFFFFFFull) | (uint64_t)val << 32
+                          : (cur & ~0xFFFFFFFFull) | val;
+        offset = v - retired();
+    }
+    // SD is read-only: set while FS is Dirty
+    void update_sd()
+    {
+        if (((mstatus >> 13) & 0x3) == 3)
+            mstatus |= 1u << 31;
+        else
+            mstatus &= ~(1u << 31);
+    }
+
     uint32_t hw_mip = 0; // bits driven by hardware (CLINT/PLIC)
     uint32_t sw_mip = 0; // bits writable by software (SSIP only)
+    bool irq_maybe_pending_ = false;
 
     void set_hw_bit(int bit, bool v)
     {
@@ -72,18 +129,19 @@ private:
             hw_mip |= (1u << bit);
         else
             hw_mip &= ~(1u << bit);
+        update_irq_flag();
     }
 
     // WARL mask: only these mstatus bits are writable
     static constexpr uint32_t MSTATUS_WRITE_MASK =
         (1 << 1) | (1 << 3) | (1 << 5) | (1 << 7) | // SIE MIE SPIE MPIE
-        (1 << 8) | (3 << 11) |                      // SPP MPP
+        (1 << 8) | (3 << 11) | (3 << 13) |          // SPP MPP FS
         (1 << 17) | (1 << 18) | (1 << 19) |         // MPRV SUM MXR
         (1 << 20) | (1 << 21) | (1 << 22);          // TVM TW TSR
 
     // S-mode sees only these mstatus bits
     static constexpr uint32_t SSTATUS_MASK =
-        (1 << 1) | (1 << 5) | (1 << 8) | (1 << 18) | (1 << 19);
+        (1 << 1) | (1 << 5) | (1 << 8) | (3 << 13) | (1 << 18) | (1 << 19) | (1u << 31);
 
     // S-mode can see/write these mie/mip bits
     static constexpr uint32_t S_INT_MASK =
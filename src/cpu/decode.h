@@ -65,6 +65,65 @@ enum class InstrType
     REM,
     REMU,
 
+    // B Extension: Zba, Zbb, Zbs (immediate forms keep the shamt in imm)
+    SH1ADD,
+    SH2ADD,
+    SH3ADD,
+    ANDN,
+    ORN,
+    XNOR,
+    CLZ,
+    CTZ,
+    CPOP,
+    MAX,
+    MAXU,
+    MIN,
+    MINU,
+    SEXT_B,
+    SEXT_H,
+    ZEXT_H,
+    ROL,
+    ROR,
+    RORI,
+    ORC_B,
+    REV8,
+    BCLR,
+    BCLRI,
+    BEXT,
+    BEXTI,
+    BINV,
+    BINVI,
+    BSET,
+    BSETI,
+
+    // F Extension, single precision. rm is the instruction's rounding mode
+    FLW,
+    FSW,
+    FMADD_S,
+    FMSUB_S,
+    FNMSUB_S,
+    FNMADD_S,
+    FADD_S,
+    FSUB_S,
+    FMUL_S,
+    FDIV_S,
+    FSQRT_S,
+    FSGNJ_S,
+    FSGNJN_S,
+    FSGNJX_S,
+    FMIN_S,
+    FMAX_S,
+    FCVT_W_S,
+    FCVT_WU_S,
+    FMV_X_W,
+    FEQ_S,
+    FLT_S,
+    FLE_S,
+    FCLASS_S,
+    FCVT_S_W,
+    FCVT_S_WU,
+    FMV_W_X,
+
     // A Extension, Atomics
     LR_W,
     SC_W,
@@ -87,6 +146,12 @@ enum class InstrType
     // System, Fence
     FENCE, FENCEI,
 
+    // Fused macro-ops, two adjacent instructions (see fuse())
+    FUSED_LUI_ADDI,   // lui rd, hi; addi rd, rd, lo      -> rd = hi + lo
+    FUSED_AUIPC_JALR, // auipc rt, hi; jalr rd, lo(rt)    -> far call/tail
+    FUSED_LUI_MEM,    // lui rt, hi; l*/s* .., lo(rt)     -> absolute access
+    FUSED_SLLI_SRLI,  // slli rd, rs, a; srli rd, rd, b   -> bitfield extract
+
     // Invalid
     ILLEGAL
 };
@@ -99,15 +164,40 @@ struct DecodedInstr
     uint32_t rs2 = 0;
     int32_t imm = 0;
     uint32_t csr = 0;        // CSR address for CSR instructions
+    uint8_t rs3 = 0;         // FMA addend
+    uint8_t rm = 0;          // FP rounding mode, 7 = dynamic (frm)
     uint32_t raw = 0;        // Original instruction word
     bool compressed = false; // True if was 16-bit RVC
 
-    uint32_t instr_len() const { return compressed ? 2 : 4; }
+    // Fused ops only. rd/rs1/imm are the first half, these the second
+    // (op2 = its InstrType for FUSED_LUI_MEM, rs2 stays the store source)
+    InstrType op2 = InstrType::ILLEGAL;
+    uint32_t rd2 = 0;
+    int32_t imm2 = 0;
+    uint8_t len1 = 0; // 0 = not fused
+    uint8_t len2 = 0;
+
+    bool fused() const { return len1 != 0; }
+    uint32_t instr_len() const { return len1 ? len1 + len2 : (compressed ? 2 : 4); }
+    uint32_t insn_count() const { return len1 ? 2 : 1; }
 };
 
-// Stateless decoder — handles RV32IMAC including compressed expansion
+constexpr int NUM_FUSED = 4;
+constexpr int fused_index(InstrType t) {
+    return static_cast<int>(t) - static_cast<int>(InstrType::FUSED_LUI_ADDI);
+}
+
+// Stateless decoder — handles RV32IMAFC_Zba_Zbb_Zbs including compressed expansion.
+// Table driven, gives exactly what decode_ref::decode() does
 DecodedInstr decode(uint32_t instr);
 
+// Macro-op fusion: if a followed by b is one of the idioms above, write the
+// fused op to out. Only done when building blocks, decode() itself (and the
+// decode cache, single-stepping, GDB) always sees single instructions.
+// Traps stay precise: only FUSED_LUI_MEM's second half can fault, and the
+// ISS retires the first half on its own when it does
+bool fuse(const DecodedInstr& a, const DecodedInstr& b, DecodedInstr& out);
+
 // Expand a 16-bit compressed instruction to its 32-bit equivalent.
 // Returns 0 (illegal) if the compressed instruction has no mapping.
 uint32_t expand_compressed(uint16_t cinstr);
@@ -0,0 +1,133 @@
+// gamingcpu-decode-bench -- decode throughput, the table decoder against the
+// switch one it's generated from
+//
+//   gamingcpu-decode-bench [firmware.elf ...]
+//
+// Streams: random 32-bit words (mostly illegal), random legal instructions
+// (about half compressed), and the executable segments of any ELFs given
+
+#include "cpu/decode.h"
+#include "cpu/decode_ref.h"
+#include "util/elf_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Out of line like decode(), so neither side gets inlined into the loop
+__attribute__((noinline)) DecodedInstr decode_switch(uint32_t instr) {
+    return decode_ref::decode(instr);
+}
+
+bool same(const DecodedInstr& a, const DecodedInstr& b) {
+    return a.type == b.type && a.rd == b.rd && a.rs1 == b.rs1 && a.rs2 == b.rs2 &&
+           a.imm == b.imm && a.csr == b.csr && a.rs3 == b.rs3 && a.rm == b.rm &&
+           a.raw == b.raw && a.compressed == b.compressed;
+}
+
+// ns per decoded instruction, over at least ~16M decodes
+template <typename F>
+double time_decode(const std::vector<uint32_t>& words, F dec, uint64_t& sum) {
+    size_t reps = std::max<size_t>(1, (16u << 20) / words.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < reps; r++) {
+        for (uint32_t w : words) {
+            DecodedInstr d = dec(w);
+            sum += static_cast<uint32_t>(d.type) + d.rd + d.rs1 + static_cast<uint32_t>(d.imm);
+        }
+    }
+    std::chrono::duration<double, std::nano> t = std::chrono::steady_clock::now() - start;
+    return t.count() / static_cast<double>(reps * words.size());
+}
+
+bool run(const std::string& name, const std::vector<uint32_t>& words) {
+    if (words.empty())
+        return true;
+
+    size_t bad = 0;
+    for (uint32_t w : words)
+        bad += !same(decode(w), decode_switch(w));
+
+    uint64_t s_table = 0, s_switch = 0;
+    double t_table = time_decode(words, decode, s_table);
+    double t_switch = time_decode(words, decode_switch, s_switch);
+
+    std::printf("%-24s %8zu words   table %6.2f ns   switch %6.2f ns   %5.2fx   %zu mismatches\n",
+                name.c_str(), words.size(), t_table, t_switch, t_switch / t_table, bad);
+    return bad == 0 && s_table == s_switch;
+}
+
+std::vector<uint32_t> random_words(std::mt19937& rng, size_t n) {
+    std::vector<uint32_t> v(n);
+    for (uint32_t& w : v)
+        w = rng();
+    return v;
+}
+
+std::vector<uint32_t> random_legal(std::mt19937& rng, size_t n) {
+    std::vector<uint32_t> v;
+    while (v.size() < n) {
+        uint32_t w = rng();
+        bool compressed = w & 0x10000; // half the time
+        w = compressed ? w & 0xFFFF : w | 0x3;
+        if (compressed && (w & 0x3) == 0x3)
+            continue;
+        if (decode_switch(w).type != InstrType::ILLEGAL)
+            v.push_back(w);
+    }
+    return v;
+}
+
+// Instructions in program order, parcel by parcel like the fetch path sees them
+std::vector<uint32_t> elf_stream(const std::string& path) {
+    struct Chunk { uint32_t paddr; std::vector<uint8_t> bytes; };
+    std::vector<Chunk> chunks;
+    ElfLoadResult res = load_elf(path, [&](uint32_t paddr, const uint8_t* data, size_t len) {
+        chunks.push_back({paddr, std::vector<uint8_t>(data, data + len)});
+    });
+
+    std::vector<uint32_t> v;
+    for (const Chunk& c : chunks) {
+        bool exec = false;
+        for (const ElfSegment& s : res.segments)
+            exec |= s.exec && s.paddr == c.paddr;
+        if (!exec)
+            continue;
+        size_t pos = 0;
+        while (pos + 2 <= c.bytes.size()) {
+            uint32_t w = c.bytes[pos] | c.bytes[pos + 1] << 8;
+            if ((w & 0x3) == 0x3 && pos + 4 <= c.bytes.size()) {
+                w |= c.bytes[pos + 2] << 16 | static_cast<uint32_t>(c.bytes[pos + 3]) << 24;
+                pos += 4;
+            } else {
+                pos += 2;
+            }
+            v.push_back(w);
+        }
+    }
+    return v;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::mt19937 rng(12345);
+    bool ok = run("random words", random_words(rng, 1 << 16));
+    ok &= run("random legal insns", random_legal(rng, 1 << 16));
+
+    for (int k = 1; k < argc; k++) {
+        try {
+            ok &= run(argv[k], elf_stream(argv[k]));
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[BENCH] " << argv[k] << ": " << e.what() << "\n";
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
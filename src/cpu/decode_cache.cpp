@@ -0,0 +1,96 @@
+#include "decode_cache.h"
+#include <cstring>
+
+DecodeCache::DecodeCache()
+    : code_pages_(1u << (32 - PAGE_SHIFT), 0)
+{
+}
+
+DecodeCache::Page* DecodeCache::find_page(uint32_t ppn) {
+    if (ppn == last_ppn_)
+        return last_page_;
+
+    auto it = pages_.find(ppn);
+    if (it == pages_.end())
+        return nullptr;
+
+    last_ppn_ = ppn;
+    last_page_ = it->second.get();
+    return last_page_;
+}
+
+const DecodedInstr* DecodeCache::lookup(uint32_t paddr) {
+    Page* p = find_page(paddr >> PAGE_SHIFT);
+    uint32_t slot = (paddr & (PAGE_SIZE - 1)) >> 1;
+    if (p && p->valid[slot]) {
+        hits++;
+        return &p->slots[slot];
+    }
+    misses++;
+    return nullptr;
+}
+
+const DecodedInstr& DecodeCache::insert(uint32_t paddr, const DecodedInstr& d) {
+    uint32_t ppn = paddr >> PAGE_SHIFT;
+    Page* p = find_page(ppn);
+    if (!p) {
+        auto& slot = pages_[ppn];
+        slot.reset(new Page());
+        p = slot.get();
+        last_ppn_ = ppn;
+        last_page_ = p;
+    }
+
+    code_pages_[ppn] = 1;
+
+    uint32_t idx = (paddr & (PAGE_SIZE - 1)) >> 1;
+    p->slots[idx] = d;
+    p->valid[idx] = 1;
+    return p->slots[idx];
+}
+
+void DecodeCache::invalidate(uint64_t start, uint64_t end) {
+    if (end > 0xFFFFFFFFull)
+        end = 0xFFFFFFFFull;
+    if (start > end)
+        return;
+
+    // Single-page stores (the common case) only kill the slots they overlap,
+    // plus the slot 2 bytes back in case a 32-bit instruction starts there
+    if ((start >> PAGE_SHIFT) == (end >> PAGE_SHIFT)) {
+        Page* p = find_page(static_cast<uint32_t>(start >> PAGE_SHIFT));
+        if (!p)
+            return;
+        uint32_t first = (start & (PAGE_SIZE - 1)) >> 1;
+        uint32_t last = (end & (PAGE_SIZE - 1)) >> 1;
+        if (first > 0)
+            first--;
+        for (uint32_t i = first; i <= last; i++) {
+            if (p->valid[i]) {
+                p->valid[i] = 0;
+                invalidations++;
+            }
+        }
+        return;
+    }
+
+    for (uint64_t ppn = start >> PAGE_SHIFT; ppn <= (end >> PAGE_SHIFT); ppn++) {
+        if (!code_pages_[ppn])
+            continue;
+
+        // Keep the page storage around, the code usually comes right back
+        Page* p = find_page(static_cast<uint32_t>(ppn));
+        if (p)
+            std::memset(p->valid, 0, sizeof(p->valid));
+        code_pages_[ppn] = 0;
+        invalidations++;
+    }
+}
+
+void DecodeCache::flush() {
+    for (auto& kv : pages_) {
+        std::memset(kv.second->valid, 0, sizeof(kv.second->valid));
+        code_pages_[kv.first] = 0;
+    }
+    invalidations++;
+}
@@ -0,0 +1,59 @@
+#ifndef GAMINGCPU_VP_DECODE_CACHE_H
+#define GAMINGCPU_VP_DECODE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "decode.h"
+
+// Per-page cache of DecodedInstr keyed by physical PC
+// One slot per halfword so RVC and 32-bit code can live on the same page
+// Only DMI-backed fetches get cached, MMIO code is always re-fetched
+class DecodeCache
+{
+public:
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+    static constexpr uint32_t SLOTS = PAGE_SIZE / 2;
+
+    DecodeCache();
+
+    // nullptr on miss. Bumps hits/misses
+    const DecodedInstr* lookup(uint32_t paddr);
+    const DecodedInstr& insert(uint32_t paddr, const DecodedInstr& d);
+
+    // True if any cached instruction lives on this physical page
+    // Cheap enough to check on every DMI store
+    bool has_code(uint32_t paddr) const { return code_pages_[paddr >> PAGE_SHIFT] != 0; }
+
+    // One byte per physical page, non-zero if it holds cached code
+    // (byte-sized so native code can test it directly)
+    const uint8_t* code_page_map() const { return code_pages_.data(); }
+
+    // Drop cached instructions overlapping [start, end] (inclusive, like DMI ranges)
+    // Small stores only kill the slots they touch, bigger ranges kill whole pages
+    void invalidate(uint64_t start, uint64_t end);
+    void flush();
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;
+
+private:
+    struct Page {
+        DecodedInstr slots[SLOTS];
+        uint8_t valid[SLOTS] = {};
+    };
+
+    Page* find_page(uint32_t ppn);
+
+    std::unordered_map<uint32_t, std::unique_ptr<Page>> pages_;
+    std::vector<uint8_t> code_pages_;
+
+    // Tight loops stay on one page, so skip the hash lookup most of the time
+    uint32_t last_ppn_ = 0xFFFFFFFF;
+    Page* last_page_ = nullptr;
+};
+
+#endif // GAMINGCPU_VP_DECODE_CACHE_H
@@ -0,0 +1,67 @@
+#include "dmi_table.h"
+
+// Oldest first, so erasing keeps the order
+static void erase_at(DmiTable::Region* regions, int& count, int i) {
+    for (; i + 1 < count; i++)
+        regions[i] = regions[i + 1];
+    count--;
+}
+
+bool DmiTable::insert(const Region& r) {
+    bool replaced = false;
+
+    // Targets can re-grant a region (or a bigger one covering it)
+    for (int i = 0; i < count_;) {
+        if (!(regions_[i].end < r.start || regions_[i].start > r.end)) {
+            erase_at(regions_, count_, i);
+            replaced = true;
+        } else {
+            i++;
+        }
+    }
+
+    if (count_ == MAX_REGIONS) {
+        erase_at(regions_, count_, 0);
+        replaced = true;
+    }
+
+    regions_[count_++] = r;
+    return replaced;
+}
+
+bool DmiTable::invalidate(uint64_t start, uint64_t end) {
+    denied_count_ = 0;
+    denied_next_ = 0;
+
+    bool dropped = false;
+    for (int i = 0; i < count_;) {
+        if (!(regions_[i].end < start || regions_[i].start > end)) {
+            erase_at(regions_, count_, i);
+            dropped = true;
+        } else {
+            i++;
+        }
+    }
+    return dropped;
+}
+
+void DmiTable::deny(uint64_t start, uint64_t end) {
+    denied_[denied_next_] = { start, end };
+    denied_next_ = (denied_next_ + 1) % MAX_DENIED;
+    if (denied_count_ < MAX_DENIED)
+        denied_count_++;
+}
+
+bool DmiTable::denied(uint64_t addr) const {
+    for (int i = 0; i < denied_count_; i++) {
+        if (addr >= denied_[i].start && addr <= denied_[i].end)
+            return true;
+    }
+    return false;
+}
+
+void DmiTable::clear() {
+    count_ = 0;
+    denied_count_ = 0;
+    denied_next_ = 0;
+}
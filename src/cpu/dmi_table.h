@@ -0,0 +1,67 @@
+#ifndef GAMINGCPU_VP_DMI_TABLE_H
+#define GAMINGCPU_VP_DMI_TABLE_H
+
+#include <cstdint>
+
+// The DMI regions the ISS currently holds, RAM + BootROM + SRAM at once so
+// code in one can touch the others without dropping to b_transport.
+// Permissions are per region (BootROM is read-only). Addresses the bus
+// refused DMI for are remembered too, so MMIO doesn't re-ask on every access
+class DmiTable
+{
+public:
+    static constexpr int MAX_REGIONS = 4;
+    static constexpr int MAX_DENIED = 8;
+
+    struct Region {
+        uint8_t* ptr = nullptr;
+        uint64_t start = 0;
+        uint64_t end = 0; // inclusive, like tlm_dmi
+        bool readable = false;
+        bool writable = false;
+    };
+
+    // Region covering all of [addr, addr + bytes), nullptr if none
+    const Region* find(uint64_t addr, uint32_t bytes) const {
+        for (int i = 0; i < count_; i++) {
+            const Region& r = regions_[i];
+            if (addr >= r.start && addr + bytes - 1 <= r.end)
+                return &r;
+        }
+        return nullptr;
+    }
+
+    // Add a granted region. Anything it overlaps goes, and when the table is
+    // full the oldest entry does. True if an existing entry was replaced
+    bool insert(const Region& r);
+
+    // Drop regions overlapping [start, end], true if any went
+    // Forgets refused ranges too, whatever changed might grant now
+    bool invalidate(uint64_t start, uint64_t end);
+
+    void deny(uint64_t start, uint64_t end);
+    bool denied(uint64_t addr) const;
+
+    void clear();
+
+    int size() const { return count_; }
+    const Region& operator[](int i) const { return regions_[i]; }
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+private:
+    struct Range {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    Region regions_[MAX_REGIONS];
+    int count_ = 0;
+
+    Range denied_[MAX_DENIED] = {};
+    int denied_count_ = 0;
+    int denied_next_ = 0; // ring
+};
+
+#endif // GAMINGCPU_VP_DMI_TABLE_H
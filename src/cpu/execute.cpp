@@ -1,7 +1,10 @@
 #include "execute.h"
 #include "rv32m.h"
+#include "rv32b.h"
+#include "rv32f.h"
 #include "rv32a.h"
 #include "rv32_defs.h"
+#include <atomic>
 
 using namespace rv32;
 
@@ -9,7 +12,71 @@ static ExecResult make_exception(uint32_t cause, uint32_t tval = 0) {
     return {true, cause, tval};
 }
 
-ExecResult execute(CPUState& s, const DecodedInstr& d) {
+// F extension minus FLW/FSW. Illegal while mstatus.FS is Off, and for a
+// reserved rounding mode (5/6 in the instruction, or DYN with frm >= 5)
+static ExecResult execute_fp(CPUState& s, const DecodedInstr& d) {
+    if (s.csr.fs_off())
+        return make_exception(CAUSE_ILLEGAL_INSTR, d.raw);
+
+    uint32_t rm = d.rm == RM_DYN ? s.csr.frm : d.rm;
+    bool uses_rm = (d.type >= InstrType::FMADD_S && d.type <= InstrType::FSQRT_S) ||
+                   d.type == InstrType::FCVT_W_S || d.type == InstrType::FCVT_WU_S ||
+                   d.type == InstrType::FCVT_S_W || d.type == InstrType::FCVT_S_WU;
+    if (uses_rm && rm > RM_RMM)
+        return make_exception(CAUSE_ILLEGAL_INSTR, d.raw);
+
+    uint32_t a = s.fregs[d.rs1];
+    uint32_t b = s.fregs[d.rs2];
+    uint32_t c = s.fregs[d.rs3];
+    uint32_t x = s.get_regu(d.rs1);
+    uint32_t flags = 0;
+    uint32_t fd = 0;
+    bool to_x = false; // result goes to the integer rd
+    uint32_t xd = 0;
+
+    switch (d.type) {
+    case InstrType::FMADD_S:  fd = rv32f::fmadd(a, b, c, rm, flags); break;
+    case InstrType::FMSUB_S:  fd = rv32f::fmsub(a, b, c, rm, flags); break;
+    case InstrType::FNMSUB_S: fd = rv32f::fnmsub(a, b, c, rm, flags); break;
+    case InstrType::FNMADD_S: fd = rv32f::fnmadd(a, b, c, rm, flags); break;
+    case InstrType::FADD_S:   fd = rv32f::fadd(a, b, rm, flags); break;
+    case InstrType::FSUB_S:   fd = rv32f::fsub(a, b, rm, flags); break;
+    case InstrType::FMUL_S:   fd = rv32f::fmul(a, b, rm, flags); break;
+    case InstrType::FDIV_S:   fd = rv32f::fdiv(a, b, rm, flags); break;
+    case InstrType::FSQRT_S:  fd = rv32f::fsqrt(a, rm, flags); break;
+    case InstrType::FSGNJ_S:  fd = rv32f::fsgnj(a, b); break;
+    case InstrType::FSGNJN_S: fd = rv32f::fsgnjn(a, b); break;
+    case InstrType::FSGNJX_S: fd = rv32f::fsgnjx(a, b); break;
+    case InstrType::FMIN_S:   fd = rv32f::fmin(a, b, flags); break;
+    case InstrType::FMAX_S:   fd = rv32f::fmax(a, b, flags); break;
+    case InstrType::FCVT_S_W:  fd = rv32f::fcvt_s_w(x, rm, flags); break;
+    case InstrType::FCVT_S_WU: fd = rv32f::fcvt_s_wu(x, rm, flags); break;
+    case InstrType::FMV_W_X:   fd = x; break;
+
+    case InstrType::FCVT_W_S:  to_x = true; xd = rv32f::fcvt_w_s(a, rm, flags); break;
+    case InstrType::FCVT_WU_S: to_x = true; xd = rv32f::fcvt_wu_s(a, rm, flags); break;
+    case InstrType::FMV_X_W:   to_x = true; xd = a; break;
+    case InstrType::FEQ_S:     to_x = true; xd = rv32f::feq(a, b, flags); break;
+    case InstrType::FLT_S:     to_x = true; xd = rv32f::flt(a, b, flags); break;
+    case InstrType::FLE_S:     to_x = true; xd = rv32f::fle(a, b, flags); break;
+    case InstrType::FCLASS_S:  to_x = true; xd = rv32f::fclass(a); break;
+    default: break;
+    }
+
+    if (to_x) {
+        s.set_reg(d.rd, static_cast<int32_t>(xd));
+    } else {
+        s.fregs[d.rd] = fd;
+        s.csr.mark_fs_dirty();
+    }
+    if (flags) {
+        s.csr.fflags |= flags;
+        s.csr.mark_fs_dirty();
+    }
+    return {};
+}
+
+ExecResult execute_nomem(CPUState& s, const DecodedInstr& d) {
     uint32_t rs1 = s.get_regu(d.rs1);
     int32_t  rs1s = s.get_reg(d.rs1);
     uint32_t rs2 = s.get_regu(d.rs2);
@@ -18,6 +85,9 @@ ExecResult execute(CPUState& s, const DecodedInstr& d) {
 
     s.next_pc = s.pc + d.instr_len();
 
+    if (d.type >= InstrType::FMADD_S && d.type <= InstrType::FMV_W_X)
+        return execute_fp(s, d);
+
     switch (d.type) {
 
     case InstrType::LUI:
@@ -45,56 +115,6 @@ ExecResult execute(CPUState& s, const DecodedInstr& d) {
     case InstrType::BLTU: if (rs1 < rs2) s.next_pc = s.pc + imm; break;
     case InstrType::BGEU: if (rs1 >= rs2) s.next_pc = s.pc + imm; break;
 
-    case InstrType::LB: {
-        uint32_t addr = rs1 + imm;
-        s.set_reg(d.rd, static_cast<int8_t>(s.mem.read(addr, 1)));
-        break;
-    }
-    case InstrType::LH: {
-        uint32_t addr = rs1 + imm;
-        if (addr & 1) return make_exception(CAUSE_MISALIGNED_LOAD, addr);
-        s.set_reg(d.rd, static_cast<int16_t>(s.mem.read(addr, 2)));
-        break;
-    }
-    case InstrType::LW: {
-        uint32_t addr = rs1 + imm;
-        if (addr & 3) return make_exception(CAUSE_MISALIGNED_LOAD, addr);
-        s.set_reg(d.rd, static_cast<int32_t>(s.mem.read(addr, 4)));
-        break;
-    }
-    case InstrType::LBU: {
-        uint32_t addr = rs1 + imm;
-        s.set_reg(d.rd, static_cast<int32_t>(s.mem.read(addr, 1) & 0xFF));
-        break;
-    }
-    case InstrType::LHU: {
-        uint32_t addr = rs1 + imm;
-        if (addr & 1) return make_exception(CAUSE_MISALIGNED_LOAD, addr);
-        s.set_reg(d.rd, static_cast<int32_t>(s.mem.read(addr, 2) & 0xFFFF));
-        break;
-    }
-
-    case InstrType::SB: {
-        uint32_t addr = rs1 + imm;
-        s.mem.write(addr, rs2 & 0xFF, 1);
-        s.lr_sc.clear();
-        break;
-    }
-    case InstrType::SH: {
-        uint32_t addr = rs1 + imm;
-        if (addr & 1) return make_exception(CAUSE_MISALIGNED_STORE, addr);
-        s.mem.write(addr, rs2 & 0xFFFF, 2);
-        s.lr_sc.clear();
-        break;
-    }
-    case InstrType::SW: {
-        uint32_t addr = rs1 + imm;
-        if (addr & 3) return make_exception(CAUSE_MISALIGNED_STORE, addr);
-        s.mem.write(addr, rs2, 4);
-        s.lr_sc.clear();
-        break;
-    }
-
     case InstrType::ADDI:  s.set_reg(d.rd, rs1s + d.imm); break;
     case InstrType::SLTI:  s.set_reg(d.rd, rs1s < d.imm ? 1 : 0); break;
     case InstrType::SLTIU: s.set_reg(d.rd, rs1 < imm ? 1 : 0); break;
@@ -125,55 +145,35 @@ ExecResult execute(CPUState& s, const DecodedInstr& d) {
     case InstrType::REM:    s.set_reg(d.rd, static_cast<int32_t>(rv32m::rem(rs1, rs2))); break;
     case InstrType::REMU:   s.set_reg(d.rd, static_cast<int32_t>(rv32m::remu(rs1, rs2))); break;
 
-    case InstrType::LR_W: {
-        uint32_t addr = rs1;
-        if (addr & 3) return make_exception(CAUSE_MISALIGNED_LOAD, addr);
-        s.set_reg(d.rd, static_cast<int32_t>(s.mem.read(addr, 4)));
-        s.lr_sc.set(addr);
-        break;
-    }
-    case InstrType::SC_W: {
-        uint32_t addr = rs1;
-        if (addr & 3) return make_exception(CAUSE_MISALIGNED_STORE, addr);
-        if (s.lr_sc.check(addr)) {
-            s.mem.write(addr, rs2, 4);
-            s.set_reg(d.rd, 0);
-        } else {
-            s.set_reg(d.rd, 1);
-        }
-        s.lr_sc.clear();
-        break;
-    }
-
-    case InstrType::AMOSWAP_W:
-    case InstrType::AMOADD_W:
-    case InstrType::AMOXOR_W:
-    case InstrType::AMOAND_W:
-    case InstrType::AMOOR_W:
-    case InstrType::AMOMIN_W:
-    case InstrType::AMOMAX_W:
-    case InstrType::AMOMINU_W:
-    case InstrType::AMOMAXU_W: {
-        uint32_t addr = rs1;
-        if (addr & 3) return make_exception(CAUSE_MISALIGNED_STORE, addr);
-        uint32_t mem_val = s.mem.read(addr, 4);
-        s.set_reg(d.rd, static_cast<int32_t>(mem_val));
-        uint32_t result;
-        switch (d.type) {
-        case InstrType::AMOSWAP_W: result = rv32a::amo_swap(mem_val, rs2); break;
-        case InstrType::AMOADD_W:  result = rv32a::amo_add(mem_val, rs2); break;
-        case InstrType::AMOXOR_W:  result = rv32a::amo_xor(mem_val, rs2); break;
-        case InstrType::AMOAND_W:  result = rv32a::amo_and(mem_val, rs2); break;
-        case InstrType::AMOOR_W:   result = rv32a::amo_or(mem_val, rs2); break;
-        case InstrType::AMOMIN_W:  result = rv32a::amo_min(mem_val, rs2); break;
-        case InstrType::AMOMAX_W:  result = rv32a::amo_max(mem_val, rs2); break;
-        case InstrType::AMOMINU_W: result = rv32a::amo_minu(mem_val, rs2); break;
-        case InstrType::AMOMAXU_W: result = rv32a::amo_maxu(mem_val, rs2); break;
-        default: result = 0; break;
-        }
-        s.mem.write(addr, result, 4);
-        break;
-    }
+    case InstrType::SH1ADD: s.set_reg(d.rd, static_cast<int32_t>(rv32b::sh1add(rs1, rs2))); break;
+    case InstrType::SH2ADD: s.set_reg(d.rd, static_cast<int32_t>(rv32b::sh2add(rs1, rs2))); break;
+    case InstrType::SH3ADD: s.set_reg(d.rd, static_cast<int32_t>(rv32b::sh3add(rs1, rs2))); break;
+    case InstrType::ANDN:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::andn(rs1, rs2))); break;
+    case InstrType::ORN:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::orn(rs1, rs2))); break;
+    case InstrType::XNOR:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::xnor(rs1, rs2))); break;
+    case InstrType::CLZ:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::clz(rs1, 0))); break;
+    case InstrType::CTZ:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::ctz(rs1, 0))); break;
+    case InstrType::CPOP:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::cpop(rs1, 0))); break;
+    case InstrType::MAX:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::max(rs1, rs2))); break;
+    case InstrType::MAXU:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::maxu(rs1, rs2))); break;
+    case InstrType::MIN:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::min(rs1, rs2))); break;
+    case InstrType::MINU:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::minu(rs1, rs2))); break;
+    case InstrType::SEXT_B: s.set_reg(d.rd, static_cast<int32_t>(rv32b::sext_b(rs1, 0))); break;
+    case InstrType::SEXT_H: s.set_reg(d.rd, static_cast<int32_t>(rv32b::sext_h(rs1, 0))); break;
+    case InstrType::ZEXT_H: s.set_reg(d.rd, static_cast<int32_t>(rv32b::zext_h(rs1, 0))); break;
+    case InstrType::ROL:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::rol(rs1, rs2))); break;
+    case InstrType::ROR:    s.set_reg(d.rd, static_cast<int32_t>(rv32b::ror(rs1, rs2))); break;
+    case InstrType::RORI:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::ror(rs1, imm))); break;
+    case InstrType::ORC_B:  s.set_reg(d.rd, static_cast<int32_t>(rv32b::orc_b(rs1, 0))); break;
+    case InstrType::REV8:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::rev8(rs1, 0))); break;
+    case InstrType::BCLR:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::bclr(rs1, rs2))); break;
+    case InstrType::BCLRI:  s.set_reg(d.rd, static_cast<int32_t>(rv32b::bclr(rs1, imm))); break;
+    case InstrType::BEXT:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::bext(rs1, rs2))); break;
+    case InstrType::BEXTI:  s.set_reg(d.rd, static_cast<int32_t>(rv32b::bext(rs1, imm))); break;
+    case InstrType::BINV:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::binv(rs1, rs2))); break;
+    case InstrType::BINVI:  s.set_reg(d.rd, static_cast<int32_t>(rv32b::binv(rs1, imm))); break;
+    case InstrType::BSET:   s.set_reg(d.rd, static_cast<int32_t>(rv32b::bset(rs1, rs2))); break;
+    case InstrType::BSETI:  s.set_reg(d.rd, static_cast<int32_t>(rv32b::bset(rs1, imm))); break;
 
     case InstrType::CSRRW: {
         uint32_t old_val;
@@ -298,13 +298,32 @@ ExecResult execute(CPUState& s, const DecodedInstr& d) {
             return make_exception(CAUSE_ILLEGAL_INSTR, d.raw);
         { ExecResult sfence_r; sfence_r.sfence_vma = true; return sfence_r; }
 
-    case InstrType::FENCE:
+    case InstrType::FENCE: // other harts may be running on other host threads
+        std::atomic_thread_fence(std::memory_order_seq_cst);
         break;
     case InstrType::FENCEI:
         { ExecResult fi_r; fi_r.fence_i = true; return fi_r; }
 
     case InstrType::ILLEGAL:
         return make_exception(CAUSE_ILLEGAL_INSTR, d.raw);
+
+    // Fused ops, both halves' results in program order
+    case InstrType::FUSED_LUI_ADDI:
+        s.set_reg(d.rd, d.imm);
+        break;
+    case InstrType::FUSED_AUIPC_JALR: {
+        uint32_t hi = s.pc + imm;
+        s.set_reg(d.rd, static_cast<int32_t>(hi));
+        s.set_reg(d.rd2, static_cast<int32_t>(s.pc + d.instr_len()));
+        s.next_pc = (hi + static_cast<uint32_t>(d.imm2)) & ~1u;
+        break;
+    }
+    case InstrType::FUSED_SLLI_SRLI:
+        s.set_reg(d.rd, static_cast<int32_t>((rs1 << (d.imm & 0x1F)) >> (d.imm2 & 0x1F)));
+        break;
+
+    default: // loads/stores/AMOs live in the execute() template
+        break;
     }
 
     return {};
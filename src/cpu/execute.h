@@ -2,18 +2,16 @@
 #define GAMINGCPU_VP_EXECUTE_H
 
 #include <cstdint>
-#include <functional>
+#include <type_traits>
+#include <utility>
 #include "decode.h"
 #include "csr.h"
 #include "rv32a.h"
-
-struct MemIf {
-    std::function<uint32_t(uint32_t addr, int bytes)> read;
-    std::function<void(uint32_t addr, uint32_t data, int bytes)> write;
-};
+#include "rv32_defs.h"
 
 struct CPUState {
     int32_t  regs[32] = {};
+    uint32_t fregs[32] = {}; // binary32 bits, FLEN = 32 so no NaN-boxing
     uint32_t pc       = 0;
     uint32_t next_pc  = 0;
     uint8_t  priv     = 3; // M-mode
@@ -21,7 +19,9 @@ struct CPUState {
     CSRFile  csr;
     Reservation lr_sc;
 
-    MemIf    mem;
+    // Implementation choice, not architectural: do misaligned LH/LHU/LW/SH/SW
+    // in hardware instead of raising the misaligned trap. LR/SC/AMOs always trap
+    bool misaligned_ok = false;
 
     int32_t  get_reg(uint32_t i) const { return (i == 0) ? 0 : regs[i]; }
     uint32_t get_regu(uint32_t i) const { return static_cast<uint32_t>(get_reg(i)); }
@@ -38,6 +38,207 @@ struct ExecResult {
     bool sfence_vma = false;
 };
 
-ExecResult execute(CPUState& s, const DecodedInstr& d);
+// Everything except loads/stores/LR/SC/AMOs
+ExecResult execute_nomem(CPUState& s, const DecodedInstr& d);
+
+namespace detail {
+inline ExecResult mem_exception(uint32_t cause, uint32_t tval) {
+    ExecResult r;
+    r.exception = true;
+    r.cause = cause;
+    r.tval = tval;
+    return r;
+}
+
+// Mems that can hand out a host pointer for an aligned word (MemIf) get
+// LR/SC/AMOs done with host atomics, the rest read-modify-write through read/write
+template <typename Mem, typename = void>
+struct has_amo_ptr : std::false_type {};
+template <typename Mem>
+struct has_amo_ptr<Mem, std::void_t<decltype(std::declval<Mem&>().amo_ptr(0u))>> : std::true_type {};
+
+template <typename Mem>
+uint32_t* amo_ptr(Mem& mem, uint32_t addr) {
+    if constexpr (has_amo_ptr<Mem>::value)
+        return mem.amo_ptr(addr);
+    else
+        return nullptr;
+}
+} // namespace detail
+
+// Execute one instruction. Mem is anything with
+//   uint32_t read(uint32_t addr, int bytes)
+//   void write(uint32_t addr, uint32_t data, int bytes)
+// Templated instead of going through std::function so the ISS's DMI fast path
+// inlines right into the load/store cases. Unit tests pass a plain array
+template <typename Mem>
+ExecResult execute(CPUState& s, const DecodedInstr& d, Mem& mem) {
+    using namespace rv32;
+
+    uint32_t rs1 = s.get_regu(d.rs1);
+    uint32_t rs2 = s.get_regu(d.rs2);
+    uint32_t imm = static_cast<uint32_t>(d.imm);
+
+    s.next_pc = s.pc + d.instr_len();
+
+    switch (d.type) {
+    default:
+        return execute_nomem(s, d);
+
+    // lui lands first so it's visible if the access faults. The ISS then
+    // retires it alone and traps with pc on the second half
+    case InstrType::FUSED_LUI_MEM: {
+        s.set_reg(d.rd, d.imm);
+        DecodedInstr h;
+        h.type = d.op2;
+        h.rd = d.rd2;
+        h.rs1 = d.rd;
+        h.rs2 = d.rs2;
+        h.imm = d.imm2;
+        ExecResult r = execute(s, h, mem);
+        s.next_pc = s.pc + d.instr_len();
+        return r;
+    }
+
+    case InstrType::LB: {
+        uint32_t addr = rs1 + imm;
+        s.set_reg(d.rd, static_cast<int8_t>(mem.read(addr, 1)));
+        break;
+    }
+    case InstrType::LH: {
+        uint32_t addr = rs1 + imm;
+        if ((addr & 1) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_LOAD, addr);
+        s.set_reg(d.rd, static_cast<int16_t>(mem.read(addr, 2)));
+        break;
+    }
+    case InstrType::LW: {
+        uint32_t addr = rs1 + imm;
+        if ((addr & 3) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_LOAD, addr);
+        s.set_reg(d.rd, static_cast<int32_t>(mem.read(addr, 4)));
+        break;
+    }
+    case InstrType::LBU: {
+        uint32_t addr = rs1 + imm;
+        s.set_reg(d.rd, static_cast<int32_t>(mem.read(addr, 1) & 0xFF));
+        break;
+    }
+    case InstrType::LHU: {
+        uint32_t addr = rs1 + imm;
+        if ((addr & 1) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_LOAD, addr);
+        s.set_reg(d.rd, static_cast<int32_t>(mem.read(addr, 2) & 0xFFFF));
+        break;
+    }
+
+    case InstrType::SB: {
+        uint32_t addr = rs1 + imm;
+        mem.write(addr, rs2 & 0xFF, 1);
+        s.lr_sc.clear();
+        break;
+    }
+    case InstrType::SH: {
+        uint32_t addr = rs1 + imm;
+        if ((addr & 1) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_STORE, addr);
+        mem.write(addr, rs2 & 0xFFFF, 2);
+        s.lr_sc.clear();
+        break;
+    }
+    case InstrType::SW: {
+        uint32_t addr = rs1 + imm;
+        if ((addr & 3) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_STORE, addr);
+        mem.write(addr, rs2, 4);
+        s.lr_sc.clear();
+        break;
+    }
+
+    case InstrType::FLW: {
+        uint32_t addr = rs1 + imm;
+        if (s.csr.fs_off()) return detail::mem_exception(CAUSE_ILLEGAL_INSTR, d.raw);
+        if ((addr & 3) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_LOAD, addr);
+        s.fregs[d.rd] = mem.read(addr, 4);
+        s.csr.mark_fs_dirty();
+        break;
+    }
+    case InstrType::FSW: {
+        uint32_t addr = rs1 + imm;
+        if (s.csr.fs_off()) return detail::mem_exception(CAUSE_ILLEGAL_INSTR, d.raw);
+        if ((addr & 3) && !s.misaligned_ok) return detail::mem_exception(CAUSE_MISALIGNED_STORE, addr);
+        mem.write(addr, s.fregs[d.rs2], 4);
+        s.lr_sc.clear();
+        break;
+    }
+
+    case InstrType::LR_W: {
+        uint32_t addr = rs1;
+        if (addr & 3) return detail::mem_exception(CAUSE_MISALIGNED_LOAD, addr);
+        uint32_t v = mem.read(addr, 4);
+        s.set_reg(d.rd, static_cast<int32_t>(v));
+        s.lr_sc.set(addr, v);
+        break;
+    }
+    case InstrType::SC_W: {
+        uint32_t addr = rs1;
+        if (addr & 3) return detail::mem_exception(CAUSE_MISALIGNED_STORE, addr);
+        bool ok = s.lr_sc.check(addr);
+        if (ok) {
+            if (uint32_t* p = detail::amo_ptr(mem, addr))
+                ok = rv32a::atomic_sc(p, s.lr_sc.value, rs2);
+            else
+                mem.write(addr, rs2, 4);
+        }
+        s.set_reg(d.rd, ok ? 0 : 1);
+        s.lr_sc.clear();
+        break;
+    }
+
+    case InstrType::AMOSWAP_W:
+    case InstrType::AMOADD_W:
+    case InstrType::AMOXOR_W:
+    case InstrType::AMOAND_W:
+    case InstrType::AMOOR_W:
+    case InstrType::AMOMIN_W:
+    case InstrType::AMOMAX_W:
+    case InstrType::AMOMINU_W:
+    case InstrType::AMOMAXU_W: {
+        uint32_t addr = rs1;
+        if (addr & 3) return detail::mem_exception(CAUSE_MISALIGNED_STORE, addr);
+        if (uint32_t* p = detail::amo_ptr(mem, addr)) {
+            uint32_t old;
+            switch (d.type) {
+            case InstrType::AMOSWAP_W: old = rv32a::atomic_swap(p, rs2); break;
+            case InstrType::AMOADD_W:  old = rv32a::atomic_add(p, rs2); break;
+            case InstrType::AMOXOR_W:  old = rv32a::atomic_xor(p, rs2); break;
+            case InstrType::AMOAND_W:  old = rv32a::atomic_and(p, rs2); break;
+            case InstrType::AMOOR_W:   old = rv32a::atomic_or(p, rs2); break;
+            case InstrType::AMOMIN_W:  old = rv32a::atomic_rmw<rv32a::amo_min>(p, rs2); break;
+            case InstrType::AMOMAX_W:  old = rv32a::atomic_rmw<rv32a::amo_max>(p, rs2); break;
+            case InstrType::AMOMINU_W: old = rv32a::atomic_rmw<rv32a::amo_minu>(p, rs2); break;
+            default:                   old = rv32a::atomic_rmw<rv32a::amo_maxu>(p, rs2); break;
+            }
+            s.set_reg(d.rd, static_cast<int32_t>(old));
+            s.lr_sc.clear();
+            break;
+        }
+        uint32_t mem_val = mem.read(addr, 4);
+        s.set_reg(d.rd, static_cast<int32_t>(mem_val));
+        uint32_t result;
+        switch (d.type) {
+        case InstrType::AMOSWAP_W: result = rv32a::amo_swap(mem_val, rs2); break;
+        case InstrType::AMOADD_W:  result = rv32a::amo_add(mem_val, rs2); break;
+        case InstrType::AMOXOR_W:  result = rv32a::amo_xor(mem_val, rs2); break;
+        case InstrType::AMOAND_W:  result = rv32a::amo_and(mem_val, rs2); break;
+        case InstrType::AMOOR_W:   result = rv32a::amo_or(mem_val, rs2); break;
+        case InstrType::AMOMIN_W:  result = rv32a::amo_min(mem_val, rs2); break;
+        case InstrType::AMOMAX_W:  result = rv32a::amo_max(mem_val, rs2); break;
+        case InstrType::AMOMINU_W: result = rv32a::amo_minu(mem_val, rs2); break;
+        case InstrType::AMOMAXU_W: result = rv32a::amo_maxu(mem_val, rs2); break;
+        default: result = 0; break;
+        }
+        mem.write(addr, result, 4);
+        break;
+    }
+    }
+
+    return {};
+}
 
 #endif // GAMINGCPU_VP_EXECUTE_H
@@ -0,0 +1,94 @@
+#include "hart_pool.h"
+#include "iss.h"
+#include <algorithm>
+
+HartPool::HartPool(sc_core::sc_module_name name, unsigned threads)
+    : sc_module(name)
+{
+    SC_THREAD(dispatch);
+
+    for (unsigned k = 1; k < std::max(threads, 1u); k++)
+        workers_.emplace_back(&HartPool::worker, this);
+}
+
+HartPool::~HartPool() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        quit_ = true;
+    }
+    work_cv_.notify_all();
+    for (std::thread& t : workers_)
+        t.join();
+}
+
+void HartPool::run(ISS& hart) {
+    // First one in this delta wakes the dispatcher for the next, everyone
+    // arriving before then rides along
+    if (batch_.empty())
+        kick_.notify(sc_core::SC_ZERO_TIME);
+    batch_.push_back(&hart);
+    sc_core::wait(done_);
+}
+
+void HartPool::dispatch() {
+    while (true) {
+        wait(kick_);
+
+        std::vector<ISS*> batch;
+        batch.swap(batch_);
+        batches++;
+        slices += batch.size();
+        max_batch = std::max(max_batch, batch.size());
+
+        if (batch.size() == 1 || workers_.empty()) {
+            for (ISS* h : batch)
+                h->run_slice();
+        } else {
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                jobs_ = std::move(batch);
+                next_ = 0;
+                pending_ = jobs_.size();
+            }
+            work_cv_.notify_all();
+
+            // This thread takes jobs too, then waits out the stragglers
+            while (run_job()) {
+            }
+            std::unique_lock<std::mutex> lk(m_);
+            done_cv_.wait(lk, [this] { return pending_ == 0; });
+        }
+
+        done_.notify();
+    }
+}
+
+void HartPool::worker() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(m_);
+            work_cv_.wait(lk, [this] { return quit_ || next_ < jobs_.size(); });
+            if (quit_)
+                return;
+        }
+        while (run_job()) {
+        }
+    }
+}
+
+bool HartPool::run_job() {
+    ISS* h;
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        if (next_ >= jobs_.size())
+            return false;
+        h = jobs_[next_++];
+    }
+
+    h->run_slice();
+
+    std::lock_guard<std::mutex> lk(m_);
+    if (--pending_ == 0)
+        done_cv_.notify_all();
+    return true;
+}
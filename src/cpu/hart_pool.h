@@ -0,0 +1,55 @@
+#ifndef GAMINGCPU_VP_HART_POOL_H
+#define GAMINGCPU_VP_HART_POOL_H
+
+#include <systemc>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ISS;
+
+// Runs the harts of an SMP platform on host threads. Every hart hands its
+// quantum over with run(), the harts that arrive in the same delta form a
+// batch, and the dispatcher runs the batch's slices in parallel and blocks
+// the kernel until all of them are back: that's the barrier, nothing else
+// in the simulation moves meanwhile. Slices only touch their own hart and
+// DMI memory (shared RAM goes through host atomics for LR/SC/AMOs), anything
+// else stops the slice and is finished on the hart's own SystemC thread
+class HartPool : public sc_core::sc_module
+{
+public:
+    // threads: host threads running slices, including the simulation's own
+    HartPool(sc_core::sc_module_name name, unsigned threads);
+    ~HartPool();
+    SC_HAS_PROCESS(HartPool);
+
+    // From the hart's SC_THREAD. Returns once its slice is done
+    void run(ISS& hart);
+
+    unsigned threads() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    uint64_t batches = 0;
+    uint64_t slices = 0;
+    size_t max_batch = 0; // most harts in one batch
+
+private:
+    void dispatch();
+    void worker();
+    bool run_job(); // false once the batch has nothing left to start
+
+    std::vector<ISS*> batch_; // gathering, SystemC side only
+    sc_core::sc_event kick_;
+    sc_core::sc_event done_;
+
+    std::vector<std::thread> workers_;
+    std::mutex m_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<ISS*> jobs_; // the batch being run
+    size_t next_ = 0;        // next job to start
+    size_t pending_ = 0;     // jobs not finished yet
+    bool quit_ = false;
+};
+
+#endif // GAMINGCPU_VP_HART_POOL_H
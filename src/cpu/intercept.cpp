@@ -0,0 +1,100 @@
+#include "intercept.h"
+#include <cstring>
+
+uint8_t* GuestCall::ram(uint32_t addr, uint32_t len, bool write) {
+    if (len == 0)
+        len = 1;
+    const DmiTable::Region* rg = dmi.find(addr, len);
+    if (!rg || !rg->readable || (write && !rg->writable))
+        return nullptr;
+
+    if (write) {
+        uint32_t last = addr + len - 1;
+        for (uint32_t p = addr & ~(DecodeCache::PAGE_SIZE - 1); p <= last; p += DecodeCache::PAGE_SIZE) {
+            if (code.has_code(p))
+                return nullptr;
+            if (p + DecodeCache::PAGE_SIZE < p)
+                break; // top page
+        }
+    }
+    return rg->ptr + (addr - rg->start);
+}
+
+namespace intercept {
+
+bool memcpy(GuestCall& c) {
+    uint32_t dst = c.arg(0), src = c.arg(1), n = c.arg(2);
+    uint8_t* d = c.ram(dst, n, true);
+    const uint8_t* s = c.ram(src, n, false);
+    if (!d || !s)
+        return false;
+
+    // Overlap is undefined for memcpy, do what a forward copy would mostly get right
+    std::memmove(d, s, n);
+    c.bytes = n;
+    c.ret(dst);
+    return true;
+}
+
+bool memset(GuestCall& c) {
+    uint32_t dst = c.arg(0), n = c.arg(2);
+    uint8_t* d = c.ram(dst, n, true);
+    if (!d)
+        return false;
+
+    std::memset(d, static_cast<uint8_t>(c.arg(1)), n);
+    c.bytes = n;
+    c.ret(dst);
+    return true;
+}
+
+bool strlen(GuestCall& c) {
+    // No length up front: search to the end of whatever region the string
+    // starts in, and leave strings running off it to the guest
+    uint32_t s = c.arg(0);
+    const DmiTable::Region* rg = c.dmi.find(s, 1);
+    if (!rg || !rg->readable)
+        return false;
+    const uint8_t* p = rg->ptr + (s - rg->start);
+    const void* z = std::memchr(p, 0, rg->end - s + 1);
+    if (!z)
+        return false;
+
+    uint32_t n = static_cast<uint32_t>(static_cast<const uint8_t*>(z) - p);
+    c.bytes = n;
+    c.ret(n);
+    return true;
+}
+
+bool fixed_mul(GuestCall& c) {
+    int64_t a = static_cast<int32_t>(c.arg(0));
+    int64_t b = static_cast<int32_t>(c.arg(1));
+    c.ret(static_cast<uint32_t>((a * b) >> 16));
+    return true;
+}
+
+bool fixed_div(GuestCall& c) {
+    int32_t a = static_cast<int32_t>(c.arg(0));
+    int32_t b = static_cast<int32_t>(c.arg(1));
+
+    // abs() wraps on INT_MIN in the guest too
+    auto wabs = [](int32_t v) { return static_cast<int32_t>(v < 0 ? 0u - static_cast<uint32_t>(v) : v); };
+    if ((wabs(a) >> 14) >= wabs(b)) {
+        c.ret((a ^ b) < 0 ? 0x80000000u : 0x7FFFFFFFu);
+        return true;
+    }
+    if (b == 0)
+        return false; // only INT_MIN / 0 gets here, let the guest have it
+    c.ret(static_cast<uint32_t>((static_cast<int64_t>(a) * 65536) / b));
+    return true;
+}
+
+const Builtin BUILTINS[5] = {
+    {"memcpy", memcpy, 10, 20},
+    {"memset", memset, 10, 12},
+    {"strlen", strlen, 4, 48},
+    {"FixedMul", fixed_mul, 6, 0},
+    {"FixedDiv", fixed_div, 40, 0},
+};
+
+} // namespace intercept
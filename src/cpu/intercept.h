@@ -0,0 +1,66 @@
+#ifndef GAMINGCPU_VP_INTERCEPT_H
+#define GAMINGCPU_VP_INTERCEPT_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "execute.h"
+#include "dmi_table.h"
+#include "decode_cache.h"
+
+// Guest function interception: a native hook runs in place of a guest
+// function whenever a call lands on its entry. The hook takes its arguments
+// from a0.., leaves the result in a0 and the ISS returns to ra, crediting
+// Intercept::cost instructions for the work skipped. Only in bare mode
+// (vaddr == paddr) and only on DMI memory: when a pointer argument isn't
+// plain RAM the hook declines and the guest code runs as usual
+struct GuestCall {
+    CPUState& state;
+    const DmiTable& dmi;
+    const DecodeCache& code;
+    uint64_t bytes = 0; // work done, for Intercept::cost_per_16b
+
+    uint32_t arg(int n) const { return state.get_regu(10 + n); }
+    void ret(uint32_t v) { state.set_reg(10, static_cast<int32_t>(v)); }
+
+    // Host pointer to all of [addr, addr + len), nullptr if any of it isn't
+    // DMI memory (or isn't writable, for write). Refuses to write pages with
+    // decoded code on them so nothing stale ever runs
+    uint8_t* ram(uint32_t addr, uint32_t len, bool write);
+};
+
+// Returns false to decline, before touching any guest state
+using InterceptFn = std::function<bool(GuestCall&)>;
+
+struct Intercept {
+    std::string name;
+    InterceptFn fn;
+    bool enabled = true;
+    uint32_t cost = 1;         // instructions credited per call
+    uint32_t cost_per_16b = 0; // plus this per 16 bytes of GuestCall::bytes
+
+    uint64_t calls = 0;
+    uint64_t declined = 0;
+};
+
+namespace intercept {
+
+// Native versions of what Doom and the firmware spend most time in. The
+// costs are rough instruction counts of the newlib/Doom guest versions
+bool memcpy(GuestCall& c);
+bool memset(GuestCall& c);
+bool strlen(GuestCall& c);
+bool fixed_mul(GuestCall& c); // Doom FixedMul, 16.16
+bool fixed_div(GuestCall& c); // Doom FixedDiv, saturates like the original
+
+struct Builtin {
+    const char* symbol;
+    bool (*fn)(GuestCall&);
+    uint32_t cost;
+    uint32_t cost_per_16b;
+};
+extern const Builtin BUILTINS[5];
+
+} // namespace intercept
+
+#endif // GAMINGCPU_VP_INTERCEPT_H
@@ -1,13 +1,20 @@
 #include "iss.h"
+#include "hart_pool.h"
 #include "decode.h"
 #include "rv32_defs.h"
 #include "platform/platform_config.h"
-#include <tlm_utils/tlm_quantumkeeper.h>
+#include <algorithm>
 #include <cstring>
+#include <iostream>
+
+static bool is_csr_op(const DecodedInstr& d) {
+    return d.type >= InstrType::CSRRW && d.type <= InstrType::CSRRCI;
+}
 
 ISS::ISS(sc_core::sc_module_name name, uint32_t reset_pc)
     : sc_module(name)
     , isock("isock")
+    , mmu(phys_)
     , reset_pc_(reset_pc)
     , clk_period_(10, sc_core::SC_NS)
 {
@@ -15,48 +22,143 @@ ISS::ISS(sc_core::sc_module_name name, uint32_t reset_pc)
 
     isock.register_invalidate_direct_mem_ptr(this, &ISS::invalidate_dmi);
 
-    mmu.mem_read = [this](uint32_t paddr) -> uint32_t {
-        return bus_read(paddr, 4);
-    };
-    mmu.mem_write = [this](uint32_t paddr, uint32_t val) {
-        bus_write(paddr, val, 4);
+    dmem_.iss = this;
+    state.csr.bind_retired(&insn_count);
+
+    state.csr.on_satp_write = [this]() {
+        mmu.satp_written(state.csr.satp);
+        flush_soft_tlb();
+        mode_dirty_ = true;
     };
+}
 
-    state.csr.on_satp_write = [this]() { mmu.flush_tlb(); };
+// Only RAM pages get a host pointer for loads/stores, and stores only while
+// the page holds no cached code (fetch_decoded drops W tags when that changes).
+// Fetch tags are just the translation, so they're filled for any page
+void ISS::tlb_fill(uint32_t vaddr, uint32_t paddr, AccessType type) {
+    uint32_t ppage = paddr & SoftTlb::PAGE_MASK;
+    const DmiTable::Region* rg = dmi_.find(ppage, SoftTlb::PAGE_SIZE);
+    uint8_t* host = nullptr;
+    if (rg && rg->readable)
+        host = rg->ptr + (ppage - rg->start);
+    if (type == AccessType::STORE && (!rg || !rg->writable || icache_.has_code(paddr)))
+        host = nullptr;
+    if (host || type == AccessType::FETCH)
+        dmem_.tlb.fill(vaddr, paddr, host, type);
+}
 
-    state.mem.read = [this](uint32_t vaddr, int bytes) -> uint32_t {
-        uint32_t paddr = vaddr;
-        if (mmu_active_data()) {
-            auto r = mmu.translate(vaddr, AccessType::LOAD,
-                                   effective_data_priv(),
-                                   state.csr.satp, state.csr.mstatus);
-            if (r.fault) {
-                mem_fault_ = true;
-                mem_fault_cause_ = r.cause;
-                mem_fault_vaddr_ = vaddr;
-                return 0;
-            }
-            paddr = r.paddr;
+// Misaligned accesses land here since the TLB tags include the low bits.
+// Still one memcpy while they stay inside a TLB'd page
+uint32_t MemIf::read_slow(uint32_t addr, int bytes) {
+    if ((addr & (bytes - 1)) && (addr & ~SoftTlb::PAGE_MASK) + bytes <= SoftTlb::PAGE_SIZE) {
+        if (const uint8_t* h = tlb.read_ptr(addr, 1)) {
+            uint32_t v = 0;
+            std::memcpy(&v, h, bytes);
+            return v;
         }
-        return bus_read(paddr, bytes);
-    };
+    }
+    return iss->data_read(addr, bytes);
+}
 
-    state.mem.write = [this](uint32_t vaddr, uint32_t data, int bytes) {
-        uint32_t paddr = vaddr;
-        if (mmu_active_data()) {
-            auto r = mmu.translate(vaddr, AccessType::STORE,
-                                   effective_data_priv(),
-                                   state.csr.satp, state.csr.mstatus);
-            if (r.fault) {
-                mem_fault_ = true;
-                mem_fault_cause_ = r.cause;
-                mem_fault_vaddr_ = vaddr;
-                return;
-            }
-            paddr = r.paddr;
+void MemIf::write_slow(uint32_t addr, uint32_t data, int bytes) {
+    if ((addr & (bytes - 1)) && (addr & ~SoftTlb::PAGE_MASK) + bytes <= SoftTlb::PAGE_SIZE) {
+        if (uint8_t* h = tlb.write_ptr(addr, 1)) {
+            std::memcpy(h, &data, bytes);
+            return;
+        }
+    }
+    iss->data_write(addr, data, bytes);
+}
+
+uint32_t* MemIf::amo_ptr_slow(uint32_t addr) {
+    return iss->data_amo_ptr(addr);
+}
+
+// Translated as a store: AMOs fault like one, and it's the W tag that tells
+// us the page holds no cached code
+uint32_t* ISS::data_amo_ptr(uint32_t vaddr) {
+    uint32_t paddr;
+    if (!translate_data(vaddr, AccessType::STORE, paddr))
+        return nullptr;
+    const DmiTable::Region* rg = dmi_.find(paddr, 4);
+    if (!rg || !rg->writable)
+        return nullptr;
+    if (icache_.has_code(paddr))
+        invalidate_code(paddr, paddr + 3);
+    return reinterpret_cast<uint32_t*>(rg->ptr + (paddr - rg->start));
+}
+
+bool ISS::translate_data(uint32_t vaddr, AccessType type, uint32_t& paddr) {
+    paddr = vaddr;
+    if (mmu_active_data()) {
+        auto r = mmu.translate(vaddr, type, effective_data_priv(),
+                               state.csr.satp, state.csr.mstatus);
+        if (defer_)
+            return false; // page tables outside DMI
+        if (r.fault) {
+            mem_fault_ = true;
+            mem_fault_cause_ = r.cause;
+            mem_fault_vaddr_ = vaddr;
+            return false;
         }
+        paddr = r.paddr;
+    }
+    tlb_fill(vaddr, paddr, type);
+    return true;
+}
+
+// Bytes of a misaligned access before its natural boundary, i.e. where it
+// gets split. Page boundaries are natural ones too
+static uint32_t misaligned_low_bytes(uint32_t vaddr, int bytes) {
+    return ((vaddr | (bytes - 1)) + 1) - vaddr;
+}
+
+uint32_t ISS::data_read(uint32_t vaddr, int bytes) {
+    uint32_t paddr;
+    if (!translate_data(vaddr, AccessType::LOAD, paddr))
+        return 0;
+    if (!(vaddr & (bytes - 1)))
+        return bus_read(paddr, bytes);
+
+    // Misaligned (only gets here with misaligned_ok). One DMI region: just
+    // copy it. Otherwise two bus accesses split at the natural boundary, and
+    // if that's a page boundary the high half gets its own translation
+    uint32_t lo = misaligned_low_bytes(vaddr, bytes);
+    bool crosses_page = ((vaddr + lo) & ~SoftTlb::PAGE_MASK) == 0;
+    if (!crosses_page && dmi_covers(paddr, bytes))
+        return bus_read(paddr, bytes);
+
+    uint32_t paddr_hi = paddr + lo;
+    if (crosses_page && !translate_data(vaddr + lo, AccessType::LOAD, paddr_hi))
+        return 0;
+    uint32_t v = bus_read(paddr, lo);
+    return v | bus_read(paddr_hi, bytes - lo) << (8 * lo);
+}
+
+void ISS::data_write(uint32_t vaddr, uint32_t data, int bytes) {
+    uint32_t paddr;
+    if (!translate_data(vaddr, AccessType::STORE, paddr))
+        return;
+    if (!(vaddr & (bytes - 1))) {
         bus_write(paddr, data, bytes);
-    };
+        return;
+    }
+
+    // Same split as data_read. Both pages are translated before either half
+    // is written so a fault on the second leaves memory alone
+    uint32_t lo = misaligned_low_bytes(vaddr, bytes);
+    bool crosses_page = ((vaddr + lo) & ~SoftTlb::PAGE_MASK) == 0;
+    const DmiTable::Region* rg = crosses_page ? nullptr : dmi_.find(paddr, bytes);
+    if (rg && rg->writable) {
+        bus_write(paddr, data, bytes);
+        return;
+    }
+
+    uint32_t paddr_hi = paddr + lo;
+    if (crosses_page && !translate_data(vaddr + lo, AccessType::STORE, paddr_hi))
+        return;
+    bus_write(paddr, data, lo);
+    bus_write(paddr_hi, data >> (8 * lo), bytes - lo);
 }
 
 bool ISS::mmu_active_fetch() const {
@@ -74,122 +176,849 @@ uint8_t ISS::effective_data_priv() const {
     return state.priv;
 }
 
+void ISS::attach_debugger(bool attached) {
+    debugger_attached_ = attached;
+    mode_dirty_ = true;
+}
+
 void ISS::halt() {
     halted_ = true;
+    mode_dirty_ = true;
+    wfi_event_.notify(); // don't wait for an interrupt to see the halt
 }
 
 void ISS::resume() {
     halted_ = false;
     single_step_ = false;
+    mode_dirty_ = true;
     resume_event_.notify();
 }
 
 void ISS::step() {
     halted_ = false;
     single_step_ = true;
+    mode_dirty_ = true;
     resume_event_.notify();
 }
 
 void ISS::run() {
-    tlm_utils::tlm_quantumkeeper qk;
     tlm_utils::tlm_quantumkeeper::set_global_quantum(
         sc_core::sc_time(cfg::DEFAULT_QUANTUM_US, sc_core::SC_US));
-    qk.reset();
+    qk_.reset();
+    start_quantum();
 
     state.pc = reset_pc_;
 
     while (true) {
-        if (halted_) {
-            halted_event.notify();
-            wait(resume_event_);
-            qk.reset();
+        mode_dirty_ = false;
+        run_mode_ = select_mode();
+        flush_soft_tlb();
+        mode_entries[static_cast<int>(run_mode_)]++;
+
+        switch (run_mode_) {
+        case RunMode::BARE:  run_loop<RunMode::BARE>();  break;
+        case RunMode::PAGED: run_loop<RunMode::PAGED>(); break;
+        case RunMode::DEBUG: run_loop<RunMode::DEBUG>(); break;
+        }
+    }
+}
+
+RunMode ISS::select_mode() const {
+    if (halted_ || single_step_ || debugger_attached_)
+        return RunMode::DEBUG;
+    if (mmu_active_fetch() || mmu_active_data())
+        return RunMode::PAGED;
+    return RunMode::BARE;
+}
+
+// Runs until something flips mode_dirty_ (satp/mstatus write, priv change,
+// halt/step/resume, debugger attach). Only DEBUG looks at halted_/single_step_
+// and only PAGED translates fetches
+template <RunMode M>
+void ISS::run_loop() {
+    while (!mode_dirty_) {
+        // Once per quantum: as far as it gets on a pool thread, the rest here.
+        // Whatever stopped the slice (a deferred access, WFI) is redone below
+        if (M != RunMode::DEBUG && pool && !sliced_) {
+            sliced_ = true;
+            pool->run(*this);
+            defer_ = false;
+            if (wfi_pending_) {
+                wfi_pending_ = false;
+                wait_for_interrupt();
+            } else if (quantum_used()) {
+                sync_quantum();
+            }
             continue;
         }
 
+        run_step<M>();
+
+        if (quantum_used())
+            sync_quantum();
+    }
+}
+
+void ISS::run_slice() {
+    parallel_ = true;
+    slices++;
+    switch (run_mode_) {
+    case RunMode::BARE:  slice_loop<RunMode::BARE>();  break;
+    case RunMode::PAGED: slice_loop<RunMode::PAGED>(); break;
+    case RunMode::DEBUG: break;
+    }
+    if (defer_)
+        slice_defers++;
+    parallel_ = false;
+}
+
+template <RunMode M>
+void ISS::slice_loop() {
+    while (!mode_dirty_ && !defer_ && !wfi_pending_ && !quantum_used())
+        run_step<M>();
+}
+
+template <RunMode M>
+void ISS::run_step() {
+    blocks_.reclaim();
+
+    if (M == RunMode::DEBUG && halted_) {
+        halted_event.notify();
+        wait(resume_event_);
+        unsynced_insns_ = 0;
+        qk_.reset();
+        start_quantum();
+        return;
+    }
+
+    // One fetch translation per block, and the interrupt check is just the
+    // CSR file's cached flag. mip/mie only change at CSR instructions (which
+    // end blocks) or from CLINT/PLIC while other processes run (at a sync)
+    if (state.csr.irq_maybe_pending()) {
+        irq_evals++;
         uint32_t irq = trap::check_pending_interrupts(state);
         if (irq) {
-            trap::take_trap(state, irq, 0);
-            state.pc = state.next_pc;
-            continue;
+            enter_trap(irq, 0);
+            return;
         }
+    }
 
-        if (state.pc & 1) {
-            trap::take_trap(state, rv32::CAUSE_MISALIGNED_FETCH, state.pc);
-            state.pc = state.next_pc;
-            continue;
+    if (state.pc & 1) {
+        enter_trap(rv32::CAUSE_MISALIGNED_FETCH, state.pc);
+        return;
+    }
+
+    uint32_t fetch_paddr = state.pc;
+    if (M != RunMode::BARE && mmu_active_fetch() &&
+        !dmem_.tlb.lookup_exec(state.pc, fetch_paddr)) {
+        auto r = mmu.translate(state.pc, AccessType::FETCH, state.priv,
+                               state.csr.satp, state.csr.mstatus);
+        if (defer_)
+            return;
+        if (r.fault) {
+            enter_trap(r.cause, state.pc);
+            return;
         }
+        fetch_paddr = r.paddr;
+        tlb_fill(state.pc, fetch_paddr, AccessType::FETCH);
+    }
 
-        uint32_t fetch_paddr = state.pc;
-        if (mmu_active_fetch()) {
-            auto r = mmu.translate(state.pc, AccessType::FETCH, state.priv,
-                                   state.csr.satp, state.csr.mstatus);
-            if (r.fault) {
-                trap::take_trap(state, r.cause, state.pc);
-                state.pc = state.next_pc;
-                continue;
-            }
-            fetch_paddr = r.paddr;
+    // Code fetched over the bus (ROM without DMI, MMIO) needs the kernel
+    if (parallel_ && !dmi_covers(fetch_paddr, 4)) {
+        defer_ = true;
+        return;
+    }
+
+    if (M == RunMode::DEBUG) {
+        // One instruction at a time so a halt lands on an exact PC
+        step_one(fetch_paddr);
+        if (single_step_) {
+            halted_ = true;
+            single_step_ = false;
+        }
+    } else {
+        Block* b = blocks_.lookup(fetch_paddr);
+        if (!b)
+            b = build_block(fetch_paddr);
+
+        if (b) {
+            if (M == RunMode::BARE && b->intercept && run_intercept(*b->intercept))
+                return;
+            run_block(*b);
+        } else {
+            // MMIO code or an instruction straddling a page, one at a time
+            step_one(fetch_paddr);
+        }
+    }
+}
+
+void ISS::enter_trap(uint32_t cause, uint32_t tval) {
+    uint8_t old_priv = state.priv;
+    trap::take_trap(state, cause, tval);
+    state.pc = state.next_pc;
+    if (state.priv != old_priv)
+        mode_dirty_ = true;
+}
+
+Block* ISS::build_block(uint32_t paddr) {
+    if (!dmi_covers(paddr, 4))
+        return nullptr;
+
+    auto b = std::make_unique<Block>();
+    b->paddr = paddr;
+    b->aot_fn = aot_.loaded() ? aot_match(paddr) : nullptr;
+
+    uint32_t pc = paddr;
+    uint32_t page_end = (paddr & ~(BlockCache::PAGE_SIZE - 1)) + BlockCache::PAGE_SIZE;
+
+    while (b->insns.size() < BlockCache::MAX_INSNS && dmi_covers(pc, 4)) {
+        DecodedInstr scratch;
+        const DecodedInstr& d = fetch_decoded(pc, scratch);
+        if (&d == &scratch)
+            break; // not cacheable, leave it to the single-step path
+
+        pc += d.instr_len();
+
+        // The JIT already does both halves natively, fusing only makes it stop early.
+        // AOT blocks resume in here by instruction, so they stay unfused too
+        DecodedInstr f;
+        if (fusion && engine != ExecEngine::JIT && !b->aot_fn && !b->insns.empty() &&
+            fuse(b->insns.back(), d, f)) {
+            b->insns.back() = f;
+        } else {
+            b->insns.push_back(d);
+        }
+        if (ends_block(d) || pc >= page_end)
+            break;
+    }
+
+    if (b->insns.empty())
+        return nullptr;
+
+    b->bytes = pc - paddr;
+    for (const DecodedInstr& d : b->insns)
+        b->retired += d.insn_count();
+    if (!intercepts_.empty()) {
+        auto it = intercepts_.find(paddr);
+        if (it != intercepts_.end())
+            b->intercept = &it->second;
+    }
+    if (is_poll_loop(*b)) {
+        b->poll_loop = true;
+        b->poll_insns = b->retired;
+    }
+    return blocks_.insert(std::move(b));
+}
+
+void ISS::run_block(Block& b) {
+    b.exec_count++;
+    uint32_t start_pc = state.pc;
+    uint64_t start_insns = insn_count;
+    uint64_t start_mmio = mmio_reads_;
+
+    if (b.aot_fn) {
+        run_block_aot(b);
+    } else if (engine == ExecEngine::THREADED) {
+        run_block_threaded(b);
+    } else {
+        size_t i = 0;
+        if (engine == ExecEngine::JIT && b.exec_count >= jit_threshold)
+            i = run_block_jit(b);
+
+        for (; i < b.insns.size(); i++) {
+            // A store in this block may have just rewritten the rest of it
+            if (!step_insn(b.insns[i]) || !b.valid)
+                break;
+        }
+    }
+
+    if (b.poll_loop && poll_skip && !parallel_)
+        check_poll(b, start_pc, start_insns, start_mmio);
+
+    if (profiler)
+        profile(b.insns.back(), start_pc + b.bytes, insn_count - start_insns == b.retired);
+}
+
+void ISS::step_one(uint32_t fetch_paddr) {
+    DecodedInstr scratch;
+    const DecodedInstr& d = fetch_decoded(fetch_paddr, scratch);
+    if (!profiler) {
+        step_insn(d);
+        return;
+    }
+
+    // A copy, if it is a store it could knock the cached one out
+    DecodedInstr last = d;
+    uint32_t start_pc = state.pc;
+    uint64_t start_insns = insn_count;
+    step_insn(last);
+    profile(last, start_pc + last.instr_len(), insn_count - start_insns == last.insn_count());
+}
+
+void ISS::profile(const DecodedInstr& last, uint32_t seq_pc, bool completed) {
+    // Calls and returns the way the ISA's RAS hints define them: x1/x5 as link
+    if (completed) {
+        bool fused = last.type == InstrType::FUSED_AUIPC_JALR;
+        uint32_t link = fused ? last.rd2 : last.rd;
+        if ((last.type == InstrType::JAL || last.type == InstrType::JALR || fused) &&
+            (link == 1 || link == 5))
+            profiler->call(seq_pc);
+        else if (last.type == InstrType::JALR && link == 0 && (last.rs1 == 1 || last.rs1 == 5))
+            profiler->ret(state.pc);
+    }
+    profiler->tick(profile_now(), state.pc);
+}
+
+uint64_t ISS::profile_now() const {
+    if (profiler->unit() == Profiler::Unit::INSNS)
+        return insn_count;
+    sc_core::sc_time now = qk_.get_current_time() + clk_period_ * static_cast<double>(unsynced_insns_);
+    return static_cast<uint64_t>(now / sc_core::sc_time(1, sc_core::SC_US));
+}
+
+void ISS::check_poll(const Block& b, uint32_t start_pc, uint64_t start_insns,
+                     uint64_t start_mmio) {
+    // Only a full iteration that went round to the top with exactly one bus read
+    if (!b.valid || state.pc != start_pc || mmio_reads_ != start_mmio + 1 ||
+        insn_count != start_insns + b.poll_insns) {
+        poll_at_ = ~0ull;
+        return;
+    }
+
+    // Same loop straight after the last one, same register, same value:
+    // nothing in the loop carries over, so every further iteration until
+    // something else runs would be identical too
+    if (poll_at_ == start_insns && poll_pc_ == start_pc &&
+        poll_addr_ == mmio_addr_ && poll_val_ == mmio_val_) {
+        skip_poll(b);
+        poll_at_ = insn_count;
+        return;
+    }
+
+    poll_pc_ = start_pc;
+    poll_addr_ = mmio_addr_;
+    poll_val_ = mmio_val_;
+    poll_at_ = insn_count;
+}
+
+void ISS::skip_poll(const Block& b) {
+    flush_time();
+    qk_.sync();
+
+    // Inside our quantum nobody else runs, so the register can only change
+    // once the next event anywhere fires. Registers that follow simulated
+    // time (mtime) don't need an event though, so never sleep past one
+    // quantum: that's as long as spinning would have kept us away anyway
+    sc_core::sc_time wake = sc_core::sc_time_to_pending_activity();
+    sc_core::sc_time quantum = tlm::tlm_global_quantum::instance().get();
+    if (wake > quantum)
+        wake = quantum;
+
+    sc_core::sc_time start = sc_core::sc_time_stamp();
+    wait(wake, wfi_event_);
+    sc_core::sc_time idle = sc_core::sc_time_stamp() - start;
+
+    // Whole iterations only so the loop stays at its head
+    uint64_t n = static_cast<uint64_t>(idle / clk_period_) / b.poll_insns * b.poll_insns;
+    insn_count += n;
+    poll_skips++;
+    poll_skipped_insns += n;
+    poll_idle += idle;
+
+    qk_.reset();
+    start_quantum();
+}
+
+size_t ISS::run_block_jit(Block& b) {
+    // Translated code assumes vaddr == paddr for data, so bare/M-mode only
+    if (b.jit_failed || !jit_.supported() || run_mode_ != RunMode::BARE)
+        return 0;
+
+    if (!b.jit_fn || b.jit_gen != jit_.generation()) {
+        b.jit_fn = jit_.compile(b);
+        b.jit_gen = jit_.generation();
+        if (!b.jit_fn) {
+            b.jit_failed = true;
+            return 0;
         }
-        uint32_t raw = bus_read(fetch_paddr, 4);
+    }
+
+    JitCtx ctx;
+    ctx.regs = state.regs;
+    // Native loads/stores get one window: the block's own region if it's
+    // writable, else whichever RAM-like region we have. The rest side-exits
+    const DmiTable::Region* ram = dmi_.find(b.paddr, 1);
+    for (int k = 0; k < dmi_.size() && !(ram && ram->writable); k++)
+        ram = &dmi_[k];
+    if (ram && ram->writable) {
+        ctx.ram = ram->ptr;
+        ctx.ram_base = static_cast<uint32_t>(ram->start);
+        ctx.ram_size = ram->end - ram->start + 1;
+    }
+    ctx.code_pages = icache_.code_page_map();
+    ctx.lr_valid = &state.lr_sc.valid;
+    ctx.pc = state.pc;
+
+    uint32_t n = b.jit_fn(&ctx);
+
+    state.pc = ctx.next_pc;
+    insn_count += n;
+    unsynced_insns_ += n;
+    return n;
+}
 
-        DecodedInstr d = decode(raw);
-        state.next_pc = state.pc + d.instr_len();
+void ISS::run_block_threaded(Block& b) {
+    if (b.ops.empty())
+        threaded::translate(b.insns, b.ops);
 
+    ThreadedCtx c{state, dmem_, mem_fault_, b.valid};
+    const ThreadedOp* base = b.ops.data();
+    const ThreadedOp* end = base + b.insns.size();
+    const ThreadedOp* op = base;
+
+    while (true) {
         mem_fault_ = false;
-        ExecResult r = execute(state, d);
+        const ThreadedOp* stop = threaded::run(c, op);
+
+        // Fused handlers count their extra first halves on the side
+        uint32_t n = static_cast<uint32_t>(stop - op);
+        for (int k = 0; k < NUM_FUSED; k++) {
+            n += c.fused[k];
+            fused_execs[k] += c.fused[k];
+            c.fused[k] = 0;
+        }
+        insn_count += n;
+        unsynced_insns_ += n;
 
         if (mem_fault_) {
-            mem_fault_ = false;
-            trap::take_trap(state, mem_fault_cause_, mem_fault_vaddr_);
-            state.pc = state.next_pc;
-            qk.inc(clk_period_);
-            if (qk.need_sync()) qk.sync();
-            continue;
+            take_mem_fault();
+            return;
         }
+        if (stop == end || !b.valid)
+            return;
 
-        insn_count++;
-        state.csr.inc_mcycle();
-        state.csr.inc_minstret();
+        // No fast handler (or it wants a trap), reference path for this one
+        if (!step_insn(b.insns[stop - base]) || !b.valid)
+            return;
+        op = stop + 1;
+    }
+}
 
-        if (r.exception) {
-            if (r.cause == rv32::CAUSE_BREAKPOINT && stop_on_ebreak) {
-                halted_ = true;
-                continue;
-            }
-            trap::take_trap(state, r.cause, r.tval);
+Intercept& ISS::add_intercept(uint32_t addr, Intercept ic) {
+    // Blocks already built there don't know about it yet
+    blocks_.invalidate(addr, addr);
+    Intercept& slot = intercepts_[addr];
+    slot = std::move(ic);
+    return slot;
+}
+
+Intercept* ISS::find_intercept(const std::string& name) {
+    for (auto& [addr, ic] : intercepts_)
+        if (ic.name == name)
+            return &ic;
+    return nullptr;
+}
+
+bool ISS::run_intercept(Intercept& ic) {
+    if (!ic.enabled)
+        return false;
+
+    GuestCall c{state, dmi_, icache_};
+    if (!ic.fn(c)) {
+        ic.declined++;
+        return false;
+    }
+    ic.calls++;
+
+    // The guest's writes would have cancelled our reservation too
+    if (c.bytes)
+        state.lr_sc.clear();
+
+    uint64_t n = ic.cost + c.bytes * ic.cost_per_16b / 16;
+    insn_count += n;
+    unsynced_insns_ += n;
+    intercepted_insns += n;
+
+    state.pc = state.get_regu(1) & ~1u; // ret
+    if (profiler)
+        profiler->ret(state.pc);
+    return true;
+}
+
+bool ISS::load_aot(const std::string& path) {
+    // Blocks may still point into the old image
+    blocks_.flush();
+    std::string err;
+    if (!aot_.load(path, err)) {
+        std::cout << "[ISS] " << name() << ": AOT image not loaded: " << err << "\n";
+        return false;
+    }
+    std::cout << "[ISS] " << name() << ": AOT image " << path << ", "
+              << aot_.size() << " blocks\n";
+    return true;
+}
+
+AotBlockFn ISS::aot_match(uint32_t paddr) {
+    const AotBlock* a = aot_.find(paddr);
+    if (!a)
+        return nullptr;
+    const DmiTable::Region* rg = dmi_.find(paddr, a->bytes);
+    if (!rg || !rg->readable)
+        return nullptr;
+    if (aot_hash(rg->ptr + (paddr - rg->start), a->bytes) != a->hash) {
+        aot_.stale++;
+        return nullptr;
+    }
+    aot_.attached++;
+    return a->fn;
+}
+
+uint32_t ISS::aot_read(AotCtx* c, uint32_t addr, int bytes) {
+    ISS* iss = static_cast<ISS*>(c->user);
+    uint32_t v = iss->dmem_.read(addr, bytes);
+    if (iss->mem_fault_)
+        c->stop = AOT_STOP_FAULT;
+    return v;
+}
+
+void ISS::aot_write(AotCtx* c, uint32_t addr, uint32_t data, int bytes) {
+    ISS* iss = static_cast<ISS*>(c->user);
+    iss->dmem_.write(addr, data, bytes);
+    iss->state.lr_sc.clear();
+    if (iss->mem_fault_)
+        c->stop = AOT_STOP_FAULT;
+    else if (!iss->aot_block_->valid)
+        c->stop = AOT_STOP_CODE;
+}
+
+void ISS::run_block_aot(Block& b) {
+    uint32_t start = state.pc;
+    AotCtx c;
+    c.regs = state.regs;
+    c.pc = start;
+    c.user = this;
+    c.read = &ISS::aot_read;
+    c.write = &ISS::aot_write;
+
+    aot_block_ = &b;
+    mem_fault_ = false;
+    uint32_t st = b.aot_fn(&c);
+    aot_.runs++;
+
+    state.pc = c.pc;
+    insn_count += c.retired;
+    unsynced_insns_ += c.retired;
+
+    if (mem_fault_) {
+        take_mem_fault();
+        return;
+    }
+    if (st == AOT_DONE || !b.valid)
+        return;
+
+    // Stopped on something it leaves to us. Pick the block up from there,
+    // unless that's past what this block decoded
+    uint32_t off = c.pc - start;
+    uint32_t pos = 0;
+    size_t i = 0;
+    while (i < b.insns.size() && pos < off)
+        pos += b.insns[i++].instr_len();
+    if (pos != off)
+        return;
+    for (; i < b.insns.size(); i++) {
+        if (!step_insn(b.insns[i]) || !b.valid)
+            break;
+    }
+}
+
+void ISS::wait_for_interrupt() {
+    flush_time();
+    qk_.sync();
+
+    // Nothing pending (mip & mie, MIE doesn't matter for WFI): sleep until an
+    // interrupt source calls notify_wfi(). With the CLINT/Timer only scheduling
+    // their deadlines the kernel skips straight to the next one. Sources also
+    // notify when a line drops, so keep sleeping until something's pending
+    if (!state.csr.irq_maybe_pending()) {
+        sc_core::sc_time start = sc_core::sc_time_stamp();
+        while (!state.csr.irq_maybe_pending() && !halted_)
+            wait(wfi_event_);
+        wfi_sleeps++;
+        wfi_idle += sc_core::sc_time_stamp() - start;
+    }
+
+    qk_.reset();
+    start_quantum();
+}
+
+void ISS::take_mem_fault() {
+    mem_fault_ = false;
+    if (defer_)
+        return; // not a fault, the run loop redoes it serially
+    enter_trap(mem_fault_cause_, mem_fault_vaddr_);
+    unsynced_insns_++;
+}
+
+bool ISS::step_insn(const DecodedInstr& d) {
+    state.next_pc = state.pc + d.instr_len();
+    uint8_t old_priv = state.priv;
+
+    // execute() zeroes rd on a faulting load. For a real fault that's fine
+    // (the handler doesn't care), a deferred one has to leave no trace
+    int32_t saved_rd = 0, saved_rd2 = 0;
+    uint32_t saved_frd = 0;
+    Reservation saved_lr;
+    if (parallel_) {
+        saved_rd = state.regs[d.rd & 31];
+        saved_rd2 = state.regs[d.rd2 & 31];
+        saved_frd = state.fregs[d.rd & 31];
+        saved_lr = state.lr_sc;
+    }
+
+    // Host I/O needs the SystemC thread, so a slice hands it back
+    if (d.type == InstrType::EBREAK && semihosting && is_semihost_call(d)) {
+        if (parallel_) {
+            defer_ = true;
+            return false;
         }
+        return semihost_call();
+    }
 
-        if (r.wfi) {
-            qk.sync();
-            wait(sc_core::sc_time(cfg::DEFAULT_QUANTUM_US, sc_core::SC_US),
-                 wfi_event_);
-            qk.reset();
+    mem_fault_ = false;
+    ExecResult r = execute(state, d, dmem_);
+
+    // mepc must point at the faulting instruction, which state.pc still does.
+    // For a fused op that's the second half, the first one retires on its own
+    if (mem_fault_) {
+        if (d.fused()) {
+            state.pc += d.len1;
+            insn_count++;
+            unsynced_insns_++;
+            fused_execs[fused_index(d.type)]++;
         }
-        if (r.fence_i) {
-            dmi_valid_ = false;
-            dmi_ptr_ = nullptr;
+        if (defer_) {
+            state.set_reg(d.rd2, saved_rd2);
+            state.set_reg(d.rd, d.fused() ? d.imm : saved_rd);
+            state.fregs[d.rd & 31] = saved_frd;
+            state.lr_sc = saved_lr;
         }
-        if (r.sfence_vma)
-            mmu.flush_tlb();
+        take_mem_fault();
+        return false;
+    }
 
-        state.pc = state.next_pc;
+    insn_count += d.insn_count();
+    if (d.fused())
+        fused_execs[fused_index(d.type)]++;
 
-        if (single_step_) {
+    if (r.exception) {
+        if (d.fused())
+            state.pc += d.len1;
+        if (r.cause == rv32::CAUSE_BREAKPOINT && stop_on_ebreak) {
             halted_ = true;
-            single_step_ = false;
+            mode_dirty_ = true;
+            return false;
         }
+        trap::take_trap(state, r.cause, r.tval);
+    }
 
-        qk.inc(clk_period_);
-        if (qk.need_sync())
-            qk.sync();
+    if (r.wfi) {
+        if (parallel_)
+            wfi_pending_ = true; // sleeps once back on the SystemC thread
+        else
+            wait_for_interrupt();
+    }
+    if (r.fence_i) {
+        dmi_.clear();
+        flush_soft_tlb();
+        icache_.flush();
+        blocks_.flush();
     }
+    if (r.sfence_vma) {
+        mmu.sfence_vma(d.rs1 != 0, state.get_regu(d.rs1),
+                       d.rs2 != 0, state.get_regu(d.rs2));
+        flush_soft_tlb();
+    }
+
+    state.pc = state.next_pc;
+    unsynced_insns_ += d.insn_count();
+
+    // Traps, xRET and MPRV flips pick a different run loop (satp has its own hook).
+    // sstatus too: SUM/MXR are baked into soft TLB entries
+    if (state.priv != old_priv ||
+        (is_csr_op(d) && (d.csr == rv32::CSR_MSTATUS || d.csr == rv32::CSR_SSTATUS)))
+        mode_dirty_ = true;
+
+    return !(r.exception || r.wfi || r.fence_i || r.sfence_vma);
 }
 
-uint32_t ISS::bus_read(uint32_t addr, int bytes) {
-    if (dmi_valid_ && addr >= dmi_start_ && (addr + bytes - 1) <= dmi_end_) {
-        uint32_t v = 0;
-        std::memcpy(&v, dmi_ptr_ + (addr - dmi_start_), bytes);
-        return v;
+bool ISS::is_semihost_call(const DecodedInstr& d) {
+    // c.ebreak never is. Reading the neighbours may need the bus, so in a
+    // slice every ebreak counts as a candidate and the serial redo looks
+    if (d.instr_len() != 4)
+        return false;
+    if (parallel_)
+        return true;
+
+    auto fetch = [this](uint32_t vaddr, uint32_t& w) {
+        uint32_t paddr = vaddr;
+        if (mmu_active_fetch()) {
+            auto r = mmu.translate(vaddr, AccessType::FETCH, state.priv,
+                                   state.csr.satp, state.csr.mstatus);
+            if (r.fault)
+                return false;
+            paddr = r.paddr;
+        }
+        w = bus_read(paddr, 4);
+        return true;
+    };
+    uint32_t before = 0, after = 0;
+    return fetch(state.pc - 4, before) && before == Semihost::SLLI_X0_1F &&
+           fetch(state.pc + 4, after) && after == Semihost::SRAI_X0_7;
+}
+
+bool ISS::semihost_call() {
+    uint32_t op = state.get_regu(10);
+    uint32_t arg = state.get_regu(11);
+    state.set_reg(10, static_cast<int32_t>(semihost_.call(*this, op, arg)));
+
+    // The ebreak retires, the srai after it is a nop
+    insn_count++;
+    unsynced_insns_++;
+    state.pc += 4;
+
+    if (semihost_.exited) {
+        halted_ = true;
+        mode_dirty_ = true;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ISS::copy_from_guest(uint32_t vaddr, uint8_t* dst, uint32_t len) {
+    return copy_guest(vaddr, dst, len, false);
+}
+
+uint32_t ISS::copy_to_guest(uint32_t vaddr, const uint8_t* src, uint32_t len) {
+    return copy_guest(vaddr, const_cast<uint8_t*>(src), len, true);
+}
+
+uint32_t ISS::copy_guest(uint32_t vaddr, uint8_t* host, uint32_t len, bool to_guest) {
+    uint32_t done = 0;
+    while (done < len) {
+        // One page at a time, that's what a translation covers
+        uint32_t va = vaddr + done;
+        uint32_t n = std::min(len - done, SoftTlb::PAGE_SIZE - (va & ~SoftTlb::PAGE_MASK));
+        uint32_t pa = va;
+        if (mmu_active_data()) {
+            auto r = mmu.translate(va, to_guest ? AccessType::STORE : AccessType::LOAD,
+                                   effective_data_priv(), state.csr.satp, state.csr.mstatus);
+            if (r.fault)
+                break;
+            pa = r.paddr;
+        }
+
+        const DmiTable::Region* rg = dmi_.find(pa, n);
+        if (rg && (to_guest ? rg->writable : rg->readable)) {
+            uint8_t* p = rg->ptr + (pa - rg->start);
+            if (to_guest) {
+                std::memcpy(p, host + done, n);
+                if (icache_.has_code(pa))
+                    invalidate_code(pa, pa + n - 1);
+            } else {
+                std::memcpy(host + done, p, n);
+            }
+        } else {
+            for (uint32_t k = 0; k < n; k++) {
+                if (to_guest)
+                    bus_write(pa + k, host[done + k], 1);
+                else
+                    host[done + k] = static_cast<uint8_t>(bus_read(pa + k, 1));
+            }
+        }
+        done += n;
+    }
+    if (to_guest && done)
+        state.lr_sc.clear();
+    return done;
+}
+
+sc_core::sc_time ISS::local_time() {
+    flush_time();
+    return qk_.get_current_time();
+}
+
+void ISS::flush_time() {
+    if (unsynced_insns_) {
+        qk_.inc(clk_period_ * static_cast<double>(unsynced_insns_));
+        budget_ = budget_ > unsynced_insns_ ? budget_ - unsynced_insns_ : 0;
+        unsynced_insns_ = 0;
+    }
+}
+
+// The budget is ceil(time left / clk_period_) instructions, where
+// qk_.need_sync() would first say yes. It's only checked at block
+// boundaries though, so a quantum can overrun by up to one block
+// (BlockCache::MAX_INSNS instructions)
+void ISS::start_quantum() {
+    sliced_ = false;
+    quantum_end_ = sc_core::sc_time_stamp() +
+                   tlm::tlm_global_quantum::instance().compute_local_quantum();
+    compute_budget();
+}
+
+void ISS::compute_budget() {
+    sc_core::sc_time now = qk_.get_current_time();
+    if (now >= quantum_end_) {
+        budget_ = 0;
+        return;
+    }
+    double insns = (quantum_end_ - now) / clk_period_;
+    budget_ = static_cast<uint64_t>(insns);
+    if (static_cast<double>(budget_) < insns)
+        budget_++;
+}
+
+void ISS::sync_quantum() {
+    flush_time();
+    qk_.sync();
+    start_quantum();
+}
+
+void ISS::charge_delay(const sc_core::sc_time& delay) {
+    flush_time();
+    qk_.inc(delay);
+    compute_budget();
+}
+
+void ISS::invalidate_code(uint64_t start, uint64_t end) {
+    icache_.invalidate(start, end);
+    blocks_.invalidate(start, end);
+}
+
+const DecodedInstr& ISS::fetch_decoded(uint32_t paddr, DecodedInstr& scratch) {
+    if (const DecodedInstr* hit = icache_.lookup(paddr))
+        return *hit;
+
+    uint32_t raw = bus_read(paddr, 4);
+    scratch = decode(raw);
+
+    // A 32-bit instruction straddling two pages would need both pages tracked
+    // for invalidation. Rare enough to just not cache it
+    bool straddles = !scratch.compressed &&
+                     (paddr & (DecodeCache::PAGE_SIZE - 1)) > DecodeCache::PAGE_SIZE - 4;
+    if (!straddles && dmi_covers(paddr, scratch.instr_len())) {
+        // Stores to this page now have to go through invalidation
+        if (!icache_.has_code(paddr))
+            dmem_.tlb.drop_writes();
+        return icache_.insert(paddr, scratch);
+    }
+    return scratch;
+}
+
+uint32_t ISS::bus_read_slow(uint32_t addr, int bytes) {
+    if (parallel_) {
+        defer_access();
+        return 0;
     }
 
     uint8_t buf[4] = {};
@@ -204,20 +1033,37 @@ uint32_t ISS::bus_read(uint32_t addr, int bytes) {
 
     sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
     isock->b_transport(trans, delay);
+    if (delay != sc_core::SC_ZERO_TIME)
+        charge_delay(delay);
 
-    if (!dmi_valid_)
+    dmi_.misses++;
+    if (!dmi_.find(addr, 1) && !dmi_.denied(addr))
         try_dmi(addr);
 
     uint32_t v = 0;
     std::memcpy(&v, buf, bytes);
+    mmio_reads_++;
+    mmio_addr_ = addr;
+    mmio_val_ = v;
     return v;
 }
 
 void ISS::bus_write(uint32_t addr, uint32_t data, int bytes) {
-    if (dmi_valid_ && addr >= dmi_start_ && (addr + bytes - 1) <= dmi_end_) {
-        std::memcpy(dmi_ptr_ + (addr - dmi_start_), &data, bytes);
+    // Self-modifying code, GDB breakpoints, ELF reloads... stale decodes must go
+    if (icache_.has_code(addr) || icache_.has_code(addr + bytes - 1))
+        invalidate_code(addr, addr + bytes - 1);
+
+    const DmiTable::Region* rg = dmi_.find(addr, bytes);
+    if (rg && rg->writable) {
+        dmi_.hits++;
+        std::memcpy(rg->ptr + (addr - rg->start), &data, bytes);
+        return;
+    }
+    if (parallel_) {
+        defer_access();
         return;
     }
+    dmi_.misses++;
 
     uint8_t buf[4] = {};
     std::memcpy(buf, &data, bytes);
@@ -233,6 +1079,8 @@ void ISS::bus_write(uint32_t addr, uint32_t data, int bytes) {
 
     sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
     isock->b_transport(trans, delay);
+    if (delay != sc_core::SC_ZERO_TIME)
+        charge_delay(delay);
 }
 
 void ISS::try_dmi(uint32_t addr) {
@@ -244,16 +1092,101 @@ void ISS::try_dmi(uint32_t addr) {
 
     tlm::tlm_dmi dmi_data;
     if (isock->get_direct_mem_ptr(trans, dmi_data)) {
-        dmi_valid_ = true;
-        dmi_ptr_ = dmi_data.get_dmi_ptr();
-        dmi_start_ = dmi_data.get_start_address();
-        dmi_end_ = dmi_data.get_end_address();
+        DmiTable::Region rg;
+        rg.ptr = dmi_data.get_dmi_ptr();
+        rg.start = dmi_data.get_start_address();
+        rg.end = dmi_data.get_end_address();
+        rg.readable = dmi_data.is_read_allowed();
+        rg.writable = dmi_data.is_write_allowed();
+        // Soft TLB entries may still point into whatever this replaced
+        if (dmi_.insert(rg))
+            flush_soft_tlb();
+    } else {
+        // Nobody narrows the refused range here, so just remember the page
+        dmi_.deny(addr & ~0xFFFull, addr | 0xFFFull);
     }
 }
 
+// Only the regions overlapping [start, end] go, the rest stay usable
 void ISS::invalidate_dmi(sc_dt::uint64 start, sc_dt::uint64 end) {
-    if (dmi_valid_ && !(end < dmi_start_ || start > dmi_end_)) {
-        dmi_valid_ = false;
-        dmi_ptr_ = nullptr;
+    invalidate_code(start, end);
+    if (dmi_.invalidate(start, end))
+        flush_soft_tlb();
+}
+
+void ISS::report_stats(std::ostream& os) const {
+    uint64_t lookups = icache_.hits + icache_.misses;
+    os << "[ISS] " << name() << ": " << insn_count << " instructions\n"
+       << "[ISS]   decode cache: " << icache_.hits << " hits, "
+       << icache_.misses << " misses";
+    if (lookups)
+        os << " (" << (100.0 * icache_.hits / lookups) << "% hit)";
+    os << ", " << icache_.invalidations << " invalidations\n";
+
+    uint64_t block_lookups = blocks_.hits + blocks_.misses;
+    os << "[ISS]   block cache: " << blocks_.built << " built, "
+       << blocks_.hits << " hits, " << blocks_.misses << " misses";
+    if (block_lookups)
+        os << " (" << (100.0 * blocks_.hits / block_lookups) << "% hit)";
+    os << ", " << blocks_.invalidations << " invalidations\n";
+
+    uint64_t dmi_lookups = dmi_.hits + dmi_.misses;
+    os << "[ISS]   dmi: " << dmi_.size() << " regions, " << dmi_.hits << " hits, "
+       << dmi_.misses << " misses";
+    if (dmi_lookups)
+        os << " (" << (100.0 * dmi_.hits / dmi_lookups) << "% hit)";
+    os << "\n";
+
+    os << "[ISS]   fused: " << fused_execs[0] << " lui+addi, " << fused_execs[1]
+       << " auipc+jalr, " << fused_execs[2] << " lui+load/store, " << fused_execs[3]
+       << " slli+srli\n";
+
+    os << "[ISS]   irq: " << irq_evals << " full evaluations\n";
+    os << "[ISS]   wfi: " << wfi_sleeps << " sleeps, " << wfi_idle << " idle\n";
+    os << "[ISS]   poll: " << poll_skips << " skips, " << poll_skipped_insns
+       << " insns credited, " << poll_idle << " idle\n";
+
+    if (pool)
+        os << "[ISS]   smp: hart " << state.csr.hartid << ", " << slices << " slices, "
+           << slice_defers << " deferred\n";
+
+    if (!intercepts_.empty()) {
+        os << "[ISS]   intercept: " << intercepted_insns << " insns credited";
+        for (const auto& [addr, ic] : intercepts_)
+            os << ", " << ic.name << (ic.enabled ? "" : " (off)") << " " << ic.calls
+               << " calls/" << ic.declined << " declined";
+        os << "\n";
+    }
+
+    if (profiler) {
+        os << "[ISS]   profile: " << profiler->samples << " samples, stack depth "
+           << profiler->depth() << ", " << profiler->stack_resyncs << " resyncs\n";
+    }
+
+    if (semihosting) {
+        os << "[ISS]   semihost: " << semihost_.calls << " calls, " << semihost_.bytes_written
+           << " bytes out, " << semihost_.bytes_read << " bytes in";
+        if (semihost_.exited)
+            os << ", exit " << semihost_.exit_code;
+        os << "\n";
+    }
+
+    os << "[ISS]   run loops entered: " << mode_entries[0] << " bare, "
+       << mode_entries[1] << " paged, " << mode_entries[2] << " debug\n";
+
+    os << "[ISS]   tlb: " << mmu.tlb_hits << " hits, " << mmu.tlb_misses << " misses, "
+       << mmu.tlb_flushes << " flushes, " << mmu.tlb_shootdowns << " selective\n";
+    os << "[ISS]   soft tlb: " << dmem_.tlb.fills << " fills, "
+       << dmem_.tlb.flushes << " flushes\n";
+
+    if (aot_.loaded()) {
+        os << "[ISS]   aot: " << aot_.size() << " blocks in image, " << aot_.attached
+           << " attached, " << aot_.stale << " stale, " << aot_.runs << " runs\n";
+    }
+
+    if (engine == ExecEngine::JIT) {
+        os << "[ISS]   jit: " << (jit_.supported() ? "" : "unsupported, ")
+           << jit_.compiled << " compiled, " << jit_.failed << " rejected, "
+           << jit_.code_bytes << " bytes\n";
     }
 }
@@ -4,9 +4,34 @@
 #include <systemc>
 #include <tlm>
 #include <tlm_utils/simple_initiator_socket.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
 #include "execute.h"
 #include "trap.h"
 #include "mmu.h"
+#include "decode_cache.h"
+#include "block_cache.h"
+#include "jit_x86.h"
+#include "mem_if.h"
+#include "dmi_table.h"
+#include "aot_library.h"
+#include "intercept.h"
+#include "semihost.h"
+#include "profiler.h"
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+// Which backend runs blocks. INTERPRETER is the reference execute() switch,
+// THREADED chains pre-resolved handlers, JIT compiles hot blocks to native
+// code and silently falls back to the interpreter for anything it can't take
+enum class ExecEngine { INTERPRETER, THREADED, JIT };
+
+// Run loop specializations. BARE skips all translation checks, PAGED
+// translates fetches and data, DEBUG single-steps so halts land exactly
+enum class RunMode { BARE, PAGED, DEBUG };
+
+class HartPool;
 
 class ISS : public sc_core::sc_module {
 public:
@@ -15,27 +40,227 @@ public:
     ISS(sc_core::sc_module_name name, uint32_t reset_pc);
     SC_HAS_PROCESS(ISS);
 
+    // Physical memory as the page-table walker sees it
+    struct PhysMem {
+        ISS* iss;
+        uint32_t read(uint32_t paddr, int bytes) { return iss->bus_read(paddr, bytes); }
+        void write(uint32_t paddr, uint32_t data, int bytes) { iss->bus_write(paddr, data, bytes); }
+    };
+
+private:
+    PhysMem phys_{this}; // has to be constructed before mmu
+
+public:
     CPUState state;
-    MMU mmu;
+    MMU<PhysMem> mmu;
 
     bool stop_on_ebreak = false;
+
+    // RISC-V semihosting (see semihost.h): the magic slli/ebreak/srai
+    // sequence calls the host instead of trapping. Off by default since it
+    // hands the guest the host's files. Any other ebreak, GDB's included,
+    // still goes to stop_on_ebreak or the trap handler
+    bool semihosting = false;
+    Semihost& semihost() { return semihost_; }
     uint64_t insn_count = 0;
 
+    ExecEngine engine = ExecEngine::INTERPRETER;
+    uint64_t jit_threshold = 16; // block executions before we bother compiling
+
     void notify_wfi() { wfi_event_.notify(); }
 
     // GDB debug control
+    void attach_debugger(bool attached);
     void halt();
     void resume();
     void step();
     sc_core::sc_event halted_event;
 
     // Physical bus access (GDB uses these for memory read/write)
-    uint32_t bus_read(uint32_t paddr, int bytes);
+    uint32_t bus_read(uint32_t paddr, int bytes) {
+        const DmiTable::Region* rg = dmi_.find(paddr, bytes);
+        if (rg && rg->readable) {
+            dmi_.hits++;
+            uint32_t v = 0;
+            std::memcpy(&v, rg->ptr + (paddr - rg->start), bytes);
+            return v;
+        }
+        return bus_read_slow(paddr, bytes);
+    }
     void bus_write(uint32_t paddr, uint32_t data, int bytes);
 
+    const DecodeCache& decode_cache() const { return icache_; }
+    const BlockCache& block_cache() const { return blocks_; }
+    const JitX86& jit() const { return jit_; }
+    const SoftTlb& soft_tlb() const { return dmem_.tlb; }
+    const DmiTable& dmi_table() const { return dmi_; }
+
+    RunMode run_mode() const { return run_mode_; }
+    uint64_t mode_entries[3] = {}; // times each RunMode was (re)entered
+    uint64_t irq_evals = 0;        // full interrupt checks (flag was set)
+    uint64_t wfi_sleeps = 0;       // WFIs that actually waited
+    sc_core::sc_time wfi_idle;     // simulated time spent in them
+
+    // dlopen a gamingcpu-aot image. Its blocks run in place of whatever
+    // engine is selected while the code bytes still match. False if it
+    // didn't load (the ISS just carries on without it)
+    bool load_aot(const std::string& path);
+    const AotLibrary& aot() const { return aot_; }
+
+    // Native hooks for guest functions (see intercept.h), keyed by entry
+    // address, i.e. the ELF symbol's. While enabled a block starting there
+    // runs the hook instead, in the bare run loop only so single-stepping
+    // under GDB still sees the real code. Adding at a hooked address replaces
+    Intercept& add_intercept(uint32_t addr, Intercept ic);
+    Intercept* find_intercept(const std::string& name);
+    uint64_t intercepted_insns = 0; // credited to insn_count for hooked calls
+
+    // Sampling profiler (see profiler.h), fed at block ends and after single
+    // steps. Null = off, which is one untaken branch per block
+    Profiler* profiler = nullptr;
+
+    bool fusion = true;                  // fuse idiom pairs when building blocks
+    uint64_t fused_execs[NUM_FUSED] = {}; // by fused_index()
+
+    // Busy-poll skipping: a block that spins on one MMIO load (see
+    // is_poll_loop) and reads the same value twice in a row sleeps until the
+    // next event instead. Skipped iterations still count as retired
+    bool poll_skip = true;
+    uint64_t poll_skips = 0;         // times we slept in a poll loop
+    uint64_t poll_skipped_insns = 0; // credited to insn_count for them
+    sc_core::sc_time poll_idle;
+
+    // SMP: with a pool the start of every quantum runs on a host thread,
+    // alongside the other harts' (see hart_pool.h). The slice ends at the
+    // quantum end or at the first thing that needs the SystemC kernel (a
+    // non-DMI access, WFI, a mode switch), which is then redone serially
+    HartPool* pool = nullptr;
+    uint64_t slices = 0;       // quanta started on the pool
+    uint64_t slice_defers = 0; // ...that handed an instruction back
+    void report_stats(std::ostream& os) const;
+
 private:
+    friend struct MemIf;
+    friend class HartPool;
+    friend class Semihost;
+
     void run();
 
+    // Pick a run loop from priv/satp/MPRV/debug state. The loop returns when
+    // mode_dirty_ gets set and run() picks again
+    RunMode select_mode() const;
+    template <RunMode M> void run_loop();
+    template <RunMode M> void run_step(); // one block/instruction or trap
+
+    // Pool side of the quantum. Only touches this hart and DMI memory
+    void run_slice();
+    template <RunMode M> void slice_loop();
+
+    // Soft TLB upkeep. Entries bake in priv/satp/MPRV/SUM/MXR and the DMI
+    // pointer, so anything that changes those flushes
+    void tlb_fill(uint32_t vaddr, uint32_t paddr, AccessType type);
+    void flush_soft_tlb() { dmem_.tlb.flush(); }
+
+    // Slow path behind dmem_: MMU translation + bus access, flags mem_fault_.
+    // Also does misaligned accesses when state.misaligned_ok
+    bool translate_data(uint32_t vaddr, AccessType type, uint32_t& paddr);
+    uint32_t data_read(uint32_t vaddr, int bytes);
+    void data_write(uint32_t vaddr, uint32_t data, int bytes);
+    uint32_t bus_read_slow(uint32_t paddr, int bytes);
+
+    // Host pointer to an aligned RAM word for LR/SC/AMOs, nullptr if it
+    // isn't plain DMI RAM (or the translation faulted)
+    uint32_t* data_amo_ptr(uint32_t vaddr);
+
+    // In a slice: give up on a bus access that needs the kernel. Flags it
+    // like an MMU fault so the instruction unwinds without retiring
+    void defer_access() { defer_ = mem_fault_ = true; }
+
+    // take_trap + jump to the handler, flags a mode switch if priv changed
+    void enter_trap(uint32_t cause, uint32_t tval);
+
+    // Block engine: build/run a straight-line block at a physical PC
+    Block* build_block(uint32_t paddr);
+    void run_block(Block& b);
+
+    // Run as much of b as the JIT can, returns the index the interpreter resumes at
+    size_t run_block_jit(Block& b);
+    void run_block_threaded(Block& b);
+
+    // After a poll_loop block: spinning on an unchanged MMIO value?
+    void check_poll(const Block& b, uint32_t start_pc, uint64_t start_insns,
+                    uint64_t start_mmio);
+    void skip_poll(const Block& b);
+
+    // Translated block for paddr if the image has one and memory still
+    // holds the bytes it was built from
+    AotBlockFn aot_match(uint32_t paddr);
+
+    // Semihosting: is this ebreak the magic sequence, and run the call it makes
+    bool is_semihost_call(const DecodedInstr& d);
+    bool semihost_call();
+
+    // Bulk copies between guest virtual memory and the host for semihosting,
+    // memcpy on DMI pages and bus accesses elsewhere. Returns the bytes
+    // copied, short if a page doesn't translate
+    uint32_t copy_from_guest(uint32_t vaddr, uint8_t* dst, uint32_t len);
+    uint32_t copy_to_guest(uint32_t vaddr, const uint8_t* src, uint32_t len);
+    uint32_t copy_guest(uint32_t vaddr, uint8_t* host, uint32_t len, bool to_guest);
+
+    // Simulated time including what this quantum has used so far
+    sc_core::sc_time local_time();
+
+    // Run b.intercept in place of the block. False if it's off or declined
+    bool run_intercept(Intercept& ic);
+    void run_block_aot(Block& b);
+    static uint32_t aot_read(AotCtx* c, uint32_t addr, int bytes);
+    static void aot_write(AotCtx* c, uint32_t addr, uint32_t data, int bytes);
+
+    // One instruction outside a block (DEBUG mode, MMIO code), reported to
+    // the profiler like a block of one
+    void step_one(uint32_t fetch_paddr);
+
+    // Profiler upkeep after a block/instruction ending in last. seq_pc is
+    // where it falls through to (the return address if last is a call),
+    // completed = everything in it retired, so last really jumped
+    void profile(const DecodedInstr& last, uint32_t seq_pc, bool completed);
+    uint64_t profile_now() const;
+
+    // Execute + commit one instruction at state.pc. Returns false if it trapped,
+    // halted, or otherwise needs the run loop to look at CPU state again
+    bool step_insn(const DecodedInstr& d);
+
+    // WFI: sync time and sleep until something raises an interrupt
+    void wait_for_interrupt();
+
+    // Trap on the MMU fault a load/store just hit. The instruction doesn't retire
+    void take_mem_fault();
+
+    // Charge retired-but-unaccounted instructions to the quantum keeper
+    void flush_time();
+
+    // Quantum keeping in instructions: after every sync/reset work out how
+    // many fit before the quantum ends (budget_). The run loop only compares
+    // unsynced_insns_ against it and touches qk_ once it's used up
+    void start_quantum();
+    void compute_budget();
+    void sync_quantum();
+    bool quantum_used() const { return unsynced_insns_ >= budget_; }
+
+    // Extra time a target charged on b_transport. May end the quantum early
+    void charge_delay(const sc_core::sc_time& delay);
+
+    // Drop decoded instructions and blocks covering [start, end]
+    void invalidate_code(uint64_t start, uint64_t end);
+
+    // Decode-cache backed fetch. Code outside DMI (MMIO) isn't cacheable and
+    // gets decoded into `scratch` instead
+    const DecodedInstr& fetch_decoded(uint32_t paddr, DecodedInstr& scratch);
+    bool dmi_covers(uint32_t addr, int bytes) const {
+        const DmiTable::Region* rg = dmi_.find(addr, bytes);
+        return rg && rg->readable;
+    }
+
     bool mmu_active_fetch() const;
     bool mmu_active_data() const;
     uint8_t effective_data_priv() const;
@@ -45,20 +270,50 @@ private:
 
     uint32_t reset_pc_;
     sc_core::sc_time clk_period_;
+    tlm_utils::tlm_quantumkeeper qk_;
+    uint64_t unsynced_insns_ = 0;
+    uint64_t budget_ = 0;
+    sc_core::sc_time quantum_end_;
     sc_core::sc_event wfi_event_;
+
+    // Last slow-path (non-DMI) read, and the poll loop iteration it matched
+    uint64_t mmio_reads_ = 0;
+    uint32_t mmio_addr_ = 0;
+    uint32_t mmio_val_ = 0;
+    uint32_t poll_pc_ = 0;
+    uint64_t poll_at_ = ~0ull; // insn_count after that iteration
+    uint32_t poll_addr_ = 0;
+    uint32_t poll_val_ = 0;
     sc_core::sc_event resume_event_;
 
     bool halted_ = false;
     bool single_step_ = false;
+    bool debugger_attached_ = false;
+
+    RunMode run_mode_ = RunMode::DEBUG;
+    bool mode_dirty_ = false;
 
     bool mem_fault_ = false;
     uint32_t mem_fault_cause_ = 0;
     uint32_t mem_fault_vaddr_ = 0;
 
-    bool dmi_valid_ = false;
-    uint8_t* dmi_ptr_ = nullptr;
-    uint64_t dmi_start_ = 0;
-    uint64_t dmi_end_ = 0;
+    bool parallel_ = false;    // in run_slice, off the SystemC thread
+    bool defer_ = false;       // slice stopped on something for the kernel
+    bool wfi_pending_ = false; // slice stopped on a WFI
+    bool sliced_ = false;      // this quantum already went through the pool
+
+    DmiTable dmi_;
+
+    MemIf dmem_;
+    DecodeCache icache_;
+    BlockCache blocks_;
+    JitX86 jit_;
+    AotLibrary aot_;
+    const Block* aot_block_ = nullptr; // running, so stores can tell it got hit
+
+    std::unordered_map<uint32_t, Intercept> intercepts_; // by entry address
+
+    Semihost semihost_;
 };
 
 #endif // GAMINGCPU_VP_ISS_H
@@ -0,0 +1,450 @@
+#include "jit_x86.h"
+#include "decode_cache.h"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// x86-64 register numbers
+enum Reg : int {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+// Condition codes for Jcc/SETcc/CMOVcc (low nibble)
+enum Cond : uint8_t {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+    CC_L = 0xC, CC_GE = 0xD
+};
+
+// Fixed register roles inside translated code:
+//   rdi = JitCtx*   r8 = guest regs   r9 = DMI host base
+//   r11 = DMI size  rsi = code page map   rax/rcx/rdx = scratch
+constexpr int CTX = RDI;
+constexpr int GREGS = R8;
+constexpr int HOST = R9;
+constexpr int LIMIT = R11;
+constexpr int CODEMAP = RSI;
+
+struct Emitter {
+    std::vector<uint8_t>& out;
+
+    void byte(uint8_t b) { out.push_back(b); }
+    void dword(uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void rex(bool w, int reg, int index, int base, bool force = false) {
+        uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+                    ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+        if (r != 0x40 || force)
+            byte(r);
+    }
+
+    // op reg, [base + disp32]. base must not be rsp/r12
+    void rm_mem(std::initializer_list<uint8_t> op, int reg, int base, int32_t disp,
+                bool w = false) {
+        rex(w, reg, 0, base);
+        for (uint8_t b : op) byte(b);
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        dword(static_cast<uint32_t>(disp));
+    }
+
+    // op reg, rm (register direct)
+    void rm_reg(std::initializer_list<uint8_t> op, int reg, int rm, bool w = false) {
+        rex(w, reg, 0, rm);
+        for (uint8_t b : op) byte(b);
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // op reg, [base + index] (scale 1, no disp). base must not be rbp/r13
+    void rm_sib(std::initializer_list<uint8_t> op, int reg, int base, int index,
+                uint8_t prefix = 0, bool force_rex = false) {
+        if (prefix) byte(prefix);
+        rex(false, reg, index, base, force_rex);
+        for (uint8_t b : op) byte(b);
+        byte(0x04 | ((reg & 7) << 3));
+        byte(((index & 7) << 3) | (base & 7));
+    }
+
+    // Guest register helpers
+    void load_greg(int r, uint32_t g) { rm_mem({0x8B}, r, GREGS, 4 * g); }
+    void store_greg(uint32_t g, int r) { rm_mem({0x89}, r, GREGS, 4 * g); }
+    void load_ctx32(int r, size_t off) { rm_mem({0x8B}, r, CTX, static_cast<int32_t>(off)); }
+    void load_ctx64(int r, size_t off) { rm_mem({0x8B}, r, CTX, static_cast<int32_t>(off), true); }
+    void store_ctx32(size_t off, int r) { rm_mem({0x89}, r, CTX, static_cast<int32_t>(off)); }
+
+    // ALU r32, imm32 (81 /ext)
+    void alu_imm(int ext, int r, int32_t imm) {
+        rex(false, 0, 0, r);
+        byte(0x81);
+        byte(0xC0 | (ext << 3) | (r & 7));
+        dword(static_cast<uint32_t>(imm));
+    }
+
+    // shift r32, imm8 (C1 /ext)
+    void shift_imm(int ext, int r, uint8_t n, bool w = false) {
+        rex(w, 0, 0, r);
+        byte(0xC1);
+        byte(0xC0 | (ext << 3) | (r & 7));
+        byte(n);
+    }
+
+    void mov_imm(int r, uint32_t imm) {
+        rex(false, 0, 0, r);
+        byte(0xB8 | (r & 7));
+        dword(imm);
+    }
+
+    // setcc al; movzx eax, al
+    void setcc_eax(uint8_t cc) {
+        byte(0x0F); byte(0x90 | cc); byte(0xC0);
+        byte(0x0F); byte(0xB6); byte(0xC0);
+    }
+
+    // jcc rel32 to be patched later, returns patch offset
+    size_t jcc(uint8_t cc) {
+        byte(0x0F); byte(0x80 | cc);
+        size_t at = out.size();
+        dword(0);
+        return at;
+    }
+
+    void ret() { byte(0xC3); }
+};
+
+bool translatable(InstrType t) {
+    switch (t) {
+    case InstrType::LUI:  case InstrType::AUIPC:
+    case InstrType::JAL:  case InstrType::JALR:
+    case InstrType::BEQ:  case InstrType::BNE:  case InstrType::BLT:
+    case InstrType::BGE:  case InstrType::BLTU: case InstrType::BGEU:
+    case InstrType::LB:   case InstrType::LH:   case InstrType::LW:
+    case InstrType::LBU:  case InstrType::LHU:
+    case InstrType::SB:   case InstrType::SH:   case InstrType::SW:
+    case InstrType::ADDI: case InstrType::SLTI: case InstrType::SLTIU:
+    case InstrType::XORI: case InstrType::ORI:  case InstrType::ANDI:
+    case InstrType::SLLI: case InstrType::SRLI: case InstrType::SRAI:
+    case InstrType::ADD:  case InstrType::SUB:  case InstrType::SLL:
+    case InstrType::SLT:  case InstrType::SLTU: case InstrType::XOR:
+    case InstrType::SRL:  case InstrType::SRA:  case InstrType::OR:
+    case InstrType::AND:
+    case InstrType::MUL:  case InstrType::MULH: case InstrType::MULHSU:
+    case InstrType::MULHU:
+    case InstrType::FENCE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // anonymous namespace
+
+JitX86::JitX86() {
+#if defined(__x86_64__)
+    void* p = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+        arena_ = static_cast<uint8_t*>(p);
+#endif
+}
+
+JitX86::~JitX86() {
+#if defined(__x86_64__)
+    if (arena_)
+        munmap(arena_, ARENA_SIZE);
+#endif
+}
+
+JitFn JitX86::compile(const Block& b) {
+    if (!arena_ || b.insns.empty() || !translatable(b.insns[0].type)) {
+        failed++;
+        return nullptr;
+    }
+
+    buf_.clear();
+    Emitter e{buf_};
+
+    struct Exit { size_t patch; uint32_t idx; };
+    std::vector<Exit> exits;
+    std::vector<uint32_t> offsets; // guest byte offset of each instruction
+
+    // Prologue: pull the hot pointers out of the context
+    e.load_ctx64(GREGS, offsetof(JitCtx, regs));
+    e.load_ctx64(HOST, offsetof(JitCtx, ram));
+    e.load_ctx64(LIMIT, offsetof(JitCtx, ram_size));
+    e.load_ctx64(CODEMAP, offsetof(JitCtx, code_pages));
+
+    const size_t next_pc_off = offsetof(JitCtx, next_pc);
+    const size_t pc_off = offsetof(JitCtx, pc);
+
+    // eax = ctx->pc + off
+    auto guest_pc = [&](int r, uint32_t off) {
+        e.load_ctx32(r, pc_off);
+        if (off) e.alu_imm(0, r, static_cast<int32_t>(off));
+    };
+
+    // Terminal exit with ctx->next_pc already written
+    auto finish = [&](uint32_t retired) {
+        e.mov_imm(RAX, retired);
+        e.ret();
+    };
+
+    // eax = guest address, rdx = host offset. Side-exits to `idx` if the access
+    // is misaligned or outside the DMI window
+    auto mem_check = [&](const DecodedInstr& d, uint32_t idx, int bytes) {
+        e.load_greg(RAX, d.rs1);
+        if (d.imm) e.alu_imm(0, RAX, d.imm);
+        if (bytes > 1) {
+            e.byte(0xA9); e.dword(bytes - 1);                 // test eax, bytes-1
+            exits.push_back({e.jcc(CC_NE), idx});
+        }
+        e.rm_reg({0x89}, RAX, RDX);                           // mov edx, eax
+        e.rm_mem({0x2B}, RDX, CTX, offsetof(JitCtx, ram_base)); // sub edx, [ram_base]
+        e.rm_mem({0x8D}, RCX, RDX, bytes, true);              // lea rcx, [rdx+bytes]
+        e.rm_reg({0x3B}, RCX, LIMIT, true);                   // cmp rcx, r11
+        exits.push_back({e.jcc(CC_A), idx});
+    };
+
+    uint32_t off = 0;
+    uint32_t idx = 0;
+    bool terminated = false;
+
+    for (; idx < b.insns.size(); idx++) {
+        const DecodedInstr& d = b.insns[idx];
+        if (!translatable(d.type))
+            break;
+
+        offsets.push_back(off);
+        uint32_t len = d.instr_len();
+
+        switch (d.type) {
+        case InstrType::LUI:
+            if (d.rd) {
+                e.rm_mem({0xC7}, 0, GREGS, 4 * d.rd);
+                e.dword(static_cast<uint32_t>(d.imm));
+            }
+            break;
+        case InstrType::AUIPC:
+            if (d.rd) {
+                guest_pc(RAX, off + static_cast<uint32_t>(d.imm));
+                e.store_greg(d.rd, RAX);
+            }
+            break;
+
+        case InstrType::JAL:
+            if (d.rd) {
+                guest_pc(RAX, off + len);
+                e.store_greg(d.rd, RAX);
+            }
+            guest_pc(RAX, off + static_cast<uint32_t>(d.imm));
+            e.store_ctx32(next_pc_off, RAX);
+            finish(idx + 1);
+            terminated = true;
+            break;
+        case InstrType::JALR:
+            e.load_greg(RCX, d.rs1);                 // read rs1 before rd lands
+            if (d.imm) e.alu_imm(0, RCX, d.imm);
+            e.alu_imm(4, RCX, ~1);
+            e.store_ctx32(next_pc_off, RCX);
+            if (d.rd) {
+                guest_pc(RAX, off + len);
+                e.store_greg(d.rd, RAX);
+            }
+            finish(idx + 1);
+            terminated = true;
+            break;
+
+        case InstrType::BEQ:  case InstrType::BNE:  case InstrType::BLT:
+        case InstrType::BGE:  case InstrType::BLTU: case InstrType::BGEU: {
+            uint8_t cc = CC_E;
+            switch (d.type) {
+            case InstrType::BNE:  cc = CC_NE; break;
+            case InstrType::BLT:  cc = CC_L;  break;
+            case InstrType::BGE:  cc = CC_GE; break;
+            case InstrType::BLTU: cc = CC_B;  break;
+            case InstrType::BGEU: cc = CC_AE; break;
+            default: break;
+            }
+            e.load_greg(RAX, d.rs1);
+            e.rm_mem({0x3B}, RAX, GREGS, 4 * d.rs2);           // cmp eax, rs2
+            e.mov_imm(RCX, off + len);
+            e.mov_imm(RDX, off + static_cast<uint32_t>(d.imm));
+            e.rm_reg({0x0F, static_cast<uint8_t>(0x40 | cc)}, RCX, RDX); // cmovcc ecx, edx
+            e.rm_mem({0x03}, RCX, CTX, pc_off);                 // add ecx, [pc]
+            e.store_ctx32(next_pc_off, RCX);
+            finish(idx + 1);
+            terminated = true;
+            break;
+        }
+
+        case InstrType::LB: case InstrType::LH: case InstrType::LW:
+        case InstrType::LBU: case InstrType::LHU: {
+            int bytes = (d.type == InstrType::LW) ? 4 :
+                        (d.type == InstrType::LH || d.type == InstrType::LHU) ? 2 : 1;
+            mem_check(d, idx, bytes);
+            switch (d.type) {
+            case InstrType::LB:  e.rm_sib({0x0F, 0xBE}, RAX, HOST, RDX); break;
+            case InstrType::LBU: e.rm_sib({0x0F, 0xB6}, RAX, HOST, RDX); break;
+            case InstrType::LH:  e.rm_sib({0x0F, 0xBF}, RAX, HOST, RDX); break;
+            case InstrType::LHU: e.rm_sib({0x0F, 0xB7}, RAX, HOST, RDX); break;
+            default:             e.rm_sib({0x8B}, RAX, HOST, RDX); break;
+            }
+            if (d.rd) e.store_greg(d.rd, RAX);
+            break;
+        }
+
+        case InstrType::SB: case InstrType::SH: case InstrType::SW: {
+            int bytes = (d.type == InstrType::SW) ? 4 : (d.type == InstrType::SH) ? 2 : 1;
+            mem_check(d, idx, bytes);
+            // Stores into pages with cached code go through the interpreter so
+            // the decode/block caches get invalidated properly
+            e.rm_reg({0x89}, RAX, RCX);                       // mov ecx, eax
+            e.shift_imm(5, RCX, DecodeCache::PAGE_SHIFT);     // shr ecx, 12
+            e.byte(0x80); e.byte(0x3C); e.byte(0x0E); e.byte(0x00); // cmp byte [rsi+rcx], 0
+            exits.push_back({e.jcc(CC_NE), idx});
+            e.load_greg(RCX, d.rs2);
+            if (d.type == InstrType::SW)      e.rm_sib({0x89}, RCX, HOST, RDX);
+            else if (d.type == InstrType::SH) e.rm_sib({0x89}, RCX, HOST, RDX, 0x66);
+            else                              e.rm_sib({0x88}, RCX, HOST, RDX);
+            e.load_ctx64(RAX, offsetof(JitCtx, lr_valid));
+            e.byte(0xC6); e.byte(0x00); e.byte(0x00);         // mov byte [rax], 0
+            break;
+        }
+
+        case InstrType::ADDI: case InstrType::XORI:
+        case InstrType::ORI:  case InstrType::ANDI: {
+            if (!d.rd) break;
+            int ext = (d.type == InstrType::ADDI) ? 0 : (d.type == InstrType::ORI) ? 1 :
+                      (d.type == InstrType::ANDI) ? 4 : 6;
+            e.load_greg(RAX, d.rs1);
+            e.alu_imm(ext, RAX, d.imm);
+            e.store_greg(d.rd, RAX);
+            break;
+        }
+        case InstrType::SLTI: case InstrType::SLTIU:
+            if (!d.rd) break;
+            e.load_greg(RAX, d.rs1);
+            e.alu_imm(7, RAX, d.imm);
+            e.setcc_eax(d.type == InstrType::SLTI ? CC_L : CC_B);
+            e.store_greg(d.rd, RAX);
+            break;
+        case InstrType::SLLI: case InstrType::SRLI: case InstrType::SRAI: {
+            if (!d.rd) break;
+            int ext = (d.type == InstrType::SLLI) ? 4 : (d.type == InstrType::SRLI) ? 5 : 7;
+            e.load_greg(RAX, d.rs1);
+            e.shift_imm(ext, RAX, static_cast<uint8_t>(d.imm & 0x1F));
+            e.store_greg(d.rd, RAX);
+            break;
+        }
+
+        case InstrType::ADD: case InstrType::SUB: case InstrType::XOR:
+        case InstrType::OR:  case InstrType::AND: {
+            if (!d.rd) break;
+            uint8_t op = (d.type == InstrType::ADD) ? 0x03 : (d.type == InstrType::SUB) ? 0x2B :
+                         (d.type == InstrType::XOR) ? 0x33 : (d.type == InstrType::OR) ? 0x0B : 0x23;
+            e.load_greg(RAX, d.rs1);
+            e.rm_mem({op}, RAX, GREGS, 4 * d.rs2);
+            e.store_greg(d.rd, RAX);
+            break;
+        }
+        case InstrType::SLL: case InstrType::SRL: case InstrType::SRA: {
+            if (!d.rd) break;
+            int ext = (d.type == InstrType::SLL) ? 4 : (d.type == InstrType::SRL) ? 5 : 7;
+            e.load_greg(RAX, d.rs1);
+            e.load_greg(RCX, d.rs2);
+            e.rm_reg({0xD3}, ext, RAX);                       // shift eax, cl (x86 masks to 5 bits too)
+            e.store_greg(d.rd, RAX);
+            break;
+        }
+        case InstrType::SLT: case InstrType::SLTU:
+            if (!d.rd) break;
+            e.load_greg(RAX, d.rs1);
+            e.rm_mem({0x3B}, RAX, GREGS, 4 * d.rs2);
+            e.setcc_eax(d.type == InstrType::SLT ? CC_L : CC_B);
+            e.store_greg(d.rd, RAX);
+            break;
+
+        case InstrType::MUL:
+            if (!d.rd) break;
+            e.load_greg(RAX, d.rs1);
+            e.rm_mem({0x0F, 0xAF}, RAX, GREGS, 4 * d.rs2);    // imul eax, [rs2]
+            e.store_greg(d.rd, RAX);
+            break;
+        case InstrType::MULH: case InstrType::MULHSU: case InstrType::MULHU:
+            if (!d.rd) break;
+            // Full 64-bit product of the (sign|zero)-extended operands, take the top half
+            if (d.type == InstrType::MULHU) e.load_greg(RAX, d.rs1);
+            else e.rm_mem({0x63}, RAX, GREGS, 4 * d.rs1, true);      // movsxd rax
+            if (d.type == InstrType::MULH) e.rm_mem({0x63}, RCX, GREGS, 4 * d.rs2, true);
+            else e.load_greg(RCX, d.rs2);
+            e.rm_reg({0x0F, 0xAF}, RAX, RCX, true);                   // imul rax, rcx
+            e.shift_imm(5, RAX, 32, true);                            // shr rax, 32
+            e.store_greg(d.rd, RAX);
+            break;
+
+        case InstrType::FENCE: // other harts may be running on other host threads
+            e.byte(0x0F); e.byte(0xAE); e.byte(0xF0); // mfence
+            break;
+
+        default:
+            break;
+        }
+
+        off += len;
+        if (terminated) {
+            idx++;
+            break;
+        }
+    }
+
+    if (idx == 0) {
+        failed++;
+        return nullptr;
+    }
+
+    // Fell off the end (page end / max length / untranslatable instruction):
+    // hand the rest to the interpreter
+    if (!terminated) {
+        offsets.push_back(off);
+        guest_pc(RAX, off);
+        e.store_ctx32(next_pc_off, RAX);
+        finish(idx);
+    }
+
+    // Side-exit stubs, one per instruction that can bail
+    std::vector<size_t> stub_at(b.insns.size() + 1, 0);
+    for (auto& x : exits) {
+        if (!stub_at[x.idx]) {
+            stub_at[x.idx] = buf_.size();
+            guest_pc(RAX, offsets[x.idx]);
+            e.store_ctx32(next_pc_off, RAX);
+            finish(x.idx);
+        }
+        int32_t rel = static_cast<int32_t>(stub_at[x.idx] - (x.patch + 4));
+        std::memcpy(&buf_[x.patch], &rel, 4);
+    }
+
+    if (buf_.size() > MAX_BLOCK_CODE) {
+        failed++;
+        return nullptr;
+    }
+
+    // Out of room: recycle the whole arena. Old JitFns die with the generation
+    if (used_ + buf_.size() > ARENA_SIZE) {
+        used_ = 0;
+        generation_++;
+    }
+
+    uint8_t* dst = arena_ + used_;
+    std::memcpy(dst, buf_.data(), buf_.size());
+    used_ += (buf_.size() + 15) & ~size_t(15);
+
+    compiled++;
+    code_bytes += buf_.size();
+    return reinterpret_cast<JitFn>(dst);
+}
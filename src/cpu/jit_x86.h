@@ -0,0 +1,64 @@
+#ifndef GAMINGCPU_VP_JIT_X86_H
+#define GAMINGCPU_VP_JIT_X86_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "block_cache.h"
+
+// Everything translated code needs, passed in rdi. Layout is baked into the
+// emitted code through offsetof() so don't get clever reordering it
+struct JitCtx {
+    int32_t* regs = nullptr;             // CPUState::regs
+    uint8_t* ram = nullptr;              // DMI host pointer
+    uint64_t ram_size = 0;               // 0 = no DMI, every access side-exits
+    const uint8_t* code_pages = nullptr; // DecodeCache::code_page_map()
+    bool* lr_valid = nullptr;            // stores kill the LR/SC reservation
+    uint32_t ram_base = 0;               // guest address of ram[0]
+    uint32_t pc = 0;                     // in: guest PC of the block start
+    uint32_t next_pc = 0;                // out: where the interpreter picks up
+};
+
+// Returns how many block instructions retired. Fewer than the block length
+// means a side exit: ctx->next_pc is the first instruction NOT executed and
+// the interpreter finishes the block from there
+using JitFn = uint32_t (*)(JitCtx* ctx);
+
+// x86-64 dynamic binary translator for hot RV32IM blocks
+// ALU, LUI/AUIPC, branches/jumps and aligned DMI loads/stores are translated
+// Anything else (CSR, AMO, DIV/REM, system...) ends the translation and the
+// interpreter takes over at that instruction. Loads/stores that miss the DMI
+// window, are misaligned, or hit a page with cached code side-exit the same way
+class JitX86
+{
+public:
+    JitX86();
+    ~JitX86();
+    JitX86(const JitX86&) = delete;
+    JitX86& operator=(const JitX86&) = delete;
+
+    // False on non-x86-64 hosts or if we can't get executable memory
+    bool supported() const { return arena_ != nullptr; }
+
+    // nullptr if not even the first instruction is translatable
+    JitFn compile(const Block& b);
+
+    // Bumped every time the arena is recycled. Blocks compare against it
+    // before trusting a cached JitFn
+    uint64_t generation() const { return generation_; }
+
+    uint64_t compiled = 0;
+    uint64_t failed = 0;
+    uint64_t code_bytes = 0;
+
+private:
+    static constexpr size_t ARENA_SIZE = 16 << 20;
+    static constexpr size_t MAX_BLOCK_CODE = 64 * 1024;
+
+    uint8_t* arena_ = nullptr;
+    size_t used_ = 0;
+    uint64_t generation_ = 1;
+    std::vector<uint8_t> buf_;
+};
+
+#endif // GAMINGCPU_VP_JIT_X86_H
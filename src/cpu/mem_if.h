@@ -0,0 +1,49 @@
+#ifndef GAMINGCPU_VP_MEM_IF_H
+#define GAMINGCPU_VP_MEM_IF_H
+
+#include <cstdint>
+#include <cstring>
+#include "soft_tlb.h"
+
+class ISS;
+
+// The ISS's load/store interface, what execute() and the threaded handlers
+// get as their Mem. A soft TLB hit (any mode, DMI RAM, no cached code on the
+// page for stores) is a tag compare plus a memcpy and inlines right into the
+// caller. Everything else (MMIO, page walks, code invalidation, MMU faults)
+// drops into the ISS through a plain member call, which refills the TLB
+struct MemIf {
+    SoftTlb tlb;
+    ISS* iss = nullptr;
+
+    uint32_t read(uint32_t addr, int bytes) {
+        if (const uint8_t* h = tlb.read_ptr(addr, bytes)) {
+            uint32_t v = 0;
+            std::memcpy(&v, h, bytes);
+            return v;
+        }
+        return read_slow(addr, bytes);
+    }
+
+    void write(uint32_t addr, uint32_t data, int bytes) {
+        if (uint8_t* h = tlb.write_ptr(addr, bytes)) {
+            std::memcpy(h, &data, bytes);
+            return;
+        }
+        write_slow(addr, data, bytes);
+    }
+
+    // Aligned word for an atomic read-modify-write, see execute.h
+    uint32_t* amo_ptr(uint32_t addr) {
+        if (uint8_t* h = tlb.write_ptr(addr, 4))
+            return reinterpret_cast<uint32_t*>(h);
+        return amo_ptr_slow(addr);
+    }
+
+    // iss.cpp
+    uint32_t read_slow(uint32_t addr, int bytes);
+    void write_slow(uint32_t addr, uint32_t data, int bytes);
+    uint32_t* amo_ptr_slow(uint32_t addr);
+};
+
+#endif // GAMINGCPU_VP_MEM_IF_H
@@ -1,14 +1,6 @@
 #include "mmu.h"
 
-// Sv32: [VPN1(10) | VPN0(10) | offset(12)]
-// PTE:  [PPN1(12) | PPN0(10) | RSW(2) | D A G U X W R V]
-
-static constexpr uint32_t PAGE_SHIFT = 12;
-static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
-static constexpr uint32_t VPN_BITS = 10;
-static constexpr uint32_t VPN_MASK = (1u << VPN_BITS) - 1;
-
-static uint32_t fault_cause(AccessType type) {
+uint32_t MMUCore::fault_cause(AccessType type) {
     switch (type) {
     case AccessType::FETCH: return rv32::CAUSE_FETCH_PAGE_FAULT;
     case AccessType::LOAD:  return rv32::CAUSE_LOAD_PAGE_FAULT;
@@ -17,8 +9,8 @@ static uint32_t fault_cause(AccessType type) {
     return rv32::CAUSE_LOAD_PAGE_FAULT;
 }
 
-bool MMU::check_permissions(uint32_t pte, AccessType type, uint8_t priv,
-                            uint32_t mstatus) {
+bool MMUCore::check_permissions(uint32_t pte, AccessType type, uint8_t priv,
+                                uint32_t mstatus) {
     bool user_page = (pte & rv32::PTE_U) != 0;
 
     if (priv == rv32::PRV_U && !user_page)
@@ -46,99 +38,155 @@ bool MMU::check_permissions(uint32_t pte, AccessType type, uint8_t priv,
     return false;
 }
 
-MMUResult MMU::translate(uint32_t vaddr, AccessType type, uint8_t priv,
-                         uint32_t satp, uint32_t mstatus) {
-    uint32_t mode = satp >> rv32::SATP_MODE_SHIFT;
-    if (mode == rv32::SATP_MODE_BARE)
-        return { vaddr, false, 0 };
+static uint16_t satp_asid(uint32_t satp) {
+    return static_cast<uint16_t>((satp >> rv32::SATP_ASID_SHIFT) & rv32::SATP_ASID_MASK);
+}
 
+static bool entry_is_global(uint8_t pte_flags) {
+    return (pte_flags & rv32::PTE_G) != 0;
+}
+
+MMUCore::TLBEntry* MMUCore::tlb_find(TLB& t, uint32_t vaddr, uint16_t asid, TLBSet*& set) {
+    // 4K first, it's the common case
     uint32_t vpn = vaddr >> PAGE_SHIFT;
-    auto it = tlb_.find(vpn);
-    if (it != tlb_.end()) {
-        auto& e = it->second;
-        if (check_permissions(e.pte_flags, type, priv, mstatus)) {
-            uint32_t paddr;
-            if (e.is_superpage)
-                paddr = (e.ppn & ~0x3FFu) << PAGE_SHIFT | (vaddr & 0x003FFFFF);
-            else
-                paddr = e.ppn << PAGE_SHIFT | (vaddr & (PAGE_SIZE - 1));
-            return { paddr, false, 0 };
+    TLBSet* s = &t.sets[vpn & (TLB_SETS - 1)];
+    for (uint32_t w = 0; w < TLB_WAYS; w++) {
+        TLBEntry& e = s->ways[w];
+        if (e.valid && !e.is_superpage && e.vpn == vpn &&
+            (e.asid == asid || entry_is_global(e.pte_flags))) {
+            set = s;
+            plru_touch(*s, w);
+            return &e;
         }
-        return { 0, true, fault_cause(type) };
     }
 
-    return walk(vaddr, type, priv, satp, mstatus);
+    uint32_t vpn1 = vaddr >> (PAGE_SHIFT + VPN_BITS);
+    s = &t.sets[vpn1 & (TLB_SETS - 1)];
+    for (uint32_t w = 0; w < TLB_WAYS; w++) {
+        TLBEntry& e = s->ways[w];
+        if (e.valid && e.is_superpage && e.vpn == vpn1 &&
+            (e.asid == asid || entry_is_global(e.pte_flags))) {
+            set = s;
+            plru_touch(*s, w);
+            return &e;
+        }
+    }
+    return nullptr;
 }
 
-MMUResult MMU::walk(uint32_t vaddr, AccessType type, uint8_t priv,
-                    uint32_t satp, uint32_t mstatus) {
-    uint32_t root_ppn = satp & rv32::SATP_PPN_MASK;
-    uint32_t vpn[2] = {
-        (vaddr >> PAGE_SHIFT) & VPN_MASK,
-        (vaddr >> (PAGE_SHIFT + VPN_BITS)) & VPN_MASK
-    };
-
-    uint32_t a = root_ppn * PAGE_SIZE;
-    int level = 1;
-
-    for (int depth = 0; depth < 2; depth++) {
-        uint32_t pte_addr = a + vpn[level] * 4;
-        uint32_t pte = mem_read(pte_addr);
-
-        if (!(pte & rv32::PTE_V))
-            return { 0, true, fault_cause(type) };
-
-        // R=0 W=1 is reserved. the spec explicitly says this is illegal
-        if (!(pte & rv32::PTE_R) && (pte & rv32::PTE_W))
-            return { 0, true, fault_cause(type) };
-
-        bool is_leaf = (pte & (rv32::PTE_R | rv32::PTE_W | rv32::PTE_X)) != 0;
+// Point the tree bits away from the way just used
+void MMUCore::plru_touch(TLBSet& set, uint32_t way) {
+    if (way < 2) {
+        set.plru |= 1;
+        set.plru = (way == 0) ? (set.plru | 2) : (set.plru & ~2);
+    } else {
+        set.plru &= ~1;
+        set.plru = (way == 2) ? (set.plru | 4) : (set.plru & ~4);
+    }
+}
 
-        if (is_leaf) {
-            if (!check_permissions(pte, type, priv, mstatus))
-                return { 0, true, fault_cause(type) };
+uint32_t MMUCore::plru_victim(const TLBSet& set) {
+    for (uint32_t w = 0; w < TLB_WAYS; w++) {
+        if (!set.ways[w].valid)
+            return w;
+    }
+    if (!(set.plru & 1))
+        return (set.plru & 2) ? 1 : 0;
+    return (set.plru & 4) ? 3 : 2;
+}
 
-            uint32_t ppn = pte >> rv32::PTE_PPN_SHIFT;
-            bool is_superpage = (level == 1);
+bool MMUCore::tlb_lookup(uint32_t vaddr, AccessType type, uint8_t priv,
+                         uint32_t satp, uint32_t mstatus, MMUResult& r) {
+    TLBSet* set;
+    TLBEntry* e = tlb_find(tlb_for(type), vaddr, satp_asid(satp), set);
 
-            // 4MB superpage PPN[0] must be zero or it's misaligned
-            if (is_superpage && (ppn & VPN_MASK) != 0)
-                return { 0, true, fault_cause(type) };
+    // A store through an entry filled by a load still has to walk to set D
+    if (!e || (type == AccessType::STORE && !(e->pte_flags & rv32::PTE_D))) {
+        tlb_misses++;
+        return false;
+    }
+    tlb_hits++;
+
+    if (check_permissions(e->pte_flags, type, priv, mstatus)) {
+        if (e->is_superpage)
+            r.paddr = (e->ppn & ~VPN_MASK) << PAGE_SHIFT | (vaddr & 0x003FFFFF);
+        else
+            r.paddr = e->ppn << PAGE_SHIFT | (vaddr & (PAGE_SIZE - 1));
+        r.fault = false;
+        r.cause = 0;
+    } else {
+        r = { 0, true, fault_cause(type) };
+    }
+    return true;
+}
 
-            // Hardware A/D bit update
-            uint32_t required = rv32::PTE_A;
-            if (type == AccessType::STORE)
-                required |= rv32::PTE_D;
+void MMUCore::tlb_fill(uint32_t vaddr, AccessType type, uint32_t satp,
+                       uint32_t ppn, uint32_t pte, bool is_superpage) {
+    TLB& t = tlb_for(type);
+    uint16_t asid = satp_asid(satp);
+
+    // Refill of a mapping we already hold (store after load, to set D):
+    // drop the old one so the victim pick below lands on its way
+    TLBSet* set;
+    if (TLBEntry* old = tlb_find(t, vaddr, asid, set))
+        old->valid = false;
+
+    uint32_t vpn = is_superpage ? vaddr >> (PAGE_SHIFT + VPN_BITS) : vaddr >> PAGE_SHIFT;
+    set = &t.sets[vpn & (TLB_SETS - 1)];
+    uint32_t w = plru_victim(*set);
+    plru_touch(*set, w);
+    TLBEntry* e = &set->ways[w];
+
+    e->vpn = vpn;
+    e->ppn = ppn;
+    e->asid = asid;
+    e->pte_flags = static_cast<uint8_t>(pte & 0xFF);
+    e->is_superpage = is_superpage;
+    e->valid = true;
+}
 
-            if ((pte & required) != required) {
-                pte |= required;
-                mem_write(pte_addr, pte);
+void MMUCore::shoot(TLB& t, bool by_addr, uint32_t vaddr, bool by_asid, uint16_t asid) {
+    for (TLBSet& set : t.sets) {
+        for (TLBEntry& e : set.ways) {
+            if (!e.valid)
+                continue;
+            if (by_addr) {
+                uint32_t vpn = e.is_superpage ? vaddr >> (PAGE_SHIFT + VPN_BITS)
+                                              : vaddr >> PAGE_SHIFT;
+                if (e.vpn != vpn)
+                    continue;
             }
-
-            uint32_t paddr;
-            if (is_superpage)
-                paddr = (ppn & ~VPN_MASK) << PAGE_SHIFT | (vaddr & 0x003FFFFF);
-            else
-                paddr = ppn << PAGE_SHIFT | (vaddr & (PAGE_SIZE - 1));
-
-            uint32_t vpn_key = vaddr >> PAGE_SHIFT;
-            if (tlb_.size() >= TLB_SIZE)
-                tlb_.erase(tlb_.begin());
-            tlb_[vpn_key] = { ppn, pte & 0xFF, is_superpage };
-
-            return { paddr, false, 0 };
+            // rs2 != x0 leaves global mappings alone
+            if (by_asid && (entry_is_global(e.pte_flags) || e.asid != asid))
+                continue;
+            e.valid = false;
         }
+    }
+}
 
-        if (level == 0)
-            return { 0, true, fault_cause(type) };
-
-        a = (pte >> rv32::PTE_PPN_SHIFT) * PAGE_SIZE;
-        level--;
+void MMUCore::sfence_vma(bool by_addr, uint32_t vaddr, bool by_asid, uint32_t asid) {
+    if (!by_addr && !by_asid) {
+        flush_tlb();
+        return;
     }
+    uint16_t a = static_cast<uint16_t>(asid & rv32::SATP_ASID_MASK);
+    shoot(itlb_, by_addr, vaddr, by_asid, a);
+    shoot(dtlb_, by_addr, vaddr, by_asid, a);
+    tlb_shootdowns++;
+}
 
-    return { 0, true, fault_cause(type) };
+void MMUCore::satp_written(uint32_t satp) {
+    uint32_t old = satp_;
+    satp_ = satp;
+    if (satp_asid(old) == satp_asid(satp) &&
+        (old & rv32::SATP_PPN_MASK) != (satp & rv32::SATP_PPN_MASK))
+        sfence_vma(false, 0, true, satp_asid(satp));
 }
 
-void MMU::flush_tlb() {
-    tlb_.clear();
+void MMUCore::flush_tlb() {
+    for (TLBSet& set : itlb_.sets)
+        set = TLBSet{};
+    for (TLBSet& set : dtlb_.sets)
+        set = TLBSet{};
+    tlb_flushes++;
 }
@@ -1,9 +1,8 @@
 #ifndef GAMINGCPU_VP_MMU_H
 #define GAMINGCPU_VP_MMU_H
 
+#include <cstddef>
 #include <cstdint>
-#include <functional>
-#include <unordered_map>
 #include "rv32_defs.h"
 
 enum class AccessType { FETCH, LOAD, STORE };
@@ -14,32 +13,176 @@ struct MMUResult {
     uint32_t cause = 0;
 };
 
-class MMU
+// TLB + permission checks. Doesn't touch memory so it doesn't need to know
+// what the page tables live in
+//
+// Split I/D TLBs, each TLB_SETS x TLB_WAYS with tree-PLRU replacement.
+// Entries are tagged with the satp ASID unless the PTE was global, so a
+// context switch doesn't have to throw anything away. 4K pages are indexed
+// by VPN, superpages by VPN[1], a lookup probes both sets
+class MMUCore
 {
 public:
-    std::function<uint32_t(uint32_t)> mem_read;
-    std::function<void(uint32_t, uint32_t)> mem_write;
-
-    MMUResult translate(uint32_t vaddr, AccessType type, uint8_t priv,
-                        uint32_t satp, uint32_t mstatus);
+    static constexpr uint32_t TLB_SETS = 16;
+    static constexpr uint32_t TLB_WAYS = 4;
 
     void flush_tlb();
 
+    // sfence.vma: by_addr limits it to mappings of vaddr, by_asid to non-global
+    // mappings of asid (rs1/rs2 != x0). Neither = flush everything
+    void sfence_vma(bool by_addr, uint32_t vaddr, bool by_asid, uint32_t asid);
+
+    // New satp value. Entries are ASID tagged so this normally keeps them,
+    // unless the root moved under the same ASID (guests that don't use ASIDs
+    // and skip the sfence.vma)
+    void satp_written(uint32_t satp);
+
+    uint64_t tlb_hits = 0;
+    uint64_t tlb_misses = 0;
+    uint64_t tlb_flushes = 0;     // full
+    uint64_t tlb_shootdowns = 0;  // selective sfence.vma
+
+protected:
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+    static constexpr uint32_t VPN_BITS = 10;
+    static constexpr uint32_t VPN_MASK = (1u << VPN_BITS) - 1;
+
+    // True on a TLB hit, r is the translation or the permission fault
+    bool tlb_lookup(uint32_t vaddr, AccessType type, uint8_t priv,
+                    uint32_t satp, uint32_t mstatus, MMUResult& r);
+    void tlb_fill(uint32_t vaddr, AccessType type, uint32_t satp,
+                  uint32_t ppn, uint32_t pte, bool is_superpage);
+
+    static bool check_permissions(uint32_t pte, AccessType type, uint8_t priv,
+                                  uint32_t mstatus);
+    static uint32_t fault_cause(AccessType type);
+
 private:
     struct TLBEntry {
-        uint32_t ppn;
-        uint32_t pte_flags;
-        bool is_superpage;
+        uint32_t vpn = 0;   // vaddr >> 12, or >> 22 for superpages
+        uint32_t ppn = 0;
+        uint16_t asid = 0;
+        uint8_t pte_flags = 0;
+        bool is_superpage = false;
+        bool valid = false;
+    };
+
+    struct TLBSet {
+        TLBEntry ways[TLB_WAYS];
+        uint8_t plru = 0; // bit0: root, bit1: ways 0/1, bit2: ways 2/3
     };
 
-    static constexpr size_t TLB_SIZE = 64;
-    std::unordered_map<uint32_t, TLBEntry> tlb_;
+    struct TLB {
+        TLBSet sets[TLB_SETS];
+    };
+
+    TLB& tlb_for(AccessType type) { return type == AccessType::FETCH ? itlb_ : dtlb_; }
+    static TLBEntry* tlb_find(TLB& t, uint32_t vaddr, uint16_t asid, TLBSet*& set);
+    static void plru_touch(TLBSet& set, uint32_t way);
+    static uint32_t plru_victim(const TLBSet& set);
+    void shoot(TLB& t, bool by_addr, uint32_t vaddr, bool by_asid, uint16_t asid);
+
+    TLB itlb_;
+    TLB dtlb_;
+    uint32_t satp_ = 0;
+};
+
+// Sv32 translation. Mem is whatever holds the page tables, it needs
+//   uint32_t read(uint32_t paddr, int bytes)
+//   void write(uint32_t paddr, uint32_t data, int bytes)
+// Statically dispatched so the walk's PTE loads inline into the DMI path
+template <typename Mem>
+class MMU : public MMUCore
+{
+public:
+    explicit MMU(Mem& mem) : mem_(mem) {}
+
+    MMUResult translate(uint32_t vaddr, AccessType type, uint8_t priv,
+                        uint32_t satp, uint32_t mstatus) {
+        uint32_t mode = satp >> rv32::SATP_MODE_SHIFT;
+        if (mode == rv32::SATP_MODE_BARE)
+            return { vaddr, false, 0 };
+
+        MMUResult r;
+        if (tlb_lookup(vaddr, type, priv, satp, mstatus, r))
+            return r;
+        return walk(vaddr, type, priv, satp, mstatus);
+    }
 
+private:
     MMUResult walk(uint32_t vaddr, AccessType type, uint8_t priv,
                    uint32_t satp, uint32_t mstatus);
 
-    bool check_permissions(uint32_t pte, AccessType type, uint8_t priv,
-                           uint32_t mstatus);
+    Mem& mem_;
 };
 
+// Sv32: [VPN1(10) | VPN0(10) | offset(12)]
+// PTE:  [PPN1(12) | PPN0(10) | RSW(2) | D A G U X W R V]
+template <typename Mem>
+MMUResult MMU<Mem>::walk(uint32_t vaddr, AccessType type, uint8_t priv,
+                         uint32_t satp, uint32_t mstatus) {
+    uint32_t root_ppn = satp & rv32::SATP_PPN_MASK;
+    uint32_t vpn[2] = {
+        (vaddr >> PAGE_SHIFT) & VPN_MASK,
+        (vaddr >> (PAGE_SHIFT + VPN_BITS)) & VPN_MASK
+    };
+
+    uint32_t a = root_ppn * PAGE_SIZE;
+    int level = 1;
+
+    for (int depth = 0; depth < 2; depth++) {
+        uint32_t pte_addr = a + vpn[level] * 4;
+        uint32_t pte = mem_.read(pte_addr, 4);
+
+        if (!(pte & rv32::PTE_V))
+            return { 0, true, fault_cause(type) };
+
+        // R=0 W=1 is reserved. the spec explicitly says this is illegal
+        if (!(pte & rv32::PTE_R) && (pte & rv32::PTE_W))
+            return { 0, true, fault_cause(type) };
+
+        bool is_leaf = (pte & (rv32::PTE_R | rv32::PTE_W | rv32::PTE_X)) != 0;
+
+        if (is_leaf) {
+            if (!check_permissions(pte, type, priv, mstatus))
+                return { 0, true, fault_cause(type) };
+
+            uint32_t ppn = pte >> rv32::PTE_PPN_SHIFT;
+            bool is_superpage = (level == 1);
+
+            // 4MB superpage PPN[0] must be zero or it's misaligned
+            if (is_superpage && (ppn & VPN_MASK) != 0)
+                return { 0, true, fault_cause(type) };
+
+            // Hardware A/D bit update
+            uint32_t required = rv32::PTE_A;
+            if (type == AccessType::STORE)
+                required |= rv32::PTE_D;
+
+            if ((pte & required) != required) {
+                pte |= required;
+                mem_.write(pte_addr, pte, 4);
+            }
+
+            uint32_t paddr;
+            if (is_superpage)
+                paddr = (ppn & ~VPN_MASK) << PAGE_SHIFT | (vaddr & 0x003FFFFF);
+            else
+                paddr = ppn << PAGE_SHIFT | (vaddr & (PAGE_SIZE - 1));
+
+            tlb_fill(vaddr, type, satp, ppn, pte, is_superpage);
+            return { paddr, false, 0 };
+        }
+
+        if (level == 0)
+            return { 0, true, fault_cause(type) };
+
+        a = (pte >> rv32::PTE_PPN_SHIFT) * PAGE_SIZE;
+        level--;
+    }
+
+    return { 0, true, fault_cause(type) };
+}
+
 #endif // GAMINGCPU_VP_MMU_H
@@ -0,0 +1,190 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+namespace {
+
+// Just enough protobuf encoding for profile.proto
+struct PbWriter {
+    std::string buf;
+
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            buf.push_back(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        buf.push_back(static_cast<char>(v));
+    }
+    void field(uint32_t num, uint64_t v) {
+        varint(num << 3 | 0); // varint
+        varint(v);
+    }
+    void bytes(uint32_t num, const std::string& s) {
+        varint(num << 3 | 2); // length-delimited
+        varint(s.size());
+        buf += s;
+    }
+    void packed(uint32_t num, const std::vector<uint64_t>& vs) {
+        PbWriter p;
+        for (uint64_t v : vs)
+            p.varint(v);
+        bytes(num, p.buf);
+    }
+};
+
+} // anonymous namespace
+
+Profiler::Profiler(Unit unit, uint64_t period)
+    : unit_(unit), period_(std::max<uint64_t>(period, 1))
+{
+}
+
+void Profiler::set_symbols(const std::vector<ElfSymbol>& symbols) {
+    funcs_.clear();
+    for (const ElfSymbol& s : symbols)
+        if (s.func)
+            funcs_.push_back({s.value & ~1u, s.size, s.name});
+    std::sort(funcs_.begin(), funcs_.end(),
+              [](const Func& a, const Func& b) { return a.start < b.start; });
+}
+
+void Profiler::call(uint32_t ret_addr) {
+    if (stack_.size() == MAX_DEPTH)
+        stack_.erase(stack_.begin()); // runaway recursion, keep the innermost frames
+    stack_.push_back(ret_addr);
+}
+
+void Profiler::ret(uint32_t target) {
+    for (size_t i = stack_.size(); i-- > 0;) {
+        if (stack_[i] == target) {
+            if (i + 1 != stack_.size())
+                stack_resyncs++;
+            stack_.resize(i);
+            return;
+        }
+    }
+}
+
+void Profiler::take(uint64_t now, uint32_t pc) {
+    // First call only arms it, so attaching mid-run doesn't count the past
+    if (!armed_) {
+        armed_ = true;
+        next_ = now + period_;
+        return;
+    }
+
+    // Several periods in one go (a long block, a WFI sleep) weigh the sample
+    uint64_t n = (now - next_) / period_ + 1;
+    next_ += n * period_;
+    samples += n;
+
+    std::vector<uint32_t> key = stack_;
+    key.push_back(pc);
+    counts_[key] += n;
+}
+
+std::string Profiler::symbolize(uint32_t addr) const {
+    auto it = std::upper_bound(funcs_.begin(), funcs_.end(), addr,
+                               [](uint32_t a, const Func& f) { return a < f.start; });
+    if (it != funcs_.begin()) {
+        const Func& f = *--it;
+        // Size 0 (hand-written asm) runs up to the next symbol
+        if (f.size == 0 || addr - f.start < f.size)
+            return f.name;
+    }
+    char hex[16];
+    std::snprintf(hex, sizeof(hex), "0x%08x", addr);
+    return hex;
+}
+
+void Profiler::write_folded(std::ostream& os) const {
+    // Different return addresses in the same functions fold into one line
+    std::map<std::string, uint64_t> folded;
+    for (const auto& [key, n] : counts_) {
+        std::string line;
+        for (uint32_t a : key) {
+            if (!line.empty())
+                line += ';';
+            line += symbolize(a);
+        }
+        folded[line] += n;
+    }
+    for (const auto& [line, n] : folded)
+        os << line << ' ' << n << '\n';
+}
+
+void Profiler::write_pprof(std::ostream& os) const {
+    std::vector<std::string> strings{""};
+    std::unordered_map<std::string, uint64_t> string_ids{{"", 0}};
+    auto str = [&](const std::string& s) {
+        auto [it, added] = string_ids.emplace(s, strings.size());
+        if (added)
+            strings.push_back(s);
+        return it->second;
+    };
+
+    PbWriter prof;
+    auto value_type = [&](uint32_t num, const char* type, const char* unit) {
+        PbWriter vt;
+        vt.field(1, str(type));
+        vt.field(2, str(unit));
+        prof.bytes(num, vt.buf);
+    };
+    const char* what = unit_ == Unit::INSNS ? "instructions" : "time";
+    const char* unit = unit_ == Unit::INSNS ? "count" : "microseconds";
+    value_type(1, "samples", "count");
+    value_type(1, what, unit);
+
+    // Locations by address, functions by name, ids from 1
+    std::unordered_map<uint32_t, uint64_t> loc_ids;
+    std::unordered_map<std::string, uint64_t> func_ids;
+    PbWriter locs, funcs;
+    auto location = [&](uint32_t addr) {
+        auto [it, added] = loc_ids.emplace(addr, loc_ids.size() + 1);
+        if (added) {
+            std::string name = symbolize(addr);
+            auto [f, fadded] = func_ids.emplace(name, func_ids.size() + 1);
+            if (fadded) {
+                PbWriter fn;
+                fn.field(1, f->second);
+                fn.field(2, str(name));
+                fn.field(3, str(name));
+                funcs.bytes(5, fn.buf);
+            }
+            PbWriter line;
+            line.field(1, f->second);
+            PbWriter loc;
+            loc.field(1, it->second);
+            loc.field(3, addr);
+            loc.bytes(4, line.buf);
+            locs.bytes(4, loc.buf);
+        }
+        return it->second;
+    };
+
+    for (const auto& [key, n] : counts_) {
+        // pprof wants the leaf first
+        std::vector<uint64_t> ids;
+        for (auto a = key.rbegin(); a != key.rend(); ++a)
+            ids.push_back(location(*a));
+        PbWriter sample;
+        sample.packed(1, ids);
+        sample.packed(2, {n, n * period_});
+        prof.bytes(2, sample.buf);
+    }
+    prof.buf += locs.buf;
+    prof.buf += funcs.buf;
+
+    PbWriter period_type;
+    period_type.field(1, str(what));
+    period_type.field(2, str(unit));
+    prof.bytes(11, period_type.buf);
+    prof.field(12, period_);
+
+    // Last, once nothing adds to it any more
+    for (const std::string& s : strings)
+        prof.bytes(6, s);
+
+    os.write(prof.buf.data(), static_cast<std::streamsize>(prof.buf.size()));
+}
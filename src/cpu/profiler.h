@@ -0,0 +1,75 @@
+#ifndef GAMINGCPU_VP_PROFILER_H
+#define GAMINGCPU_VP_PROFILER_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "util/elf_loader.h"
+
+// Sampling guest profiler for one hart. The ISS feeds it at block ends:
+// calls and returns keep a shadow stack of return addresses, and every
+// `period` retired instructions (or simulated microseconds) the current PC
+// plus that stack become a sample. Attach with ISS::profiler, a null
+// pointer is the whole cost when it's off
+class Profiler
+{
+public:
+    enum class Unit { INSNS, MICROSECONDS };
+
+    Profiler(Unit unit, uint64_t period);
+    Unit unit() const { return unit_; }
+
+    // Function symbols to name frames with, e.g. ElfLoadResult::symbols.
+    // Anything outside them shows up as its hex address
+    void set_symbols(const std::vector<ElfSymbol>& symbols);
+
+    // Shadow stack. A return pops down to the frame it returns to, so
+    // longjmp/context switches that skip frames don't leave it skewed,
+    // and one that matches nothing is ignored
+    void call(uint32_t ret_addr);
+    void ret(uint32_t target);
+    size_t depth() const { return stack_.size(); }
+
+    // Sampling point check, `now` in the profiler's unit. Inline so the
+    // ISS only pays a compare between samples
+    void tick(uint64_t now, uint32_t pc) {
+        if (now >= next_)
+            take(now, pc);
+    }
+
+    // Flamegraph input: one "root;...;leaf count" line per distinct stack
+    void write_folded(std::ostream& os) const;
+    // pprof profile.proto, uncompressed (pprof takes it as is)
+    void write_pprof(std::ostream& os) const;
+
+    std::string symbolize(uint32_t addr) const;
+
+    uint64_t samples = 0;       // sampling points hit, one per period passed
+    uint64_t stack_resyncs = 0; // returns that popped more than one frame
+
+private:
+    static constexpr size_t MAX_DEPTH = 256;
+
+    void take(uint64_t now, uint32_t pc);
+
+    Unit unit_;
+    uint64_t period_;
+    uint64_t next_ = 0;
+    bool armed_ = false; // next_ is set
+
+    std::vector<uint32_t> stack_; // return addresses, outermost first
+
+    // Root-first return addresses plus the sampled PC last -> weight
+    std::map<std::vector<uint32_t>, uint64_t> counts_;
+
+    struct Func {
+        uint32_t start;
+        uint32_t size;
+        std::string name;
+    };
+    std::vector<Func> funcs_; // by start
+};
+
+#endif // GAMINGCPU_VP_PROFILER_H
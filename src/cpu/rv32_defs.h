@@ -3,7 +3,7 @@
 
 #include <cstdint>
 
-// RV32IMAC opcode/CSR/cause constants. Equivalent to rtl/cpu/pkg/rv32_pkg.sv.
+// RV32IMAFC(+B) opcode/CSR/cause constants. Equivalent to rtl/cpu/pkg/rv32_pkg.sv.
 
 namespace rv32
 {
@@ -21,6 +21,13 @@ namespace rv32
     constexpr uint32_t OP_FENCE = 0b0001111;
     constexpr uint32_t OP_SYSTEM = 0b1110011;
     constexpr uint32_t OP_AMO = 0b0101111;
+    constexpr uint32_t OP_LOAD_FP = 0b0000111;
+    constexpr uint32_t OP_STORE_FP = 0b0100111;
+    constexpr uint32_t OP_FMADD = 0b1000011;
+    constexpr uint32_t OP_FMSUB = 0b1000111;
+    constexpr uint32_t OP_FNMSUB = 0b1001011;
+    constexpr uint32_t OP_FNMADD = 0b1001111;
+    constexpr uint32_t OP_FP = 0b1010011;
 
     //  funct3 for branches
     constexpr uint32_t F3_BEQ = 0b000;
@@ -56,6 +63,22 @@ namespace rv32
     constexpr uint32_t F7_NORMAL = 0b0000000;
     constexpr uint32_t F7_ALT = 0b0100000;    // SUB, SRA
     constexpr uint32_t F7_MULDIV = 0b0000001; // M extension
+    constexpr uint32_t F7_SHADD = 0b0010000;  // Zba sh*add
+    constexpr uint32_t F7_MINMAX = 0b0000101; // Zbb min/max
+    constexpr uint32_t F7_ZEXT = 0b0000100;   // Zbb zext.h (rs2 = 0)
+    constexpr uint32_t F7_ROT = 0b0110000;    // Zbb rol/ror/rori, clz/ctz/cpop/sext
+    constexpr uint32_t F7_BSET = 0b0010100;   // Zbs
+    constexpr uint32_t F7_BCLR = 0b0100100;   // Zbs bclr/bext
+    constexpr uint32_t F7_BINV = 0b0110100;   // Zbs
+
+    //  Zbb ops that live in OP-IMM's immediate field
+    constexpr uint32_t IMM_CLZ = 0x600;
+    constexpr uint32_t IMM_CTZ = 0x601;
+    constexpr uint32_t IMM_CPOP = 0x602;
+    constexpr uint32_t IMM_SEXT_B = 0x604;
+    constexpr uint32_t IMM_SEXT_H = 0x605;
+    constexpr uint32_t IMM_ORC_B = 0x287;
+    constexpr uint32_t IMM_REV8 = 0x698; // RV32 encoding
 
     //  funct3 for M extension
     constexpr uint32_t F3_MUL = 0b000;
@@ -80,6 +103,36 @@ namespace rv32
     constexpr uint32_t F5_AMOMINU = 0b11000;
     constexpr uint32_t F5_AMOMAXU = 0b11100;
 
+    //  funct7 for OP-FP, single precision (fmt = 00 in bits [26:25])
+    constexpr uint32_t F7_FADD = 0b0000000;
+    constexpr uint32_t F7_FSUB = 0b0000100;
+    constexpr uint32_t F7_FMUL = 0b0001000;
+    constexpr uint32_t F7_FDIV = 0b0001100;
+    constexpr uint32_t F7_FSQRT = 0b0101100;
+    constexpr uint32_t F7_FSGNJ = 0b0010000;
+    constexpr uint32_t F7_FMINMAX = 0b0010100;
+    constexpr uint32_t F7_FCVT_W_S = 0b1100000; // rs2 = 0 W, 1 WU
+    constexpr uint32_t F7_FMV_X_W = 0b1110000;  // funct3 = 0 FMV.X.W, 1 FCLASS
+    constexpr uint32_t F7_FCMP = 0b1010000;
+    constexpr uint32_t F7_FCVT_S_W = 0b1101000; // rs2 = 0 W, 1 WU
+    constexpr uint32_t F7_FMV_W_X = 0b1111000;
+    constexpr uint32_t F3_FLW = 0b010;          // also FSW
+
+    //  Rounding modes (instruction rm field / frm)
+    constexpr uint32_t RM_RNE = 0;
+    constexpr uint32_t RM_RTZ = 1;
+    constexpr uint32_t RM_RDN = 2;
+    constexpr uint32_t RM_RUP = 3;
+    constexpr uint32_t RM_RMM = 4;
+    constexpr uint32_t RM_DYN = 7; // use frm
+
+    //  fflags
+    constexpr uint32_t FFLAG_NX = 1 << 0;
+    constexpr uint32_t FFLAG_UF = 1 << 1;
+    constexpr uint32_t FFLAG_OF = 1 << 2;
+    constexpr uint32_t FFLAG_DZ = 1 << 3;
+    constexpr uint32_t FFLAG_NV = 1 << 4;
+
     //  funct3 for SYSTEM
     constexpr uint32_t F3_PRIV = 0b000;
     constexpr uint32_t F3_CSRRW = 0b001;
@@ -106,6 +159,9 @@ namespace rv32
 
     //  CSR addresses
     // User-level
+    constexpr uint16_t CSR_FFLAGS = 0x001;
+    constexpr uint16_t CSR_FRM = 0x002;
+    constexpr uint16_t CSR_FCSR = 0x003;
     constexpr uint16_t CSR_CYCLE = 0xC00;
     constexpr uint16_t CSR_TIME = 0xC01;
     constexpr uint16_t CSR_INSTRET = 0xC02;
@@ -159,12 +215,19 @@ namespace rv32
     constexpr uint32_t MSTATUS_MPP_SHIFT = 11;
     constexpr uint32_t MSTATUS_MPP_MASK = 0x3 << MSTATUS_MPP_SHIFT;
     constexpr uint32_t MSTATUS_SPP = 1 << 8;
+    constexpr uint32_t MSTATUS_FS_SHIFT = 13;
+    constexpr uint32_t MSTATUS_FS_MASK = 0x3 << MSTATUS_FS_SHIFT;
+    constexpr uint32_t FS_OFF = 0;
+    constexpr uint32_t FS_INITIAL = 1;
+    constexpr uint32_t FS_CLEAN = 2;
+    constexpr uint32_t FS_DIRTY = 3;
     constexpr uint32_t MSTATUS_MPRV = 1 << 17;
     constexpr uint32_t MSTATUS_SUM = 1 << 18;
     constexpr uint32_t MSTATUS_MXR = 1 << 19;
     constexpr uint32_t MSTATUS_TVM = 1 << 20;
     constexpr uint32_t MSTATUS_TW = 1 << 21;
     constexpr uint32_t MSTATUS_TSR = 1 << 22;
+    constexpr uint32_t MSTATUS_SD = 1u << 31; // read-only, FS == Dirty
 
     //  mip / mie bit positions
     constexpr uint32_t MIP_SSIP = 1 << 1;
@@ -209,6 +272,8 @@ namespace rv32
     constexpr uint32_t SATP_MODE_SV32 = 1;
     constexpr uint32_t SATP_MODE_SHIFT = 31;
     constexpr uint32_t SATP_PPN_MASK = 0x003FFFFF;
+    constexpr uint32_t SATP_ASID_SHIFT = 22;
+    constexpr uint32_t SATP_ASID_MASK = 0x1FF;
 
     //  Page table entry bits
     constexpr uint32_t PTE_V = 1 << 0;
@@ -222,28 +287,28 @@ namespace rv32
     constexpr uint32_t PTE_PPN_SHIFT = 10;
 
     //  Instruction field extraction
-    inline uint32_t opcode(uint32_t instr) { return instr & 0x7F; }
-    inline uint32_t rd(uint32_t instr) { return (instr >> 7) & 0x1F; }
-    inline uint32_t funct3(uint32_t instr) { return (instr >> 12) & 0x7; }
-    inline uint32_t rs1(uint32_t instr) { return (instr >> 15) & 0x1F; }
-    inline uint32_t rs2(uint32_t instr) { return (instr >> 20) & 0x1F; }
-    inline uint32_t funct7(uint32_t instr) { return (instr >> 25) & 0x7F; }
-    inline uint32_t funct5(uint32_t instr) { return (instr >> 27) & 0x1F; }
-    inline uint32_t funct12(uint32_t instr) { return (instr >> 20) & 0xFFF; }
+    constexpr uint32_t opcode(uint32_t instr) { return instr & 0x7F; }
+    constexpr uint32_t rd(uint32_t instr) { return (instr >> 7) & 0x1F; }
+    constexpr uint32_t funct3(uint32_t instr) { return (instr >> 12) & 0x7; }
+    constexpr uint32_t rs1(uint32_t instr) { return (instr >> 15) & 0x1F; }
+    constexpr uint32_t rs2(uint32_t instr) { return (instr >> 20) & 0x1F; }
+    constexpr uint32_t funct7(uint32_t instr) { return (instr >> 25) & 0x7F; }
+    constexpr uint32_t funct5(uint32_t instr) { return (instr >> 27) & 0x1F; }
+    constexpr uint32_t funct12(uint32_t instr) { return (instr >> 20) & 0xFFF; }
 
     //  Immediate extraction (sign-extended to 32 bits)
-    inline int32_t imm_i(uint32_t instr)
+    constexpr int32_t imm_i(uint32_t instr)
     {
         return static_cast<int32_t>(instr) >> 20;
     }
 
-    inline int32_t imm_s(uint32_t instr)
+    constexpr int32_t imm_s(uint32_t instr)
     {
         return (static_cast<int32_t>(instr & 0xFE000000) >> 20) |
                ((instr >> 7) & 0x1F);
     }
 
-    inline int32_t imm_b(uint32_t instr)
+    constexpr int32_t imm_b(uint32_t instr)
     {
         return (static_cast<int32_t>(instr & 0x80000000) >> 19) |
                ((instr & 0x80) << 4) |
@@ -251,12 +316,12 @@ namespace rv32
                ((instr >> 7) & 0x1E);
     }
 
-    inline int32_t imm_u(uint32_t instr)
+    constexpr int32_t imm_u(uint32_t instr)
     {
         return instr & 0xFFFFF000;
     }
 
-    inline int32_t imm_j(uint32_t instr)
+    constexpr int32_t imm_j(uint32_t instr)
     {
         return (static_cast<int32_t>(instr & 0x80000000) >> 11) |
                (instr & 0xFF000) |
@@ -265,17 +330,19 @@ namespace rv32
     }
 
     // CSR immediate (zero-extended 5-bit)
-    inline uint32_t csr_zimm(uint32_t instr) { return rs1(instr); }
+    constexpr uint32_t csr_zimm(uint32_t instr) { return rs1(instr); }
 
-    // MISA value for RV32IMAC
+    // MISA value for RV32IMAFCB
     constexpr uint32_t MISA_RV32 = (1 << 30); // MXL = 1 (32-bit)
+    constexpr uint32_t MISA_B = 1 << ('B' - 'A'); // Zba + Zbb + Zbs
     constexpr uint32_t MISA_I = 1 << ('I' - 'A');
     constexpr uint32_t MISA_M = 1 << ('M' - 'A');
     constexpr uint32_t MISA_A = 1 << ('A' - 'A');
     constexpr uint32_t MISA_C = 1 << ('C' - 'A');
+    constexpr uint32_t MISA_F = 1 << ('F' - 'A');
     constexpr uint32_t MISA_S = 1 << ('S' - 'A');
     constexpr uint32_t MISA_U = 1 << ('U' - 'A');
-    constexpr uint32_t MISA_VALUE = MISA_RV32 | MISA_I | MISA_M | MISA_A | MISA_C | MISA_S | MISA_U;
+    constexpr uint32_t MISA_VALUE = MISA_RV32 | MISA_I | MISA_M | MISA_A | MISA_F | MISA_B | MISA_C | MISA_S | MISA_U;
 
 } // namespace rv32
 
@@ -4,11 +4,15 @@
 #include <cstdint>
 #include <algorithm>
 
+// SC.W on host memory succeeds if the word still holds what LR.W loaded
+// (compare-and-swap), so other harts' stores break the reservation too.
+// Unless they put the same value back, the usual CAS caveat
 struct Reservation {
     uint32_t addr = 0;
+    uint32_t value = 0;
     bool valid = false;
 
-    void set(uint32_t a)   { addr = a & ~0x3u; valid = true; }
+    void set(uint32_t a, uint32_t v) { addr = a & ~0x3u; value = v; valid = true; }
     void clear()           { valid = false; }
     bool check(uint32_t a) const { return valid && addr == (a & ~0x3u); }
 };
@@ -32,6 +36,29 @@ inline uint32_t amo_max(uint32_t mem, uint32_t rs2) {
 inline uint32_t amo_minu(uint32_t mem, uint32_t rs2) { return std::min(mem, rs2); }
 inline uint32_t amo_maxu(uint32_t mem, uint32_t rs2) { return std::max(mem, rs2); }
 
+// In place on host memory, atomic against other host threads. Return the old
+// value. The ones without a host instruction are a CAS loop over the above
+inline uint32_t atomic_swap(uint32_t* p, uint32_t rs2) { return __atomic_exchange_n(p, rs2, __ATOMIC_SEQ_CST); }
+inline uint32_t atomic_add(uint32_t* p, uint32_t rs2)  { return __atomic_fetch_add(p, rs2, __ATOMIC_SEQ_CST); }
+inline uint32_t atomic_xor(uint32_t* p, uint32_t rs2)  { return __atomic_fetch_xor(p, rs2, __ATOMIC_SEQ_CST); }
+inline uint32_t atomic_and(uint32_t* p, uint32_t rs2)  { return __atomic_fetch_and(p, rs2, __ATOMIC_SEQ_CST); }
+inline uint32_t atomic_or(uint32_t* p, uint32_t rs2)   { return __atomic_fetch_or(p, rs2, __ATOMIC_SEQ_CST); }
+
+template <uint32_t (*F)(uint32_t, uint32_t)>
+inline uint32_t atomic_rmw(uint32_t* p, uint32_t rs2) {
+    uint32_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(p, &old, F(old, rs2), true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+    return old;
+}
+
+// SC.W: store rs2 if *p still holds expect
+inline bool atomic_sc(uint32_t* p, uint32_t expect, uint32_t rs2) {
+    return __atomic_compare_exchange_n(p, &expect, rs2, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
 } // namespace rv32a
 
 #endif // GAMINGCPU_VP_RV32A_H
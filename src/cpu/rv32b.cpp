@@ -0,0 +1,55 @@
+#include "rv32b.h"
+
+namespace rv32b {
+
+uint32_t sh1add(uint32_t rs1, uint32_t rs2) { return (rs1 << 1) + rs2; }
+uint32_t sh2add(uint32_t rs1, uint32_t rs2) { return (rs1 << 2) + rs2; }
+uint32_t sh3add(uint32_t rs1, uint32_t rs2) { return (rs1 << 3) + rs2; }
+
+uint32_t andn(uint32_t rs1, uint32_t rs2) { return rs1 & ~rs2; }
+uint32_t orn(uint32_t rs1, uint32_t rs2)  { return rs1 | ~rs2; }
+uint32_t xnor(uint32_t rs1, uint32_t rs2) { return ~(rs1 ^ rs2); }
+
+// The builtins are undefined for 0
+uint32_t clz(uint32_t rs1, uint32_t)  { return rs1 ? __builtin_clz(rs1) : 32; }
+uint32_t ctz(uint32_t rs1, uint32_t)  { return rs1 ? __builtin_ctz(rs1) : 32; }
+uint32_t cpop(uint32_t rs1, uint32_t) { return __builtin_popcount(rs1); }
+
+uint32_t max(uint32_t rs1, uint32_t rs2) {
+    return static_cast<int32_t>(rs1) < static_cast<int32_t>(rs2) ? rs2 : rs1;
+}
+uint32_t maxu(uint32_t rs1, uint32_t rs2) { return rs1 < rs2 ? rs2 : rs1; }
+uint32_t min(uint32_t rs1, uint32_t rs2) {
+    return static_cast<int32_t>(rs1) < static_cast<int32_t>(rs2) ? rs1 : rs2;
+}
+uint32_t minu(uint32_t rs1, uint32_t rs2) { return rs1 < rs2 ? rs1 : rs2; }
+
+uint32_t sext_b(uint32_t rs1, uint32_t) { return static_cast<uint32_t>(static_cast<int8_t>(rs1)); }
+uint32_t sext_h(uint32_t rs1, uint32_t) { return static_cast<uint32_t>(static_cast<int16_t>(rs1)); }
+uint32_t zext_h(uint32_t rs1, uint32_t) { return rs1 & 0xFFFF; }
+
+uint32_t rol(uint32_t rs1, uint32_t rs2) {
+    uint32_t sh = rs2 & 0x1F;
+    return (rs1 << sh) | (rs1 >> ((32 - sh) & 0x1F));
+}
+uint32_t ror(uint32_t rs1, uint32_t rs2) {
+    uint32_t sh = rs2 & 0x1F;
+    return (rs1 >> sh) | (rs1 << ((32 - sh) & 0x1F));
+}
+
+// Each byte -> 0xFF if any bit in it is set
+uint32_t orc_b(uint32_t rs1, uint32_t) {
+    uint32_t v = rs1;
+    v |= (v >> 1) & 0x7F7F7F7F;
+    v |= (v >> 2) & 0x3F3F3F3F;
+    v |= (v >> 4) & 0x0F0F0F0F;
+    return (v & 0x01010101) * 0xFF;
+}
+uint32_t rev8(uint32_t rs1, uint32_t) { return __builtin_bswap32(rs1); }
+
+uint32_t bclr(uint32_t rs1, uint32_t rs2) { return rs1 & ~(1u << (rs2 & 0x1F)); }
+uint32_t bext(uint32_t rs1, uint32_t rs2) { return (rs1 >> (rs2 & 0x1F)) & 1; }
+uint32_t binv(uint32_t rs1, uint32_t rs2) { return rs1 ^ (1u << (rs2 & 0x1F)); }
+uint32_t bset(uint32_t rs1, uint32_t rs2) { return rs1 | (1u << (rs2 & 0x1F)); }
+
+} // namespace rv32b
@@ -0,0 +1,43 @@
+#ifndef GAMINGCPU_VP_RV32B_H
+#define GAMINGCPU_VP_RV32B_H
+
+#include <cstdint>
+
+// Zba/Zbb/Zbs. Same (rs1, rs2) shape as rv32m so the threaded engine can
+// take them as template arguments. Immediate forms pass the shamt/bit index
+// as rs2, the unary ones ignore it
+namespace rv32b {
+
+// Zba
+uint32_t sh1add(uint32_t rs1, uint32_t rs2);
+uint32_t sh2add(uint32_t rs1, uint32_t rs2);
+uint32_t sh3add(uint32_t rs1, uint32_t rs2);
+
+// Zbb
+uint32_t andn(uint32_t rs1, uint32_t rs2);
+uint32_t orn(uint32_t rs1, uint32_t rs2);
+uint32_t xnor(uint32_t rs1, uint32_t rs2);
+uint32_t clz(uint32_t rs1, uint32_t);
+uint32_t ctz(uint32_t rs1, uint32_t);
+uint32_t cpop(uint32_t rs1, uint32_t);
+uint32_t max(uint32_t rs1, uint32_t rs2);
+uint32_t maxu(uint32_t rs1, uint32_t rs2);
+uint32_t min(uint32_t rs1, uint32_t rs2);
+uint32_t minu(uint32_t rs1, uint32_t rs2);
+uint32_t sext_b(uint32_t rs1, uint32_t);
+uint32_t sext_h(uint32_t rs1, uint32_t);
+uint32_t zext_h(uint32_t rs1, uint32_t);
+uint32_t rol(uint32_t rs1, uint32_t rs2);
+uint32_t ror(uint32_t rs1, uint32_t rs2);
+uint32_t orc_b(uint32_t rs1, uint32_t);
+uint32_t rev8(uint32_t rs1, uint32_t);
+
+// Zbs
+uint32_t bclr(uint32_t rs1, uint32_t rs2);
+uint32_t bext(uint32_t rs1, uint32_t rs2);
+uint32_t binv(uint32_t rs1, uint32_t rs2);
+uint32_t bset(uint32_t rs1, uint32_t rs2);
+
+} // namespace rv32b
+
+#endif // GAMINGCPU_VP_RV32B_H
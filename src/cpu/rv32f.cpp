@@ -0,0 +1,188 @@
+#include "rv32f.h"
+#include "rv32_defs.h"
+#include <cfenv>
+#include <cmath>
+#include <cstring>
+
+using namespace rv32;
+
+namespace rv32f {
+
+namespace {
+
+float to_f(uint32_t v) { float f; std::memcpy(&f, &v, 4); return f; }
+uint32_t to_u(float f) { uint32_t v; std::memcpy(&v, &f, 4); return v; }
+
+bool is_nan(uint32_t v)  { return (v & 0x7F800000) == 0x7F800000 && (v & 0x007FFFFF); }
+bool is_snan(uint32_t v) { return is_nan(v) && !(v & 0x00400000); }
+
+// GCC assumes the default FP environment and would happily fold or move the
+// arithmetic across fesetround/fetestexcept, this pins a value in place
+template <typename T>
+T pin(T v) {
+    asm volatile("" : "+m"(v) : : "memory");
+    return v;
+}
+
+// Host rounding mode + exception flags for one op. RMM has no host
+// equivalent and runs as RNE (ties to even instead of away)
+class HostFp
+{
+public:
+    explicit HostFp(uint32_t rm) {
+        if (rm == RM_RTZ)      set(FE_TOWARDZERO);
+        else if (rm == RM_RDN) set(FE_DOWNWARD);
+        else if (rm == RM_RUP) set(FE_UPWARD);
+        std::feclearexcept(FE_ALL_EXCEPT);
+    }
+    ~HostFp() {
+        if (changed_) std::fesetround(FE_TONEAREST);
+    }
+
+    uint32_t flags() const {
+        int e = std::fetestexcept(FE_ALL_EXCEPT);
+        uint32_t f = 0;
+        if (e & FE_INEXACT)   f |= FFLAG_NX;
+        if (e & FE_UNDERFLOW) f |= FFLAG_UF;
+        if (e & FE_OVERFLOW)  f |= FFLAG_OF;
+        if (e & FE_DIVBYZERO) f |= FFLAG_DZ;
+        if (e & FE_INVALID)   f |= FFLAG_NV;
+        return f;
+    }
+
+private:
+    void set(int mode) { std::fesetround(mode); changed_ = true; }
+    bool changed_ = false;
+};
+
+uint32_t canon(float r) {
+    uint32_t v = to_u(r);
+    return is_nan(v) ? CANONICAL_NAN : v;
+}
+
+template <typename Op>
+uint32_t arith(uint32_t rm, uint32_t& flags, Op op) {
+    HostFp fp(rm);
+    float r = pin(op());
+    flags |= fp.flags();
+    return canon(r);
+}
+
+// Round to an integral value under rm, exact since it stays in double
+double round_rm(double v, uint32_t rm) {
+    switch (rm) {
+    case RM_RTZ: return std::trunc(v);
+    case RM_RDN: return std::floor(v);
+    case RM_RUP: return std::ceil(v);
+    case RM_RMM: return std::round(v);
+    default:     return std::nearbyint(v); // host is in RNE outside HostFp
+    }
+}
+
+uint32_t minmax(uint32_t a, uint32_t b, uint32_t& flags, bool want_max) {
+    if (is_snan(a) || is_snan(b)) flags |= FFLAG_NV;
+    if (is_nan(a) && is_nan(b)) return CANONICAL_NAN;
+    if (is_nan(a)) return b;
+    if (is_nan(b)) return a;
+
+    float fa = to_f(a), fb = to_f(b);
+    if (fa == fb) // only differs for +-0, pick by sign
+        return want_max ? (a & b) : (a | b);
+    return (fa < fb) != want_max ? a : b;
+}
+
+} // namespace
+
+uint32_t fadd(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return pin(to_f(a)) + pin(to_f(b)); });
+}
+uint32_t fsub(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return pin(to_f(a)) - pin(to_f(b)); });
+}
+uint32_t fmul(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return pin(to_f(a)) * pin(to_f(b)); });
+}
+uint32_t fdiv(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return pin(to_f(a)) / pin(to_f(b)); });
+}
+uint32_t fsqrt(uint32_t a, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return std::sqrt(pin(to_f(a))); });
+}
+
+uint32_t fmadd(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return std::fma(pin(to_f(a)), pin(to_f(b)), pin(to_f(c))); });
+}
+uint32_t fmsub(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags) {
+    return fmadd(a, b, c ^ 0x80000000, rm, flags);
+}
+uint32_t fnmsub(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags) {
+    return fmadd(a ^ 0x80000000, b, c, rm, flags);
+}
+uint32_t fnmadd(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags) {
+    return fmadd(a ^ 0x80000000, b, c ^ 0x80000000, rm, flags);
+}
+
+uint32_t fsgnj(uint32_t a, uint32_t b)  { return (a & 0x7FFFFFFF) | (b & 0x80000000); }
+uint32_t fsgnjn(uint32_t a, uint32_t b) { return (a & 0x7FFFFFFF) | (~b & 0x80000000); }
+uint32_t fsgnjx(uint32_t a, uint32_t b) { return a ^ (b & 0x80000000); }
+
+uint32_t fmin(uint32_t a, uint32_t b, uint32_t& flags) { return minmax(a, b, flags, false); }
+uint32_t fmax(uint32_t a, uint32_t b, uint32_t& flags) { return minmax(a, b, flags, true); }
+
+uint32_t fcvt_w_s(uint32_t a, uint32_t rm, uint32_t& flags) {
+    if (is_nan(a)) { flags |= FFLAG_NV; return 0x7FFFFFFF; }
+    double v = to_f(a);
+    double r = round_rm(v, rm);
+    if (r < -2147483648.0) { flags |= FFLAG_NV; return 0x80000000; }
+    if (r > 2147483647.0)  { flags |= FFLAG_NV; return 0x7FFFFFFF; }
+    if (r != v) flags |= FFLAG_NX;
+    return static_cast<uint32_t>(static_cast<int32_t>(r));
+}
+
+uint32_t fcvt_wu_s(uint32_t a, uint32_t rm, uint32_t& flags) {
+    if (is_nan(a)) { flags |= FFLAG_NV; return 0xFFFFFFFF; }
+    double v = to_f(a);
+    double r = round_rm(v, rm);
+    if (r < 0.0)          { flags |= FFLAG_NV; return 0; }
+    if (r > 4294967295.0) { flags |= FFLAG_NV; return 0xFFFFFFFF; }
+    if (r != v) flags |= FFLAG_NX;
+    return static_cast<uint32_t>(r);
+}
+
+uint32_t fcvt_s_w(uint32_t x, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return static_cast<float>(pin(static_cast<int32_t>(x))); });
+}
+uint32_t fcvt_s_wu(uint32_t x, uint32_t rm, uint32_t& flags) {
+    return arith(rm, flags, [&] { return static_cast<float>(pin(x)); });
+}
+
+uint32_t feq(uint32_t a, uint32_t b, uint32_t& flags) {
+    if (is_snan(a) || is_snan(b)) flags |= FFLAG_NV;
+    if (is_nan(a) || is_nan(b)) return 0;
+    return to_f(a) == to_f(b);
+}
+uint32_t flt(uint32_t a, uint32_t b, uint32_t& flags) {
+    if (is_nan(a) || is_nan(b)) { flags |= FFLAG_NV; return 0; }
+    return to_f(a) < to_f(b);
+}
+uint32_t fle(uint32_t a, uint32_t b, uint32_t& flags) {
+    if (is_nan(a) || is_nan(b)) { flags |= FFLAG_NV; return 0; }
+    return to_f(a) <= to_f(b);
+}
+
+uint32_t fclass(uint32_t a) {
+    bool neg = a >> 31;
+    uint32_t exp = (a >> 23) & 0xFF;
+    uint32_t frac = a & 0x007FFFFF;
+    if (exp == 0xFF) {
+        if (!frac) return neg ? 1u << 0 : 1u << 7;
+        return is_snan(a) ? 1u << 8 : 1u << 9;
+    }
+    if (exp == 0) {
+        if (!frac) return neg ? 1u << 3 : 1u << 4;
+        return neg ? 1u << 2 : 1u << 5;
+    }
+    return neg ? 1u << 1 : 1u << 6;
+}
+
+} // namespace rv32f
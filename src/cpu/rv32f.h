@@ -0,0 +1,50 @@
+#ifndef GAMINGCPU_VP_RV32F_H
+#define GAMINGCPU_VP_RV32F_H
+
+#include <cstdint>
+
+// F extension on the host FPU. Values are raw binary32 bits in and out. rm
+// is an already resolved static mode (RNE..RMM, never DYN), flags gets the
+// fflags bits the op raised or'd in. Results that are NaN come back as the
+// canonical NaN, the host would propagate the input payload
+namespace rv32f {
+
+constexpr uint32_t CANONICAL_NAN = 0x7FC00000;
+
+uint32_t fadd(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags);
+uint32_t fsub(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags);
+uint32_t fmul(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags);
+uint32_t fdiv(uint32_t a, uint32_t b, uint32_t rm, uint32_t& flags);
+uint32_t fsqrt(uint32_t a, uint32_t rm, uint32_t& flags);
+
+// a*b+c, a*b-c, -(a*b)+c, -(a*b)-c, one rounding
+uint32_t fmadd(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags);
+uint32_t fmsub(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags);
+uint32_t fnmsub(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags);
+uint32_t fnmadd(uint32_t a, uint32_t b, uint32_t c, uint32_t rm, uint32_t& flags);
+
+uint32_t fsgnj(uint32_t a, uint32_t b);
+uint32_t fsgnjn(uint32_t a, uint32_t b);
+uint32_t fsgnjx(uint32_t a, uint32_t b);
+
+// -0 < +0, a single NaN operand loses to the other one
+uint32_t fmin(uint32_t a, uint32_t b, uint32_t& flags);
+uint32_t fmax(uint32_t a, uint32_t b, uint32_t& flags);
+
+// Out of range and NaN saturate and raise NV
+uint32_t fcvt_w_s(uint32_t a, uint32_t rm, uint32_t& flags);
+uint32_t fcvt_wu_s(uint32_t a, uint32_t rm, uint32_t& flags);
+uint32_t fcvt_s_w(uint32_t x, uint32_t rm, uint32_t& flags);
+uint32_t fcvt_s_wu(uint32_t x, uint32_t rm, uint32_t& flags);
+
+// feq is quiet (NV on sNaN only), flt/fle signal on any NaN
+uint32_t feq(uint32_t a, uint32_t b, uint32_t& flags);
+uint32_t flt(uint32_t a, uint32_t b, uint32_t& flags);
+uint32_t fle(uint32_t a, uint32_t b, uint32_t& flags);
+
+// One-hot class mask, bit 0 = -inf ... bit 9 = quiet NaN
+uint32_t fclass(uint32_t a);
+
+} // namespace rv32f
+
+#endif // GAMINGCPU_VP_RV32F_H
@@ -0,0 +1,21 @@
+#ifndef GAMINGCPU_VP_RVC_TABLE_H
+#define GAMINGCPU_VP_RVC_TABLE_H
+
+#include <cstdint>
+
+// Every 16-bit encoding already decoded, indexed by the raw halfword.
+// Generated at build time by gamingcpu-rvcgen (rvc_table_gen.cpp) from
+// decode_ref. Compressed instructions only ever set these fields; the
+// generator refuses to write a table if one sets anything else. Entries
+// for 32-bit encodings (low bits 11) are never looked at
+struct RvcEntry {
+    uint8_t type; // InstrType
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;
+};
+
+extern const RvcEntry RVC_TABLE[1 << 16];
+
+#endif // GAMINGCPU_VP_RVC_TABLE_H
@@ -0,0 +1,51 @@
+// gamingcpu-rvcgen -- write the 64K-entry RVC decode table (see rvc_table.h)
+//
+//   gamingcpu-rvcgen rvc_table.cpp
+
+#include "decode_ref.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <out.cpp>\n";
+        return 2;
+    }
+
+    std::ofstream f(argv[1]);
+    if (!f) {
+        std::cerr << "[RVC] can't write " << argv[1] << "\n";
+        return 1;
+    }
+
+    f << "// Generated by gamingcpu-rvcgen, don't edit\n"
+      << "#include \"cpu/rvc_table.h\"\n\n"
+      << "const RvcEntry RVC_TABLE[1 << 16] = {\n";
+
+    for (uint32_t ci = 0; ci < (1u << 16); ci++) {
+        DecodedInstr d;
+        if ((ci & 0x3) != 0x3)
+            d = decode_ref::decode(ci);
+
+        if (d.csr || d.rs3 || d.rm || d.fused()) {
+            std::cerr << "[RVC] 0x" << std::hex << ci << " sets fields RvcEntry doesn't have\n";
+            f.close();
+            std::remove(argv[1]);
+            return 1;
+        }
+
+        char line[64];
+        std::snprintf(line, sizeof(line), "{%u,%u,%u,%u,%d},", static_cast<unsigned>(d.type),
+                      d.rd, d.rs1, d.rs2, d.imm);
+        f << line << ((ci & 7) == 7 ? "\n" : "");
+    }
+    f << "};\n";
+
+    if (!f) {
+        std::cerr << "[RVC] write to " << argv[1] << " failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "semihost.h"
+#include "iss.h"
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t FAIL = 0xFFFFFFFF; // -1
+constexpr uint32_t CHUNK = 64 * 1024;
+
+// SYS_OPEN modes 0..11, ISO C fopen() strings
+const char* const MODES[12] = {
+    "r", "rb", "r+", "r+b", "w", "wb", "w+", "w+b", "a", "ab", "a+", "a+b",
+};
+
+} // anonymous namespace
+
+Semihost::~Semihost() {
+    for (Handle& h : handles_)
+        if (h.owned && h.f)
+            std::fclose(h.f);
+}
+
+uint32_t Semihost::call(ISS& iss, uint32_t op, uint32_t arg) {
+    calls++;
+
+    // Argument block, all the calls we take have at most three words
+    uint32_t a[3] = {};
+    auto args = [&](uint32_t n) {
+        return iss.copy_from_guest(arg, reinterpret_cast<uint8_t*>(a), 4 * n) == 4 * n;
+    };
+
+    switch (op) {
+    case SYS_OPEN:
+        if (!args(3))
+            return FAIL;
+        return open(iss, a[0], a[1], a[2]);
+
+    case SYS_CLOSE: {
+        if (!args(1) || !file(a[0]))
+            return FAIL;
+        Handle& h = handles_[a[0]];
+        int r = h.owned ? std::fclose(h.f) : 0;
+        h = Handle{};
+        return r == 0 ? 0 : FAIL;
+    }
+
+    // Both return how many bytes did NOT make it, so 0 is complete
+    case SYS_WRITE: {
+        if (!args(3))
+            return FAIL;
+        std::FILE* f = file(a[0]);
+        uint32_t ptr = a[1], left = a[2];
+        while (f && left) {
+            uint32_t n = std::min(left, CHUNK);
+            buf_.resize(n);
+            uint32_t got = iss.copy_from_guest(ptr, buf_.data(), n);
+            uint32_t put = static_cast<uint32_t>(std::fwrite(buf_.data(), 1, got, f));
+            bytes_written += put;
+            ptr += put;
+            left -= put;
+            if (put < n)
+                break;
+        }
+        if (f && !handles_[a[0]].owned)
+            std::fflush(f); // console output shows up as it's written
+        return left;
+    }
+    case SYS_READ: {
+        if (!args(3))
+            return FAIL;
+        std::FILE* f = file(a[0]);
+        uint32_t ptr = a[1], left = a[2];
+        while (f && left) {
+            uint32_t n = std::min(left, CHUNK);
+            buf_.resize(n);
+            uint32_t got = static_cast<uint32_t>(std::fread(buf_.data(), 1, n, f));
+            uint32_t put = iss.copy_to_guest(ptr, buf_.data(), got);
+            bytes_read += put;
+            ptr += put;
+            left -= put;
+            if (put < n)
+                break; // EOF, or the buffer ran into a fault
+        }
+        return left;
+    }
+
+    case SYS_CLOCK: // centiseconds of simulated time
+        return static_cast<uint32_t>(iss.local_time() / sc_core::sc_time(10, sc_core::SC_MS));
+
+    case SYS_EXIT: // 32-bit: the reason itself, no block
+        exited = true;
+        exit_code = arg == ADP_STOPPED_APPLICATION_EXIT ? 0 : 1;
+        return 0;
+
+    default:
+        return FAIL;
+    }
+}
+
+uint32_t Semihost::open(ISS& iss, uint32_t name, uint32_t mode, uint32_t len) {
+    if (mode >= 12 || len > 4096)
+        return FAIL;
+    std::string path(len, '\0');
+    if (iss.copy_from_guest(name, reinterpret_cast<uint8_t*>(&path[0]), len) != len)
+        return FAIL;
+
+    Handle h;
+    if (path == ":tt") {
+        h.f = mode < 4 ? stdin : mode < 8 ? stdout : stderr;
+    } else {
+        h.f = std::fopen((root.empty() ? path : root + "/" + path).c_str(), MODES[mode]);
+        h.owned = true;
+        if (!h.f)
+            return FAIL;
+    }
+
+    // Reuse a closed slot first so handles stay small
+    for (uint32_t k = 0; k < handles_.size(); k++) {
+        if (!handles_[k].f) {
+            handles_[k] = h;
+            return k;
+        }
+    }
+    handles_.push_back(h);
+    return static_cast<uint32_t>(handles_.size() - 1);
+}
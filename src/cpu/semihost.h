@@ -0,0 +1,69 @@
+#ifndef GAMINGCPU_VP_SEMIHOST_H
+#define GAMINGCPU_VP_SEMIHOST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class ISS;
+
+// RISC-V semihosting, i.e. ARM's numbering behind the
+//   slli x0, x0, 0x1f / ebreak / srai x0, x0, 7
+// sequence: a0 = operation, a1 = argument (or a pointer to a block of word
+// arguments), result back in a0. Buffers are copied in bulk through DMI,
+// so logging and asset loading skip the UART/SD register protocols
+class Semihost
+{
+public:
+    static constexpr uint32_t SYS_OPEN = 0x01;
+    static constexpr uint32_t SYS_CLOSE = 0x02;
+    static constexpr uint32_t SYS_WRITE = 0x05;
+    static constexpr uint32_t SYS_READ = 0x06;
+    static constexpr uint32_t SYS_CLOCK = 0x10;
+    static constexpr uint32_t SYS_EXIT = 0x18;
+
+    // SYS_EXIT reason for a normal exit, anything else exits with 1
+    static constexpr uint32_t ADP_STOPPED_APPLICATION_EXIT = 0x20026;
+
+    // Is the 32-bit ebreak at pc the middle of the magic sequence?
+    static constexpr uint32_t SLLI_X0_1F = 0x01F01013;
+    static constexpr uint32_t EBREAK = 0x00100073;
+    static constexpr uint32_t SRAI_X0_7 = 0x40705013;
+
+    Semihost() = default;
+    ~Semihost();
+    Semihost(const Semihost&) = delete;
+    Semihost& operator=(const Semihost&) = delete;
+
+    // Runs one call against the hart's memory and clock. Unknown
+    // operations return -1, like a failed known one
+    uint32_t call(ISS& iss, uint32_t op, uint32_t arg);
+
+    // Host directory SYS_OPEN names are relative to, empty = cwd.
+    // ":tt" is the console either way (stdin for reads, stdout otherwise)
+    std::string root;
+
+    bool exited = false; // SYS_EXIT happened, the hart halted
+    int exit_code = 0;
+
+    uint64_t calls = 0;
+    uint64_t bytes_written = 0; // guest -> host
+    uint64_t bytes_read = 0;    // host -> guest
+
+private:
+    struct Handle {
+        std::FILE* f = nullptr;
+        bool owned = false; // not stdin/stdout
+    };
+    std::vector<Handle> handles_; // by semihosting handle
+
+    uint32_t open(ISS& iss, uint32_t name, uint32_t mode, uint32_t len);
+    std::FILE* file(uint32_t h) const {
+        return h < handles_.size() ? handles_[h].f : nullptr;
+    }
+
+    std::vector<uint8_t> buf_; // staging for reads/writes
+};
+
+#endif // GAMINGCPU_VP_SEMIHOST_H
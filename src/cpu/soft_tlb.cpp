@@ -0,0 +1,46 @@
+#include "soft_tlb.h"
+
+void SoftTlb::fill(uint32_t vaddr, uint32_t paddr, uint8_t* host_page, AccessType type) {
+    Entry& e = entries_[index(vaddr)];
+    uint32_t vpage = vaddr & PAGE_MASK;
+    uint32_t ppage = paddr & PAGE_MASK;
+
+    // Different page in this slot (or same vpage remapped): start over
+    if (e.vpage != vpage || e.ppage != ppage) {
+        e.tag_r = e.tag_w = e.tag_x = INVALID;
+        e.vpage = vpage;
+        e.ppage = ppage;
+    }
+    // An X-only fill may have happened before DMI showed up
+    if (host_page)
+        e.addend = reinterpret_cast<uintptr_t>(host_page) - vpage;
+
+    switch (type) {
+    case AccessType::FETCH:
+        e.tag_x = vpage;
+        break;
+    case AccessType::LOAD:
+        if (host_page)
+            e.tag_r = vpage;
+        break;
+    case AccessType::STORE:
+        if (host_page)
+            e.tag_w = vpage;
+        break;
+    }
+    fills++;
+}
+
+void SoftTlb::drop_writes() {
+    for (Entry& e : entries_)
+        e.tag_w = INVALID;
+}
+
+void SoftTlb::flush() {
+    for (Entry& e : entries_) {
+        e.tag_r = e.tag_w = e.tag_x = INVALID;
+        e.vpage = e.ppage = 0;
+        e.addend = 0;
+    }
+    flushes++;
+}
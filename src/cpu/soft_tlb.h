@@ -0,0 +1,77 @@
+#ifndef GAMINGCPU_VP_SOFT_TLB_H
+#define GAMINGCPU_VP_SOFT_TLB_H
+
+#include <cstdint>
+#include "mmu.h"
+
+// Direct-mapped guest-virtual page -> host pointer cache, QEMU softmmu style
+// Sits in front of MMU::translate + the DMI lookup. Separate R/W/X tags so a
+// page can be readable but not (yet) writable, e.g. before its D bit is set or
+// while it holds cached code. A hit is one compare and an add
+//
+// Entries are only good for the priv/satp/mstatus they were filled under, so
+// the ISS flushes on every mode switch, satp write, sfence.vma and DMI change
+class SoftTlb
+{
+public:
+    static constexpr uint32_t ENTRIES = 256;
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+    static constexpr uint32_t PAGE_MASK = ~(PAGE_SIZE - 1);
+
+    SoftTlb() { flush(); }
+
+    // Host pointer if this access hits, nullptr otherwise
+    // Misaligned addresses never match since the tag's low bits are zero
+    uint8_t* read_ptr(uint32_t vaddr, int bytes) const {
+        const Entry& e = entries_[index(vaddr)];
+        if (e.tag_r != (vaddr & (PAGE_MASK | (bytes - 1))))
+            return nullptr;
+        return reinterpret_cast<uint8_t*>(e.addend + vaddr);
+    }
+    uint8_t* write_ptr(uint32_t vaddr, int bytes) const {
+        const Entry& e = entries_[index(vaddr)];
+        if (e.tag_w != (vaddr & (PAGE_MASK | (bytes - 1))))
+            return nullptr;
+        return reinterpret_cast<uint8_t*>(e.addend + vaddr);
+    }
+
+    // Cached fetch translation, works for MMIO pages too
+    bool lookup_exec(uint32_t vaddr, uint32_t& paddr) const {
+        const Entry& e = entries_[index(vaddr)];
+        if (e.tag_x != (vaddr & PAGE_MASK))
+            return false;
+        paddr = e.ppage | (vaddr & ~PAGE_MASK);
+        return true;
+    }
+
+    // Record a successful translation of `type` for vaddr -> paddr
+    // host_page is the DMI pointer for paddr's page, nullptr if it isn't RAM
+    // (loads/stores to it then keep taking the slow path)
+    void fill(uint32_t vaddr, uint32_t paddr, uint8_t* host_page, AccessType type);
+
+    // A page just picked up cached code, stores to it have to go the slow way
+    void drop_writes();
+    void flush();
+
+    uint64_t fills = 0;
+    uint64_t flushes = 0;
+
+private:
+    static constexpr uint32_t INVALID = 0xFFF; // no page-aligned tag looks like this
+
+    struct Entry {
+        uint32_t tag_r;
+        uint32_t tag_w;
+        uint32_t tag_x;
+        uint32_t vpage;
+        uint32_t ppage;
+        uintptr_t addend; // host = addend + vaddr
+    };
+
+    static uint32_t index(uint32_t vaddr) { return (vaddr >> PAGE_SHIFT) & (ENTRIES - 1); }
+
+    Entry entries_[ENTRIES];
+};
+
+#endif // GAMINGCPU_VP_SOFT_TLB_H
@@ -0,0 +1,325 @@
+#include "threaded.h"
+#include "rv32m.h"
+#include "rv32b.h"
+#include <atomic>
+
+namespace {
+
+// Advance past op and jump straight into the next handler
+inline const ThreadedOp* next(ThreadedCtx& c, const ThreadedOp* op) {
+    c.s.pc += op->len;
+    ++op;
+    return op->fn(c, op);
+}
+
+// rd is never x0 for ALU ops (those become nops), so write regs[] directly
+inline void wr(ThreadedCtx& c, const ThreadedOp* op, uint32_t v) {
+    c.s.regs[op->rd] = static_cast<int32_t>(v);
+}
+inline uint32_t rs1(ThreadedCtx& c, const ThreadedOp* op) { return static_cast<uint32_t>(c.s.regs[op->rs1]); }
+inline uint32_t rs2(ThreadedCtx& c, const ThreadedOp* op) { return static_cast<uint32_t>(c.s.regs[op->rs2]); }
+
+// Stop here, the ISS takes it from this op (no fast handler, or end of block)
+const ThreadedOp* op_stop(ThreadedCtx&, const ThreadedOp* op) { return op; }
+const ThreadedOp* op_nop(ThreadedCtx& c, const ThreadedOp* op) { return next(c, op); }
+const ThreadedOp* op_fence(ThreadedCtx& c, const ThreadedOp* op) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return next(c, op);
+}
+
+// ALU bodies, shared by the reg-reg and reg-imm templates
+uint32_t f_add(uint32_t a, uint32_t b)  { return a + b; }
+uint32_t f_sub(uint32_t a, uint32_t b)  { return a - b; }
+uint32_t f_sll(uint32_t a, uint32_t b)  { return a << (b & 0x1F); }
+uint32_t f_slt(uint32_t a, uint32_t b)  { return static_cast<int32_t>(a) < static_cast<int32_t>(b); }
+uint32_t f_sltu(uint32_t a, uint32_t b) { return a < b; }
+uint32_t f_xor(uint32_t a, uint32_t b)  { return a ^ b; }
+uint32_t f_srl(uint32_t a, uint32_t b)  { return a >> (b & 0x1F); }
+uint32_t f_sra(uint32_t a, uint32_t b)  { return static_cast<uint32_t>(static_cast<int32_t>(a) >> (b & 0x1F)); }
+uint32_t f_or(uint32_t a, uint32_t b)   { return a | b; }
+uint32_t f_and(uint32_t a, uint32_t b)  { return a & b; }
+
+template <uint32_t (*F)(uint32_t, uint32_t)>
+const ThreadedOp* op_rr(ThreadedCtx& c, const ThreadedOp* op) {
+    wr(c, op, F(rs1(c, op), rs2(c, op)));
+    return next(c, op);
+}
+
+template <uint32_t (*F)(uint32_t, uint32_t)>
+const ThreadedOp* op_ri(ThreadedCtx& c, const ThreadedOp* op) {
+    wr(c, op, F(rs1(c, op), static_cast<uint32_t>(op->imm)));
+    return next(c, op);
+}
+
+const ThreadedOp* op_lui(ThreadedCtx& c, const ThreadedOp* op) {
+    wr(c, op, static_cast<uint32_t>(op->imm));
+    return next(c, op);
+}
+const ThreadedOp* op_auipc(ThreadedCtx& c, const ThreadedOp* op) {
+    wr(c, op, c.s.pc + static_cast<uint32_t>(op->imm));
+    return next(c, op);
+}
+
+// Control flow always ends a block, so these don't chain
+const ThreadedOp* op_jal(ThreadedCtx& c, const ThreadedOp* op) {
+    c.s.set_reg(op->rd, static_cast<int32_t>(c.s.pc + op->len));
+    c.s.pc += static_cast<uint32_t>(op->imm);
+    return op + 1;
+}
+const ThreadedOp* op_jalr(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t target = (rs1(c, op) + static_cast<uint32_t>(op->imm)) & ~1u;
+    c.s.set_reg(op->rd, static_cast<int32_t>(c.s.pc + op->len));
+    c.s.pc = target;
+    return op + 1;
+}
+
+uint32_t f_beq(uint32_t a, uint32_t b)  { return a == b; }
+uint32_t f_bne(uint32_t a, uint32_t b)  { return a != b; }
+uint32_t f_bge(uint32_t a, uint32_t b)  { return !f_slt(a, b); }
+uint32_t f_bgeu(uint32_t a, uint32_t b) { return a >= b; }
+
+template <uint32_t (*F)(uint32_t, uint32_t)>
+const ThreadedOp* op_branch(ThreadedCtx& c, const ThreadedOp* op) {
+    c.s.pc += F(rs1(c, op), rs2(c, op)) ? static_cast<uint32_t>(op->imm) : op->len;
+    return op + 1;
+}
+
+// Loads. Misaligned ones go back to execute() for the trap unless the hart
+// does them in hardware, an MMU fault stops the chain with mem_fault set and
+// rd untouched
+template <int BYTES, typename T>
+const ThreadedOp* op_load(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t addr = rs1(c, op) + static_cast<uint32_t>(op->imm);
+    if ((addr & (BYTES - 1)) && !c.s.misaligned_ok)
+        return op;
+    uint32_t v = c.mem.read(addr, BYTES);
+    if (c.mem_fault)
+        return op;
+    c.s.set_reg(op->rd, static_cast<int32_t>(static_cast<T>(v)));
+    return next(c, op);
+}
+
+template <int BYTES>
+const ThreadedOp* op_store(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t addr = rs1(c, op) + static_cast<uint32_t>(op->imm);
+    if ((addr & (BYTES - 1)) && !c.s.misaligned_ok)
+        return op;
+    uint32_t mask = (BYTES == 4) ? 0xFFFFFFFFu : (1u << (8 * BYTES)) - 1;
+    c.mem.write(addr, rs2(c, op) & mask, BYTES);
+    c.s.lr_sc.clear();
+    if (c.mem_fault)
+        return op;
+    // Self-modifying code: the rest of this block may be stale now
+    if (!c.block_valid) {
+        c.s.pc += op->len;
+        return op + 1;
+    }
+    return next(c, op);
+}
+
+// Fused macro-ops. Counted in c.fused so the ISS can retire the extra insn
+constexpr int K_LUI_ADDI = fused_index(InstrType::FUSED_LUI_ADDI);
+constexpr int K_LUI_MEM = fused_index(InstrType::FUSED_LUI_MEM);
+constexpr int K_SLLI_SRLI = fused_index(InstrType::FUSED_SLLI_SRLI);
+
+const ThreadedOp* op_lui_addi(ThreadedCtx& c, const ThreadedOp* op) {
+    wr(c, op, static_cast<uint32_t>(op->imm));
+    c.fused[K_LUI_ADDI]++;
+    return next(c, op);
+}
+
+// imm = left | right << 8
+const ThreadedOp* op_slli_srli(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t sh = static_cast<uint32_t>(op->imm);
+    wr(c, op, (rs1(c, op) << (sh & 0x1F)) >> ((sh >> 8) & 0x1F));
+    c.fused[K_SLLI_SRLI]++;
+    return next(c, op);
+}
+
+// lui rt + load/store off rt: imm = full address, rd = rt, rs1 = lui's
+// length, rs2 = load dest / store source. Like the plain versions a
+// misaligned address goes back to execute(). If the access faults the lui
+// has still retired, so step pc onto the second half before stopping
+inline uint32_t lui_part(const ThreadedOp* op) {
+    return (static_cast<uint32_t>(op->imm) + 0x800) & ~0xFFFu;
+}
+
+template <int BYTES, typename T>
+const ThreadedOp* op_lui_load(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t addr = static_cast<uint32_t>(op->imm);
+    if ((addr & (BYTES - 1)) && !c.s.misaligned_ok)
+        return op;
+    wr(c, op, lui_part(op));
+    uint32_t v = c.mem.read(addr, BYTES);
+    c.fused[K_LUI_MEM]++;
+    if (c.mem_fault) {
+        c.s.pc += op->rs1;
+        return op;
+    }
+    c.s.set_reg(op->rs2, static_cast<int32_t>(static_cast<T>(v)));
+    return next(c, op);
+}
+
+template <int BYTES>
+const ThreadedOp* op_lui_store(ThreadedCtx& c, const ThreadedOp* op) {
+    uint32_t addr = static_cast<uint32_t>(op->imm);
+    if ((addr & (BYTES - 1)) && !c.s.misaligned_ok)
+        return op;
+    wr(c, op, lui_part(op));
+    uint32_t mask = (BYTES == 4) ? 0xFFFFFFFFu : (1u << (8 * BYTES)) - 1;
+    c.mem.write(addr, rs2(c, op) & mask, BYTES);
+    c.s.lr_sc.clear();
+    c.fused[K_LUI_MEM]++;
+    if (c.mem_fault) {
+        c.s.pc += op->rs1;
+        return op;
+    }
+    if (!c.block_valid) {
+        c.s.pc += op->len;
+        return op + 1;
+    }
+    return next(c, op);
+}
+
+ThreadedFn lui_mem_handler(InstrType t) {
+    switch (t) {
+    case InstrType::LB:     return op_lui_load<1, int8_t>;
+    case InstrType::LH:     return op_lui_load<2, int16_t>;
+    case InstrType::LW:     return op_lui_load<4, int32_t>;
+    case InstrType::LBU:    return op_lui_load<1, uint8_t>;
+    case InstrType::LHU:    return op_lui_load<2, uint16_t>;
+    case InstrType::SB:     return op_lui_store<1>;
+    case InstrType::SH:     return op_lui_store<2>;
+    case InstrType::SW:     return op_lui_store<4>;
+    default:                return op_stop;
+    }
+}
+
+ThreadedFn handler_for(const DecodedInstr& d) {
+    // Nothing to do for ALU ops into x0 (loads still hit memory)
+    bool alu = (d.type >= InstrType::LUI && d.type <= InstrType::AUIPC) ||
+               (d.type >= InstrType::ADDI && d.type <= InstrType::BSETI);
+    if (alu && d.rd == 0)
+        return op_nop;
+
+    switch (d.type) {
+    case InstrType::LUI:    return op_lui;
+    case InstrType::AUIPC:  return op_auipc;
+    case InstrType::JAL:    return op_jal;
+    case InstrType::JALR:   return op_jalr;
+
+    case InstrType::BEQ:    return op_branch<f_beq>;
+    case InstrType::BNE:    return op_branch<f_bne>;
+    case InstrType::BLT:    return op_branch<f_slt>;
+    case InstrType::BGE:    return op_branch<f_bge>;
+    case InstrType::BLTU:   return op_branch<f_sltu>;
+    case InstrType::BGEU:   return op_branch<f_bgeu>;
+
+    case InstrType::LB:     return op_load<1, int8_t>;
+    case InstrType::LH:     return op_load<2, int16_t>;
+    case InstrType::LW:     return op_load<4, int32_t>;
+    case InstrType::LBU:    return op_load<1, uint8_t>;
+    case InstrType::LHU:    return op_load<2, uint16_t>;
+    case InstrType::SB:     return op_store<1>;
+    case InstrType::SH:     return op_store<2>;
+    case InstrType::SW:     return op_store<4>;
+
+    case InstrType::ADDI:   return op_ri<f_add>;
+    case InstrType::SLTI:   return op_ri<f_slt>;
+    case InstrType::SLTIU:  return op_ri<f_sltu>;
+    case InstrType::XORI:   return op_ri<f_xor>;
+    case InstrType::ORI:    return op_ri<f_or>;
+    case InstrType::ANDI:   return op_ri<f_and>;
+    case InstrType::SLLI:   return op_ri<f_sll>;
+    case InstrType::SRLI:   return op_ri<f_srl>;
+    case InstrType::SRAI:   return op_ri<f_sra>;
+
+    case InstrType::ADD:    return op_rr<f_add>;
+    case InstrType::SUB:    return op_rr<f_sub>;
+    case InstrType::SLL:    return op_rr<f_sll>;
+    case InstrType::SLT:    return op_rr<f_slt>;
+    case InstrType::SLTU:   return op_rr<f_sltu>;
+    case InstrType::XOR:    return op_rr<f_xor>;
+    case InstrType::SRL:    return op_rr<f_srl>;
+    case InstrType::SRA:    return op_rr<f_sra>;
+    case InstrType::OR:     return op_rr<f_or>;
+    case InstrType::AND:    return op_rr<f_and>;
+
+    case InstrType::MUL:    return op_rr<rv32m::mul>;
+    case InstrType::MULH:   return op_rr<rv32m::mulh>;
+    case InstrType::MULHSU: return op_rr<rv32m::mulhsu>;
+    case InstrType::MULHU:  return op_rr<rv32m::mulhu>;
+    case InstrType::DIV:    return op_rr<rv32m::div>;
+    case InstrType::DIVU:   return op_rr<rv32m::divu>;
+    case InstrType::REM:    return op_rr<rv32m::rem>;
+    case InstrType::REMU:   return op_rr<rv32m::remu>;
+
+    // Unary ones go through op_ri and ignore the (zero) immediate
+    case InstrType::SH1ADD: return op_rr<rv32b::sh1add>;
+    case InstrType::SH2ADD: return op_rr<rv32b::sh2add>;
+    case InstrType::SH3ADD: return op_rr<rv32b::sh3add>;
+    case InstrType::ANDN:   return op_rr<rv32b::andn>;
+    case InstrType::ORN:    return op_rr<rv32b::orn>;
+    case InstrType::XNOR:   return op_rr<rv32b::xnor>;
+    case InstrType::CLZ:    return op_ri<rv32b::clz>;
+    case InstrType::CTZ:    return op_ri<rv32b::ctz>;
+    case InstrType::CPOP:   return op_ri<rv32b::cpop>;
+    case InstrType::MAX:    return op_rr<rv32b::max>;
+    case InstrType::MAXU:   return op_rr<rv32b::maxu>;
+    case InstrType::MIN:    return op_rr<rv32b::min>;
+    case InstrType::MINU:   return op_rr<rv32b::minu>;
+    case InstrType::SEXT_B: return op_ri<rv32b::sext_b>;
+    case InstrType::SEXT_H: return op_ri<rv32b::sext_h>;
+    case InstrType::ZEXT_H: return op_ri<rv32b::zext_h>;
+    case InstrType::ROL:    return op_rr<rv32b::rol>;
+    case InstrType::ROR:    return op_rr<rv32b::ror>;
+    case InstrType::RORI:   return op_ri<rv32b::ror>;
+    case InstrType::ORC_B:  return op_ri<rv32b::orc_b>;
+    case InstrType::REV8:   return op_ri<rv32b::rev8>;
+    case InstrType::BCLR:   return op_rr<rv32b::bclr>;
+    case InstrType::BCLRI:  return op_ri<rv32b::bclr>;
+    case InstrType::BEXT:   return op_rr<rv32b::bext>;
+    case InstrType::BEXTI:  return op_ri<rv32b::bext>;
+    case InstrType::BINV:   return op_rr<rv32b::binv>;
+    case InstrType::BINVI:  return op_ri<rv32b::binv>;
+    case InstrType::BSET:   return op_rr<rv32b::bset>;
+    case InstrType::BSETI:  return op_ri<rv32b::bset>;
+
+    case InstrType::FENCE:  return op_fence;
+
+    case InstrType::FUSED_LUI_ADDI:  return op_lui_addi;
+    case InstrType::FUSED_SLLI_SRLI: return op_slli_srli;
+    case InstrType::FUSED_LUI_MEM:   return lui_mem_handler(d.op2);
+
+    default:                return op_stop;
+    }
+}
+
+} // anonymous namespace
+
+namespace threaded {
+
+void translate(const std::vector<DecodedInstr>& insns, std::vector<ThreadedOp>& ops) {
+    ops.clear();
+    ops.reserve(insns.size() + 1);
+    for (const DecodedInstr& d : insns) {
+        ThreadedOp op;
+        op.fn = handler_for(d);
+        op.imm = d.imm;
+        op.rd = static_cast<uint8_t>(d.rd);
+        op.rs1 = static_cast<uint8_t>(d.rs1);
+        op.rs2 = static_cast<uint8_t>(d.rs2);
+        op.len = static_cast<uint8_t>(d.instr_len());
+        if (d.type == InstrType::FUSED_SLLI_SRLI) {
+            op.imm = (d.imm & 0x1F) | (d.imm2 & 0x1F) << 8;
+        } else if (d.type == InstrType::FUSED_LUI_MEM) {
+            op.imm = d.imm + d.imm2;
+            op.rs1 = d.len1;
+            op.rs2 = static_cast<uint8_t>(d.op2 >= InstrType::SB ? d.rs2 : d.rd2);
+        }
+        ops.push_back(op);
+    }
+    ops.push_back({op_stop, 0, 0, 0, 0, 0});
+}
+
+} // namespace threaded
@@ -0,0 +1,54 @@
+#ifndef GAMINGCPU_VP_THREADED_H
+#define GAMINGCPU_VP_THREADED_H
+
+#include <cstdint>
+#include <vector>
+#include "decode.h"
+#include "execute.h"
+#include "mem_if.h"
+
+struct ThreadedOp;
+
+// What handlers get to see. mem_fault is the ISS's MMU fault flag, block_valid
+// lets a store stop the chain when it just overwrote the block it's running in
+struct ThreadedCtx {
+    CPUState& s;
+    MemIf& mem;
+    const bool& mem_fault;
+    const bool& block_valid;
+    uint32_t fused[NUM_FUSED] = {}; // fused ops run, each retired one extra insn
+};
+
+// Runs op and tail-calls the next handler. Returns the op it stopped at:
+// everything before it retired, s.pc points at it
+using ThreadedFn = const ThreadedOp* (*)(ThreadedCtx& c, const ThreadedOp* op);
+
+// One pre-resolved instruction, 4 per cache line
+// Operands are pulled out of DecodedInstr so handlers never look at InstrType
+// Fused ops repack theirs, see translate()
+struct ThreadedOp {
+    ThreadedFn fn;
+    int32_t imm;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t len;
+};
+
+namespace threaded {
+
+// One op per instruction plus a trailing stop op
+// Anything without a fast handler (CSR, AMO, system...) stops the chain at
+// that op and the ISS runs it through execute() instead. Same goes for
+// misaligned loads/stores, so traps always come from the reference path
+// (unless CPUState::misaligned_ok, then the handlers do them through MemIf)
+void translate(const std::vector<DecodedInstr>& insns, std::vector<ThreadedOp>& ops);
+
+// Start the chain at ops[0]
+inline const ThreadedOp* run(ThreadedCtx& c, const ThreadedOp* ops) {
+    return ops->fn(c, ops);
+}
+
+} // namespace threaded
+
+#endif // GAMINGCPU_VP_THREADED_H
@@ -45,10 +45,12 @@ void GDBServer::server_thread() {
     int client = accept(server_fd_, nullptr, nullptr);
     if (client >= 0) {
         std::cout << "[GDB] Client connected\n";
+        iss_.attach_debugger(true);
         iss_.halt();
         wait(iss_.halted_event);
         handle_client(client);
         close(client);
+        iss_.attach_debugger(false);
     }
 
     close(server_fd_);
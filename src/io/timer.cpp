@@ -1,4 +1,5 @@
 #include "timer.h"
+#include <algorithm>
 #include <cstring>
 
 Timer::Timer(sc_core::sc_module_name name, sc_core::sc_time tick_period)
@@ -7,21 +8,40 @@ Timer::Timer(sc_core::sc_module_name name, sc_core::sc_time tick_period)
     , tick_period_(tick_period)
 {
     tsock.register_b_transport(this, &Timer::b_transport);
-    SC_THREAD(tick_thread);
+    SC_THREAD(deadline_thread);
 }
 
-void Timer::tick_thread() {
+uint64_t Timer::get_time() const {
+    sc_core::sc_time elapsed = sc_core::sc_time_stamp() - epoch_;
+    return time_base_ + elapsed.value() / tick_period_.value();
+}
+
+void Timer::set_time(uint64_t v) {
+    time_base_ = v;
+    epoch_ = sc_core::sc_time_stamp();
+}
+
+void Timer::deadline_thread() {
     while (true) {
-        wait(tick_period_);
-        time_++;
+        wait(deadline_event_);
         update_irq();
     }
 }
 
 void Timer::update_irq() {
-    bool fire = (ctrl_ & 1) && (time_ >= cmp_);
+    uint64_t now = get_time();
+    bool fire = (ctrl_ & 1) && (now >= cmp_);
     if (on_irq)
         on_irq(fire);
+
+    deadline_event_.cancel();
+    if (fire || !(ctrl_ & 1))
+        return;
+
+    constexpr uint64_t MAX_TICKS = 1ull << 32;
+    uint64_t ticks = std::min(cmp_ - now, MAX_TICKS);
+    uint64_t target = (now - time_base_ + ticks) * tick_period_.value();
+    deadline_event_.notify(epoch_ + sc_core::sc_time::from_value(target) - sc_core::sc_time_stamp());
 }
 
 void Timer::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay) {
@@ -37,12 +57,12 @@ void Timer::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay
 
     switch (addr) {
     case 0x00:
-        if (is_write) { time_ = (time_ & 0xFFFFFFFF00000000ULL) | val; update_irq(); }
-        else val = static_cast<uint32_t>(time_);
+        if (is_write) { set_time((get_time() & 0xFFFFFFFF00000000ULL) | val); update_irq(); }
+        else val = static_cast<uint32_t>(get_time());
         break;
     case 0x04:
-        if (is_write) { time_ = (time_ & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32); update_irq(); }
-        else val = static_cast<uint32_t>(time_ >> 32);
+        if (is_write) { set_time((get_time() & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32)); update_irq(); }
+        else val = static_cast<uint32_t>(get_time() >> 32);
         break;
     case 0x08:
         if (is_write) { cmp_ = (cmp_ & 0xFFFFFFFF00000000ULL) | val; update_irq(); }
@@ -18,19 +18,24 @@ public:
     Timer(sc_core::sc_module_name name, sc_core::sc_time tick_period);
     SC_HAS_PROCESS(Timer);
 
-    uint64_t get_time() const { return time_; }
+    // Event driven like the CLINT: time comes from sc_time_stamp() and only
+    // the compare deadline is scheduled (when enabled)
+    uint64_t get_time() const;
 
 private:
     void b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay);
-    void tick_thread();
+    void deadline_thread();
+    void set_time(uint64_t v);
     void update_irq();
 
     sc_core::sc_time tick_period_;
 
     // 0x00 time_lo  0x04 time_hi  0x08 cmp_lo  0x0C cmp_hi  0x10 ctrl
-    uint64_t time_ = 0;
+    uint64_t time_base_ = 0;
+    sc_core::sc_time epoch_;
     uint64_t cmp_ = 0xFFFFFFFFFFFFFFFFULL;
     uint32_t ctrl_ = 0;
+    sc_core::sc_event deadline_event_;
 };
 
 #endif // GAMINGCPU_VP_TIMER_H
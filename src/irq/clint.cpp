@@ -1,34 +1,64 @@
 #include "clint.h"
+#include <algorithm>
 #include <cstring>
 
 // Register offsets per SiFive CLINT spec (and our spec too)
-// 0x0000  msip
-// 0x4000  mtimecmp lo
+// 0x0000  msip, hart h at 0x0000 + 4h
+// 0x4000  mtimecmp lo, hart h at 0x4000 + 8h
 // 0x4004  mtimecmp hi
 // 0xBFF8  mtime lo
 // 0xBFFC  mtime hi
 
-CLINT::CLINT(sc_core::sc_module_name name, sc_core::sc_time tick_period)
+CLINT::CLINT(sc_core::sc_module_name name, sc_core::sc_time tick_period,
+             unsigned num_harts)
     : sc_module(name)
     , tsock("tsock")
     , tick_period_(tick_period)
+    , mtimecmp_(num_harts, 0xFFFFFFFFFFFFFFFFULL)
+    , msip_(num_harts, 0)
 {
     tsock.register_b_transport(this, &CLINT::b_transport);
-    SC_THREAD(tick_thread);
+    SC_THREAD(deadline_thread);
 }
 
-void CLINT::tick_thread() {
+uint64_t CLINT::get_mtime() const {
+    sc_core::sc_time elapsed = sc_core::sc_time_stamp() - epoch_;
+    return mtime_base_ + elapsed.value() / tick_period_.value();
+}
+
+void CLINT::set_mtime(uint64_t v) {
+    mtime_base_ = v;
+    epoch_ = sc_core::sc_time_stamp();
+}
+
+void CLINT::deadline_thread() {
     while (true) {
-        wait(tick_period_);
-        mtime_++;
+        wait(deadline_event_);
         update_timer_irq();
     }
 }
 
 void CLINT::update_timer_irq() {
-    bool fire = (mtime_ >= mtimecmp_);
-    if (on_timer_irq)
-        on_timer_irq(fire);
+    // Far-off compares (or max = off) get a wakeup at the cap and re-arm from there
+    constexpr uint64_t MAX_TICKS = 1ull << 32;
+    uint64_t now = get_mtime();
+    uint64_t ticks = ~0ull;
+    for (uint32_t h = 0; h < mtimecmp_.size(); h++) {
+        bool fire = (now >= mtimecmp_[h]);
+        if (on_timer_irq)
+            on_timer_irq(h, fire);
+        if (!fire)
+            ticks = std::min(ticks, mtimecmp_[h] - now);
+    }
+
+    deadline_event_.cancel();
+    if (ticks == ~0ull)
+        return; // all firing, nothing to wait for
+
+    ticks = std::min(ticks, MAX_TICKS);
+    uint64_t target = (now - mtime_base_ + ticks) * tick_period_.value();
+    sc_core::sc_time at = epoch_ + sc_core::sc_time::from_value(target);
+    deadline_event_.notify(at - sc_core::sc_time_stamp());
 }
 
 void CLINT::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay) {
@@ -49,54 +79,41 @@ void CLINT::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay
     if (is_write)
         std::memcpy(&val, ptr, 4);
 
-    switch (addr) {
-    case 0x0000: // msip - bit 0 only
+    uint32_t n = num_harts();
+    if (addr < 4 * n) { // msip - bit 0 only
+        uint32_t h = addr / 4;
         if (is_write) {
-            msip_ = val & 1;
+            msip_[h] = val & 1;
             if (on_sw_irq)
-                on_sw_irq(msip_ != 0);
-        } else {
-            val = msip_;
-        }
-        break;
-
-    case 0x4000: // mtimecmp lo
-        if (is_write) {
-            mtimecmp_ = (mtimecmp_ & 0xFFFFFFFF00000000ULL) | val;
-            update_timer_irq();
-        } else {
-            val = static_cast<uint32_t>(mtimecmp_);
-        }
-        break;
-
-    case 0x4004: // mtimecmp hi
-        if (is_write) {
-            mtimecmp_ = (mtimecmp_ & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32);
-            update_timer_irq();
+                on_sw_irq(h, msip_[h] != 0);
         } else {
-            val = static_cast<uint32_t>(mtimecmp_ >> 32);
+            val = msip_[h];
         }
-        break;
-
-    case 0xBFF8: // mtime lo
+    } else if (addr >= 0x4000 && addr < 0x4000 + 8 * n) { // mtimecmp lo/hi
+        uint64_t& cmp = mtimecmp_[(addr - 0x4000) / 8];
+        bool hi = addr & 4;
         if (is_write) {
-            mtime_ = (mtime_ & 0xFFFFFFFF00000000ULL) | val;
+            if (hi)
+                cmp = (cmp & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32);
+            else
+                cmp = (cmp & 0xFFFFFFFF00000000ULL) | val;
             update_timer_irq();
         } else {
-            val = static_cast<uint32_t>(mtime_);
+            val = static_cast<uint32_t>(hi ? cmp >> 32 : cmp);
         }
-        break;
-
-    case 0xBFFC: // mtime hi
+    } else if (addr == 0xBFF8 || addr == 0xBFFC) { // mtime lo/hi
+        bool hi = addr & 4;
+        uint64_t now = get_mtime();
         if (is_write) {
-            mtime_ = (mtime_ & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32);
+            if (hi)
+                set_mtime((now & 0x00000000FFFFFFFFULL) | ((uint64_t)val << 32));
+            else
+                set_mtime((now & 0xFFFFFFFF00000000ULL) | val);
             update_timer_irq();
         } else {
-            val = static_cast<uint32_t>(mtime_ >> 32);
+            val = static_cast<uint32_t>(hi ? now >> 32 : now);
         }
-        break;
-
-    default:
+    } else {
         trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
         return;
     }
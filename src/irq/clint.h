@@ -6,31 +6,42 @@
 #include <tlm_utils/simple_target_socket.h>
 #include <cstdint>
 #include <functional>
+#include <vector>
 
 class CLINT : public sc_core::sc_module
 {
 public:
     tlm_utils::simple_target_socket<CLINT> tsock;
 
-    // Callback to poke mip.MTIP and mip.MSIP on the ISS
-    std::function<void(bool)> on_timer_irq;
-    std::function<void(bool)> on_sw_irq;
+    // Callbacks to poke mip.MTIP and mip.MSIP on a hart's ISS
+    std::function<void(uint32_t hart, bool)> on_timer_irq;
+    std::function<void(uint32_t hart, bool)> on_sw_irq;
 
-    CLINT(sc_core::sc_module_name name, sc_core::sc_time tick_period);
+    // One msip and one mtimecmp per hart, mtime is shared
+    CLINT(sc_core::sc_module_name name, sc_core::sc_time tick_period,
+          unsigned num_harts = 1);
     SC_HAS_PROCESS(CLINT);
 
-    uint64_t get_mtime() const { return mtime_; }
+    unsigned num_harts() const { return static_cast<unsigned>(msip_.size()); }
+
+    // Derived from simulated time, there's no per-tick process. The only
+    // thing ever scheduled is the mtimecmp deadline, so an idle platform
+    // lets the kernel jump straight to it
+    uint64_t get_mtime() const;
 
 private:
     void b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay);
-    void tick_thread();
-    void update_timer_irq();
+    void deadline_thread();
+    void set_mtime(uint64_t v);
+    void update_timer_irq(); // raise/lower every MTIP, re-arm the earliest deadline
 
     sc_core::sc_time tick_period_;
 
-    uint64_t mtime_ = 0;
-    uint64_t mtimecmp_ = 0xFFFFFFFFFFFFFFFFULL; // max so no spurious IRQ at boot
-    uint32_t msip_ = 0;
+    uint64_t mtime_base_ = 0;       // mtime at epoch_
+    sc_core::sc_time epoch_;        // last mtime write
+    std::vector<uint64_t> mtimecmp_; // max at reset so no spurious IRQ at boot
+    std::vector<uint32_t> msip_;
+    sc_core::sc_event deadline_event_;
 };
 
 #endif // GAMINGCPU_VP_CLINT_H
@@ -1,9 +1,11 @@
 #include "plic.h"
 #include <cstring>
 
-PLIC::PLIC(sc_core::sc_module_name name)
+PLIC::PLIC(sc_core::sc_module_name name, unsigned num_contexts)
     : sc_module(name)
     , tsock("tsock")
+    , enabled_(num_contexts, 0)
+    , threshold_(num_contexts, 0)
 {
     tsock.register_b_transport(this, &PLIC::b_transport);
 }
@@ -20,33 +22,31 @@ void PLIC::set_pending(uint32_t source_id, bool pending) {
     evaluate_irq();
 }
 
-void PLIC::evaluate_irq() {
-    // Find highest-priority pending+enabled interrupt that beats the threshold
-    // Source 0 is reserved, skip it. Highest priority wins, lowest ID breaks ties
-    uint32_t best_prio = 0;
-    uint32_t actionable = pending_ & enabled_ & ~claimed_;
-
-    for (uint32_t i = 1; i < NUM_SOURCES; i++) {
-        if ((actionable & (1u << i)) && priority_[i] > threshold_ && priority_[i] > best_prio)
-            best_prio = priority_[i];
-    }
-
-    if (on_external_irq)
-        on_external_irq(best_prio > 0);
-}
-
-uint32_t PLIC::claim_best() {
+// Highest-priority pending+enabled interrupt that beats ctx's threshold.
+// Source 0 is reserved, skip it. Highest priority wins, lowest ID breaks ties
+uint32_t PLIC::best_source(uint32_t ctx) const {
     uint32_t best_id = 0;
     uint32_t best_prio = 0;
-    uint32_t actionable = pending_ & enabled_ & ~claimed_;
+    uint32_t actionable = pending_ & enabled_[ctx] & ~claimed_;
 
     for (uint32_t i = 1; i < NUM_SOURCES; i++) {
-        if ((actionable & (1u << i)) && priority_[i] > threshold_ && priority_[i] > best_prio) {
+        if ((actionable & (1u << i)) && priority_[i] > threshold_[ctx] && priority_[i] > best_prio) {
             best_prio = priority_[i];
             best_id = i;
         }
     }
+    return best_id;
+}
+
+void PLIC::evaluate_irq() {
+    if (!on_external_irq)
+        return;
+    for (uint32_t c = 0; c < num_contexts(); c++)
+        on_external_irq(c, best_source(c) != 0);
+}
 
+uint32_t PLIC::claim_best(uint32_t ctx) {
+    uint32_t best_id = best_source(ctx);
     if (best_id) {
         // Mark as claimed, clear pending
         claimed_ |= (1u << best_id);
@@ -74,6 +74,8 @@ void PLIC::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay)
     if (is_write)
         std::memcpy(&val, ptr, 4);
 
+    uint32_t n = num_contexts();
+
     // Priority registers: 0x000000 + source_id * 4
     if (addr < NUM_SOURCES * 4) {
         uint32_t src = addr / 4;
@@ -96,33 +98,36 @@ void PLIC::b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay)
             val = pending_;
         }
     }
-    // Enable bits: 0x002000
-    else if (addr == 0x2000) {
+    // Enable bits: 0x002000 + 0x80 per context
+    else if (addr >= 0x2000 && addr < 0x2000 + 0x80 * n && !(addr & 0x7F)) {
+        uint32_t c = (addr - 0x2000) / 0x80;
         if (is_write) {
-            enabled_ = val;
+            enabled_[c] = val;
             evaluate_irq();
         } else {
-            val = enabled_;
+            val = enabled_[c];
         }
     }
-    // Threshold: 0x200000
-    else if (addr == 0x200000) {
+    // Threshold: 0x200000 + 0x1000 per context
+    else if (addr >= 0x200000 && addr < 0x200000 + 0x1000 * n && (addr & 0xFFF) == 0) {
+        uint32_t c = (addr - 0x200000) / 0x1000;
         if (is_write) {
-            threshold_ = val & 0x7;
+            threshold_[c] = val & 0x7;
             evaluate_irq();
         } else {
-            val = threshold_;
+            val = threshold_[c];
         }
     }
-    // Claim/Complete: 0x200004
-    else if (addr == 0x200004) {
+    // Claim/Complete: 0x200004 + 0x1000 per context
+    else if (addr >= 0x200000 && addr < 0x200000 + 0x1000 * n && (addr & 0xFFF) == 4) {
+        uint32_t c = (addr - 0x200000) / 0x1000;
         if (is_write) {
             // Complete: release the claimed source
             if (val < NUM_SOURCES)
                 claimed_ &= ~(1u << val);
             evaluate_irq();
         } else {
-            val = claim_best();
+            val = claim_best(c);
         }
     }
     else {
@@ -6,42 +6,46 @@
 #include <tlm_utils/simple_target_socket.h>
 #include <cstdint>
 #include <functional>
+#include <vector>
 #include "platform/platform_config.h"
 
-// SiFive-style PLIC register map (single context for our single hart):
+// SiFive-style PLIC register map (one M-mode context per hart):
 // 0x000000  source 0 priority (reserved, always 0)
 // 0x000004  source 1 priority
 // ...
 // 0x001000  pending bits [31:0] (bit N = source N)
-// 0x002000  enable bits [31:0] for context 0
-// 0x200000  priority threshold for context 0
-// 0x200004  claim/complete for context 0
+// 0x002000  enable bits [31:0] for context 0, context c at 0x2000 + 0x80c
+// 0x200000  priority threshold for context 0, context c at 0x200000 + 0x1000c
+// 0x200004  claim/complete for context 0, context c at 0x200004 + 0x1000c
 
 class PLIC : public sc_core::sc_module
 {
 public:
     tlm_utils::simple_target_socket<PLIC> tsock;
 
-    std::function<void(bool)> on_external_irq;
+    std::function<void(uint32_t ctx, bool)> on_external_irq;
 
-    PLIC(sc_core::sc_module_name name);
+    PLIC(sc_core::sc_module_name name, unsigned num_contexts = 1);
     SC_HAS_PROCESS(PLIC);
 
+    unsigned num_contexts() const { return static_cast<unsigned>(enabled_.size()); }
+
     // Peripherals call this to assert/deassert their interrupt line
     void set_pending(uint32_t source_id, bool pending);
 
 private:
     void b_transport(tlm::tlm_generic_payload& trans, sc_core::sc_time& delay);
     void evaluate_irq();
-    uint32_t claim_best();
+    uint32_t best_source(uint32_t ctx) const;
+    uint32_t claim_best(uint32_t ctx);
 
     static constexpr uint32_t NUM_SOURCES = cfg::IRQ_NUM_SOURCES;
 
     uint32_t priority_[NUM_SOURCES] = {};
     uint32_t pending_ = 0;
-    uint32_t enabled_ = 0;
-    uint32_t threshold_ = 0;
-    uint32_t claimed_ = 0; // sources currently in-service
+    std::vector<uint32_t> enabled_;   // per context
+    std::vector<uint32_t> threshold_; // per context
+    uint32_t claimed_ = 0; // sources currently in-service, by any context
 };
 
 #endif // GAMINGCPU_VP_PLIC_H
@@ -6,21 +6,33 @@
 #include <tlm_utils/simple_initiator_socket.h>
 #include <iostream>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 
 #include "mem/memory.h"
 #include "mem/bootrom.h"
 #include "bus/tlm_bus.h"
 #include "platform/platform_config.h"
 #include "cpu/decode.h"
+#include "cpu/decode_ref.h"
 #include "cpu/rv32_defs.h"
 #include "cpu/csr.h"
 #include "cpu/execute.h"
 #include "cpu/rv32m.h"
+#include "cpu/rv32b.h"
+#include "cpu/rv32f.h"
 #include "cpu/rv32a.h"
 #include "cpu/trap.h"
 #include "cpu/mmu.h"
 #include "cpu/iss.h"
+#include "cpu/hart_pool.h"
+#include "cpu/intercept.h"
+#include "cpu/profiler.h"
+#include "cpu/soft_tlb.h"
 #include "util/elf_loader.h"
+#include "aot/aot_translate.h"
 #include "irq/clint.h"
 #include "irq/plic.h"
 #include "io/uart.h"
@@ -39,6 +51,21 @@
 static int pass_count = 0;
 static int fail_count = 0;
 
+// Flat little-endian memory for plugging into execute()/MMU unit tests
+struct TestMem {
+    std::vector<uint8_t>& bytes;
+    uint32_t read(uint32_t addr, int n) const {
+        uint32_t v = 0;
+        for (int i = 0; i < n; i++)
+            v |= uint32_t(bytes[addr + i]) << (i * 8);
+        return v;
+    }
+    void write(uint32_t addr, uint32_t data, int n) {
+        for (int i = 0; i < n; i++)
+            bytes[addr + i] = (data >> (i * 8)) & 0xFF;
+    }
+};
+
 static void check(bool cond, const char* name) {
     if (cond) {
         std::cout << "[TEST] " << name << "... PASS\n";
@@ -70,6 +97,33 @@ struct TestInitiator : public sc_core::sc_module {
     tlm_utils::simple_initiator_socket<TestInitiator> bus_isock;
 
     ISS* iss_ptr = nullptr;
+    ISS* blk_iss_ptr = nullptr;
+    ISS* jit_ref_ptr = nullptr;
+    ISS* jit_iss_ptr = nullptr;
+    ISS* thr_iss_ptr = nullptr;
+    ISS* pg_iss_ptr = nullptr;
+    ISS* rom_iss_ptr = nullptr;
+    ISS* irq_iss_ptr = nullptr;
+    ISS* fuse_iss_ptr = nullptr;
+    ISS* fuse_thr_ptr = nullptr;
+    ISS* aot_ref_ptr = nullptr;
+    ISS* aot_iss_ptr = nullptr;
+    ISS* aot_cross_ptr = nullptr;
+    ISS* wfi_iss_ptr = nullptr;
+    ISS* poll_iss_ptr = nullptr;
+    ISS* mis_iss_ptr = nullptr;
+    ISS* bit_iss_ptr = nullptr;
+    ISS* bit_thr_ptr = nullptr;
+    ISS* fp_iss_ptr = nullptr;
+    ISS* fp_thr_ptr = nullptr;
+    ISS* icpt_iss_ptr = nullptr;
+    ISS* icpt_ref_ptr = nullptr;
+    ISS* sh_iss_ptr = nullptr;
+    ISS* sh_off_ptr = nullptr;
+    ISS* prof_iss_ptr = nullptr;
+    std::vector<ISS*> smp_harts;
+    HartPool* smp_pool_ptr = nullptr;
+    uint32_t aot_gen_blocks = 0; // 0 = translation/compile failed
     CLINT* clint_ptr = nullptr;
     PLIC* plic_ptr = nullptr;
     UART* uart_ptr = nullptr;
@@ -297,6 +351,80 @@ struct TestInitiator : public sc_core::sc_module {
         }
         check(decode(0x402081B3).type == InstrType::SUB, "SUB type");
 
+        // Zba/Zbb/Zbs, all with rd=x3 rs1=x1 (rs2=x2 where there is one)
+        {
+            struct { uint32_t raw; InstrType type; } bops[] = {
+                {0x2020A1B3, InstrType::SH1ADD}, {0x2020C1B3, InstrType::SH2ADD},
+                {0x2020E1B3, InstrType::SH3ADD}, {0x4020F1B3, InstrType::ANDN},
+                {0x4020E1B3, InstrType::ORN},    {0x4020C1B3, InstrType::XNOR},
+                {0x60009193, InstrType::CLZ},    {0x60109193, InstrType::CTZ},
+                {0x60209193, InstrType::CPOP},   {0x0A20E1B3, InstrType::MAX},
+                {0x0A20F1B3, InstrType::MAXU},   {0x0A20C1B3, InstrType::MIN},
+                {0x0A20D1B3, InstrType::MINU},   {0x60409193, InstrType::SEXT_B},
+                {0x60509193, InstrType::SEXT_H}, {0x0800C1B3, InstrType::ZEXT_H},
+                {0x602091B3, InstrType::ROL},    {0x6020D1B3, InstrType::ROR},
+                {0x6070D193, InstrType::RORI},   {0x2870D193, InstrType::ORC_B},
+                {0x6980D193, InstrType::REV8},   {0x482091B3, InstrType::BCLR},
+                {0x48509193, InstrType::BCLRI},  {0x4820D1B3, InstrType::BEXT},
+                {0x4850D193, InstrType::BEXTI},  {0x682091B3, InstrType::BINV},
+                {0x68509193, InstrType::BINVI},  {0x282091B3, InstrType::BSET},
+                {0x28509193, InstrType::BSETI},
+            };
+            bool ok = true;
+            for (const auto& b : bops) {
+                DecodedInstr d = decode(b.raw);
+                ok = ok && d.type == b.type && d.rd == 3 && d.rs1 == 1;
+            }
+            check(ok, "B extension types and operands");
+            check(decode(0x6070D193).imm == 7 && decode(0x28509193).imm == 5 &&
+                  decode(0x60009193).rs2 == 0, "B extension shamt/bit index in imm");
+            check(decode(0x60309193).type == InstrType::ILLEGAL, "Unassigned Zbb unary op is illegal");
+            check(decode(0x0820C1B3).type == InstrType::ILLEGAL, "zext.h needs rs2=0");
+        }
+
+        // F extension, rd=f3/x3 rs1=1 (rs2=2, rs3=4 where there is one), rm=DYN
+        {
+            struct { uint32_t raw; InstrType type; } fops[] = {
+                {0x0080A187, InstrType::FLW},       {0x2020F1C3, InstrType::FMADD_S},
+                {0x2020F1C7, InstrType::FMSUB_S},   {0x2020F1CB, InstrType::FNMSUB_S},
+                {0x2020F1CF, InstrType::FNMADD_S},  {0x0020F1D3, InstrType::FADD_S},
+                {0x0820F1D3, InstrType::FSUB_S},    {0x1020F1D3, InstrType::FMUL_S},
+                {0x1820F1D3, InstrType::FDIV_S},    {0x5800F1D3, InstrType::FSQRT_S},
+                {0x202081D3, InstrType::FSGNJ_S},   {0x202091D3, InstrType::FSGNJN_S},
+                {0x2020A1D3, InstrType::FSGNJX_S},  {0x282081D3, InstrType::FMIN_S},
+                {0x282091D3, InstrType::FMAX_S},    {0xC000F1D3, InstrType::FCVT_W_S},
+                {0xC010F1D3, InstrType::FCVT_WU_S}, {0xE00081D3, InstrType::FMV_X_W},
+                {0xA020A1D3, InstrType::FEQ_S},     {0xA02091D3, InstrType::FLT_S},
+                {0xA02081D3, InstrType::FLE_S},     {0xE00091D3, InstrType::FCLASS_S},
+                {0xD000F1D3, InstrType::FCVT_S_W},  {0xD010F1D3, InstrType::FCVT_S_WU},
+                {0xF00081D3, InstrType::FMV_W_X},
+            };
+            bool ok = true;
+            for (const auto& f : fops) {
+                DecodedInstr d = decode(f.raw);
+                ok = ok && d.type == f.type && d.rd == 3 && d.rs1 == 1;
+            }
+            check(ok, "F extension types and operands");
+            DecodedInstr fma = decode(0x2020F1C3); // fmadd.s f3, f1, f2, f4
+            check(fma.rs2 == 2 && fma.rs3 == 4 && fma.rm == 7, "FMADD rs3 and rm");
+            DecodedInstr fsw = decode(0x0020A427); // fsw f2, 8(x1)
+            check(fsw.type == InstrType::FSW && fsw.rs2 == 2 && fsw.imm == 8, "FSW operands");
+            check(decode(0x2220F1C3).type == InstrType::ILLEGAL, "FMADD.D (fmt=01) is illegal");
+            check(decode(0x5810F1D3).type == InstrType::ILLEGAL, "fsqrt.s needs rs2=0");
+            check(decode(0x0080B187).type == InstrType::ILLEGAL, "FLD is illegal");
+
+            DecodedInstr c = decode(0x60C0); // c.flw f8, 4(x9)
+            check(c.type == InstrType::FLW && c.compressed && c.rd == 8 && c.rs1 == 9 && c.imm == 4,
+                  "C.FLW expands");
+            c = decode(0xE104); // c.fsw f9, 0(x10)
+            check(c.type == InstrType::FSW && c.rs2 == 9 && c.rs1 == 10 && c.imm == 0, "C.FSW expands");
+            c = decode(0x6032); // c.flwsp f0, 12(sp)
+            check(c.type == InstrType::FLW && c.rd == 0 && c.rs1 == 2 && c.imm == 12,
+                  "C.FLWSP expands, f0 allowed");
+            c = decode(0xE40E); // c.fswsp f3, 8(sp)
+            check(c.type == InstrType::FSW && c.rs2 == 3 && c.rs1 == 2 && c.imm == 8, "C.FSWSP expands");
+        }
+
         // Branch
         {
             DecodedInstr d = decode(0x00208463);
@@ -631,6 +759,37 @@ struct TestInitiator : public sc_core::sc_module {
             check(d.type == InstrType::ADD && d.rd == 1 && d.rs1 == 1 && d.rs2 == 2,
                   "C.ADD x1,x2");
         }
+
+        // The tables against the switch decoder they're built from
+        {
+            auto same = [](const DecodedInstr& a, const DecodedInstr& b) {
+                return a.type == b.type && a.rd == b.rd && a.rs1 == b.rs1 && a.rs2 == b.rs2 &&
+                       a.imm == b.imm && a.csr == b.csr && a.rs3 == b.rs3 && a.rm == b.rm &&
+                       a.raw == b.raw && a.compressed == b.compressed;
+            };
+            bool rvc_ok = true;
+            for (uint32_t ci = 0; ci < (1u << 16); ci++) {
+                if ((ci & 0x3) != 0x3)
+                    rvc_ok &= same(decode(ci), decode_ref::decode(ci));
+            }
+            check(rvc_ok, "RVC table matches expand + decode for all 16-bit encodings");
+
+            // Every opcode/funct3/funct7 key, the other bits random
+            uint32_t x = 0x12345678;
+            bool key_ok = true;
+            for (uint32_t key = 0; key < (1u << 15); key++) {
+                for (int k = 0; k < 4; k++) {
+                    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                    uint32_t w = (x & 0x01F00F80) | (key & 0x7F) << 25 | ((key >> 7) & 0x7) << 12 |
+                                 (key >> 10) << 2 | 0x3;
+                    key_ok &= same(decode(w), decode_ref::decode(w));
+                }
+            }
+            check(key_ok, "Decode tables match the switch decoder on every type key");
+            check(decode(0x60009093).type == InstrType::CLZ && decode(0x6980D093).type == InstrType::REV8 &&
+                  decode(0x30200073).type == InstrType::MRET && decode(0xC0101553).type == InstrType::FCVT_WU_S,
+                  "Decode falls back to the switch where rs2/imm pick the type");
+        }
     }
 
     void step5_csr() {
@@ -639,15 +798,21 @@ struct TestInitiator : public sc_core::sc_module {
 
         CSRFile csr;
 
-        // misa should be initialized to RV32IMACSU
+        // misa should be initialized to RV32IMAFBCSU
         uint32_t val = 0;
-        check(csr.read(CSR_MISA, PRV_M, val) && val == MISA_VALUE, "misa = RV32IMACSU");
+        check(csr.read(CSR_MISA, PRV_M, val) && val == MISA_VALUE, "misa = RV32IMAFBCSU");
+        check(val & MISA_B, "misa advertises B (Zba/Zbb/Zbs)");
+        check(val & MISA_F, "misa advertises F");
 
         // Read-only info CSRs
         csr.read(CSR_MVENDORID, PRV_M, val);
         check(val == 0, "mvendorid = 0");
         csr.read(CSR_MHARTID, PRV_M, val);
         check(val == 0, "mhartid = 0");
+        csr.hartid = 3;
+        check(csr.read(CSR_MHARTID, PRV_M, val) && val == 3, "mhartid reads the hart's id");
+        check(!csr.write(CSR_MHARTID, PRV_M, 0) && csr.hartid == 3, "mhartid is read-only");
+        csr.hartid = 0;
 
         // Write/read mstatus
         csr.write(CSR_MSTATUS, PRV_M, MSTATUS_MIE | MSTATUS_MPIE);
@@ -703,6 +868,28 @@ struct TestInitiator : public sc_core::sc_module {
         check((val & (1 << 1)) != 0, "sstatus.SIE reflects mstatus");
         check((val & (1 << 3)) == 0, "sstatus doesn't expose MIE");
 
+        // fcsr and friends only exist while mstatus.FS != Off
+        {
+            CSRFile fc;
+            uint32_t v = 0;
+            check(!fc.read(CSR_FCSR, PRV_U, v) && !fc.write(CSR_FFLAGS, PRV_M, 1),
+                  "fcsr illegal while FS is Off");
+            fc.write(CSR_MSTATUS, PRV_M, FS_INITIAL << MSTATUS_FS_SHIFT);
+            check(fc.write(CSR_FCSR, PRV_U, 0xFF) && fc.frm == 7 && fc.fflags == 0x1F,
+                  "fcsr write splits into frm/fflags");
+            check(fc.read(CSR_FRM, PRV_U, v) && v == 7 && fc.read(CSR_FCSR, PRV_U, v) && v == 0xFF,
+                  "frm/fcsr read back");
+            fc.read(CSR_MSTATUS, PRV_M, v);
+            check(((v & MSTATUS_FS_MASK) >> MSTATUS_FS_SHIFT) == FS_DIRTY && (v & MSTATUS_SD),
+                  "fcsr write marks FS dirty, SD set");
+            fc.read(CSR_SSTATUS, PRV_S, v);
+            check((v & MSTATUS_FS_MASK) && (v & MSTATUS_SD), "sstatus exposes FS and SD");
+            fc.write(CSR_MSTATUS, PRV_M, (FS_CLEAN << MSTATUS_FS_SHIFT) | MSTATUS_SD);
+            fc.read(CSR_MSTATUS, PRV_M, v);
+            check(((v & MSTATUS_FS_MASK) >> MSTATUS_FS_SHIFT) == FS_CLEAN && !(v & MSTATUS_SD),
+                  "SD is read-only, follows FS");
+        }
+
         // Privilege violation: S-mode can't read M-mode CSR
         check(!csr.read(CSR_MSTATUS, PRV_S, val), "S-mode can't read mstatus");
         check(!csr.read(CSR_MTVEC, PRV_S, val), "S-mode can't read mtvec");
@@ -710,14 +897,57 @@ struct TestInitiator : public sc_core::sc_module {
         // Read-only CSR write rejected
         check(!csr.write(CSR_MVENDORID, PRV_M, 42), "can't write mvendorid");
 
-        // mcycle / minstret
-        csr.inc_mcycle();
-        csr.inc_mcycle();
-        csr.inc_minstret();
+        // Unimplemented addresses are illegal at every privilege, also next to real ones
+        check(!csr.read(0x7C0, PRV_M, val) && !csr.write(0x307, PRV_M, 0) &&
+                  !csr.read(0xB03, PRV_M, val) && !csr.read(0xFFF, PRV_M, val),
+              "Unimplemented CSRs are illegal");
+
+        // sstatus/sie writes only reach the S-visible bits underneath
+        {
+            CSRFile sc;
+            sc.write(CSR_MSTATUS, PRV_M, MSTATUS_MIE | (3u << 11));
+            sc.write(CSR_MIE, PRV_M, MIP_MTIP);
+            sc.write(CSR_SSTATUS, PRV_S, 0xFFFFFFFF);
+            sc.write(CSR_SIE, PRV_S, 0xFFFFFFFF);
+            check((sc.mstatus & MSTATUS_MIE) && ((sc.mstatus >> 11) & 3) == 3 &&
+                      (sc.mstatus & MSTATUS_SIE) && (sc.mie & MIP_MTIP) && (sc.mie & MIP_STIP) &&
+                      !(sc.mie & MIP_MSIP),
+                  "sstatus/sie writes keep M-only bits");
+            uint32_t v = 0;
+            check(sc.read(CSR_SIE, PRV_S, v) && v == (1u << 1 | 1u << 5 | 1u << 9),
+                  "sie reads only the S bits of mie");
+        }
+
+        // mcycle / minstret, derived from the bound retired count
+        uint64_t retired = 0;
+        csr.read(CSR_MCYCLE, PRV_M, val);
+        check(val == 0, "unbound mcycle reads 0");
+        csr.bind_retired(&retired);
+        retired = 2;
         csr.read(CSR_MCYCLE, PRV_M, val);
-        check(val == 2, "mcycle incremented to 2");
+        check(val == 2, "mcycle follows retired count");
         csr.read(CSR_MINSTRET, PRV_M, val);
-        check(val == 1, "minstret incremented to 1");
+        check(val == 2, "minstret follows retired count");
+        csr.write(CSR_MINSTRET, PRV_M, 100);
+        retired += 5;
+        csr.read(CSR_MINSTRET, PRV_M, val);
+        check(val == 105, "minstret write becomes an offset");
+        csr.read(CSR_MCYCLE, PRV_M, val);
+        check(val == 7, "mcycle unaffected by minstret write");
+        csr.write(CSR_MCYCLEH, PRV_M, 1);
+        csr.read(CSR_MCYCLEH, PRV_M, val);
+        check(val == 1, "mcycleh write sticks");
+        csr.read(CSR_MCYCLE, PRV_M, val);
+        check(val == 7, "mcycleh write keeps low half");
+        csr.read(CSR_TIME, PRV_U, val);
+        check(val == 7, "time without mtime source falls back to mcycle");
+        csr.read_mtime = []() { return 0x500000123ull; };
+        csr.read(CSR_TIME, PRV_U, val);
+        check(val == 0x123, "time reads mtime");
+        csr.read(CSR_TIMEH, PRV_U, val);
+        check(val == 5, "timeh reads mtime high");
+        csr.read_mtime = nullptr;
+        csr.bind_retired(nullptr);
 
         // satp callback
         bool flushed = false;
@@ -752,6 +982,92 @@ struct TestInitiator : public sc_core::sc_module {
         check(rv32m::remu(43, 7) == 1, "REMU 43%7=1");
         check(rv32m::remu(43, 0) == 43, "REMU by zero=dividend");
 
+        // --- B extension helpers ---
+        check(rv32b::sh3add(3, 1) == 25, "SH3ADD 3<<3+1");
+        check(rv32b::andn(0xFF, 0x0F) == 0xF0 && rv32b::orn(0, 0xFFFFFFF0) == 0xF &&
+              rv32b::xnor(0xF0F0F0F0, 0xFF00FF00) == 0xF00FF00F, "ANDN/ORN/XNOR");
+        check(rv32b::clz(1, 0) == 31 && rv32b::clz(0, 0) == 32, "CLZ incl. zero");
+        check(rv32b::ctz(0x80, 0) == 7 && rv32b::ctz(0, 0) == 32, "CTZ incl. zero");
+        check(rv32b::cpop(0xF0F0F0F1, 0) == 17, "CPOP");
+        check(rv32b::max(0xFFFFFFFF, 1) == 1 && rv32b::maxu(0xFFFFFFFF, 1) == 0xFFFFFFFF &&
+              rv32b::min(0xFFFFFFFF, 1) == 0xFFFFFFFF && rv32b::minu(0xFFFFFFFF, 1) == 1,
+              "MIN/MAX signed vs unsigned");
+        check(rv32b::sext_b(0x80, 0) == 0xFFFFFF80 && rv32b::sext_h(0x8000, 0) == 0xFFFF8000 &&
+              rv32b::zext_h(0xFFFF8000, 0) == 0x8000, "SEXT.B/SEXT.H/ZEXT.H");
+        check(rv32b::rol(0x80000001, 1) == 3 && rv32b::ror(3, 1) == 0x80000001 &&
+              rv32b::ror(0x1234, 0) == 0x1234, "ROL/ROR incl. zero shift");
+        check(rv32b::orc_b(0x00801000, 0) == 0x00FFFF00, "ORC.B");
+        check(rv32b::rev8(0x11223344, 0) == 0x44332211, "REV8");
+        check(rv32b::bset(0, 31) == 0x80000000 && rv32b::bclr(0xFF, 35) == 0xF7 &&
+              rv32b::binv(1, 0) == 0 && rv32b::bext(0x20, 5) == 1, "BSET/BCLR/BINV/BEXT (index mod 32)");
+
+        // --- F extension helpers (binary32 bits) ---
+        {
+            const uint32_t F_ONE = 0x3F800000, F_THREE = 0x40400000, F_PINF = 0x7F800000;
+            const uint32_t F_SNAN = 0x7F800001, F_QNAN = 0x7FC12345, F_NZERO = 0x80000000;
+            uint32_t fl = 0;
+            check(rv32f::fadd(F_ONE, F_ONE, RM_RNE, fl) == 0x40000000 && fl == 0, "FADD 1+1=2 exact");
+            fl = 0;
+            check(rv32f::fdiv(F_ONE, F_THREE, RM_RNE, fl) == 0x3EAAAAAB && fl == FFLAG_NX, "FDIV 1/3 RNE, NX");
+            fl = 0;
+            check(rv32f::fdiv(F_ONE, F_THREE, RM_RTZ, fl) == 0x3EAAAAAA && rv32f::fdiv(F_ONE, F_THREE, RM_RDN, fl) == 0x3EAAAAAA &&
+                  rv32f::fdiv(F_ONE, F_THREE, RM_RUP, fl) == 0x3EAAAAAB, "FDIV 1/3 honours RTZ/RDN/RUP");
+            fl = 0;
+            check(rv32f::fdiv(F_ONE, 0, RM_RNE, fl) == F_PINF && fl == FFLAG_DZ, "FDIV by zero = inf, DZ");
+            fl = 0;
+            check(rv32f::fsub(F_PINF, F_PINF, RM_RNE, fl) == rv32f::CANONICAL_NAN && fl == FFLAG_NV,
+                  "inf-inf = canonical NaN, NV");
+            fl = 0;
+            check(rv32f::fadd(F_QNAN, F_ONE, RM_RNE, fl) == rv32f::CANONICAL_NAN && fl == 0,
+                  "qNaN input gives canonical NaN, no flags");
+            fl = 0;
+            check(rv32f::fmul(0x7F7FFFFF, 0x40000000, RM_RNE, fl) == F_PINF && (fl & FFLAG_OF),
+                  "FMUL overflow, OF");
+            fl = 0;
+            check(rv32f::fmul(0x7F7FFFFF, 0x40000000, RM_RTZ, fl) == 0x7F7FFFFF, "FMUL overflow RTZ = max finite");
+            fl = 0;
+            check(rv32f::fsqrt(0xBF800000, RM_RNE, fl) == rv32f::CANONICAL_NAN && fl == FFLAG_NV, "FSQRT(-1) NV");
+            fl = 0;
+            // (1+2^-23)^2 - (1+2^-22) = 2^-46, a rounded product would cancel to 0
+            check(rv32f::fmadd(0x3F800001, 0x3F800001, 0xBF800002, RM_RNE, fl) == 0x28800000,
+                  "FMADD single rounding");
+            check(rv32f::fsgnj(F_ONE, F_NZERO) == 0xBF800000 && rv32f::fsgnjn(F_ONE, F_NZERO) == F_ONE &&
+                  rv32f::fsgnjx(0xBF800000, F_NZERO) == F_ONE, "FSGNJ/FSGNJN/FSGNJX");
+            fl = 0;
+            check(rv32f::fmin(0, F_NZERO, fl) == F_NZERO && rv32f::fmax(F_NZERO, 0, fl) == 0 && fl == 0,
+                  "FMIN/FMAX order -0 below +0");
+            check(rv32f::fmin(F_QNAN, F_ONE, fl) == F_ONE && fl == 0, "FMIN with one qNaN returns the other");
+            check(rv32f::fmax(F_SNAN, F_SNAN, fl) == rv32f::CANONICAL_NAN && fl == FFLAG_NV,
+                  "FMAX of two NaNs = canonical NaN, sNaN raises NV");
+            fl = 0;
+            check(rv32f::fcvt_w_s(0x40300000, RM_RNE, fl) == 3 && rv32f::fcvt_w_s(0x40300000, RM_RUP, fl) == 3 &&
+                  rv32f::fcvt_w_s(0xC0300000, RM_RDN, fl) == uint32_t(-3) && fl == FFLAG_NX,
+                  "FCVT.W.S rounding modes (2.75, -2.75)");
+            fl = 0;
+            check(rv32f::fcvt_w_s(0x3FC00000, RM_RMM, fl) == 2 && rv32f::fcvt_w_s(0x40200000, RM_RMM, fl) == 3 &&
+                  rv32f::fcvt_w_s(0x40200000, RM_RNE, fl) == 2, "FCVT.W.S RMM ties away, RNE ties even");
+            fl = 0;
+            check(rv32f::fcvt_w_s(0x4F000000, RM_RTZ, fl) == 0x7FFFFFFF && fl == FFLAG_NV &&
+                  rv32f::fcvt_w_s(F_QNAN, RM_RTZ, fl) == 0x7FFFFFFF, "FCVT.W.S saturates, NaN = max");
+            fl = 0;
+            check(rv32f::fcvt_wu_s(0xBF800000, RM_RTZ, fl) == 0 && fl == FFLAG_NV, "FCVT.WU.S negative = 0, NV");
+            fl = 0;
+            check(rv32f::fcvt_wu_s(0xBF000000, RM_RTZ, fl) == 0 && fl == FFLAG_NX, "FCVT.WU.S -0.5 RTZ = 0, NX only");
+            fl = 0;
+            check(rv32f::fcvt_s_wu(0xFFFFFFFF, RM_RNE, fl) == 0x4F800000 && fl == FFLAG_NX &&
+                  rv32f::fcvt_s_wu(0xFFFFFFFF, RM_RTZ, fl) == 0x4F7FFFFF, "FCVT.S.WU rounds");
+            fl = 0;
+            check(rv32f::feq(F_QNAN, F_ONE, fl) == 0 && fl == 0 && rv32f::feq(F_SNAN, F_ONE, fl) == 0 && fl == FFLAG_NV,
+                  "FEQ quiet except for sNaN");
+            fl = 0;
+            check(rv32f::flt(F_QNAN, F_ONE, fl) == 0 && fl == FFLAG_NV, "FLT signals on qNaN");
+            fl = 0;
+            check(rv32f::fle(F_NZERO, 0, fl) == 1 && rv32f::flt(F_NZERO, 0, fl) == 0 && fl == 0, "FLE/FLT -0 == +0");
+            check(rv32f::fclass(0xFF800000) == 1 && rv32f::fclass(F_NZERO) == 8 && rv32f::fclass(1) == 32 &&
+                  rv32f::fclass(F_ONE) == 64 && rv32f::fclass(F_SNAN) == 256 && rv32f::fclass(F_QNAN) == 512,
+                  "FCLASS");
+        }
+
         // --- 6b: RV32A standalone AMO helpers ---
         check(rv32a::amo_swap(10, 20) == 20, "AMO swap");
         check(rv32a::amo_add(10, 20) == 30, "AMO add");
@@ -762,33 +1078,29 @@ struct TestInitiator : public sc_core::sc_module {
         check(rv32a::amo_max(5, uint32_t(-3)) == 5, "AMO max signed");
         check(rv32a::amo_minu(5, uint32_t(-3)) == 5, "AMO minu unsigned");
         check(rv32a::amo_maxu(5, uint32_t(-3)) == uint32_t(-3), "AMO maxu unsigned");
+        {
+            uint32_t w = 10;
+            check(rv32a::atomic_add(&w, 20) == 10 && w == 30, "AMO host add in place");
+            check(rv32a::atomic_rmw<rv32a::amo_min>(&w, uint32_t(-3)) == 30 && w == uint32_t(-3),
+                  "AMO host min via CAS loop");
+            check(rv32a::atomic_sc(&w, uint32_t(-3), 7) && w == 7, "AMO host SC succeeds on LR value");
+            check(!rv32a::atomic_sc(&w, 8, 9) && w == 7, "AMO host SC fails once the word changed");
+        }
 
         // --- 6c: Execute engine ---
         // Set up a small test memory (4KB)
         std::vector<uint8_t> tmem(4096, 0);
-        auto mem_read = [&](uint32_t addr, int bytes) -> uint32_t {
-            uint32_t v = 0;
-            for (int i = 0; i < bytes; i++)
-                v |= uint32_t(tmem[addr + i]) << (i * 8);
-            return v;
-        };
-        auto mem_write = [&](uint32_t addr, uint32_t data, int bytes) {
-            for (int i = 0; i < bytes; i++)
-                tmem[addr + i] = (data >> (i * 8)) & 0xFF;
-        };
+        TestMem tm{tmem};
+        auto mem_read = [&](uint32_t addr, int bytes) { return tm.read(addr, bytes); };
+        auto mem_write = [&](uint32_t addr, uint32_t data, int bytes) { tm.write(addr, data, bytes); };
 
-        auto make_cpu = [&]() -> CPUState {
-            CPUState s;
-            s.mem.read = mem_read;
-            s.mem.write = mem_write;
-            return s;
-        };
+        auto make_cpu = []() { return CPUState{}; };
 
         // ALU: ADDI x1, x0, 42
         {
             CPUState s = make_cpu();
             DecodedInstr d = decode(0x02A00093); // addi x1, x0, 42
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(!r.exception && s.get_reg(1) == 42, "exec ADDI x1=42");
         }
 
@@ -798,7 +1110,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 10;
             s.regs[2] = 20;
             DecodedInstr d = decode(0x002081B3); // add x3, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == 30, "exec ADD 10+20=30");
         }
 
@@ -808,7 +1120,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 50;
             s.regs[2] = 8;
             DecodedInstr d = decode(0x402081B3); // sub x3, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == 42, "exec SUB 50-8=42");
         }
 
@@ -816,7 +1128,7 @@ struct TestInitiator : public sc_core::sc_module {
         {
             CPUState s = make_cpu();
             DecodedInstr d = decode(0x123450B7); // lui x1, 0x12345
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(1) == 0x12345000, "exec LUI x1=0x12345000");
         }
 
@@ -826,7 +1138,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.pc = 0x100;
             DecodedInstr d = decode(0x000010B7 | (OP_AUIPC & 0x7F)); // auipc x1, 1
             d = decode(0x00001097); // auipc x1, 1
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(1) == 0x1100, "exec AUIPC pc+0x1000");
         }
 
@@ -838,11 +1150,11 @@ struct TestInitiator : public sc_core::sc_module {
             DecodedInstr d;
 
             d = decode(0x0020A1B3); // slt x3, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == 1, "exec SLT -5<3=1");
 
             d = decode(0x0020B1B3); // sltu x3, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == 0, "exec SLTU 0xFFFFFFFB<3=0");
         }
 
@@ -859,14 +1171,14 @@ struct TestInitiator : public sc_core::sc_module {
             // 000000000100_00001_101_00010_0010011
             // 0x0040D113
             d = decode(0x0040D113);
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(2) == 0x08000000, "exec SRLI >>4");
 
             // SRAI x3, x1, 4: funct7[5]=1 -> imm=0x404
             // 010000000100_00001_101_00011_0010011
             // 0x4040D193
             d = decode(0x4040D193);
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == static_cast<int32_t>(0xF8000000u), "exec SRAI >>4 sign-ext");
         }
 
@@ -877,12 +1189,12 @@ struct TestInitiator : public sc_core::sc_module {
             // Store 0xDEADBEEF at [0x100]
             s.regs[2] = static_cast<int32_t>(0xDEADBEEF);
             DecodedInstr d = decode(0x0020A023); // sw x2, 0(x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(mem_read(0x100, 4) == 0xDEADBEEF, "exec SW stores to mem");
 
             // Load it back into x3
             d = decode(0x0000A183); // lw x3, 0(x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(3) == 0xDEADBEEF, "exec LW loads from mem");
         }
 
@@ -893,11 +1205,11 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 0x200;
 
             DecodedInstr d = decode(0x00008183); // lb x3, 0(x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == -1, "exec LB sign-extends 0xFF=-1");
 
             d = decode(0x0000C183); // lbu x3, 0(x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(3) == 255, "exec LBU zero-extends 0xFF=255");
         }
 
@@ -906,10 +1218,59 @@ struct TestInitiator : public sc_core::sc_module {
             CPUState s = make_cpu();
             s.regs[1] = 0x101;
             DecodedInstr d = decode(0x0000A183); // lw x3, 0(x1)
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception && r.cause == CAUSE_MISALIGNED_LOAD, "exec LW misaligned exception");
         }
 
+        // Same with misaligned accesses done in hardware. LR still traps
+        {
+            CPUState s = make_cpu();
+            s.misaligned_ok = true;
+            for (int k = 0; k < 8; k++)
+                tmem[0x100 + k] = static_cast<uint8_t>(0x11 * (k + 1));
+            s.regs[1] = 0x101;
+            ExecResult r = execute(s, decode(0x0000A183), tm); // lw x3, 0(x1)
+            check(!r.exception && s.get_regu(3) == 0x55443322, "exec LW misaligned in hardware");
+
+            r = execute(s, decode(0x00309123), tm); // sh x3, 2(x1)
+            check(!r.exception && tm.read(0x103, 2) == 0x3322, "exec SH misaligned in hardware");
+
+            r = execute(s, decode(0x1000A1AF), tm); // lr.w x3, (x1)
+            check(r.exception && r.cause == CAUSE_MISALIGNED_LOAD, "exec LR.W misaligned still traps");
+        }
+
+        // F instructions: FS gating, frm, fflags accrual
+        {
+            CPUState s = make_cpu();
+            s.fregs[1] = 0x3F800000; // 1.0
+            s.fregs[2] = 0x40400000; // 3.0
+            ExecResult r = execute(s, decode(0x0020F1D3), tm); // fadd.s f3, f1, f2
+            check(r.exception && r.cause == CAUSE_ILLEGAL_INSTR, "exec FADD.S illegal while FS is Off");
+            r = execute(s, decode(0x0000A187), tm); // flw f3, 0(x1)
+            check(r.exception && r.cause == CAUSE_ILLEGAL_INSTR, "exec FLW illegal while FS is Off");
+
+            s.csr.write(CSR_MSTATUS, PRV_M, FS_INITIAL << MSTATUS_FS_SHIFT);
+            s.csr.frm = RM_RTZ;
+            r = execute(s, decode(0x1820F1D3), tm); // fdiv.s f3, f1, f2 (dyn)
+            check(!r.exception && s.fregs[3] == 0x3EAAAAAA && s.csr.fflags == FFLAG_NX,
+                  "exec FDIV.S uses frm, accrues NX");
+            check(((s.csr.mstatus & MSTATUS_FS_MASK) >> MSTATUS_FS_SHIFT) == FS_DIRTY, "exec FP write dirties FS");
+            s.csr.frm = 5;
+            r = execute(s, decode(0x1820F1D3), tm);
+            check(r.exception && r.cause == CAUSE_ILLEGAL_INSTR, "exec DYN with reserved frm is illegal");
+            r = execute(s, decode(0x202081D3), tm); // fsgnj.s ignores frm
+            check(!r.exception, "exec FSGNJ.S doesn't look at frm");
+
+            s.regs[1] = 0x100;
+            s.fregs[5] = 0xC0490FDB;
+            execute(s, decode(0x0050A427), tm); // fsw f5, 8(x1)
+            r = execute(s, decode(0x0080A307), tm); // flw f6, 8(x1)
+            check(!r.exception && s.fregs[6] == 0xC0490FDB && tm.read(0x108, 4) == 0xC0490FDB,
+                  "exec FSW/FLW move raw bits");
+            r = execute(s, decode(0x0050A4A7), tm); // fsw f5, 9(x1)
+            check(r.exception && r.cause == CAUSE_MISALIGNED_STORE, "exec FSW misaligned traps");
+        }
+
         // BEQ taken / not taken
         {
             CPUState s = make_cpu();
@@ -917,12 +1278,12 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 42;
             s.regs[2] = 42;
             DecodedInstr d = decode(0x00208463); // beq x1, x2, +8
-            execute(s, d);
+            execute(s, d, tm);
             check(s.next_pc == 0x1008, "exec BEQ taken");
 
             s.regs[2] = 99;
             s.pc = 0x1000;
-            execute(s, d);
+            execute(s, d, tm);
             check(s.next_pc == 0x1004, "exec BEQ not taken");
         }
 
@@ -931,7 +1292,7 @@ struct TestInitiator : public sc_core::sc_module {
             CPUState s = make_cpu();
             s.pc = 0x2000;
             DecodedInstr d = decode(0x008000EF); // jal x1, +8
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(1) == 0x2004, "exec JAL link=pc+4");
             check(s.next_pc == 0x2008, "exec JAL target=pc+8");
         }
@@ -942,7 +1303,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.pc = 0x3000;
             s.regs[5] = 0x4000;
             DecodedInstr d = decode(0x000280E7); // jalr x1, 0(x5)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(1) == 0x3004, "exec JALR link=pc+4");
             check(s.next_pc == 0x4000, "exec JALR target=x5");
         }
@@ -951,7 +1312,7 @@ struct TestInitiator : public sc_core::sc_module {
         {
             CPUState s = make_cpu();
             DecodedInstr d = decode(0x02A00013); // addi x0, x0, 42
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(0) == 0, "exec write to x0 ignored");
         }
 
@@ -961,7 +1322,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 6;
             s.regs[2] = 7;
             DecodedInstr d = decode(0x022080B3); // mul x1, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(1) == 42, "exec MUL 6*7=42");
         }
 
@@ -971,7 +1332,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 42;
             s.regs[2] = 0;
             DecodedInstr d = decode(0x0220C1B3); // div x3, x1, x2
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(3) == 0xFFFFFFFF, "exec DIV by zero=-1");
         }
 
@@ -983,12 +1344,12 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[2] = 0xBBBBBBBB;
 
             DecodedInstr d_lr = decode(0x1000A52F); // lr.w x10, (x1)
-            execute(s, d_lr);
+            execute(s, d_lr, tm);
             check(s.get_regu(10) == 0xAAAAAAAA, "exec LR.W loads value");
             check(s.lr_sc.valid, "exec LR.W sets reservation");
 
             DecodedInstr d_sc = decode(0x1820A5AF); // sc.w x11, x2, (x1)
-            execute(s, d_sc);
+            execute(s, d_sc, tm);
             check(s.get_reg(11) == 0, "exec SC.W success=0");
             check(mem_read(0x300, 4) == 0xBBBBBBBB, "exec SC.W wrote value");
         }
@@ -1001,7 +1362,7 @@ struct TestInitiator : public sc_core::sc_module {
             mem_write(0x300, 0x11111111, 4);
 
             DecodedInstr d_sc = decode(0x1820A5AF); // sc.w x11, x2, (x1)
-            execute(s, d_sc);
+            execute(s, d_sc, tm);
             check(s.get_reg(11) == 1, "exec SC.W failure=1");
             check(mem_read(0x300, 4) == 0x11111111, "exec SC.W didn't write");
         }
@@ -1013,7 +1374,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 0x400;
             s.regs[2] = 200;
             DecodedInstr d = decode(0x0820A52F); // amoswap.w x10, x2, (x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(10) == 100, "exec AMOSWAP old=100");
             check(mem_read(0x400, 4) == 200, "exec AMOSWAP new=200");
         }
@@ -1025,7 +1386,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.regs[1] = 0x400;
             s.regs[2] = 12;
             DecodedInstr d = decode(0x0020A52F); // amoadd.w x10, x2, (x1)
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_reg(10) == 30, "exec AMOADD old=30");
             check(mem_read(0x400, 4) == 42, "exec AMOADD new=42");
         }
@@ -1039,7 +1400,7 @@ struct TestInitiator : public sc_core::sc_module {
             // 0011_0000_0101_00001_001_00010_1110011
             // 0x30509173
             DecodedInstr d = decode(0x30509173);
-            execute(s, d);
+            execute(s, d, tm);
             uint32_t val;
             s.csr.read(CSR_MTVEC, PRV_M, val);
             check(val == 0x80000100, "exec CSRRW writes mtvec");
@@ -1053,7 +1414,7 @@ struct TestInitiator : public sc_core::sc_module {
             // 0011_0100_0000_00000_010_00001_1110011
             // 0x340020F3
             DecodedInstr d = decode(0x340020F3);
-            execute(s, d);
+            execute(s, d, tm);
             check(s.get_regu(1) == 0xDEADBEEF, "exec CSRRS reads mscratch");
         }
 
@@ -1062,7 +1423,7 @@ struct TestInitiator : public sc_core::sc_module {
             CPUState s = make_cpu();
             s.priv = PRV_M;
             DecodedInstr d = decode(0x00000073);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception && r.cause == CAUSE_ECALL_M, "exec ECALL M-mode");
         }
 
@@ -1071,7 +1432,7 @@ struct TestInitiator : public sc_core::sc_module {
             CPUState s = make_cpu();
             s.priv = PRV_U;
             DecodedInstr d = decode(0x00000073);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception && r.cause == CAUSE_ECALL_U, "exec ECALL U-mode");
         }
 
@@ -1080,7 +1441,7 @@ struct TestInitiator : public sc_core::sc_module {
             CPUState s = make_cpu();
             s.pc = 0x5000;
             DecodedInstr d = decode(0x00100073);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception && r.cause == CAUSE_BREAKPOINT, "exec EBREAK");
         }
 
@@ -1091,7 +1452,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.csr.mepc = 0x80000000;
             s.csr.mstatus = MSTATUS_MPIE | (PRV_S << MSTATUS_MPP_SHIFT);
             DecodedInstr d = decode(0x30200073);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(!r.exception, "exec MRET no exception");
             check(s.next_pc == 0x80000000, "exec MRET pc=mepc");
             check(s.priv == PRV_S, "exec MRET priv=S (from MPP)");
@@ -1102,7 +1463,7 @@ struct TestInitiator : public sc_core::sc_module {
         {
             CPUState s = make_cpu();
             DecodedInstr d = decode(0x00000000);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception && r.cause == CAUSE_ILLEGAL_INSTR, "exec ILLEGAL exception");
         }
 
@@ -1110,7 +1471,7 @@ struct TestInitiator : public sc_core::sc_module {
         {
             CPUState s = make_cpu();
             DecodedInstr d = decode(0x0FF0000F);
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(!r.exception, "exec FENCE no-op");
         }
     }
@@ -1120,22 +1481,8 @@ struct TestInitiator : public sc_core::sc_module {
         using namespace rv32;
 
         std::vector<uint8_t> tmem(4096, 0);
-        auto mem_read = [&](uint32_t addr, int bytes) -> uint32_t {
-            uint32_t v = 0;
-            for (int i = 0; i < bytes; i++)
-                v |= uint32_t(tmem[addr + i]) << (i * 8);
-            return v;
-        };
-        auto mem_write = [&](uint32_t addr, uint32_t data, int bytes) {
-            for (int i = 0; i < bytes; i++)
-                tmem[addr + i] = (data >> (i * 8)) & 0xFF;
-        };
-        auto make_cpu = [&]() -> CPUState {
-            CPUState s;
-            s.mem.read = mem_read;
-            s.mem.write = mem_write;
-            return s;
-        };
+        TestMem tm{tmem};
+        auto make_cpu = []() { return CPUState{}; };
 
         // take_trap: ECALL from U-mode -> M-mode (no delegation)
         {
@@ -1248,6 +1595,21 @@ struct TestInitiator : public sc_core::sc_module {
             check(irq == IRQ_M_TIMER, "pending timer IRQ detected");
         }
 
+        // Cached irq flag follows mip & mie through set_mip_* and CSR writes
+        {
+            CSRFile c;
+            check(!c.irq_maybe_pending(), "irq flag clear at reset");
+            c.set_mip_mtip(true);
+            check(!c.irq_maybe_pending(), "irq flag clear while MTIE off");
+            c.write(CSR_MIE, PRV_M, MIP_MTIP);
+            check(c.irq_maybe_pending(), "irq flag set by mie write");
+            c.set_mip_mtip(false);
+            check(!c.irq_maybe_pending(), "irq flag cleared with MTIP");
+            c.set_mip_stip(true);
+            c.write(CSR_SIE, PRV_S, MIP_STIP);
+            check(c.irq_maybe_pending(), "irq flag set by sie write");
+        }
+
         // check_pending_interrupts: MIE disabled in M-mode -> no interrupt
         {
             CPUState s = make_cpu();
@@ -1336,7 +1698,7 @@ struct TestInitiator : public sc_core::sc_module {
             s.pc = 0x80010000;
             s.csr.mtvec = 0x80000100;
             DecodedInstr d = decode(0x00000073); // ecall
-            ExecResult r = execute(s, d);
+            ExecResult r = execute(s, d, tm);
             check(r.exception, "ecall returns exception");
             trap::take_trap(s, r.cause, r.tval);
             check(s.priv == PRV_M, "round-trip: ecall -> M-mode trap");
@@ -1351,16 +1713,13 @@ struct TestInitiator : public sc_core::sc_module {
 
         // Simulated physical memory for page tables (1MB should be plenty)
         std::vector<uint32_t> pmem(256 * 1024, 0);
-        auto pmem_read = [&](uint32_t addr) -> uint32_t {
-            return pmem[addr / 4];
-        };
-        auto pmem_write = [&](uint32_t addr, uint32_t val) {
-            pmem[addr / 4] = val;
-        };
+        struct PteMem {
+            std::vector<uint32_t>& words;
+            uint32_t read(uint32_t addr, int) const { return words[addr / 4]; }
+            void write(uint32_t addr, uint32_t val, int) { words[addr / 4] = val; }
+        } ptm{pmem};
 
-        MMU mmu;
-        mmu.mem_read = pmem_read;
-        mmu.mem_write = pmem_write;
+        MMU<PteMem> mmu(ptm);
 
         // Build a simple Sv32 page table:
         // Root table at physical page 1 (addr 0x1000)
@@ -1496,6 +1855,80 @@ struct TestInitiator : public sc_core::sc_module {
 
         // Restore
         pmem[0x2000/4 + 0] = (target_ppn << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_W | PTE_X | PTE_U;
+
+        // Test 18: ASID tagging. Same vaddr under another ASID doesn't hit
+        uint32_t satp_a1 = satp | (1u << SATP_ASID_SHIFT);
+        uint32_t satp_a2 = satp | (2u << SATP_ASID_SHIFT);
+        mmu.flush_tlb();
+        mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        pmem[0x2000/4 + 0] = 0;
+        r = mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(!r.fault, "MMU TLB hit under same ASID");
+        r = mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a2, 0);
+        check(r.fault, "MMU TLB miss under other ASID");
+        mmu.satp_written(satp_a2);
+        r = mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(!r.fault, "MMU satp switch keeps other ASID's entries");
+
+        // Test 19: sfence.vma rs1=addr only drops that page, rs2=asid only that ASID
+        pmem[0x2000/4 + 0] = (target_ppn << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_W | PTE_X | PTE_U;
+        pmem[0x2000/4 + 1] = ((target_ppn + 1) << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_W | PTE_U | PTE_G;
+        mmu.flush_tlb();
+        mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        mmu.translate(0x00401000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        saved_pte = pmem[0x2000/4 + 0];
+        pmem[0x2000/4 + 0] = 0;
+        pmem[0x2000/4 + 1] = 0;
+        mmu.sfence_vma(true, 0x00400123, false, 0);
+        r = mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(r.fault, "MMU sfence.vma by address drops that page");
+        r = mmu.translate(0x00401000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(!r.fault, "MMU sfence.vma by address keeps other pages");
+
+        // Test 20: global pages hit under any ASID and survive per-ASID sfence
+        r = mmu.translate(0x00401000, AccessType::LOAD, PRV_U, satp_a2, 0);
+        check(!r.fault && r.paddr == 0x80001000, "MMU global page hits under other ASID");
+        mmu.sfence_vma(false, 0, true, 1);
+        r = mmu.translate(0x00401000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(!r.fault, "MMU per-ASID sfence.vma keeps global pages");
+        mmu.sfence_vma(false, 0, false, 0);
+        r = mmu.translate(0x00401000, AccessType::LOAD, PRV_U, satp_a1, 0);
+        check(r.fault, "MMU full sfence.vma drops global pages");
+        pmem[0x2000/4 + 0] = saved_pte;
+
+        // Test 21: split I/D, a load's walk doesn't serve fetches
+        mmu.flush_tlb();
+        mmu.translate(0x00400000, AccessType::LOAD, PRV_U, satp, 0);
+        uint64_t misses = mmu.tlb_misses;
+        mmu.translate(0x00400000, AccessType::FETCH, PRV_U, satp, 0);
+        check(mmu.tlb_misses == misses + 1, "MMU ITLB misses after DTLB fill");
+        uint64_t hits = mmu.tlb_hits;
+        mmu.translate(0x00400004, AccessType::FETCH, PRV_U, satp, 0);
+        check(mmu.tlb_hits == hits + 1, "MMU ITLB hits after its own fill");
+
+        // Test 22: store through a load-filled entry re-walks to set D
+        pmem[0x2000/4 + 2] = ((target_ppn + 2) << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_W | PTE_U;
+        mmu.translate(0x00402000, AccessType::LOAD, PRV_U, satp, 0);
+        check(!(pmem[0x2000/4 + 2] & PTE_D), "MMU load leaves D clear");
+        mmu.translate(0x00402000, AccessType::STORE, PRV_U, satp, 0);
+        check((pmem[0x2000/4 + 2] & PTE_D) != 0, "MMU store after load sets D");
+
+        // Test 23: PLRU. Five pages in one set: the oldest one goes
+        uint32_t stride = MMUCore::TLB_SETS;
+        for (uint32_t k = 0; k <= MMUCore::TLB_WAYS; k++)
+            pmem[0x2000/4 + 16 + k * stride] = ((target_ppn + k) << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_U | PTE_A;
+        mmu.flush_tlb();
+        for (uint32_t k = 0; k <= MMUCore::TLB_WAYS; k++)
+            mmu.translate(0x00400000 + ((16 + k * stride) << 12), AccessType::LOAD, PRV_U, satp, 0);
+        for (uint32_t k = 0; k <= MMUCore::TLB_WAYS; k++)
+            pmem[0x2000/4 + 16 + k * stride] = 0;
+        bool newest_hit = true;
+        for (uint32_t k = 2; k <= MMUCore::TLB_WAYS; k++)
+            newest_hit &= !mmu.translate(0x00400000 + ((16 + k * stride) << 12), AccessType::LOAD, PRV_U, satp, 0).fault;
+        check(newest_hit, "MMU PLRU keeps recent pages");
+        r = mmu.translate(0x00400000 + (16 << 12), AccessType::LOAD, PRV_U, satp, 0);
+        check(r.fault, "MMU PLRU evicts oldest page");
+        mmu.flush_tlb();
     }
 
     void step9_iss() {
@@ -1508,6 +1941,28 @@ struct TestInitiator : public sc_core::sc_module {
         auto& s = iss_ptr->state;
 
         check(iss_ptr->insn_count == 10, "ISS executed 10 instructions");
+        check(iss_ptr->irq_evals == 0, "ISS never evaluates irqs with nothing pending");
+
+        // Interrupt delivery through the cached flag: spinning with MTIE+MIE on
+        {
+            const CPUState& q = irq_iss_ptr->state;
+            check(q.csr.mcause == 0 && irq_iss_ptr->irq_evals == 0, "IRQ ISS spins with nothing pending");
+            // Budgeted quantum keeping: the ISS ran up to its quantum end, no further
+            sc_core::sc_time iss_time = sc_core::sc_time(10, sc_core::SC_NS) *
+                                        static_cast<double>(irq_iss_ptr->insn_count);
+            sc_core::sc_time now = sc_core::sc_time_stamp();
+            check(iss_time >= now, "IRQ ISS kept up with sim time");
+            check(iss_time <= now + sc_core::sc_time(cfg::DEFAULT_QUANTUM_US, sc_core::SC_US) +
+                                   sc_core::sc_time(10, sc_core::SC_NS),
+                  "IRQ ISS at most one quantum ahead");
+            irq_iss_ptr->state.csr.set_mip_mtip(true);
+            // ISS may be up to a quantum ahead, it sees MTIP at its next sync
+            wait(sc_core::sc_time(2 * cfg::DEFAULT_QUANTUM_US, sc_core::SC_US));
+            check(q.csr.mcause == IRQ_M_TIMER, "IRQ ISS takes timer interrupt");
+            check(q.csr.mepc == cfg::RAM_BASE + 0x1401C, "IRQ ISS mepc at spin loop");
+            check(irq_iss_ptr->irq_evals >= 1, "IRQ ISS evaluated irqs once flagged");
+            irq_iss_ptr->state.csr.set_mip_mtip(false);
+        }
         check(s.get_regu(1) == 0x80000000, "ISS x1 = 0x80000000 (LUI)");
         check(s.get_reg(2) == 42, "ISS x2 = 42 (ADDI)");
         check(s.get_reg(3) == 10, "ISS x3 = 10 (ADDI)");
@@ -1527,6 +1982,475 @@ struct TestInitiator : public sc_core::sc_module {
             check(inst == 10, "ISS minstret = 10");
         }
 
+        // Straight-line program from RAM: every fetch misses once and gets cached
+        {
+            const DecodeCache& dc = iss_ptr->decode_cache();
+            check(dc.misses == 10, "ISS decode cache 10 misses");
+            check(dc.hits == 0, "ISS decode cache no hits on straight-line code");
+
+            // First fetch goes through b_transport (no DMI yet), the rest splits
+            // at the BNE into [0x04..0x18] and [0x20..0x26]
+            const BlockCache& bc = iss_ptr->block_cache();
+            check(bc.built == 2, "ISS built 2 basic blocks");
+            check(bc.hits == 0, "ISS block cache no hits on straight-line code");
+            iss_ptr->report_stats(std::cout);
+        }
+
+        // Block cache on its own
+        {
+            check(ends_block(decode(0x00229463)), "BNE ends a block");
+            check(ends_block(decode(0x30200073)), "MRET ends a block");
+            check(ends_block(decode(0x34029073)), "CSRRW ends a block");
+            check(!ends_block(decode(0x1000A283)), "LW doesn't end a block");
+
+            BlockCache bc;
+            auto b = std::make_unique<Block>();
+            b->paddr = 0x80000100;
+            b->bytes = 8;
+            b->insns.push_back(decode(0x02A00093));
+            b->insns.push_back(decode(0x00229463));
+            Block* bp = bc.insert(std::move(b));
+            check(bc.lookup(0x80000100) == bp, "BlockCache hit");
+            check(bc.lookup(0x80000104) == nullptr, "BlockCache keyed by start PC only");
+
+            bc.invalidate(0x80000108, 0x8000010B);
+            check(bc.lookup(0x80000100) == bp && bp->valid, "BlockCache store past block keeps it");
+            bc.invalidate(0x80000104, 0x80000104);
+            check(!bp->valid, "BlockCache store into block kills it");
+            check(bc.lookup(0x80000100) == nullptr, "BlockCache killed block gone");
+            bc.reclaim();
+        }
+
+        // Block engine: hot loop + precise trap in the middle of a block
+        {
+            auto& b = blk_iss_ptr->state;
+            check(b.get_reg(1) == 100, "Block ISS loop ran 100 times");
+            // 1st iteration falls through from the block at 0x04, 99 more at 0x08 (1 build + 98 hits)
+            check(blk_iss_ptr->block_cache().hits == 98, "Block ISS loop block re-used");
+            check(b.get_reg(5) == 5, "Block ISS insn before fault retired");
+            check(b.get_reg(7) == 0, "Block ISS insn after fault not executed");
+            check(b.csr.mcause == CAUSE_MISALIGNED_LOAD, "Block ISS mid-block trap cause");
+            check(b.csr.mepc == cfg::RAM_BASE + 0x8020, "Block ISS mid-block mepc precise");
+            check(b.csr.mtval == cfg::RAM_BASE + 0x8001, "Block ISS mid-block mtval");
+            check(b.pc == cfg::RAM_BASE + 0x8040, "Block ISS stopped in handler");
+            // 2 + 2*100 + 5 (incl. faulting LW, it retires as an exception) + EBREAK
+            check(blk_iss_ptr->insn_count == 208, "Block ISS instruction count");
+            blk_iss_ptr->report_stats(std::cout);
+        }
+
+        // JIT vs interpreter on the same program, everything must match
+        {
+            const CPUState& r = jit_ref_ptr->state;
+            const CPUState& j = jit_iss_ptr->state;
+            bool regs_match = true;
+            for (int k = 1; k < 32; k++) {
+                if (k == 3 || k == 13) continue; // PC-relative data pointers
+                regs_match &= (r.get_reg(k) == j.get_reg(k));
+            }
+            check(r.get_reg(1) == 200, "JIT ref loop ran 200 times");
+            check(regs_match, "JIT registers match interpreter");
+            check(j.pc - cfg::RAM_BASE == 0xB06C && r.pc - cfg::RAM_BASE == 0x906C,
+                  "JIT and interpreter both stopped at EBREAK");
+            check(jit_iss_ptr->insn_count == jit_ref_ptr->insn_count, "JIT instruction count matches");
+            uint32_t r_inst = 0, j_inst = 0, r_cyc = 0, j_cyc = 0;
+            r.csr.read(CSR_MINSTRET, PRV_M, r_inst);
+            j.csr.read(CSR_MINSTRET, PRV_M, j_inst);
+            r.csr.read(CSR_MCYCLE, PRV_M, r_cyc);
+            j.csr.read(CSR_MCYCLE, PRV_M, j_cyc);
+            check(r_inst == j_inst && r_cyc == j_cyc, "JIT minstret/mcycle match");
+
+            bool mem_match = true;
+            for (uint32_t off = 0; off < 0x800; off += 4) {
+                mem_match &= jit_ref_ptr->bus_read(cfg::RAM_BASE + 0xA000 + off, 4) ==
+                             jit_iss_ptr->bus_read(cfg::RAM_BASE + 0xC000 + off, 4);
+            }
+            mem_match &= jit_ref_ptr->bus_read(cfg::RAM_BASE + 0x9FFC, 4) ==
+                         jit_iss_ptr->bus_read(cfg::RAM_BASE + 0xBFFC, 4);
+            check(mem_match, "JIT memory matches interpreter");
+
+            if (jit_iss_ptr->jit().supported()) {
+                check(jit_iss_ptr->jit().compiled >= 1, "JIT compiled the hot loop");
+            } else {
+                check(jit_iss_ptr->jit().compiled == 0, "JIT unsupported host falls back");
+            }
+            check(jit_ref_ptr->jit().compiled == 0, "Interpreter ISS never compiles");
+            jit_iss_ptr->report_stats(std::cout);
+        }
+
+        // Threaded dispatch vs the execute() switch, same program again
+        {
+            const CPUState& r = jit_ref_ptr->state;
+            const CPUState& t = thr_iss_ptr->state;
+            bool regs_match = true;
+            for (int k = 1; k < 32; k++) {
+                if (k == 3 || k == 13) continue;
+                regs_match &= (r.get_reg(k) == t.get_reg(k));
+            }
+            check(regs_match, "Threaded registers match interpreter");
+            check(t.pc - cfg::RAM_BASE == 0xD06C, "Threaded stopped at EBREAK");
+            check(thr_iss_ptr->insn_count == jit_ref_ptr->insn_count, "Threaded instruction count matches");
+            uint32_t r_inst = 0, t_inst = 0;
+            r.csr.read(CSR_MINSTRET, PRV_M, r_inst);
+            t.csr.read(CSR_MINSTRET, PRV_M, t_inst);
+            check(r_inst == t_inst, "Threaded minstret matches");
+
+            bool mem_match = true;
+            for (uint32_t off = 0; off < 0x800; off += 4) {
+                mem_match &= jit_ref_ptr->bus_read(cfg::RAM_BASE + 0xA000 + off, 4) ==
+                             thr_iss_ptr->bus_read(cfg::RAM_BASE + 0xE000 + off, 4);
+            }
+            check(mem_match, "Threaded memory matches interpreter");
+
+            check(sizeof(ThreadedOp) == 16, "ThreadedOp is 16 bytes");
+            std::vector<DecodedInstr> insns = {decode(0x02A00093), decode(0x34029073), decode(0x00108093)};
+            std::vector<ThreadedOp> ops;
+            threaded::translate(insns, ops);
+            check(ops.size() == 4, "Threaded translate adds a stop op");
+            CPUState ts;
+            bool no_fault = false, valid = true;
+            MemIf no_mem; // chain stops before touching memory
+            ThreadedCtx tc{ts, no_mem, no_fault, valid};
+            const ThreadedOp* stop = threaded::run(tc, ops.data());
+            check(stop == &ops[1] && ts.get_reg(1) == 42 && ts.pc == 4,
+                  "Threaded chain stops at CSR op for the reference path");
+        }
+
+        // Macro-op fusion: same idioms through execute() and the threaded handlers
+        {
+            DecodedInstr f;
+            check(fuse(decode(0x800162B7), decode(0x90028293), f) &&
+                  f.type == InstrType::FUSED_LUI_ADDI && f.imm == static_cast<int32_t>(0x80015900) &&
+                  f.instr_len() == 8 && f.insn_count() == 2,
+                  "fuse lui+addi folds the constant");
+            check(!fuse(decode(0x800162B7), decode(0x90030293), f), "fuse needs the same temp register");
+            check(!fuse(decode(0x00000037), decode(0x00000013), f), "fuse skips lui into x0");
+            check(jit_ref_ptr->fused_execs[fused_index(InstrType::FUSED_LUI_ADDI)] == 1 &&
+                  thr_iss_ptr->fused_execs[fused_index(InstrType::FUSED_LUI_ADDI)] == 1,
+                  "Interpreter and threaded fuse the checksum's lui+addi");
+            check(jit_iss_ptr->fused_execs[fused_index(InstrType::FUSED_LUI_ADDI)] == 0,
+                  "JIT blocks stay unfused");
+
+            for (ISS* iss : {fuse_iss_ptr, fuse_thr_ptr}) {
+                const CPUState& q = iss->state;
+                bool thr = iss == fuse_thr_ptr;
+                bool ok = q.get_regu(5) == cfg::RAM_BASE + 0x15900 && q.get_reg(6) == 9 &&
+                          q.get_regu(8) == 0xFEEDC0DE &&
+                          iss->bus_read(cfg::RAM_BASE + 0x15204, 4) == 0xFEEDC0DE &&
+                          q.get_regu(11) == iss->state.csr.mtvec - 0x80 + 0x34;
+                check(ok, thr ? "Fused ops compute the same results (threaded)" : "Fused ops compute the same results (interp)");
+                check(q.get_regu(12) == cfg::RAM_BASE + 0x15000 && q.get_reg(13) == 0 && q.get_reg(14) == 0,
+                      thr ? "Fused lui retires before its load traps (threaded)" : "Fused lui retires before its load traps (interp)");
+                check(q.csr.mcause == CAUSE_MISALIGNED_LOAD && q.csr.mepc == q.csr.mtvec - 0x80 + 0x40 &&
+                      q.csr.mtval == cfg::RAM_BASE + 0x15201,
+                      thr ? "Fused trap is precise on the second half (threaded)" : "Fused trap is precise on the second half (interp)");
+                check(iss->insn_count == 16, thr ? "Fused ops retire two instructions (threaded)" : "Fused ops retire two instructions (interp)");
+                check(iss->fused_execs[0] == 1 && iss->fused_execs[1] == 1 &&
+                      iss->fused_execs[2] == 3 && iss->fused_execs[3] == 1,
+                      thr ? "Fusion stats (threaded)" : "Fusion stats (interp)");
+            }
+            fuse_thr_ptr->report_stats(std::cout);
+        }
+
+        // AOT image vs the interpreter, including a patched block and a trap
+        {
+            const CPUState& r = aot_ref_ptr->state;
+            const CPUState& a = aot_iss_ptr->state;
+            bool regs_match = true;
+            for (int k = 2; k < 32; k++) {
+                if (k == 3 || k == 7 || k == 11) continue; // PC-relative
+                regs_match &= (r.get_reg(k) == a.get_reg(k));
+            }
+            check(r.get_reg(5) == 50, "AOT ref loop ran 50 times");
+            check(regs_match, "AOT registers match interpreter");
+            check(a.get_reg(20) == 2 && a.get_reg(21) == 0 && a.get_reg(22) == 0,
+                  "AOT falls back on patched code");
+            check(a.csr.mcause == CAUSE_MISALIGNED_LOAD && a.csr.mepc == cfg::RAM_BASE + 0x17060 &&
+                  r.csr.mepc == cfg::RAM_BASE + 0x19060, "AOT misaligned load traps precisely");
+            check(aot_iss_ptr->insn_count == aot_ref_ptr->insn_count, "AOT instruction count matches");
+
+            bool mem_match = true;
+            for (uint32_t off = 0; off < 50 * 4; off += 4) {
+                mem_match &= aot_ref_ptr->bus_read(cfg::RAM_BASE + 0x1A000 + off, 4) ==
+                             aot_iss_ptr->bus_read(cfg::RAM_BASE + 0x18000 + off, 4);
+            }
+            check(mem_match, "AOT memory matches interpreter");
+
+            const AotLibrary& lib = aot_iss_ptr->aot();
+            if (aot_gen_blocks) {
+                check(lib.loaded() && lib.size() == aot_gen_blocks, "AOT image loaded");
+                check(lib.attached >= 4 && lib.runs >= 100, "AOT blocks ran");
+                check(lib.stale == 1, "AOT rejects the patched block");
+            } else {
+                check(!lib.loaded(), "AOT without a host compiler falls back");
+            }
+            check(!aot_ref_ptr->aot().loaded(), "Interpreter ISS has no AOT image");
+
+            const ISS& x = *aot_cross_ptr;
+            check(x.state.get_reg(6) == 2 && x.state.get_reg(20) == 2,
+                  "AOT leaves a page-crossing instruction to the interpreter");
+            if (aot_gen_blocks)
+                check(x.aot().loaded() && x.aot().attached >= 1, "AOT page-crossing image ran");
+            aot_iss_ptr->report_stats(std::cout);
+        }
+
+        // Run-loop modes: M bare -> S paged -> trap back to M -> halted
+        {
+            const CPUState& p = pg_iss_ptr->state;
+            check(p.get_reg(10) == 50, "Paged ISS loop ran in S-mode");
+            check(p.get_reg(13) == 50, "Paged ISS load through Sv32");
+            check(p.csr.mcause == CAUSE_ECALL_S, "Paged ISS ecall from S");
+            check(p.priv == PRV_M, "Paged ISS back in M-mode");
+            // reset, csrw mstatus, csrw satp (still M so still bare), ecall
+            check(pg_iss_ptr->mode_entries[static_cast<int>(RunMode::BARE)] == 4,
+                  "Paged ISS re-picks bare loop on mstatus/satp/trap");
+            check(pg_iss_ptr->mode_entries[static_cast<int>(RunMode::PAGED)] == 1,
+                  "Paged ISS paged loop entered once after mret");
+            check(pg_iss_ptr->run_mode() == RunMode::DEBUG, "Halted ISS sits in debug loop");
+            check(blk_iss_ptr->mode_entries[static_cast<int>(RunMode::PAGED)] == 0,
+                  "Bare-only ISS never enters paged loop");
+            check(pg_iss_ptr->soft_tlb().fills > 0, "Paged ISS fills soft TLB");
+            check(pg_iss_ptr->soft_tlb().flushes >= 5, "Paged ISS flushes soft TLB on mode switches");
+        }
+
+        // Zba/Zbb/Zbs through the interpreter and the threaded handlers
+        for (ISS* iss : {bit_iss_ptr, bit_thr_ptr}) {
+            const CPUState& q = iss->state;
+            bool thr = iss == bit_thr_ptr;
+            uint32_t a = 0x80F00123, b = 5;
+            bool ok = q.get_regu(3) == rv32b::sh2add(a, b) && q.get_regu(4) == rv32b::andn(a, b) &&
+                      q.get_regu(5) == 29 && q.get_regu(6) == 0 && q.get_regu(7) == 9 &&
+                      q.get_regu(8) == 5 && q.get_regu(9) == a &&
+                      q.get_regu(10) == 0x2301F080 && q.get_regu(11) == 0xFFFFFFFF &&
+                      q.get_regu(12) == rv32b::ror(a, 7) && q.get_regu(13) == 0x80000000 &&
+                      q.get_regu(14) == 1 && q.get_regu(15) == 0x23 && q.get_regu(16) == 0x0123 &&
+                      q.get_regu(17) == (a ^ 0x20);
+            check(ok, thr ? "B extension ops in a block (threaded)" : "B extension ops in a block (interp)");
+            check(iss->insn_count == 19 && q.pc == cfg::RAM_BASE + 0x22048,
+                  thr ? "B extension block retires without traps (threaded)" : "B extension block retires without traps (interp)");
+        }
+
+        // F extension end to end, both engines
+        for (ISS* iss : {fp_iss_ptr, fp_thr_ptr}) {
+            const CPUState& q = iss->state;
+            bool thr = iss == fp_thr_ptr;
+            bool ok = q.fregs[3] == 0x40800000 && q.fregs[4] == 0x40700000 && q.fregs[5] == 0x40F80000 &&
+                      q.get_regu(10) == 7 && q.get_regu(11) == 8 && q.get_regu(12) == 1 &&
+                      q.fregs[7] == 0x40F80000 && q.fregs[8] == 0x40E00000 && q.fregs[6] == 0x3F19999A;
+            check(ok, thr ? "F extension results (threaded)" : "F extension results (interp)");
+            check(q.get_regu(13) == FFLAG_NX && q.get_regu(14) == FFLAG_NX,
+                  thr ? "fflags accrue and clear through the CSR (threaded)" : "fflags accrue and clear through the CSR (interp)");
+            check(((q.get_regu(15) & MSTATUS_FS_MASK) >> MSTATUS_FS_SHIFT) == FS_DIRTY && (q.get_regu(15) & MSTATUS_SD),
+                  thr ? "FP program leaves FS dirty (threaded)" : "FP program leaves FS dirty (interp)");
+            check(iss->insn_count == 22 && q.pc == cfg::RAM_BASE + 0x23054,
+                  thr ? "F extension program retires without traps (threaded)" : "F extension program retires without traps (interp)");
+        }
+
+        // Guest functions hooked by native ones vs the same program with
+        // the hooks switched off
+        {
+            const char* str = "intercepted!";
+            bool same = true;
+            for (ISS* iss : {icpt_iss_ptr, icpt_ref_ptr}) {
+                const CPUState& q = iss->state;
+                uint32_t dst = cfg::RAM_BASE + 0x28100 + 0x100 * q.csr.hartid;
+                for (uint32_t k = 0; k < 64; k++)
+                    same &= iss->bus_read(dst + k, 1) == iss->bus_read(cfg::RAM_BASE + 0x28000 + k, 1);
+                same &= q.get_regu(20) == std::strlen(str) && q.get_regu(21) == 0x78000 &&
+                        q.pc == cfg::RAM_BASE + 0x2703C;
+            }
+            check(same, "Intercepted calls give the guest functions' results");
+
+            ISS* h = icpt_iss_ptr;
+            bool calls = true;
+            for (const char* n : {"memcpy", "strlen", "FixedMul"}) {
+                calls &= h->find_intercept(n) && h->find_intercept(n)->calls == 1;
+                calls &= icpt_ref_ptr->find_intercept(n)->calls == 0;
+            }
+            check(calls, "Each hook runs once, disabled hooks never");
+            check(h->intercepted_insns == 90 + 40 + 6 &&
+                      h->insn_count == 16 + h->intercepted_insns &&
+                      icpt_ref_ptr->insn_count == 16 + 451 + 53 + 6,
+                  "Intercepted calls credit their configured cost");
+            h->report_stats(std::cout);
+
+            // Arguments that aren't plain RAM are left to the guest
+            CPUState st;
+            DmiTable none;
+            DecodeCache dc;
+            GuestCall c{st, none, dc};
+            st.regs[10] = cfg::RAM_BASE;
+            st.regs[11] = cfg::UART_BASE;
+            st.regs[12] = 4;
+            check(!intercept::memcpy(c) && !intercept::strlen(c) && st.regs[10] == (int32_t)cfg::RAM_BASE,
+                  "Hooks decline non-DMI memory");
+
+            auto fdiv = [&](int32_t a, int32_t b) {
+                st.regs[10] = a;
+                st.regs[11] = b;
+                return intercept::fixed_div(c) ? st.get_regu(10) : 0xDEADBEEFu;
+            };
+            check(fdiv(3 << 16, 2 << 16) == 0x18000 && fdiv(-(3 << 16), 2 << 16) == 0xFFFE8000 &&
+                      fdiv(0x7FFF0000, 1) == 0x7FFFFFFF && fdiv(0x7FFF0000, -1) == 0x80000000 &&
+                      fdiv(1, 0) == 0x7FFFFFFF,
+                  "FixedDiv matches Doom, saturation included");
+        }
+
+        // Semihosting: console + file I/O + clock + exit, and the same
+        // program with it off just stops at the first ebreak
+        {
+            const CPUState& q = sh_iss_ptr->state;
+            const Semihost& sh = sh_iss_ptr->semihost();
+            check(q.get_regu(20) == 0 && q.get_regu(21) == 12 && q.get_regu(22) == 0 && q.get_regu(23) == 0,
+                  "Semihosting open/write/read/close results");
+            std::ifstream out(std::filesystem::temp_directory_path() / "gamingcpu_sh_out.bin", std::ios::binary);
+            std::string got((std::istreambuf_iterator<char>(out)), std::istreambuf_iterator<char>());
+            check(got == "0123456789abcdefghij" && sh.bytes_read == 20 && sh.bytes_written == 12 + 20,
+                  "Semihosting copies files through guest memory");
+            check(q.get_regu(24) < 100, "Semihosting clock follows simulated time");
+            check(sh.exited && sh.exit_code == 0 && sh.calls == 9 && q.get_regu(25) == 0 &&
+                      q.pc == cfg::RAM_BASE + 0x290DC,
+                  "SYS_EXIT halts the hart");
+
+            const CPUState& o = sh_off_ptr->state;
+            check(o.pc == cfg::RAM_BASE + 0x29010 && o.get_regu(10) == 1 && !sh_off_ptr->semihost().calls,
+                  "Semihosting off by default, ebreak still stops");
+            check(icpt_iss_ptr->semihosting && icpt_iss_ptr->state.pc == cfg::RAM_BASE + 0x2703C &&
+                      icpt_iss_ptr->semihost().calls == 0,
+                  "Plain ebreak still stops with semihosting on");
+        }
+
+        // Sampling profiler: the shadow stack unwinds back to empty and
+        // nearly every sample lands in main;f;g
+        {
+            const ISS& h = *prof_iss_ptr;
+            const Profiler& p = *h.profiler;
+            check(h.state.pc == cfg::RAM_BASE + 0x2B004 && h.insn_count == 411 && p.depth() == 0 &&
+                      p.stack_resyncs == 0,
+                  "Profiler tracks calls and returns");
+            check(p.samples >= 55 && p.samples <= 58, "Profiler samples every period");
+
+            std::ostringstream folded;
+            p.write_folded(folded);
+            std::istringstream lines(folded.str());
+            uint64_t in_g = 0, total = 0;
+            for (std::string line; std::getline(lines, line);) {
+                uint64_t n = std::stoull(line.substr(line.rfind(' ') + 1));
+                total += n;
+                if (line.rfind("main;f;g ", 0) == 0)
+                    in_g = n;
+            }
+            check(total == p.samples && in_g * 10 >= total * 9, "Profiler folded stacks");
+
+            std::ostringstream pb;
+            p.write_pprof(pb);
+            check(pb.str().size() > 64 && pb.str().find("main") != std::string::npos &&
+                      p.symbolize(cfg::RAM_BASE + 0x2B020) == "0x8002b020",
+                  "Profiler pprof output and symbols");
+        }
+
+        // Misaligned accesses in hardware, S-mode on 4K pages
+        {
+            const CPUState& m = mis_iss_ptr->state;
+            check(m.get_regu(13) == 0x55443322 && m.get_regu(14) == 0x5544,
+                  "Misaligned load inside a page");
+            check(m.get_regu(16) == 0xA5A4A3A2, "Misaligned load across a page");
+            check(m.get_regu(17) == 0x55443322 &&
+                  mis_iss_ptr->bus_read(cfg::RAM_BASE + 0x20FFF, 1) == 0x22 &&
+                  mis_iss_ptr->bus_read(cfg::RAM_BASE + 0x21000, 2) == 0x4433,
+                  "Misaligned store across a page");
+            check(m.csr.mcause == CAUSE_STORE_PAGE_FAULT && m.csr.mtval == cfg::RAM_BASE + 0x22000 &&
+                  m.csr.mepc == cfg::RAM_BASE + 0x1D068,
+                  "Misaligned store faults on the unmapped half");
+            check(mis_iss_ptr->bus_read(cfg::RAM_BASE + 0x21FFC, 4) == 0xEEEEEEEE,
+                  "Faulting misaligned store writes neither half");
+        }
+
+        // DMI table: code in BootROM touching RAM and SRAM keeps all three
+        {
+            const CPUState& r = rom_iss_ptr->state;
+            check(r.get_regu(2) == 0xCAFEF00D, "ROM ISS reads ROM constant");
+            check(r.get_regu(5) == 0xCAFEF00D, "ROM ISS round-trips through RAM and SRAM");
+            check(r.get_regu(6) == 0xCAFEF00D, "ROM ISS store to ROM ignored");
+            const DmiTable& dt = rom_iss_ptr->dmi_table();
+            check(dt.size() == 3, "ROM ISS holds ROM, RAM and SRAM DMI at once");
+            bool rom_ro = false;
+            for (int k = 0; k < dt.size(); k++) {
+                if (dt[k].start == cfg::BOOTROM_BASE)
+                    rom_ro = dt[k].readable && !dt[k].writable;
+            }
+            check(rom_ro, "ROM DMI region is read-only");
+            check(dt.hits > dt.misses, "ROM ISS mostly hits DMI");
+            rom_iss_ptr->report_stats(std::cout);
+
+            DmiTable t;
+            uint8_t a[16], b[16];
+            t.insert({a, 0x1000, 0x100F, true, true});
+            t.insert({b, 0x2000, 0x200F, true, false});
+            check(t.find(0x1004, 4) && t.find(0x1004, 4)->ptr == a, "DmiTable finds first region");
+            check(t.find(0x200C, 4) && !t.find(0x200C, 4)->writable, "DmiTable keeps per-region perms");
+            check(!t.find(0x100E, 4), "DmiTable access past region end misses");
+            check(t.invalidate(0x2008, 0x2008) && t.size() == 1 && t.find(0x1000, 4),
+                  "DmiTable invalidate drops only the overlapping region");
+            t.deny(0x3000, 0x3FFF);
+            check(t.denied(0x3ABC) && !t.denied(0x4000), "DmiTable remembers refused range");
+            t.invalidate(0, 0);
+            check(!t.denied(0x3ABC), "DmiTable invalidate forgets refusals");
+        }
+
+        // Soft TLB on its own
+        {
+            SoftTlb tlb;
+            uint8_t page[4096] = {};
+            page[0x10] = 0x5A;
+            check(tlb.read_ptr(0x40001010, 1) == nullptr, "SoftTlb cold miss");
+            tlb.fill(0x40001010, 0x80003010, page, AccessType::LOAD);
+            check(tlb.read_ptr(0x40001010, 1) == &page[0x10], "SoftTlb load hit");
+            check(tlb.read_ptr(0x40001ffc, 4) == &page[0xffc], "SoftTlb load hit elsewhere in page");
+            check(tlb.read_ptr(0x40001012, 4) == nullptr, "SoftTlb misaligned access misses");
+            check(tlb.write_ptr(0x40001010, 4) == nullptr, "SoftTlb load fill doesn't allow stores");
+            uint32_t pa = 0;
+            check(!tlb.lookup_exec(0x40001010, pa), "SoftTlb load fill doesn't allow fetch");
+            tlb.fill(0x40001010, 0x80003010, page, AccessType::STORE);
+            check(tlb.write_ptr(0x40001010, 4) == &page[0x10], "SoftTlb store hit");
+            tlb.drop_writes();
+            check(tlb.write_ptr(0x40001010, 4) == nullptr && tlb.read_ptr(0x40001010, 4),
+                  "SoftTlb drop_writes keeps loads");
+            tlb.fill(0x40001000, 0x10000000, nullptr, AccessType::FETCH);
+            check(tlb.lookup_exec(0x40001234, pa) && pa == 0x10000234, "SoftTlb fetch translation");
+            check(tlb.read_ptr(0x40001010, 4) == nullptr, "SoftTlb remap drops old tags");
+            tlb.flush();
+            check(!tlb.lookup_exec(0x40001234, pa), "SoftTlb flush");
+        }
+
+        // Decode cache on its own
+        {
+            DecodeCache dc;
+            check(dc.lookup(0x80000000) == nullptr, "DecodeCache cold miss");
+            dc.insert(0x80000000, decode(0x02A00093));
+            dc.insert(0x80000004, decode(0x0000439D)); // c.li x7, 7
+            const DecodedInstr* d = dc.lookup(0x80000000);
+            check(d && d->type == InstrType::ADDI && d->imm == 42, "DecodeCache hit returns ADDI");
+            d = dc.lookup(0x80000004);
+            check(d && d->compressed, "DecodeCache halfword slot keeps RVC");
+            check(dc.hits == 2 && dc.misses == 1, "DecodeCache hit/miss counters");
+            check(dc.has_code(0x80000FFC) && !dc.has_code(0x80001000), "DecodeCache tracks code pages");
+
+            dc.invalidate(0x80001000, 0x80001FFF);
+            check(dc.lookup(0x80000000) != nullptr, "DecodeCache other page survives invalidate");
+            dc.invalidate(0x80000010, 0x80000013);
+            check(dc.lookup(0x80000000) != nullptr, "DecodeCache store to data slot keeps code");
+            dc.invalidate(0x80000002, 0x80000002);
+            check(dc.lookup(0x80000000) == nullptr, "DecodeCache store into 32-bit instr drops it");
+            check(dc.lookup(0x80000004) != nullptr, "DecodeCache neighbour slot survives");
+            dc.invalidate(0x80000000, 0x80000FFF + 4);
+            check(dc.lookup(0x80000004) == nullptr, "DecodeCache page invalidated");
+            check(!dc.has_code(0x80000000), "DecodeCache page no longer marked");
+
+            dc.insert(0x80000000, decode(0x02A00093));
+            dc.flush();
+            check(dc.lookup(0x80000000) == nullptr, "DecodeCache flush (fence.i)");
+        }
+
         // Verify the SW wrote through TLM to memory
         {
             uint32_t mem_val = 0;
@@ -1538,6 +2462,35 @@ struct TestInitiator : public sc_core::sc_module {
             bus_isock->b_transport(trans, delay);
             check(mem_val == 52, "ISS SW stored 52 via TLM bus");
         }
+
+        // SMP: four harts on the pool bumping the same two words with
+        // amoadd and an lr/sc loop. Nothing may get lost between threads
+        {
+            for (ISS* h : smp_harts) {
+                if (h->run_mode() != RunMode::DEBUG)
+                    wait(sc_core::sc_time(1, sc_core::SC_MS), h->halted_event);
+            }
+            constexpr uint32_t N = 2000;
+            uint32_t base = cfg::RAM_BASE + 0x26000;
+            ISS* h0 = smp_harts[0];
+            check(h0->bus_read(base, 4) == 4 * N, "SMP amoadd.w from 4 harts adds up");
+            check(h0->bus_read(base + 4, 4) == 4 * N, "SMP lr/sc increments from 4 harts add up");
+            bool ids = true, done = true;
+            for (uint32_t k = 0; k < smp_harts.size(); k++) {
+                const CPUState& q = smp_harts[k]->state;
+                ids &= q.get_regu(1) == k && h0->bus_read(base + 0x10 + 4 * k, 4) == k;
+                done &= q.pc == cfg::RAM_BASE + 0x25044 && q.get_regu(10) != 0 &&
+                        smp_harts[k]->slices > 0;
+            }
+            check(ids, "SMP harts read their own mhartid");
+            check(done, "SMP harts finish, MMIO read included");
+            check(smp_pool_ptr->max_batch == smp_harts.size(), "SMP pool runs all harts in one batch");
+            uint64_t defers = 0;
+            for (ISS* h : smp_harts)
+                defers += h->slice_defers;
+            check(defers >= smp_harts.size(), "SMP MMIO access hands the slice back");
+            h0->report_stats(std::cout);
+        }
     }
 
     void step10_elf_loader() {
@@ -1617,6 +2570,46 @@ struct TestInitiator : public sc_core::sc_module {
         try { load_elf_from_memory(bad_elf.data(), bad_elf.size(), write_fn); }
         catch (const std::runtime_error&) { caught = true; }
         check(caught, "ELF rejects 64-bit");
+
+        // Same ELF plus a .symtab: strtab at 92, 3 symbols at 112, 3 section headers at 160
+        check(r.symbols.empty(), "ELF without sections has no symbols");
+        std::vector<uint8_t> sym_elf = elf;
+        const char strtab[] = "\0memcpy\0frame_count\0";
+        sym_elf.resize(160 + 3 * 40, 0);
+        std::memcpy(&sym_elf[92], strtab, sizeof(strtab));
+        auto s32 = [&](size_t off, uint32_t v) { std::memcpy(&sym_elf[off], &v, 4); };
+        auto s16 = [&](size_t off, uint16_t v) { std::memcpy(&sym_elf[off], &v, 2); };
+        s32(112 + 16, 1);          // memcpy
+        s32(112 + 20, 0x80000000);
+        s32(112 + 24, 8);
+        sym_elf[112 + 28] = 0x12;  // GLOBAL FUNC
+        s32(112 + 32, 8);          // frame_count
+        s32(112 + 36, 0x80000008);
+        s32(112 + 40, 4);
+        sym_elf[112 + 44] = 0x11;  // GLOBAL OBJECT
+        s32(32, 160);              // e_shoff
+        s16(46, 40);               // e_shentsize
+        s16(48, 3);                // e_shnum
+        s32(160 + 40 + 4, 2);      // [1] SHT_SYMTAB
+        s32(160 + 40 + 16, 112);
+        s32(160 + 40 + 20, 48);
+        s32(160 + 40 + 24, 2);     // sh_link -> [2]
+        s32(160 + 80 + 4, 3);      // [2] SHT_STRTAB
+        s32(160 + 80 + 16, 92);
+        s32(160 + 80 + 20, sizeof(strtab));
+
+        r = load_elf_from_memory(sym_elf.data(), sym_elf.size(), write_fn);
+        const ElfSymbol* fn = r.find_symbol("memcpy");
+        const ElfSymbol* obj = r.find_symbol("frame_count");
+        check(r.symbols.size() == 2 && fn && fn->func && fn->value == 0x80000000 && fn->size == 8 &&
+                  obj && !obj->func && obj->value == 0x80000008 && !r.find_symbol("memset"),
+              "ELF reads functions and objects from .symtab");
+
+        s32(160 + 40 + 20, 0x10000); // symtab runs off the end
+        caught = false;
+        try { load_elf_from_memory(sym_elf.data(), sym_elf.size(), write_fn); }
+        catch (const std::runtime_error&) { caught = true; }
+        check(caught, "ELF rejects a truncated symbol table");
     }
 
     void step11_clint() {
@@ -1652,12 +2645,27 @@ struct TestInitiator : public sc_core::sc_module {
 
         // Check sw_irq callback fired
         bool sw_irq_seen = false;
-        clint_ptr->on_sw_irq = [&](bool v) { sw_irq_seen = v; };
+        clint_ptr->on_sw_irq = [&](uint32_t, bool v) { sw_irq_seen = v; };
         clint_write(0x0000, 1);
         check(sw_irq_seen == true, "CLINT msip triggers sw_irq callback");
         clint_write(0x0000, 0);
         check(sw_irq_seen == false, "CLINT msip=0 clears sw_irq");
 
+        // Hart 1 has its own msip and mtimecmp, the next ones along
+        uint32_t sw_hart = ~0u;
+        clint_ptr->on_sw_irq = [&](uint32_t h, bool v) { sw_hart = v ? h : ~0u; };
+        clint_write(0x0004, 1);
+        check(sw_hart == 1 && clint_read(0x0000) == 0 && clint_read(0x0004) == 1,
+              "CLINT hart 1 msip is separate");
+        clint_write(0x0004, 0);
+        clint_write(0x4008, 0x11111111);
+        clint_write(0x400C, 0x22222222);
+        check(clint_read(0x4008) == 0x11111111 && clint_read(0x400C) == 0x22222222 &&
+              clint_read(0x4004) != 0x22222222, "CLINT hart 1 mtimecmp is separate");
+        clint_write(0x4008, 0xFFFFFFFF);
+        clint_write(0x400C, 0xFFFFFFFF);
+        clint_ptr->on_sw_irq = [&](uint32_t, bool v) { sw_irq_seen = v; };
+
         // Write mtimecmp lo/hi and read back
         clint_write(0x4000, 0x12345678);
         clint_write(0x4004, 0xAABBCCDD);
@@ -1672,7 +2680,10 @@ struct TestInitiator : public sc_core::sc_module {
 
         // Timer IRQ test: set mtime >= mtimecmp, callback should fire
         bool timer_irq_seen = false;
-        clint_ptr->on_timer_irq = [&](bool v) { timer_irq_seen = v; };
+        clint_ptr->on_timer_irq = [&](uint32_t h, bool v) {
+            if (h == 0)
+                timer_irq_seen = v;
+        };
 
         // Set mtimecmp to 100
         clint_write(0x4000, 100);
@@ -1692,11 +2703,44 @@ struct TestInitiator : public sc_core::sc_module {
         clint_write(0x4000, 200);
         check(timer_irq_seen == false, "CLINT IRQ clears when mtimecmp raised");
 
-        // Let simulation advance so tick_thread runs a couple ticks
+        // No tick process any more, mtime follows simulated time
         uint64_t before = clint_ptr->get_mtime();
         wait(sc_core::sc_time(300, sc_core::SC_NS));
         uint64_t after = clint_ptr->get_mtime();
-        check(after > before, "CLINT mtime increments via tick_thread");
+        check(after == before + 3, "CLINT mtime advances with simulated time");
+
+        // The deadline alone raises MTIP, nobody has to touch the CLINT
+        timer_irq_seen = false;
+        clint_write(0x4000, static_cast<uint32_t>(clint_ptr->get_mtime() + 5));
+        check(!timer_irq_seen, "CLINT compare in the future doesn't fire yet");
+        wait(sc_core::sc_time(500, sc_core::SC_NS));
+        check(timer_irq_seen, "CLINT fires at the mtimecmp deadline");
+
+        // WFI fast-forward: wfi_iss has been asleep in WFI since t=0. Arm a
+        // compare 1000 ticks out and it should wake exactly then, with the
+        // kernel skipping the idle stretch instead of polling through it
+        ISS* w = wfi_iss_ptr;
+        clint_ptr->on_sw_irq = nullptr;
+        clint_ptr->on_timer_irq = [w](uint32_t h, bool v) {
+            if (h != 0)
+                return;
+            w->state.csr.set_mip_mtip(v);
+            w->notify_wfi();
+        };
+        check(w->insn_count == 3 && w->wfi_sleeps == 0, "WFI hart asleep without polling");
+        sc_core::sc_time armed = sc_core::sc_time_stamp();
+        clint_write(0x4000, static_cast<uint32_t>(clint_ptr->get_mtime() + 1000));
+        wait(sc_core::sc_time(1, sc_core::SC_MS), w->halted_event);
+        sc_core::sc_time woke = sc_core::sc_time_stamp() - armed;
+        check(woke >= sc_core::sc_time(100, sc_core::SC_US) &&
+              woke < sc_core::sc_time(100 + cfg::DEFAULT_QUANTUM_US, sc_core::SC_US),
+              "WFI wakes at the mtimecmp deadline");
+        check((w->state.get_regu(3) & rv32::MIP_MTIP) && w->insn_count == 5 && w->wfi_sleeps == 1,
+              "WFI resumes after the timer interrupt");
+        check(w->wfi_idle >= woke, "WFI idle time covers the skipped stretch");
+        clint_write(0x4004, 0xFFFFFFFF);
+        clint_ptr->on_timer_irq = nullptr;
+        w->report_stats(std::cout);
     }
 
     void step12_plic() {
@@ -1723,7 +2767,10 @@ struct TestInitiator : public sc_core::sc_module {
         };
 
         bool ext_irq = false;
-        plic_ptr->on_external_irq = [&](bool v) { ext_irq = v; };
+        plic_ptr->on_external_irq = [&](uint32_t ctx, bool v) {
+            if (ctx == 0)
+                ext_irq = v;
+        };
 
         // Set UART (source 1) priority to 5
         plic_write(cfg::IRQ_UART * 4, 5);
@@ -1794,6 +2841,74 @@ struct TestInitiator : public sc_core::sc_module {
         plic_write(0x200004, cfg::IRQ_GPIO);
         plic_write(0x200004, cfg::IRQ_UART);
         plic_write(0x200000, 0);
+
+        // Context 1 (hart 1): its own enables, threshold and claim register
+        {
+            bool ext1 = false;
+            plic_ptr->on_external_irq = [&](uint32_t ctx, bool v) {
+                if (ctx == 0)
+                    ext_irq = v;
+                else
+                    ext1 = v;
+            };
+            plic_write(0x2000, 0);
+            plic_write(0x2080, 1u << cfg::IRQ_GPIO);
+            plic_write(0x201000, 2);
+            check(plic_read(0x2080) == (1u << cfg::IRQ_GPIO) && plic_read(0x2000) == 0 &&
+                  plic_read(0x201000) == 2 && plic_read(0x200000) == 0,
+                  "PLIC context 1 enable/threshold are separate");
+            plic_ptr->set_pending(cfg::IRQ_GPIO, true);
+            check(ext1 && !ext_irq, "PLIC routes to the enabled context only");
+            check(plic_read(0x200004) == 0, "PLIC context 0 can't claim what it hasn't enabled");
+            check(plic_read(0x201004) == cfg::IRQ_GPIO && !ext1, "PLIC context 1 claims its source");
+            plic_write(0x201004, cfg::IRQ_GPIO);
+            plic_write(0x2080, 0);
+            plic_write(0x201000, 0);
+            plic_write(0x2000, (1u << cfg::IRQ_UART) | (1u << cfg::IRQ_GPIO));
+            plic_ptr->on_external_irq = [&](uint32_t ctx, bool v) {
+                if (ctx == 0)
+                    ext_irq = v;
+            };
+        }
+
+        // Busy-poll detection on hand-built blocks
+        {
+            Block spin;
+            spin.paddr = 0x1000;
+            spin.insns = {decode(0x01C0A103), decode(0xFE010EE3)}; // lw x2, 0x1C(x1); beq x2, x0, -4
+            spin.bytes = 8;
+            check(is_poll_loop(spin), "Poll loop: load + branch back to the top");
+
+            Block timeout = spin; // addi x5, x5, -1 in front, beq -8
+            timeout.insns = {decode(0xFFF28293), decode(0x01C0A103), decode(0xFE010CE3)};
+            timeout.bytes = 12;
+            check(!is_poll_loop(timeout), "Poll loop: a counter carried between iterations isn't one");
+
+            Block store = spin; // sw x2, 0(x1) instead of the counter
+            store.insns = {decode(0x0020A023), decode(0x01C0A103), decode(0xFE010CE3)};
+            store.bytes = 12;
+            check(!is_poll_loop(store), "Poll loop: no stores");
+        }
+
+        // poll_iss has been spinning on source 7's priority since t=0. It
+        // should have slept through it, with the time still showing up as
+        // retired instructions
+        ISS* p = poll_iss_ptr;
+        sc_core::sc_time q(cfg::DEFAULT_QUANTUM_US, sc_core::SC_US);
+        sc_core::sc_time ran = sc_core::sc_time(10, sc_core::SC_NS) * static_cast<double>(p->insn_count);
+        sc_core::sc_time now = sc_core::sc_time_stamp();
+        check(p->poll_skips > 0 && p->poll_skipped_insns > p->insn_count / 2,
+              "Poll loop sleeps instead of spinning");
+        check(ran + q > now && ran < now + q, "Poll loop credits the skipped instructions");
+
+        plic_write(cfg::IRQ_AUDIO * 4, 3);
+        wait(sc_core::sc_time(1, sc_core::SC_MS), p->halted_event);
+        check(p->state.get_reg(2) == 3, "Poll loop sees the register change");
+        uint64_t minstret = p->state.get_regu(3);
+        check(minstret + 2 == p->insn_count && minstret * 10 > (sc_core::sc_time_stamp() - q).to_seconds() * 1e9,
+              "Poll loop minstret keeps up with simulated time");
+        plic_write(cfg::IRQ_AUDIO * 4, 0);
+        p->report_stats(std::cout);
     }
 
     void step13_uart() {
@@ -1994,10 +3109,16 @@ struct TestInitiator : public sc_core::sc_module {
         timer_write(0x00, 50); // time = 50
         check(timer_irq, "Timer IRQ at cmp");
 
-        // Tick thread
+        // Time follows simulated time, the compare fires on its own
         uint64_t before = timer_ptr->get_time();
         wait(sc_core::sc_time(500, sc_core::SC_NS));
-        check(timer_ptr->get_time() > before, "Timer ticks via thread");
+        check(timer_ptr->get_time() > before, "Timer time advances with simulated time");
+        timer_write(0x08, static_cast<uint32_t>(timer_ptr->get_time() + 5));
+        check(!timer_irq, "Timer compare in the future doesn't fire yet");
+        wait(sc_core::sc_time(600, sc_core::SC_NS));
+        check(timer_irq, "Timer fires at the compare deadline");
+        timer_write(0x10, 0);
+        timer_ptr->on_irq = nullptr;
     }
 
     void step17_spi() {
@@ -2198,13 +3319,13 @@ int sc_main(int, char*[])
     bus.map(cfg::RAM_BASE, 0x100000);
 
     // Step 11: CLINT (100ns tick = 10MHz mtime clock)
-    CLINT clint("clint", sc_core::sc_time(100, sc_core::SC_NS));
+    CLINT clint("clint", sc_core::sc_time(100, sc_core::SC_NS), 2);
     bus.isock.bind(clint.tsock);
     bus.map(cfg::CLINT_BASE, cfg::CLINT_SIZE);
     tester.clint_ptr = &clint;
 
     // Step 12: PLIC
-    PLIC plic("plic");
+    PLIC plic("plic", 2);
     bus.isock.bind(plic.tsock);
     bus.map(cfg::PLIC_BASE, cfg::PLIC_SIZE);
     tester.plic_ptr = &plic;
@@ -2268,6 +3389,705 @@ int sc_main(int, char*[])
     };
     std::memcpy(ram.data(), program, sizeof(program));
 
+    // Second ISS for the block engine, runs out of RAM+0x8000:
+    //   loop 100 times, then trap on a misaligned LW in the middle of a block
+    ISS blk_iss("blk_iss", cfg::RAM_BASE + 0x8000);
+    blk_iss.stop_on_ebreak = true;
+    blk_iss.isock.bind(bus.tsock);
+    tester.blk_iss_ptr = &blk_iss;
+
+    uint32_t blk_prog[] = {
+        0x00000093, // 00: addi x1, x0, 0
+        0x06400113, // 04: addi x2, x0, 100
+        0x00108093, // 08: addi x1, x1, 1
+        0xFE209EE3, // 0C: bne  x1, x2, -4
+        0x800081B7, // 10: lui  x3, 0x80008
+        0x04018213, // 14: addi x4, x3, 0x40
+        0x30521073, // 18: csrw mtvec, x4
+        0x00500293, // 1C: addi x5, x0, 5
+        0x0011A303, // 20: lw   x6, 1(x3)   ; misaligned -> trap
+        0x00700393, // 24: addi x7, x0, 7   ; never runs
+    };
+    std::memcpy(ram.data() + 0x8000, blk_prog, sizeof(blk_prog));
+    uint32_t ebreak = 0x00100073;
+    std::memcpy(ram.data() + 0x8040, &ebreak, sizeof(ebreak));
+
+    // Same checksum loop twice: interpreter at RAM+0x9000, JIT at RAM+0xB000
+    // Data is PC-relative (one page up) so the two don't step on each other
+    ISS jit_ref("jit_ref", cfg::RAM_BASE + 0x9000);
+    jit_ref.stop_on_ebreak = true;
+    jit_ref.isock.bind(bus.tsock);
+    tester.jit_ref_ptr = &jit_ref;
+
+    ISS jit_iss("jit_iss", cfg::RAM_BASE + 0xB000);
+    jit_iss.stop_on_ebreak = true;
+    jit_iss.engine = ExecEngine::JIT;
+    jit_iss.isock.bind(bus.tsock);
+    tester.jit_iss_ptr = &jit_iss;
+
+    uint32_t jit_prog[] = {
+        0x00001197, // 00: auipc x3, 1          ; x3 = data page
+        0x00000093, // 04: addi  x1, x0, 0
+        0x0C800113, // 08: addi  x2, x0, 200
+        0x12345537, // 0C: lui   x10, 0x12345
+        0x67850513, // 10: addi  x10, x10, 0x678
+        0x021505B3, // 14: mul   x11, x10, x1    ; loop:
+        0x02A53633, // 18: mulhu x12, x10, x10
+        0x00C54533, // 1C: xor   x10, x10, x12
+        0x00B50533, // 20: add   x10, x10, x11
+        0x00209693, // 24: slli  x13, x1, 2
+        0x003686B3, // 28: add   x13, x13, x3
+        0x00A6A023, // 2C: sw    x10, 0(x13)
+        0x0006A703, // 30: lw    x14, 0(x13)
+        0x0016C783, // 34: lbu   x15, 1(x13)
+        0x00269803, // 38: lh    x16, 2(x13)
+        0x00F50533, // 3C: add   x10, x10, x15
+        0x41050533, // 40: sub   x10, x10, x16
+        0x40355893, // 44: srai  x17, x10, 3
+        0x00A8B933, // 48: sltu  x18, x17, x10
+        0x01250533, // 4C: add   x10, x10, x18
+        0x40A69023, // 50: sh    x10, 0x400(x13)
+        0x40E68123, // 54: sb    x14, 0x402(x13)
+        0xFEA1AE23, // 58: sw    x10, -4(x3)     ; code page -> side exit
+        0x022579B3, // 5C: remu  x19, x10, x2    ; JIT stops here
+        0x01350533, // 60: add   x10, x10, x19
+        0x00108093, // 64: addi  x1, x1, 1
+        0xFA2096E3, // 68: bne   x1, x2, loop
+        0x00100073, // 6C: ebreak
+    };
+    std::memcpy(ram.data() + 0x9000, jit_prog, sizeof(jit_prog));
+    std::memcpy(ram.data() + 0xB000, jit_prog, sizeof(jit_prog));
+
+    ISS thr_iss("thr_iss", cfg::RAM_BASE + 0xD000);
+    thr_iss.stop_on_ebreak = true;
+    thr_iss.engine = ExecEngine::THREADED;
+    thr_iss.isock.bind(bus.tsock);
+    tester.thr_iss_ptr = &thr_iss;
+    std::memcpy(ram.data() + 0xD000, jit_prog, sizeof(jit_prog));
+
+    // Paged-mode ISS at RAM+0x10000: identity-map RAM with one Sv32 megapage,
+    // mret into S-mode, loop + load/store, ecall back to M
+    ISS pg_iss("pg_iss", cfg::RAM_BASE + 0x10000);
+    pg_iss.stop_on_ebreak = true;
+    pg_iss.isock.bind(bus.tsock);
+    tester.pg_iss_ptr = &pg_iss;
+
+    uint32_t pg_prog[] = {
+        0x800112B7, // 00: lui   x5, 0x80011     ; root page table
+        0x00C2D293, // 04: srli  x5, x5, 12
+        0x80000337, // 08: lui   x6, 0x80000     ; satp.MODE = Sv32
+        0x0062E2B3, // 0C: or    x5, x5, x6
+        0x00000397, // 10: auipc x7, 0
+        0x03038393, // 14: addi  x7, x7, 0x30    ; S-mode entry at +0x40
+        0x34139073, // 18: csrw  mepc, x7
+        0x00001437, // 1C: lui   x8, 1
+        0x00145413, // 20: srli  x8, x8, 1       ; MPP = S
+        0x30041073, // 24: csrw  mstatus, x8
+        0x00000497, // 28: auipc x9, 0
+        0x05848493, // 2C: addi  x9, x9, 0x58    ; handler at +0x80
+        0x30549073, // 30: csrw  mtvec, x9
+        0x18029073, // 34: csrw  satp, x5
+        0x30200073, // 38: mret
+        0x00000013, // 3C: nop
+        0x00000513, // 40: addi  x10, x0, 0      ; S-mode, paged
+        0x03200593, // 44: addi  x11, x0, 50
+        0x00150513, // 48: addi  x10, x10, 1
+        0xFEB51EE3, // 4C: bne   x10, x11, -4
+        0x80012637, // 50: lui   x12, 0x80012
+        0x00A62023, // 54: sw    x10, 0(x12)
+        0x00062683, // 58: lw    x13, 0(x12)
+        0x00000073, // 5C: ecall                 ; back to M
+    };
+    std::memcpy(ram.data() + 0x10000, pg_prog, sizeof(pg_prog));
+    std::memcpy(ram.data() + 0x10080, &ebreak, sizeof(ebreak));
+    uint32_t ram_megapage = ((cfg::RAM_BASE >> 12) << 10) | 0xCF; // V|R|W|X|A|D
+    std::memcpy(ram.data() + 0x11000 + (cfg::RAM_BASE >> 22) * 4, &ram_megapage, 4);
+
+    // BootROM ISS at ROM+0x100: constant in ROM, copied through RAM and SRAM
+    ISS rom_iss("rom_iss", cfg::BOOTROM_BASE + 0x100);
+    rom_iss.stop_on_ebreak = true;
+    rom_iss.isock.bind(bus.tsock);
+    tester.rom_iss_ptr = &rom_iss;
+
+    uint32_t rom_prog[] = {
+        0x00000097, // 00: auipc x1, 0           ; x1 = ROM+0x100
+        0x1000A103, // 04: lw    x2, 0x100(x1)   ; ROM constant
+        0x800131B7, // 08: lui   x3, 0x80013     ; RAM
+        0x01000237, // 0C: lui   x4, 0x01000     ; SRAM
+        0x01400393, // 10: addi  x7, x0, 20
+        0x0021A023, // 14: sw    x2, 0(x3)       ; loop:
+        0x0001A403, // 18: lw    x8, 0(x3)
+        0x10822023, // 1C: sw    x8, 0x100(x4)
+        0x10022283, // 20: lw    x5, 0x100(x4)
+        0xFFF38393, // 24: addi  x7, x7, -1
+        0xFE0396E3, // 28: bne   x7, x0, loop
+        0x1000A023, // 2C: sw    x0, 0x100(x1)   ; ROM ignores this
+        0x1000A303, // 30: lw    x6, 0x100(x1)
+        0x00100073, // 34: ebreak
+    };
+    std::memcpy(bootrom.data() + 0x100, rom_prog, sizeof(rom_prog));
+    uint32_t rom_const = 0xCAFEF00D;
+    std::memcpy(bootrom.data() + 0x200, &rom_const, sizeof(rom_const));
+
+    // IRQ ISS at RAM+0x14000: enable MTIE + MIE and spin until the tester
+    // raises MTIP, handler at +0x40 halts
+    ISS irq_iss("irq_iss", cfg::RAM_BASE + 0x14000);
+    irq_iss.stop_on_ebreak = true;
+    irq_iss.isock.bind(bus.tsock);
+    tester.irq_iss_ptr = &irq_iss;
+
+    uint32_t irq_prog[] = {
+        0x00000097, // 00: auipc x1, 0
+        0x04008093, // 04: addi  x1, x1, 0x40    ; handler at +0x40
+        0x30509073, // 08: csrw  mtvec, x1
+        0x08000113, // 0C: addi  x2, x0, 0x80
+        0x30411073, // 10: csrw  mie, x2         ; MTIE
+        0x00800193, // 14: addi  x3, x0, 8
+        0x30019073, // 18: csrw  mstatus, x3     ; MIE
+        0x0000006F, // 1C: j     .
+    };
+    std::memcpy(ram.data() + 0x14000, irq_prog, sizeof(irq_prog));
+    std::memcpy(ram.data() + 0x14040, &ebreak, sizeof(ebreak));
+
+    // Fusion: every fused idiom once plus a lui+lw whose load traps. Same
+    // program under the interpreter at RAM+0x15000 and threaded at RAM+0x16000,
+    // both use the absolute data at RAM+0x15200
+    ISS fuse_iss("fuse_iss", cfg::RAM_BASE + 0x15000);
+    fuse_iss.stop_on_ebreak = true;
+    fuse_iss.isock.bind(bus.tsock);
+    tester.fuse_iss_ptr = &fuse_iss;
+
+    ISS fuse_thr("fuse_thr", cfg::RAM_BASE + 0x16000);
+    fuse_thr.stop_on_ebreak = true;
+    fuse_thr.engine = ExecEngine::THREADED;
+    fuse_thr.isock.bind(bus.tsock);
+    tester.fuse_thr_ptr = &fuse_thr;
+
+    uint32_t fuse_prog[] = {
+        0x00000097, // 00: auipc x1, 0
+        0x08008093, // 04: addi  x1, x1, 0x80    ; handler at +0x80
+        0x30509073, // 08: csrw  mtvec, x1
+        0x800162B7, // 0C: lui   x5, 0x80016     ; lui+addi
+        0x90028293, // 10: addi  x5, x5, -0x700  ; x5 = RAM+0x15900
+        0x01429313, // 14: slli  x6, x5, 20      ; slli+srli
+        0x01C35313, // 18: srli  x6, x6, 28      ; x6 = 9
+        0x800153B7, // 1C: lui   x7, 0x80015     ; lui+lw
+        0x2003A403, // 20: lw    x8, 0x200(x7)
+        0x800154B7, // 24: lui   x9, 0x80015     ; lui+sw
+        0x2084A223, // 28: sw    x8, 0x204(x9)
+        0x00000517, // 2C: auipc x10, 0          ; auipc+jalr
+        0x010505E7, // 30: jalr  x11, 0x10(x10)  ; -> 3C
+        0x00100073, // 34: ebreak                ; skipped
+        0x00100073, // 38: ebreak                ; skipped
+        0x80015637, // 3C: lui   x12, 0x80015    ; lui+lw, misaligned
+        0x20162683, // 40: lw    x13, 0x201(x12) ; traps, x12 already set
+        0x00100713, // 44: addi  x14, x0, 1      ; never runs
+    };
+    uint32_t fuse_data = 0xFEEDC0DE;
+    std::memcpy(ram.data() + 0x15000, fuse_prog, sizeof(fuse_prog));
+    std::memcpy(ram.data() + 0x15080, &ebreak, sizeof(ebreak));
+    std::memcpy(ram.data() + 0x15200, &fuse_data, sizeof(fuse_data));
+    std::memcpy(ram.data() + 0x16000, fuse_prog, sizeof(fuse_prog));
+    std::memcpy(ram.data() + 0x16080, &ebreak, sizeof(ebreak));
+
+    // AOT: loop + call + loads/stores, then patch the next block and take a
+    // misaligned load. Translated for RAM+0x17000, the interpreter runs the
+    // same bytes at RAM+0x19000. Data one page up from each
+    ISS aot_ref("aot_ref", cfg::RAM_BASE + 0x19000);
+    aot_ref.stop_on_ebreak = true;
+    aot_ref.isock.bind(bus.tsock);
+    tester.aot_ref_ptr = &aot_ref;
+
+    ISS aot_iss("aot_iss", cfg::RAM_BASE + 0x17000);
+    aot_iss.stop_on_ebreak = true;
+    aot_iss.isock.bind(bus.tsock);
+    tester.aot_iss_ptr = &aot_iss;
+
+    uint32_t aot_prog[0x40] = {
+        0x00001197, // 00: auipc x3, 1           ; x3 = data page
+        0x00000097, // 04: auipc x1, 0
+        0x0F808093, // 08: addi  x1, x1, 0xF8    ; handler at +0xFC
+        0x30509073, // 0C: csrw  mtvec, x1       ; AOT stops, ISS runs it
+        0x00000293, // 10: addi  x5, x0, 0
+        0x03200313, // 14: addi  x6, x0, 50
+        0x00700513, // 18: addi  x10, x0, 7
+        0x064000EF, // 1C: jal   x1, func        ; loop:
+        0x00229393, // 20: slli  x7, x5, 2
+        0x003383B3, // 24: add   x7, x7, x3
+        0x00A3A023, // 28: sw    x10, 0(x7)
+        0x00239403, // 2C: lh    x8, 2(x7)
+        0x0013C483, // 30: lbu   x9, 1(x7)
+        0x00850533, // 34: add   x10, x10, x8
+        0x00954533, // 38: xor   x10, x10, x9
+        0x00128293, // 3C: addi  x5, x5, 1
+        0xFC629EE3, // 40: bne   x5, x6, loop
+        0x00000597, // 44: auipc x11, 0
+        0x00201637, // 48: lui   x12, 0x00201
+        0xA1360613, // 4C: addi  x12, x12, -0x5ED ; x12 = addi x20, x0, 2
+        0x00C5AA23, // 50: sw    x12, 0x14(x11)  ; patch 0x58
+        0x0040006F, // 54: j     .+4
+        0x00100A13, // 58: addi  x20, x0, 1      ; patched, AOT block is stale
+        0x0040006F, // 5C: j     .+4
+        0x0011AA83, // 60: lw    x21, 1(x3)      ; misaligned: AOT stops, ISS traps
+        0x00100B13, // 64: addi  x22, x0, 1      ; never runs
+    };
+    uint32_t aot_func[] = {
+        0x025506B3, // 80: mul   x13, x10, x5    ; func:
+        0x00D50533, // 84: add   x10, x10, x13
+        0x00355713, // 88: srli  x14, x10, 3
+        0x00E54533, // 8C: xor   x10, x10, x14
+        0x00008067, // 90: ret
+    };
+    std::memcpy(aot_prog + 0x80 / 4, aot_func, sizeof(aot_func));
+    aot_prog[0xFC / 4] = ebreak;
+    std::memcpy(ram.data() + 0x17000, aot_prog, sizeof(aot_prog));
+    std::memcpy(ram.data() + 0x19000, aot_prog, sizeof(aot_prog));
+    {
+        aot::CodeSegment seg;
+        seg.paddr = cfg::RAM_BASE + 0x17000;
+        seg.bytes.resize(sizeof(aot_prog));
+        std::memcpy(seg.bytes.data(), aot_prog, sizeof(aot_prog));
+        aot::GenStats gs;
+        std::string so = "/tmp/gamingcpu_aot_test.so";
+        std::string err;
+        if (aot::compile(aot::generate({seg}, &gs), so, err) && aot_iss.load_aot(so))
+            tester.aot_gen_blocks = gs.blocks;
+        else
+            std::cout << "[VP] AOT test image: " << err << "\n";
+    }
+
+    // AOT around a 32-bit instruction crossing from RAM+0x2C000's page into
+    // the next one: run it, patch both halves, run it again
+    ISS aot_cross("aot_cross", cfg::RAM_BASE + 0x2CFE0);
+    aot_cross.stop_on_ebreak = true;
+    aot_cross.isock.bind(bus.tsock);
+    tester.aot_cross_ptr = &aot_cross;
+    uint32_t cross_lo[] = {
+        0x00000597, // E0: auipc x11, 0
+        0x00201637, // E4: lui   x12, 0x00201
+        0xA1360613, // E8: addi  x12, x12, -0x5ED ; x12 = addi x20, x0, 2
+        0x0040006F, // EC: j     loop            ; so loop starts a block
+        0x00130313, // F0: addi  x6, x6, 1       ; loop:
+        0x00000013, // F4: nop
+        0x00000013, // F8: nop
+        0x0A130001, // FC: c.nop / FE: addi x20, x0, 1 (low half)
+    };
+    uint32_t cross_hi[] = {
+        0x00010010, // 00: (high half) / 02: c.nop
+        0x00200393, // 04: addi  x7, x0, 2
+        0x00730A63, // 08: beq   x6, x7, done
+        0x00C59F23, // 0C: sh    x12, 0x1E(x11)  ; patch low half
+        0x01065693, // 10: srli  x13, x12, 16
+        0x02D59023, // 14: sh    x13, 0x20(x11)  ; patch high half
+        0xFD9FF06F, // 18: j     loop
+        0x00100073, // 1C: ebreak                ; done:
+    };
+    std::memcpy(ram.data() + 0x2CFE0, cross_lo, sizeof(cross_lo));
+    std::memcpy(ram.data() + 0x2D000, cross_hi, sizeof(cross_hi));
+    {
+        aot::CodeSegment seg;
+        seg.paddr = cfg::RAM_BASE + 0x2CFE0;
+        seg.bytes.assign(ram.data() + 0x2CFE0, ram.data() + 0x2D020);
+        std::string err;
+        if (!aot::compile(aot::generate({seg}), "/tmp/gamingcpu_aot_cross.so", err) ||
+            !aot_cross.load_aot("/tmp/gamingcpu_aot_cross.so"))
+            std::cout << "[VP] AOT page-crossing image: " << err << "\n";
+    }
+
+    // WFI hart for step 11: enable MTIE (not MIE) and sleep, the CLINT wakes it
+    ISS wfi_iss("wfi_iss", cfg::RAM_BASE + 0x1B000);
+    wfi_iss.stop_on_ebreak = true;
+    wfi_iss.isock.bind(bus.tsock);
+    tester.wfi_iss_ptr = &wfi_iss;
+    uint32_t wfi_prog[] = {
+        0x08000113, // 00: addi  x2, x0, 0x80
+        0x30411073, // 04: csrw  mie, x2         ; MTIE, MIE stays off
+        0x10500073, // 08: wfi                   ; sleeps until mtimecmp
+        0x344021F3, // 0C: csrr  x3, mip
+        0x00100073, // 10: ebreak
+    };
+    std::memcpy(ram.data() + 0x1B000, wfi_prog, sizeof(wfi_prog));
+
+    // Misaligned hart: loads/stores inside a page, across two mapped 4K
+    // pages, and a store whose high half hits an unmapped one. Code at
+    // RAM+0x1D000, root table 0x1E000, leaf table 0x1F000, data 0x20000-0x21FFF
+    ISS mis_iss("mis_iss", cfg::RAM_BASE + 0x1D000);
+    mis_iss.stop_on_ebreak = true;
+    mis_iss.state.misaligned_ok = true;
+    mis_iss.isock.bind(bus.tsock);
+    tester.mis_iss_ptr = &mis_iss;
+    uint32_t mis_prog[] = {
+        0x8001E2B7, // 00: lui   x5, 0x8001E     ; root page table
+        0x00C2D293, // 04: srli  x5, x5, 12
+        0x80000337, // 08: lui   x6, 0x80000     ; satp.MODE = Sv32
+        0x0062E2B3, // 0C: or    x5, x5, x6
+        0x00000397, // 10: auipc x7, 0
+        0x03038393, // 14: addi  x7, x7, 0x30    ; S-mode entry at +0x40
+        0x34139073, // 18: csrw  mepc, x7
+        0x00001437, // 1C: lui   x8, 1
+        0x00145413, // 20: srli  x8, x8, 1       ; MPP = S
+        0x30041073, // 24: csrw  mstatus, x8
+        0x00000497, // 28: auipc x9, 0
+        0x05848493, // 2C: addi  x9, x9, 0x58    ; handler at +0x80
+        0x30549073, // 30: csrw  mtvec, x9
+        0x18029073, // 34: csrw  satp, x5
+        0x30200073, // 38: mret
+        0x00000013, // 3C: nop
+        0x80020637, // 40: lui   x12, 0x80020    ; S-mode, 4K pages
+        0x00162683, // 44: lw    x13, 1(x12)     ; inside one page
+        0x00361703, // 48: lh    x14, 3(x12)
+        0x7FF60793, // 4C: addi  x15, x12, 0x7FF
+        0x7FF78793, // 50: addi  x15, x15, 0x7FF ; 0x80020FFE
+        0x0007A803, // 54: lw    x16, 0(x15)     ; across into 0x80021000
+        0x00D7A0A3, // 58: sw    x13, 1(x15)     ; same, store
+        0x0017A883, // 5C: lw    x17, 1(x15)
+        0x80022937, // 60: lui   x18, 0x80022
+        0xFFE90913, // 64: addi  x18, x18, -2    ; 0x80021FFE
+        0x00D92023, // 68: sw    x13, 0(x18)     ; 0x80022000 unmapped: fault
+        0x00100073, // 6C: ebreak
+    };
+    std::memcpy(ram.data() + 0x1D000, mis_prog, sizeof(mis_prog));
+    std::memcpy(ram.data() + 0x1D080, &ebreak, sizeof(ebreak));
+    uint32_t mis_l0 = ((cfg::RAM_BASE + 0x1F000) >> 12) << 10 | 0x01; // V, next level
+    std::memcpy(ram.data() + 0x1E000 + (cfg::RAM_BASE >> 22) * 4, &mis_l0, 4);
+    for (uint32_t pg : {0x1Du, 0x20u, 0x21u}) {
+        uint32_t pte = ((cfg::RAM_BASE >> 12) + pg) << 10 | 0xCF; // V|R|W|X|A|D
+        std::memcpy(ram.data() + 0x1F000 + (((cfg::RAM_BASE >> 12) + pg) & 0x3FF) * 4, &pte, 4);
+    }
+    for (int k = 0; k < 8; k++) {
+        ram.data()[0x20000 + k] = static_cast<uint8_t>(0x11 * (k + 1));
+        ram.data()[0x20FFC + k] = static_cast<uint8_t>(0xA0 + k);
+    }
+    std::memset(ram.data() + 0x21FFC, 0xEE, 4);
+
+    // Zba/Zbb/Zbs program at RAM+0x22000, once per engine
+    ISS bit_iss("bit_iss", cfg::RAM_BASE + 0x22000);
+    bit_iss.stop_on_ebreak = true;
+    bit_iss.isock.bind(bus.tsock);
+    tester.bit_iss_ptr = &bit_iss;
+    ISS bit_thr("bit_thr", cfg::RAM_BASE + 0x22000);
+    bit_thr.stop_on_ebreak = true;
+    bit_thr.engine = ExecEngine::THREADED;
+    bit_thr.isock.bind(bus.tsock);
+    tester.bit_thr_ptr = &bit_thr;
+    uint32_t bit_prog[] = {
+        0x80F000B7, // 00: lui    x1, 0x80F00
+        0x12308093, // 04: addi   x1, x1, 0x123  ; 0x80F00123
+        0x00500113, // 08: addi   x2, x0, 5
+        0x2020C1B3, // 0C: sh2add x3, x1, x2
+        0x4020F233, // 10: andn   x4, x1, x2
+        0x60011293, // 14: clz    x5, x2
+        0x60109313, // 18: ctz    x6, x1
+        0x60209393, // 1C: cpop   x7, x1
+        0x0A20E433, // 20: max    x8, x1, x2
+        0x0A20F4B3, // 24: maxu   x9, x1, x2
+        0x6980D513, // 28: rev8   x10, x1
+        0x2870D593, // 2C: orc.b  x11, x1
+        0x6070D613, // 30: rori   x12, x1, 7
+        0x29F01693, // 34: bseti  x13, x0, 31
+        0x4820D733, // 38: bext   x14, x1, x2
+        0x60409793, // 3C: sext.b x15, x1
+        0x0800C833, // 40: zext.h x16, x1
+        0x682098B3, // 44: binv   x17, x1, x2
+        0x00100073, // 48: ebreak
+    };
+    std::memcpy(ram.data() + 0x22000, bit_prog, sizeof(bit_prog));
+
+    // F extension program at RAM+0x23000 (data at 0x24030), once per engine.
+    // The threaded engine has no FP handlers, those go through execute()
+    ISS fp_iss("fp_iss", cfg::RAM_BASE + 0x23000);
+    fp_iss.stop_on_ebreak = true;
+    fp_iss.isock.bind(bus.tsock);
+    tester.fp_iss_ptr = &fp_iss;
+    ISS fp_thr("fp_thr", cfg::RAM_BASE + 0x23000);
+    fp_thr.stop_on_ebreak = true;
+    fp_thr.engine = ExecEngine::THREADED;
+    fp_thr.isock.bind(bus.tsock);
+    tester.fp_thr_ptr = &fp_thr;
+    uint32_t fp_prog[] = {
+        0x000022B7, // 00: lui    x5, 0x2         ; mstatus.FS = Initial
+        0x3002A073, // 04: csrrs  x0, mstatus, x5
+        0x3FC000B7, // 08: lui    x1, 0x3FC00     ; 1.5f
+        0xF00080D3, // 0C: fmv.w.x f1, x1
+        0x40200137, // 10: lui    x2, 0x40200     ; 2.5f
+        0xF0010153, // 14: fmv.w.x f2, x2
+        0x0020F1D3, // 18: fadd.s f3, f1, f2
+        0x1020F253, // 1C: fmul.s f4, f1, f2
+        0x1820F2C3, // 20: fmadd.s f5, f1, f2, f3
+        0xC0029553, // 24: fcvt.w.s x10, f5, rtz
+        0xC002B5D3, // 28: fcvt.w.s x11, f5, rup
+        0xA0209653, // 2C: flt.s  x12, f1, f2
+        0x00001A17, // 30: auipc  x20, 1
+        0x005A2027, // 34: fsw    f5, 0(x20)
+        0x000A2387, // 38: flw    f7, 0(x20)
+        0xD0057453, // 3C: fcvt.s.w f8, x10
+        0x001026F3, // 40: csrrs  x13, fflags, x0
+        0x00101073, // 44: csrrw  x0, fflags, x0  ; clear
+        0x1820F353, // 48: fdiv.s f6, f1, f2      ; inexact
+        0x00102773, // 4C: csrrs  x14, fflags, x0
+        0x300027F3, // 50: csrrs  x15, mstatus, x0
+        0x00100073, // 54: ebreak
+    };
+    std::memcpy(ram.data() + 0x23000, fp_prog, sizeof(fp_prog));
+
+    // SMP: four harts on a pool of four threads, same program at RAM+0x25000,
+    // shared counters at RAM+0x26000 and one slot per hart after them
+    HartPool smp_pool("smp_pool", 4);
+    tester.smp_pool_ptr = &smp_pool;
+    std::vector<std::unique_ptr<ISS>> smp_harts;
+    for (uint32_t k = 0; k < 4; k++) {
+        std::string n = "smp" + std::to_string(k);
+        smp_harts.push_back(std::make_unique<ISS>(n.c_str(), cfg::RAM_BASE + 0x25000));
+        ISS& h = *smp_harts.back();
+        h.stop_on_ebreak = true;
+        h.state.csr.hartid = k;
+        h.pool = &smp_pool;
+        h.isock.bind(bus.tsock);
+        tester.smp_harts.push_back(&h);
+    }
+    uint32_t smp_prog[] = {
+        0xF14020F3, // 00: csrr   x1, mhartid
+        0x80026137, // 04: lui    x2, 0x80026     ; counters
+        0x00410313, // 08: addi   x6, x2, 4
+        0x7D000193, // 0C: addi   x3, x0, 2000
+        0x00100213, // 10: addi   x4, x0, 1
+        0x0041202F, // 14: amoadd.w x0, x4, (x2)
+        0x100322AF, // 18: lr.w   x5, (x6)
+        0x00128293, // 1C: addi   x5, x5, 1
+        0x185323AF, // 20: sc.w   x7, x5, (x6)
+        0xFE039AE3, // 24: bne    x7, x0, 18
+        0xFFF18193, // 28: addi   x3, x3, -1
+        0xFE0194E3, // 2C: bne    x3, x0, 14
+        0x00209413, // 30: slli   x8, x1, 2
+        0x00240433, // 34: add    x8, x8, x2
+        0x00142823, // 38: sw     x1, 0x10(x8)    ; slot[hartid]
+        0x0200C4B7, // 3C: lui    x9, 0x0200C
+        0xFF84A503, // 40: lw     x10, -8(x9)     ; mtime, not DMI
+        0x00100073, // 44: ebreak
+    };
+    std::memcpy(ram.data() + 0x25000, smp_prog, sizeof(smp_prog));
+    std::memset(ram.data() + 0x26010, 0xFF, 16);
+
+    // Interception: the same program at RAM+0x27000 on two harts, one with
+    // native memcpy/strlen/FixedMul hooks, one with them registered but off.
+    // mhartid picks each one's memcpy destination in the data at RAM+0x28000
+    ISS icpt_iss("icpt_iss", cfg::RAM_BASE + 0x27000);
+    ISS icpt_ref("icpt_ref", cfg::RAM_BASE + 0x27000);
+    tester.icpt_iss_ptr = &icpt_iss;
+    tester.icpt_ref_ptr = &icpt_ref;
+    icpt_ref.state.csr.hartid = 1;
+    for (ISS* h : {&icpt_iss, &icpt_ref}) {
+        h->stop_on_ebreak = true;
+        h->isock.bind(bus.tsock);
+        // memcpy, strlen, FixedMul
+        const std::pair<int, uint32_t> hooks[] = {{0, 0x27080}, {2, 0x270C0}, {3, 0x270E0}};
+        for (auto [k, off] : hooks) {
+            const intercept::Builtin& b = intercept::BUILTINS[k];
+            Intercept ic;
+            ic.name = b.symbol;
+            ic.fn = b.fn;
+            ic.cost = b.cost;
+            ic.cost_per_16b = b.cost_per_16b;
+            ic.enabled = h == &icpt_iss;
+            h->add_intercept(cfg::RAM_BASE + off, ic);
+        }
+    }
+    uint32_t icpt_main[] = {
+        0x80028437, // 00: lui    x8, 0x80028     ; data
+        0xF14024F3, // 04: csrr   x9, mhartid
+        0x00849493, // 08: slli   x9, x9, 8
+        0x00940533, // 0C: add    x10, x8, x9
+        0x10050513, // 10: addi   x10, x10, 0x100 ; dst
+        0x00040593, // 14: addi   x11, x8, 0      ; src
+        0x04000613, // 18: addi   x12, x0, 64
+        0x064000EF, // 1C: jal    x1, memcpy
+        0x00040513, // 20: addi   x10, x8, 0
+        0x09C000EF, // 24: jal    x1, strlen
+        0x00050A13, // 28: addi   x20, x10, 0
+        0x00030537, // 2C: lui    x10, 0x30       ; 3.0
+        0x000285B7, // 30: lui    x11, 0x28       ; 2.5
+        0x0AC000EF, // 34: jal    x1, FixedMul
+        0x00050A93, // 38: addi   x21, x10, 0
+        0x00100073, // 3C: ebreak
+    };
+    uint32_t icpt_memcpy[] = {
+        0x00050293, // 80: addi   x5, x10, 0
+        0x00060E63, // 84: beq    x12, x0, A0
+        0x0005C303, // 88: lbu    x6, 0(x11)
+        0x00628023, // 8C: sb     x6, 0(x5)
+        0x00158593, // 90: addi   x11, x11, 1
+        0x00128293, // 94: addi   x5, x5, 1
+        0xFFF60613, // 98: addi   x12, x12, -1
+        0xFE9FF06F, // 9C: jal    x0, 84
+        0x00008067, // A0: ret
+    };
+    uint32_t icpt_strlen[] = {
+        0x00050293, // C0: addi   x5, x10, 0
+        0x0002C303, // C4: lbu    x6, 0(x5)
+        0x00030663, // C8: beq    x6, x0, D4
+        0x00128293, // CC: addi   x5, x5, 1
+        0xFF5FF06F, // D0: jal    x0, C4
+        0x40A28533, // D4: sub    x10, x5, x10
+        0x00008067, // D8: ret
+    };
+    uint32_t icpt_fixedmul[] = {
+        0x02B502B3, // E0: mul    x5, x10, x11
+        0x02B51333, // E4: mulh   x6, x10, x11
+        0x0102D293, // E8: srli   x5, x5, 16
+        0x01031313, // EC: slli   x6, x6, 16
+        0x0062E533, // F0: or     x10, x5, x6
+        0x00008067, // F4: ret
+    };
+    std::memcpy(ram.data() + 0x27000, icpt_main, sizeof(icpt_main));
+    std::memcpy(ram.data() + 0x27080, icpt_memcpy, sizeof(icpt_memcpy));
+    std::memcpy(ram.data() + 0x270C0, icpt_strlen, sizeof(icpt_strlen));
+    std::memcpy(ram.data() + 0x270E0, icpt_fixedmul, sizeof(icpt_fixedmul));
+    for (uint32_t k = 0; k < 64; k++)
+        ram.data()[0x28000 + k] = static_cast<uint8_t>(k < 12 ? "intercepted!"[k] : k == 12 ? 0 : k);
+
+    // Semihosting program at RAM+0x29000, argument blocks and buffers at
+    // RAM+0x2A000, files in the host temp dir. sh_off runs it without
+    icpt_iss.semihosting = true; // its plain ebreak has to still stop it
+    ISS sh_iss("sh_iss", cfg::RAM_BASE + 0x29000);
+    ISS sh_off("sh_off", cfg::RAM_BASE + 0x29000);
+    sh_iss.semihosting = true;
+    sh_iss.semihost().root = std::filesystem::temp_directory_path().string();
+    tester.sh_iss_ptr = &sh_iss;
+    tester.sh_off_ptr = &sh_off;
+    for (ISS* h : {&sh_iss, &sh_off}) {
+        h->stop_on_ebreak = true;
+        h->isock.bind(bus.tsock);
+    }
+    {
+        std::ofstream in(std::filesystem::temp_directory_path() / "gamingcpu_sh_in.bin", std::ios::binary);
+        in << "0123456789abcdefghij";
+    }
+    uint32_t sh_prog[] = {
+        0x8002A437, // 00: lui    x8, 0x8002A     ; data
+        0x00100513, // 04: addi   x10, x0, 0x1    ; SYS_OPEN :tt
+        0x01040593, // 08: addi   x11, x8, 0x10
+        0x01F01013, // 0C: slli   x0, x0, 0x1f
+        0x00100073, // 10: ebreak
+        0x40705013, // 14: srai   x0, x0, 7
+        0x02A42823, // 18: sw     x10, 0x30(x8)
+        0x00500513, // 1C: addi   x10, x0, 0x5    ; SYS_WRITE
+        0x03040593, // 20: addi   x11, x8, 0x30
+        0x01F01013, // 24: slli   x0, x0, 0x1f
+        0x00100073, // 28: ebreak
+        0x40705013, // 2C: srai   x0, x0, 7
+        0x00050A13, // 30: addi   x20, x10, 0
+        0x00100513, // 34: addi   x10, x0, 0x1    ; SYS_OPEN in
+        0x06040593, // 38: addi   x11, x8, 0x60
+        0x01F01013, // 3C: slli   x0, x0, 0x1f
+        0x00100073, // 40: ebreak
+        0x40705013, // 44: srai   x0, x0, 7
+        0x06A42823, // 48: sw     x10, 0x70(x8)
+        0x00600513, // 4C: addi   x10, x0, 0x6    ; SYS_READ
+        0x07040593, // 50: addi   x11, x8, 0x70
+        0x01F01013, // 54: slli   x0, x0, 0x1f
+        0x00100073, // 58: ebreak
+        0x40705013, // 5C: srai   x0, x0, 7
+        0x00050A93, // 60: addi   x21, x10, 0
+        0x00100513, // 64: addi   x10, x0, 0x1    ; SYS_OPEN out
+        0x0A040593, // 68: addi   x11, x8, 0xA0
+        0x01F01013, // 6C: slli   x0, x0, 0x1f
+        0x00100073, // 70: ebreak
+        0x40705013, // 74: srai   x0, x0, 7
+        0x0AA42823, // 78: sw     x10, 0xB0(x8)
+        0x0CA42023, // 7C: sw     x10, 0xC0(x8)
+        0x00500513, // 80: addi   x10, x0, 0x5    ; SYS_WRITE
+        0x0B040593, // 84: addi   x11, x8, 0xB0
+        0x01F01013, // 88: slli   x0, x0, 0x1f
+        0x00100073, // 8C: ebreak
+        0x40705013, // 90: srai   x0, x0, 7
+        0x00050B13, // 94: addi   x22, x10, 0
+        0x00200513, // 98: addi   x10, x0, 0x2    ; SYS_CLOSE
+        0x0C040593, // 9C: addi   x11, x8, 0xC0
+        0x01F01013, // A0: slli   x0, x0, 0x1f
+        0x00100073, // A4: ebreak
+        0x40705013, // A8: srai   x0, x0, 7
+        0x00050B93, // AC: addi   x23, x10, 0
+        0x01000513, // B0: addi   x10, x0, 0x10   ; SYS_CLOCK
+        0x00000593, // B4: addi   x11, x0, 0
+        0x01F01013, // B8: slli   x0, x0, 0x1f
+        0x00100073, // BC: ebreak
+        0x40705013, // C0: srai   x0, x0, 7
+        0x00050C13, // C4: addi   x24, x10, 0
+        0x01800513, // C8: addi   x10, x0, 0x18   ; SYS_EXIT
+        0x000205B7, // CC: lui    x11, 0x20
+        0x02658593, // D0: addi   x11, x11, 0x26  ; ApplicationExit
+        0x01F01013, // D4: slli   x0, x0, 0x1f
+        0x00100073, // D8: ebreak
+        0x40705013, // DC: srai   x0, x0, 7
+        0x00100C93, // E0: addi   x25, x0, 1      ; not reached
+        0x00100073, // E4: ebreak
+    };
+    std::memcpy(ram.data() + 0x29000, sh_prog, sizeof(sh_prog));
+    {
+        uint8_t* d = ram.data() + 0x2A000;
+        auto blk = [&](uint32_t off, uint32_t a0, uint32_t a1, uint32_t a2) {
+            uint32_t w[3] = {a0, a1, a2};
+            std::memcpy(d + off, w, sizeof(w));
+        };
+        std::memcpy(d + 0x00, ":tt", 3);
+        blk(0x10, 0x8002A000, 4, 3); // open ":tt", "w"
+        std::memcpy(d + 0x20, "semihost ok\n", 12);
+        blk(0x30, 0, 0x8002A020, 12);
+        std::memcpy(d + 0x40, "gamingcpu_sh_in.bin", 19);
+        blk(0x60, 0x8002A040, 1, 19); // "rb"
+        blk(0x70, 0, 0x8002A100, 32); // 20 bytes there
+        std::memcpy(d + 0x80, "gamingcpu_sh_out.bin", 20);
+        blk(0xA0, 0x8002A080, 5, 20); // "wb"
+        blk(0xB0, 0, 0x8002A100, 20);
+    }
+
+    // Profiled hart at RAM+0x2B000: main calls f, f calls g twice, g spins
+    // 100 times, sampled every 7 instructions
+    ISS prof_iss("prof_iss", cfg::RAM_BASE + 0x2B000);
+    Profiler prof(Profiler::Unit::INSNS, 7);
+    prof.set_symbols({{"main", cfg::RAM_BASE + 0x2B000, 8, true},
+                      {"f", cfg::RAM_BASE + 0x2B040, 20, true},
+                      {"g", cfg::RAM_BASE + 0x2B080, 16, true}});
+    prof_iss.profiler = &prof;
+    prof_iss.stop_on_ebreak = true;
+    prof_iss.isock.bind(bus.tsock);
+    tester.prof_iss_ptr = &prof_iss;
+    uint32_t prof_main[] = {
+        0x040000EF, // 00: jal    x1, f
+        0x00100073, // 04: ebreak
+    };
+    uint32_t prof_f[] = {
+        0x00008913, // 40: addi   x18, x1, 0
+        0x03C000EF, // 44: jal    x1, g
+        0x038000EF, // 48: jal    x1, g
+        0x00090093, // 4C: addi   x1, x18, 0
+        0x00008067, // 50: jalr   x0, 0(x1)
+    };
+    uint32_t prof_g[] = {
+        0x06400313, // 80: addi   x6, x0, 100
+        0xFFF30313, // 84: addi   x6, x6, -1
+        0xFE031EE3, // 88: bne    x6, x0, -4
+        0x00008067, // 8C: jalr   x0, 0(x1)
+    };
+    std::memcpy(ram.data() + 0x2B000, prof_main, sizeof(prof_main));
+    std::memcpy(ram.data() + 0x2B040, prof_f, sizeof(prof_f));
+    std::memcpy(ram.data() + 0x2B080, prof_g, sizeof(prof_g));
+
+    // Poll hart for step 12: spins on a PLIC priority register until the
+    // tester sets it
+    ISS poll_iss("poll_iss", cfg::RAM_BASE + 0x1C000);
+    poll_iss.stop_on_ebreak = true;
+    poll_iss.isock.bind(bus.tsock);
+    tester.poll_iss_ptr = &poll_iss;
+    uint32_t poll_prog[] = {
+        0x0C0000B7, // 00: lui   x1, 0x0C000     ; PLIC_BASE
+        0x01C0A103, // 04: lw    x2, 0x1C(x1)    ; source 7 priority
+        0xFE010EE3, // 08: beq   x2, x0, 04
+        0xB02021F3, // 0C: csrr  x3, minstret
+        0x00100073, // 10: ebreak
+    };
+    std::memcpy(ram.data() + 0x1C000, poll_prog, sizeof(poll_prog));
+
     // Step 14: Full platform instance with its own ISS/bus/RAM/etc
     GamingCPU_VP platform("platform");
     platform.cpu.stop_on_ebreak = true;
@@ -1,18 +1,22 @@
 #include "gamingcpu_vp.h"
 #include "util/elf_loader.h"
 #include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <thread>
 
 GamingCPU_VP::GamingCPU_VP(sc_core::sc_module_name name,
                            const std::string& elf_path,
-                           const std::string& sd_image_path)
+                           const std::string& sd_image_path,
+                           const std::string& aot_path,
+                           unsigned num_harts)
     : sc_module(name)
     , cpu("cpu", cfg::RAM_BASE)
     , bus("bus")
     , ram("ram", cfg::RAM_BASE, cfg::RAM_SIZE)
     , bootrom("bootrom", cfg::BOOTROM_BASE, cfg::BOOTROM_SIZE)
-    , clint("clint", sc_core::sc_time(1.0e9 / cfg::CLINT_TICK_HZ, sc_core::SC_NS))
-    , plic("plic")
+    , clint("clint", sc_core::sc_time(1.0e9 / cfg::CLINT_TICK_HZ, sc_core::SC_NS), num_harts)
+    , plic("plic", num_harts)
     , uart("uart")
     , gpio("gpio")
     , timer("timer", sc_core::sc_time(1.0e9 / cfg::CLINT_TICK_HZ, sc_core::SC_NS))
@@ -22,8 +26,20 @@ GamingCPU_VP::GamingCPU_VP(sc_core::sc_module_name name,
     , fb_ctrl("fb_ctrl")
     , audio("audio")
 {
+    harts.push_back(&cpu);
+    for (unsigned h = 1; h < num_harts; h++) {
+        std::string n = "cpu" + std::to_string(h);
+        extra_harts_.push_back(std::make_unique<ISS>(n.c_str(), cfg::RAM_BASE));
+        harts.push_back(extra_harts_.back().get());
+    }
+    if (num_harts > 1) {
+        unsigned threads = std::min(num_harts, std::max(std::thread::hardware_concurrency(), 1u));
+        pool = std::make_unique<HartPool>("hart_pool", threads);
+    }
+
     // Masters -> Bus
-    cpu.isock.bind(bus.tsock);
+    for (ISS* h : harts)
+        h->isock.bind(bus.tsock);
     dma.isock.bind(bus.tsock);
     sd_ctrl.isock.bind(bus.tsock);
 
@@ -67,21 +83,28 @@ GamingCPU_VP::GamingCPU_VP(sc_core::sc_module_name name,
     bus.map(cfg::AUDIO_BASE, cfg::AUDIO_SIZE);
 
     // CLINT -> ISS
-    clint.on_timer_irq = [this](bool v) {
-        cpu.state.csr.set_mip_mtip(v);
-        cpu.notify_wfi();
+    clint.on_timer_irq = [this](uint32_t h, bool v) {
+        harts[h]->state.csr.set_mip_mtip(v);
+        harts[h]->notify_wfi();
     };
-    clint.on_sw_irq = [this](bool v) {
-        cpu.state.csr.set_mip_msip(v);
-        cpu.notify_wfi();
+    clint.on_sw_irq = [this](uint32_t h, bool v) {
+        harts[h]->state.csr.set_mip_msip(v);
+        harts[h]->notify_wfi();
     };
 
-    // PLIC -> ISS
-    plic.on_external_irq = [this](bool v) {
-        cpu.state.csr.set_mip_meip(v);
-        cpu.notify_wfi();
+    // PLIC -> ISS, context n is hart n's M-mode
+    plic.on_external_irq = [this](uint32_t ctx, bool v) {
+        harts[ctx]->state.csr.set_mip_meip(v);
+        harts[ctx]->notify_wfi();
     };
 
+    for (uint32_t h = 0; h < harts.size(); h++) {
+        harts[h]->state.csr.hartid = h;
+        harts[h]->pool = pool.get();
+        // rdtime reads mtime, same clock software programs mtimecmp against
+        harts[h]->state.csr.read_mtime = [this]() { return clint.get_mtime(); };
+    }
+
     // Peripheral IRQs -> PLIC (spec Table 3)
     uart.on_irq    = [this](bool v) { plic.set_pending(cfg::IRQ_UART, v); };
     gpio.on_irq    = [this](bool v) { plic.set_pending(cfg::IRQ_GPIO, v); };
@@ -105,8 +128,56 @@ GamingCPU_VP::GamingCPU_VP(sc_core::sc_module_name name,
             else if (paddr >= cfg::BOOTROM_BASE && paddr + len <= cfg::BOOTROM_BASE + cfg::BOOTROM_SIZE)
                 std::memcpy(bootrom.data() + (paddr - cfg::BOOTROM_BASE), data, len);
         });
-        cpu.state.pc = result.entry_point;
+        for (ISS* h : harts)
+            h->state.pc = result.entry_point;
+        symbols = std::move(result.symbols);
         std::cout << "[VP] ELF loaded: entry=0x" << std::hex << result.entry_point
                   << " segments=" << std::dec << result.segments_loaded << "\n";
     }
+
+    // Stale or missing translations are harmless, blocks are hash-checked
+    if (!aot_path.empty()) {
+        for (ISS* h : harts)
+            h->load_aot(aot_path);
+    }
+}
+
+bool GamingCPU_VP::intercept(const std::string& symbol, InterceptFn fn, uint32_t cost,
+                             uint32_t cost_per_16b) {
+    const ElfSymbol* sym = nullptr;
+    for (const ElfSymbol& s : symbols) {
+        if (s.func && s.name == symbol) {
+            sym = &s;
+            break;
+        }
+    }
+    if (!sym)
+        return false;
+
+    Intercept ic;
+    ic.name = symbol;
+    ic.fn = std::move(fn);
+    ic.cost = cost;
+    ic.cost_per_16b = cost_per_16b;
+    for (ISS* h : harts)
+        h->add_intercept(sym->value & ~1u, ic);
+    return true;
+}
+
+unsigned GamingCPU_VP::intercept_builtins() {
+    unsigned n = 0;
+    for (const intercept::Builtin& b : intercept::BUILTINS)
+        n += intercept(b.symbol, b.fn, b.cost, b.cost_per_16b);
+    return n;
+}
+
+bool GamingCPU_VP::set_intercept_enabled(const std::string& symbol, bool enabled) {
+    bool found = false;
+    for (ISS* h : harts) {
+        if (Intercept* ic = h->find_intercept(symbol)) {
+            ic->enabled = enabled;
+            found = true;
+        }
+    }
+    return found;
 }
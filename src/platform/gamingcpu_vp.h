@@ -2,11 +2,15 @@
 #define GAMINGCPU_VP_PLATFORM_H
 
 #include <systemc>
+#include <memory>
+#include <vector>
 #include "platform_config.h"
 #include "mem/memory.h"
 #include "mem/bootrom.h"
 #include "bus/tlm_bus.h"
 #include "cpu/iss.h"
+#include "cpu/hart_pool.h"
+#include "util/elf_loader.h"
 #include "irq/clint.h"
 #include "irq/plic.h"
 #include "io/uart.h"
@@ -23,11 +27,14 @@
 class GamingCPU_VP : public sc_core::sc_module
 {
 public:
+    // aot_path: optional gamingcpu-aot translation of the ELF
+    // num_harts: more than one runs them on a HartPool, all from the ELF entry
     GamingCPU_VP(sc_core::sc_module_name name, const std::string& elf_path = "",
-                 const std::string& sd_image_path = "");
+                 const std::string& sd_image_path = "", const std::string& aot_path = "",
+                 unsigned num_harts = 1);
     SC_HAS_PROCESS(GamingCPU_VP);
 
-    ISS       cpu;
+    ISS       cpu; // hart 0
     TLM_Bus   bus;
     Memory    ram;
     BootROM   bootrom;
@@ -43,6 +50,23 @@ public:
     AudioOut  audio;
 
     SDCardModel sd_card;
+
+    std::vector<ISS*> harts; // by mhartid, cpu first
+    std::unique_ptr<HartPool> pool;
+
+    std::vector<ElfSymbol> symbols; // the ELF's .symtab, if it had one
+
+    // Hook a guest function by symbol name on every hart, see intercept.h.
+    // False if the ELF has no such function
+    bool intercept(const std::string& symbol, InterceptFn fn, uint32_t cost,
+                   uint32_t cost_per_16b = 0);
+    // All of intercept::BUILTINS the ELF has, returns how many
+    unsigned intercept_builtins();
+    // Per-symbol switch, for measuring what a hook buys. False if not hooked
+    bool set_intercept_enabled(const std::string& symbol, bool enabled);
+
+private:
+    std::vector<std::unique_ptr<ISS>> extra_harts_;
 };
 
 #endif // GAMINGCPU_VP_PLATFORM_H
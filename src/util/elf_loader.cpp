@@ -37,9 +37,35 @@ struct Elf32_Phdr {
     uint32_t p_align;
 };
 
+struct Elf32_Shdr {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint32_t sh_flags;
+    uint32_t sh_addr;
+    uint32_t sh_offset;
+    uint32_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint32_t sh_addralign;
+    uint32_t sh_entsize;
+};
+
+struct Elf32_Sym {
+    uint32_t st_name;
+    uint32_t st_value;
+    uint32_t st_size;
+    uint8_t  st_info;
+    uint8_t  st_other;
+    uint16_t st_shndx;
+};
+
 constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t PF_X = 1;
 constexpr uint16_t EM_RISCV = 0xF3;
 constexpr uint16_t ET_EXEC = 2;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint8_t STT_OBJECT = 1;
+constexpr uint8_t STT_FUNC = 2;
 
 void validate_header(const Elf32_Ehdr& eh) {
     // 7F 45 4C 46 or go home
@@ -61,6 +87,50 @@ void validate_header(const Elf32_Ehdr& eh) {
         throw std::runtime_error("ELF: not an executable");
 }
 
+// Named functions and objects from .symtab. Section headers are optional
+// in an executable, so no table (stripped) is fine, a broken one isn't
+void read_symbols(const uint8_t* data, size_t size, const Elf32_Ehdr& eh,
+                  std::vector<ElfSymbol>& out) {
+    if (eh.e_shoff == 0 || eh.e_shnum == 0)
+        return;
+    if (eh.e_shentsize < sizeof(Elf32_Shdr) ||
+        (size_t)eh.e_shoff + (size_t)eh.e_shnum * eh.e_shentsize > size)
+        throw std::runtime_error("ELF: section headers exceed file");
+
+    auto section = [&](uint32_t i) {
+        Elf32_Shdr sh;
+        std::memcpy(&sh, data + eh.e_shoff + i * eh.e_shentsize, sizeof(sh));
+        return sh;
+    };
+
+    for (uint16_t i = 0; i < eh.e_shnum; i++) {
+        Elf32_Shdr symtab = section(i);
+        if (symtab.sh_type != SHT_SYMTAB)
+            continue;
+        if (symtab.sh_link >= eh.e_shnum)
+            throw std::runtime_error("ELF: bad symbol string table");
+        Elf32_Shdr strtab = section(symtab.sh_link);
+        if ((size_t)symtab.sh_offset + symtab.sh_size > size ||
+            (size_t)strtab.sh_offset + strtab.sh_size > size)
+            throw std::runtime_error("ELF: symbol table exceeds file");
+
+        const char* names = reinterpret_cast<const char*>(data + strtab.sh_offset);
+        for (uint32_t off = 0; off + sizeof(Elf32_Sym) <= symtab.sh_size; off += sizeof(Elf32_Sym)) {
+            Elf32_Sym sym;
+            std::memcpy(&sym, data + symtab.sh_offset + off, sizeof(sym));
+            uint8_t type = sym.st_info & 0xF;
+            if (sym.st_name == 0 || sym.st_name >= strtab.sh_size ||
+                (type != STT_FUNC && type != STT_OBJECT))
+                continue;
+            // strnlen so an unterminated last name can't run off the table
+            size_t len = strnlen(names + sym.st_name, strtab.sh_size - sym.st_name);
+            out.push_back({std::string(names + sym.st_name, len), sym.st_value, sym.st_size,
+                           type == STT_FUNC});
+        }
+        return; // only ever one .symtab
+    }
+}
+
 ElfLoadResult do_load(const uint8_t* data, size_t size, elf_write_fn write) {
     if (size < sizeof(Elf32_Ehdr))
         throw std::runtime_error("ELF: file too small");
@@ -102,8 +172,10 @@ ElfLoadResult do_load(const uint8_t* data, size_t size, elf_write_fn write) {
             result.load_max = ph.p_paddr + ph.p_memsz;
 
         result.segments_loaded++;
+        result.segments.push_back({ph.p_paddr, ph.p_filesz, ph.p_memsz, (ph.p_flags & PF_X) != 0});
     }
 
+    read_symbols(data, size, eh, result.symbols);
     return result;
 }
 
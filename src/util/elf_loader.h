@@ -4,12 +4,39 @@
 #include <cstdint>
 #include <string>
 #include <functional>
+#include <vector>
+
+// One PT_LOAD program header, as loaded
+struct ElfSegment {
+    uint32_t paddr = 0;
+    uint32_t filesz = 0;
+    uint32_t memsz = 0;
+    bool exec = false; // PF_X
+};
+
+// One named .symtab entry
+struct ElfSymbol {
+    std::string name;
+    uint32_t value = 0;
+    uint32_t size = 0;
+    bool func = false; // STT_FUNC
+};
 
 struct ElfLoadResult {
     uint32_t entry_point = 0;
     uint32_t load_min = 0xFFFFFFFF;
     uint32_t load_max = 0;
     int segments_loaded = 0;
+    std::vector<ElfSegment> segments;
+    std::vector<ElfSymbol> symbols; // empty if the ELF was stripped
+
+    // First symbol called name, nullptr if there's none
+    const ElfSymbol* find_symbol(const std::string& name) const {
+        for (const ElfSymbol& s : symbols)
+            if (s.name == name)
+                return &s;
+        return nullptr;
+    }
 };
 
 using elf_write_fn = std::function<void(uint32_t, const uint8_t*, size_t)>;